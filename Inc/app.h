@@ -25,6 +25,25 @@
 
 #define _ASCII_NUMBER_FOR_PATTERN_CODE
 
+// activity of app, reported by telemetry(RPI_TLM_PHASE)
+#define APP_PHASE_IDLE 0
+#define APP_PHASE_SEARCH 1 // searching cat
+#define APP_PHASE_VIB_WAIT 2 // cat not found, beeping until vibration
+#define APP_PHASE_PLAY 3 // executing scheduled patterns
+#define APP_PHASE_SNACK 4
+#define APP_PHASE_PARK 5 // moving to a wall after play
+#define APP_PHASE_CANCELLED 6 // autoplay cancelled, replays on vibration
+#define APP_PHASE_MANUAL 7
+#define APP_PHASE_CALIBRATE 8
+
+// state of snack dispensing, reported by TYPE_SNACK_EVT(RPI_SNK_STATE)
+#define SNACK_ST_IDLE 0
+#define SNACK_ST_LURE 1 // spinning with laser on
+#define SNACK_ST_SETTLE 2
+#define SNACK_ST_APPROACH 3 // driving forward
+#define SNACK_ST_STOP 4
+#define SNACK_ST_DOOR 5 // door opens, holds and closes
+
 void app_start(); // start application. call this function in core
 void app_opTimeout(uint8_t opcode);
 
@@ -28,8 +28,31 @@
  */
 
 /* definitions */
+// duty ratios served from the generated CCR table(fxtables.h). others use Q16 scaling.
+// run tools/gen_fxtables.py after changing these or the tone values below
+#define BUZZER_STD_DUTY_0 10
+#define BUZZER_STD_DUTY_1 25
+#define BUZZER_STD_DUTY_2 50
+
+// melody player
+#define BUZZER_REST 0 // tone value of a rest note
+#define BUZZER_REST_ARR 1000 // timer period during rests(1ms). output is held low
+#define BUZZER_NOTE_UNIT_MS 10 // unit of note length
+#define BUZZER_LOOP_FOREVER 0xFF
+#define BUZZER_NOTE(tone, duty, ms) { (uint16_t)(tone), (duty), (uint8_t)((ms) / BUZZER_NOTE_UNIT_MS) } // ms: up to 2550
 
 /* exported struct */
+struct BuzzerNote { // 4 bytes. keep melodies const to place them in flash
+	uint16_t tone; // buzzerToneARRvalTypeDef or BUZZER_REST
+	uint8_t duty; // 5 ~ 50
+	uint8_t len; // in BUZZER_NOTE_UNIT_MS
+};
+
+struct BuzzerMelody {
+	const struct BuzzerNote* pNotes;
+	uint8_t cnt;
+	uint8_t loop; // times to repeat after the first play. BUZZER_LOOP_FOREVER: until stopped
+};
 
 /* exported typedef */
 typedef enum {
@@ -124,12 +147,21 @@ typedef enum {
 /* exported func prototypes */
 void buzzer_setHandle(TIM_HandleTypeDef* ph);
 void buzzer_init();
-void buzzer_mute(); // mute buzzer and stop PWM generation.
-void buzzer_unmute(); // un-mute buzzer by starting PWM generation.
+void buzzer_mute(); // mute buzzer and stop PWM generation. stops melody
+void buzzer_unmute(); // un-mute buzzer by starting PWM generation. stops melody
 void buzzer_setTone(buzzerToneARRvalTypeDef toneCode);
 void buzzer_setFreq(uint16_t freq); // frequency range: 60 <= freq <= 10000
 void buzzer_setDuty(uint8_t dutyRatio); // set Duty ratio. initial value is 50.
 										// duty ratio value is unaffected by other functions except for init.
 										// duty ratio range: 5 <= duty <= 50
+										// setTone, setFreq and setDuty stop melody
+
+// melody player: notes are advanced by TIM update interrupt. the caller does not wait
+_Bool buzzer_play(const struct BuzzerMelody* pMel, uint8_t priority); // preempts melody of same or lower priority. returns FALSE if rejected
+																		// playing the melody that is already playing does nothing
+void buzzer_stop(); // stop melody and mute
+_Bool buzzer_isPlaying();
+void buzzer_setMelodyDoneCallback(void (*pFunc)(const struct BuzzerMelody* pMel)); // called from TIM update interrupt when a melody ends
+void buzzer_periodElapsedHandler(TIM_HandleTypeDef *htim); // call this from HAL_TIM_PeriodElapsedCallback
 
 #endif
@@ -34,7 +34,8 @@
 #define LASER_PORT GPIOA
 #define LASER_PIN GPIO_PIN_5
 #define VIB_SNSR_PORT GPIOB
-#define VIB_SNSR_PIN GPIO_PIN_0
+#define VIB_SNSR_PIN GPIO_PIN_0 // EXTI0, falling edge
+#define VIB_SNSR_DEBOUNCE 50 // in milliseconds. edges closer than this are one vibration
 //#define LED_PORT GPIO
 //#define LED_PIN GPIO_PIN_
 #define IR_SNSR_POLL_TIMEOUT 1000
@@ -52,8 +53,11 @@ void periph_setHandle(ADC_HandleTypeDef* ph);
 void periph_init();
 void periph_laser_on();
 void periph_laser_off();
-_Bool periph_isVibration();
+_Bool periph_isVibration(); // level of the sensor now. no side effect
+uint16_t periph_vibEventCnt(); // vibrations counted from EXTI since boot
+void periph_vibEdgeHandler(uint16_t pin); // call this from HAL_GPIO_EXTI_Callback
 int periph_irSnsrChk(int mode);
 float periph_irSnsrRaw();
+float periph_irSnsrLast(); // last distance measured by irSnsrChk or irSnsrRaw. no ADC access, 0 if never measured
 
 #endif
@@ -0,0 +1,54 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : fixedpt.h
+  * BRIEF INFORMATION: Q16.16 signed fixed-point helpers
+  * 				   Used by drivers for duty/CCR scaling that is not covered by
+  * 				   generated tables(fxtables.h).
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#ifndef FIXEDPT_H
+#define FIXEDPT_H
+
+#include <stdint.h>
+
+/* definitions */
+#define FX_FRAC_BITS 16
+#define FX_ONE ((q16_t)1 << FX_FRAC_BITS)
+
+/* exported typedef */
+typedef int32_t q16_t;
+
+/* exported inline functions */
+static inline q16_t fx_fromInt(int32_t i) {
+	return (q16_t)(i * FX_ONE);
+}
+
+static inline int32_t fx_toInt(q16_t q) { // truncates toward zero, same as a float to int cast
+	return (q < 0) ? -(int32_t)((-q) >> FX_FRAC_BITS) : (int32_t)(q >> FX_FRAC_BITS);
+}
+
+static inline q16_t fx_fromRatio(int32_t num, int32_t den) { // num / den, rounded to nearest
+	int64_t n = (int64_t)num << FX_FRAC_BITS;
+	return (q16_t)((n + ((n >= 0) == (den >= 0) ? den / 2 : -den / 2)) / den);
+}
+
+static inline q16_t fx_mul(q16_t a, q16_t b) {
+	return (q16_t)(((int64_t)a * b) >> FX_FRAC_BITS);
+}
+
+static inline q16_t fx_div(q16_t a, q16_t b) {
+	return (q16_t)(((int64_t)a << FX_FRAC_BITS) / b);
+}
+
+static inline uint32_t fx_scaleU(uint32_t u, q16_t q) { // u * q truncated, for non-negative q
+	return (uint32_t)(((uint64_t)u * (uint32_t)q) >> FX_FRAC_BITS);
+}
+
+#endif
@@ -0,0 +1,38 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : fxtables.h
+  * BRIEF INFORMATION: GENERATED BY tools/gen_fxtables.py. DO NOT EDIT.
+  * 				   CCR lookup tables for sg90, l298n and buzzer.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#ifndef FXTABLES_H
+#define FXTABLES_H
+
+#include <stdint.h>
+
+/* generator inputs: compared against the driver headers at compile time */
+#define FXT_SG90_TIM_ARR 50000
+#define FXT_SG90_MIN_DUTY 5
+#define FXT_SG90_MAX_DUTY 10
+#define FXT_L298N_TIM_ARR 2000
+#define FXT_L298N_MAX_SPD 100
+#define FXT_BUZZER_STD_DUTY_CNT 3
+#define FXT_BUZZER_STD_DUTY_0 10
+#define FXT_BUZZER_STD_DUTY_1 25
+#define FXT_BUZZER_STD_DUTY_2 50
+#define FXT_TONE_CNT 84
+
+/* exported vars */
+extern const uint16_t fxtSg90AngleCCR[181]; // index: angle 0 to 180
+extern const uint16_t fxtL298nSpdCCR[FXT_L298N_MAX_SPD + 1]; // index: speed 0 to L298N_MAX_SPD
+extern const uint16_t fxtToneARR[FXT_TONE_CNT]; // tone enum values in ascending order
+extern const uint16_t fxtToneCCR[FXT_BUZZER_STD_DUTY_CNT][FXT_TONE_CNT]; // [std duty index][tone index]
+
+#endif
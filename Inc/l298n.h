@@ -32,8 +32,19 @@
 #define L298N_CW 1
 #define L298N_CCW 2
 
-#define L298N_MOTOR_A 0
-#define L298N_MOTOR_B 1
+#define L298N_MOTOR_A 0 // left wheel
+#define L298N_MOTOR_B 1 // right wheel
+
+#define L298N_FORWARD 0 // direction args of l298n_queueDrive
+#define L298N_BACKWARD 1
+#define L298N_LEFT 0 // direction args of l298n_queueRotate
+#define L298N_RIGHT 1
+
+// ramp profiles. speed changes are applied by TIM update interrupt when a profile other than NONE is set
+#define L298N_RAMP_NONE 0 // write target duty directly(initial value)
+#define L298N_RAMP_LINEAR 1 // constant slew rate
+#define L298N_RAMP_TRAPEZOID 2 // accel. for first 25%, constant for 50%, decel. for last 25% of ramp time
+#define L298N_RAMP_SCURVE 3 // smoothstep(3x^2 - 2x^3)
 
 // edit here if system configuration is changed
 #define L298N_IN_PORT_A GPIOB
@@ -42,6 +53,14 @@
 #define L298N_IN_2 GPIO_PIN_5
 #define L298N_IN_3 GPIO_PIN_1
 #define L298N_IN_4 GPIO_PIN_3
+#define L298N_FWD_A L298N_CCW // rotation of each wheel when the robot moves forward
+#define L298N_FWD_B L298N_CW
+#define L298N_BWD_A L298N_CW
+#define L298N_BWD_B L298N_CCW
+#define L298N_QUEUE_SIZE 32 // motion segment queue length
+#define L298N_TIM_ARR 2000 // TIM1 ARR. run tools/gen_fxtables.py after changing
+#define L298N_TIM_FREQ 500 // TIM1 update frequency in Hz. ramp ticks are counted with this value
+#define L298N_DEF_SLEW_RATE 400 // default slew rate in speed units per second. 0 to 100 takes 250ms
 
 /* exported struct */
 struct L298nStats {
@@ -50,6 +69,16 @@ struct L298nStats {
 	uint8_t rotB;
 	uint8_t spdA;
 	uint8_t spdB;
+	uint8_t tgtA; // target speed of ramp. equals spdA when settled
+	uint8_t tgtB;
+};
+
+struct L298nSegment { // one motion primitive: wheel states held for a duration
+	uint8_t dirA;
+	uint8_t spdA;
+	uint8_t dirB;
+	uint8_t spdB;
+	uint32_t ms;
 };
 
 /* exported vars */
@@ -59,8 +88,24 @@ void l298n_setHandle(TIM_HandleTypeDef* ph);
 void l298n_init();
 void l298n_enable(); // enable motor operation. This starts PWM generation
 void l298n_disable(); // implies setRotation( , STOP): disable motor operation. This stops PWM generation
-void l298n_setSpeed(uint8_t motorNum, uint8_t spd); // speed scale: 0(stop) to 100(max.)
-void l298n_setRotation(uint8_t motorNum, uint8_t dir); // implies setSpeed(motorNum, 0): set rotation CW or CCW.
+void l298n_setSpeed(uint8_t motorNum, uint8_t spd); // speed scale: 0(stop) to 100(max.). ramps to spd if ramp profile is set
+void l298n_setRotation(uint8_t motorNum, uint8_t dir); // implies setSpeed(motorNum, 0): set rotation CW or CCW. applied on the next PWM period edge
+void l298n_drive(uint8_t dirA, uint8_t spdA, uint8_t dirB, uint8_t spdB); // set both wheels. applied on the same PWM period edge
 struct L298nStats l298n_getStat(); // get status struct data
+void l298n_setRamp(uint8_t profile, uint16_t slewRate); // set ramp profile used by setSpeed. slew rate: speed units per second
+_Bool l298n_isSettled(); // returns TRUE if both motors reached target speed
+void l298n_waitSettled(); // block until both motors reached target speed
+void l298n_setSettledCallback(void (*pFunc)(uint8_t motorNum)); // called from TIM update interrupt when a ramp finishes
+void l298n_periodElapsedHandler(TIM_HandleTypeDef *htim); // call this from HAL_TIM_PeriodElapsedCallback
+
+// motion queue: segments are loaded by TIM update interrupt at exact boundaries. motors stop when queue drains
+_Bool l298n_queuePush(const struct L298nSegment* pSeg); // returns FALSE if queue is full or motor is disabled
+_Bool l298n_queueDrive(uint8_t dir, uint8_t spd, uint32_t ms); // dir: L298N_FORWARD or L298N_BACKWARD
+_Bool l298n_queueRotate(uint8_t dir, uint8_t spd, uint32_t ms); // rotate in place. dir: L298N_LEFT or L298N_RIGHT
+_Bool l298n_queueArc(uint8_t spdA, uint8_t spdB, uint32_t ms); // forward with different wheel speeds
+_Bool l298n_queuePause(uint32_t ms); // stop for ms
+unsigned l298n_queueDepth(); // number of queued segments including the running one
+void l298n_queueAbort(); // drop every segment and stop motors
+void l298n_setQueueDoneCallback(void (*pFunc)()); // called from TIM update interrupt when queue drains
 
 #endif
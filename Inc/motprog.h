@@ -0,0 +1,124 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : motprog.h
+  * BRIEF INFORMATION: motion program of a play pattern
+  * 				   Byte code of wheel segments, waits, loops, sensor branches, buzzer, laser
+  * 				   and servo. The interpreter returns one action per step and keeps no
+  * 				   hardware state: the app performs the action and steps again on the next
+  * 				   timer tick. Patterns 1 ~ 9 are built-in tables, patterns 10 ~ 13 are
+  * 				   uploaded to RAM slots with TYPE_MOTION_SET.
+  * 				   Assembler and trace check: tools/motprog_check.py
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#ifndef MOTPROG_H
+#define MOTPROG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+/* definitions */
+// opcodes, operands follow. ms: 16 bit little endian
+#define MOTPROG_OP_END 0x00 // end of pattern
+#define MOTPROG_OP_DRIVE 0x01 // dirs spdA spdB ms: queue wheel segment. dirs: dirA | dirB << 4(L298N_STOP, CW, CCW)
+#define MOTPROG_OP_WAIT 0x02 // ms: wait until queued segments ran, then ms more
+#define MOTPROG_OP_LOOP 0x03 // cnt: run body up to matching NEXT cnt times(1 ~ 255)
+#define MOTPROG_OP_LOOPV 0x04 // param div min dflt: cnt = param / div, dflt if cnt < min
+#define MOTPROG_OP_NEXT 0x05 // end of loop body
+#define MOTPROG_OP_BR 0x06 // cond rel: jump rel(signed, from next op) if cond
+#define MOTPROG_OP_SOUND 0x07 // id: play melody id of the app
+#define MOTPROG_OP_LASER 0x08 // on: 0 off, 1 on
+#define MOTPROG_OP_SERVO 0x09 // motor angle ms: move servo in ms
+
+#define MOTPROG_COND_ALWAYS 0
+#define MOTPROG_COND_IR_NEAR 1
+#define MOTPROG_COND_IR_FAR 2
+#define MOTPROG_COND_VIB 3
+#define MOTPROG_COND_NO_VIB 4
+#define MOTPROG_COND_CNT 5
+
+// speed byte: 0 ~ 100 as it is, or symbolic: MOTPROG_SPD(base, add) resolved by MotProgEnv when run
+#define MOTPROG_SPD_SYM 0x80
+#define MOTPROG_SPD(base, add) (MOTPROG_SPD_SYM | ((base) << 2) | (add))
+#define MOTPROG_SPD_DRV 0 // base: driving speed of the play speed setting
+#define MOTPROG_SPD_ROT 1 // base: rotation speed of the play speed setting
+#define MOTPROG_SPD_MIN_ROT 2 // base: fixed slow rotation
+#define MOTPROG_SPD_DEF_ROT 3 // base: fixed default rotation
+#define MOTPROG_ADD_NONE 0
+#define MOTPROG_ADD_OVERSHOOT 1
+#define MOTPROG_ADD_HALF_OVERSHOOT 2
+#define MOTPROG_ADD_CIRCLE 3
+
+#define MOTPROG_PARAM_INTV 0 // interval of the pattern, seconds
+#define MOTPROG_PARAM_WAIT 1 // time pattern 7 waits for the cat, seconds
+#define MOTPROG_PARAM_CNT 2
+
+#define MOTPROG_MAX_DEPTH 4 // nesting of loops
+#define MOTPROG_MAX_LEN 127 // bytes of an uploaded program: one TYPE_MOTION_SET frame(RPI_MAX_PAYLOAD - 1)
+#define MOTPROG_MAX_SPD 100
+#define MOTPROG_STEP_LIMIT 100000 // steps of one run. uploaded programs cannot loop forever
+
+#define MOTPROG_BUILTIN_CNT 9 // codes 1 ~ 9
+#define MOTPROG_USER_FIRST 10
+#define MOTPROG_USER_SLOTS 4 // codes 10 ~ 13
+
+#define MOTPROG_ACT_END 0
+#define MOTPROG_ACT_DRIVE 1
+#define MOTPROG_ACT_WAIT 2
+#define MOTPROG_ACT_SOUND 3
+#define MOTPROG_ACT_LASER 4
+#define MOTPROG_ACT_SERVO 5
+#define MOTPROG_ACT_NONE 6 // control op only. nothing to do this step
+
+/* exported typedef */
+struct MotProgEnv { // filled by the app before each run
+	uint8_t base[4]; // speeds of MOTPROG_SPD_xxx
+	uint8_t add[4]; // addends of MOTPROG_ADD_xxx
+	int32_t param[MOTPROG_PARAM_CNT];
+	uint16_t reps; // runs of every LOOPV on MOTPROG_PARAM_INTV. 0: param / div as programmed
+	_Bool (*pCond)(uint8_t cond); // sensor check of BR. ALWAYS is not passed
+};
+
+struct MotProgAct {
+	uint8_t kind; // MOTPROG_ACT_xxx
+	uint8_t dirA; // DRIVE
+	uint8_t spdA;
+	uint8_t dirB;
+	uint8_t spdB;
+	uint8_t id; // SOUND melody, LASER on, SERVO motor
+	uint8_t angle; // SERVO
+	uint16_t ms; // DRIVE, WAIT, SERVO
+};
+
+struct MotProgVm { // program itself is not copied
+	const struct MotProgEnv* pEnv;
+	uint32_t steps;
+	uint8_t pc;
+	uint8_t depth;
+	struct {
+		uint8_t body; // pc of first op in loop
+		uint16_t left; // runs left, including current one
+	} loop[MOTPROG_MAX_DEPTH];
+};
+
+/* exported functions */
+_Bool motprog_check(const uint8_t* p, uint8_t len); // validate op boundaries, operands, loops and branch targets
+void motprog_begin(struct MotProgVm* vm, const struct MotProgEnv* pEnv);
+_Bool motprog_step(struct MotProgVm* vm, const uint8_t* p, uint8_t len, struct MotProgAct* pAct); // next action. FALSE at end. program must pass motprog_check
+uint32_t motprog_time(const uint8_t* p, uint8_t len, const struct MotProgEnv* pEnv); // ms of DRIVE and WAIT up to the first END, no branch taken. saturates
+const uint8_t* motprog_builtin(uint8_t code, uint8_t* pLen); // NULL if code is not built in
+
+#endif
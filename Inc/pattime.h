@@ -0,0 +1,41 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : pattime.h
+  * BRIEF INFORMATION: GENERATED BY tools/gen_pattime.py. DO NOT EDIT.
+  * 				   Play time of built-in patterns 1 ~ 9, also in rpi/pattime.json.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#ifndef PATTIME_H
+#define PATTIME_H
+
+#include <stdint.h>
+
+/* generator inputs(Src/app.c) */
+#define PATTIME_GAP_MS 300 // PATTERN_GAP_TIME, before every pattern. not in the table
+#define PATTIME_WAIT_S 20 // PATTERN_WAIT_AND_FLEE_WAIT_TIME. pattern 7 waits all of it
+#define PATTIME_SNACK_MS 8300 // whole snack
+/* generator inputs(motprog.h): compared at compile time */
+#define PATTIME_STEP_LIMIT 100000
+#define PATTIME_CNT 9
+
+/* exported typedef */
+struct PatTime { // ms = baseMs + repMs x runs. runs = interval / div, dflt if under min, or repeats of the play plan
+	uint32_t baseMs;
+	uint32_t repMs; // 0: no interval loop
+	uint8_t div; // 0: no interval loop
+	uint8_t min;
+	uint8_t dflt;
+	uint16_t maxRuns; // runs that end within MOTPROG_STEP_LIMIT. over it the pattern is cut short
+};
+
+/* exported vars */
+extern const struct PatTime pattime[PATTIME_CNT + 1]; // by pattern code. 0(auto-decide) is empty
+
+#endif
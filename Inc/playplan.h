@@ -0,0 +1,68 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : playplan.h
+  * BRIEF INFORMATION: play time budget of an autoplay session
+  * 				   Every item of the session(pattern or snack) has a cost of fixed ms plus
+  * 				   ms per repeat. The plan keeps the minimum cost of what is still ahead and
+  * 				   splits the slack left before the deadline over the patterns that repeat.
+  * 				   Repeats are decided when each pattern starts, from the time actually
+  * 				   left: an overrun(pattern 7 waiting for the cat, a slow snack) is taken
+  * 				   out of the patterns after it.
+  * 				   No hardware access: also built on host by tools/playplan_check.py.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#ifndef PLAYPLAN_H
+#define PLAYPLAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+/* definitions */
+#define PLAYPLAN_MAX_REPS 0xFFFF
+#define PLAYPLAN_OVERRUN_MS 1000 // item over its plan this much is counted as overrun
+
+/* exported typedef */
+struct PlayPlanCost { // ms of an item: baseMs + repMs x repeats
+	uint32_t baseMs;
+	uint32_t repMs; // 0: fixed item, not repeated by the plan
+	uint16_t maxReps; // 0: PLAYPLAN_MAX_REPS
+};
+
+struct PlayPlan {
+	uint32_t start; // tick the session started, ms
+	uint32_t budget; // ms
+	uint32_t aheadMs; // minimum cost of items not started yet: fixed ones and one repeat of the others
+	uint32_t flexAhead; // items not started yet that repeat
+	uint32_t itemStart; // tick the current item started
+	uint32_t itemPlan; // ms planned for it
+	_Bool inItem;
+	// planned against actual, per session
+	uint32_t plannedMs; // items ended
+	uint32_t actualMs;
+	int32_t worstMs; // actual - planned of the item furthest off
+	uint16_t items;
+	uint16_t overruns;
+};
+
+/* exported functions */
+void playplan_begin(struct PlayPlan* pl, uint32_t now, uint32_t budgetMs);
+void playplan_add(struct PlayPlan* pl, const struct PlayPlanCost* pc, uint32_t cnt); // cnt items ahead. call before the first playplan_start
+uint16_t playplan_start(struct PlayPlan* pl, uint32_t now, const struct PlayPlanCost* pc); // item begins. returns repeats(1 ~ PLAYPLAN_MAX_REPS), 0 for a fixed item
+void playplan_end(struct PlayPlan* pl, uint32_t now); // item ended, early or not
+uint32_t playplan_left(const struct PlayPlan* pl, uint32_t now); // ms of budget left. 0 when over
+
+#endif
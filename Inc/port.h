@@ -0,0 +1,201 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : port.h
+  * BRIEF INFORMATION: thin hardware access layer used by every driver
+  * 				   Backend is selected at compile time by PORT_BACKEND:
+  * 				   PORT_BACKEND_HAL : STM32 HAL calls(default)
+  * 				   PORT_BACKEND_LL  : direct register access. no parameter checks, no HAL state
+  * 				   PORT_BACKEND_HOST: records calls for Linux host build(tools/port_check.py). main.h of
+  * 				                      host build must provide GPIO_TypeDef, TIM_TypeDef(CR1, CCMR1/2,
+  * 				                      CCR1~4, ARR, CNT), TIM/ADC_HandleTypeDef with Instance, GPIOA/GPIOB,
+  * 				                      GPIO_PIN_x, TIM_CHANNEL_x, TIM_CR1_UDIS, TIM_CCMRx_OCxPE, HAL_Delay
+  * 				                      and __disable_irq/__enable_irq. MAIN_H of port_check.py is one.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#ifndef PORT_H
+#define PORT_H
+
+#include "main.h"
+
+/*
+ * LL backend keeps HAL semantics of PWM stop: when every channel of a timer is off,
+ * main output(break instances) and counter are disabled as well.
+ * Do NOT mix HAL_TIM_PWM_* calls with LL backend on the same timer, HAL state will be out of date.
+ */
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+/* definitions */
+#define PORT_BACKEND_HAL 0
+#define PORT_BACKEND_LL 1
+#define PORT_BACKEND_HOST 2
+
+#ifndef PORT_BACKEND
+#define PORT_BACKEND PORT_BACKEND_HAL
+#endif
+
+#define PORT_HOST_LOG_LEN 256
+
+/* exported typedef */
+typedef enum {
+	PORT_OP_GPIO_SET = 1,
+	PORT_OP_GPIO_RESET,
+	PORT_OP_GPIO_BSRR,
+	PORT_OP_GPIO_READ,
+	PORT_OP_PWM_ENABLE,
+	PORT_OP_PWM_DISABLE,
+	PORT_OP_TIM_START_IT,
+	PORT_OP_ADC_START,
+	PORT_OP_ADC_READ
+} portOpTypeDef;
+
+/* exported struct */
+struct PortHostCall {
+	portOpTypeDef op;
+	void* target; // port or handle
+	uint32_t arg; // pin, BSRR word or channel
+};
+
+#if PORT_BACKEND == PORT_BACKEND_HOST
+/* exported vars: host backend only, defined in port.c */
+extern struct PortHostCall portHostLog[PORT_HOST_LOG_LEN];
+extern unsigned portHostLogCnt; // total number of recorded calls. log wraps around
+extern uint16_t portHostGpioIn; // pin levels returned by port_gpio_read
+extern uint32_t portHostAdcVal; // value returned by port_adc_read
+
+void port_host_record(portOpTypeDef op, void* target, uint32_t arg);
+#endif
+
+/* exported inline functions */
+
+static inline void port_gpio_set(GPIO_TypeDef* port, uint16_t pin) {
+#if PORT_BACKEND == PORT_BACKEND_HAL
+	HAL_GPIO_WritePin(port, pin, GPIO_PIN_SET);
+#elif PORT_BACKEND == PORT_BACKEND_LL
+	port->BSRR = (uint32_t)pin;
+#else
+	port_host_record(PORT_OP_GPIO_SET, port, pin);
+#endif
+}
+
+static inline void port_gpio_reset(GPIO_TypeDef* port, uint16_t pin) {
+#if PORT_BACKEND == PORT_BACKEND_HAL
+	HAL_GPIO_WritePin(port, pin, GPIO_PIN_RESET);
+#elif PORT_BACKEND == PORT_BACKEND_LL
+	port->BSRR = (uint32_t)pin << 16;
+#else
+	port_host_record(PORT_OP_GPIO_RESET, port, pin);
+#endif
+}
+
+static inline void port_gpio_write(GPIO_TypeDef* port, uint16_t pin, _Bool high) {
+	if (high) port_gpio_set(port, pin);
+	else port_gpio_reset(port, pin);
+}
+
+static inline void port_gpio_bsrr(GPIO_TypeDef* port, uint32_t word) { // set and reset several pins with one write
+#if PORT_BACKEND == PORT_BACKEND_HOST
+	port_host_record(PORT_OP_GPIO_BSRR, port, word);
+#else
+	port->BSRR = word; // HAL has no multi-pin write, same for both backends
+#endif
+}
+
+static inline _Bool port_gpio_read(GPIO_TypeDef* port, uint16_t pin) { // returns TRUE if pin is high
+#if PORT_BACKEND == PORT_BACKEND_HAL
+	return (HAL_GPIO_ReadPin(port, pin) == GPIO_PIN_SET);
+#elif PORT_BACKEND == PORT_BACKEND_LL
+	return ((port->IDR & pin) != 0);
+#else
+	port_host_record(PORT_OP_GPIO_READ, port, pin);
+	return ((portHostGpioIn & pin) != 0);
+#endif
+}
+
+static inline void port_tim_start_it(TIM_HandleTypeDef* ph) { // start time base with update interrupt
+#if PORT_BACKEND == PORT_BACKEND_HAL
+	HAL_TIM_Base_Start_IT(ph);
+#elif PORT_BACKEND == PORT_BACKEND_LL
+	ph->Instance->DIER |= TIM_DIER_UIE;
+	ph->Instance->CR1 |= TIM_CR1_CEN;
+#else
+	port_host_record(PORT_OP_TIM_START_IT, ph, 0);
+#endif
+}
+
+static inline void port_pwm_enable(TIM_HandleTypeDef* ph, uint32_t channel) { // channel: TIM_CHANNEL_1 ~ 4
+#if PORT_BACKEND == PORT_BACKEND_HAL
+	HAL_TIM_PWM_Start(ph, channel);
+#elif PORT_BACKEND == PORT_BACKEND_LL
+	ph->Instance->CCER |= (TIM_CCER_CC1E << channel); // TIM_CHANNEL_x is the bit offset of CCxE
+	if (IS_TIM_BREAK_INSTANCE(ph->Instance)) ph->Instance->BDTR |= TIM_BDTR_MOE;
+	ph->Instance->CR1 |= TIM_CR1_CEN;
+#else
+	port_host_record(PORT_OP_PWM_ENABLE, ph, channel);
+#endif
+}
+
+static inline void port_pwm_disable(TIM_HandleTypeDef* ph, uint32_t channel) { // channel: TIM_CHANNEL_1 ~ 4
+#if PORT_BACKEND == PORT_BACKEND_HAL
+	HAL_TIM_PWM_Stop(ph, channel);
+#elif PORT_BACKEND == PORT_BACKEND_LL
+	ph->Instance->CCER &= ~(TIM_CCER_CC1E << channel);
+	if ((ph->Instance->CCER & (TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC3E | TIM_CCER_CC4E)) == 0) {
+		if (IS_TIM_BREAK_INSTANCE(ph->Instance)) ph->Instance->BDTR &= ~TIM_BDTR_MOE;
+		ph->Instance->CR1 &= ~TIM_CR1_CEN;
+	}
+#else
+	port_host_record(PORT_OP_PWM_DISABLE, ph, channel);
+#endif
+}
+
+static inline void port_adc_start(ADC_HandleTypeDef* ph) { // enable ADC and start a conversion
+#if PORT_BACKEND == PORT_BACKEND_HAL
+	HAL_ADC_Start(ph);
+#elif PORT_BACKEND == PORT_BACKEND_LL
+	if ((ph->Instance->CR & ADC_CR_ADEN) == 0) {
+		ph->Instance->CR |= ADC_CR_ADEN;
+		while ((ph->Instance->ISR & ADC_ISR_ADRDY) == 0) {
+
+		}
+	}
+	ph->Instance->CR |= ADC_CR_ADSTART;
+#else
+	port_host_record(PORT_OP_ADC_START, ph, 0);
+#endif
+}
+
+static inline uint32_t port_adc_read(ADC_HandleTypeDef* ph, uint32_t timeout) { // single conversion. returns raw value
+#if PORT_BACKEND == PORT_BACKEND_HAL
+	uint32_t val;
+	HAL_ADC_Start(ph);
+	HAL_ADC_PollForConversion(ph, timeout);
+	val = HAL_ADC_GetValue(ph);
+	HAL_ADC_Stop(ph);
+	return val;
+#elif PORT_BACKEND == PORT_BACKEND_LL
+	uint32_t tickStart = HAL_GetTick();
+	port_adc_start(ph);
+	while ((ph->Instance->ISR & ADC_ISR_EOC) == 0) {
+		if (HAL_GetTick() - tickStart > timeout) break;
+	}
+	return ph->Instance->DR; // reading DR clears EOC. conversion is single mode, no stop needed
+#else
+	port_host_record(PORT_OP_ADC_READ, ph, timeout);
+	return portHostAdcVal;
+#endif
+}
+
+#endif
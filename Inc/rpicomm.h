@@ -30,7 +30,24 @@
 
 // pinIO code and config
 #define RPI_PIN_SEND_WAITING_TIME 1000
-#define DTA_LEN 8
+#define DTA_LEN 8 // length of ASCII(compat.) frame
+
+// binary frame: SYNC TYPE LEN SEQ PAYLOAD[LEN] CRC16(little endian)
+// CRC-16/CCITT-FALSE(poly 0x1021, init 0xFFFF) over TYPE ~ end of PAYLOAD
+#define RPI_FRAME_SYNC 0xA5
+#define RPI_FRAME_OVERHEAD 6 // sync, type, len, seq, crc x2
+#define RPI_MAX_PAYLOAD 128
+#define RPI_ASCII_COMPAT 1 // 1: also accept 8-character ASCII frames(not acknowledged)
+#define RPI_WINDOW 4 // outstanding frames the Pi may send before ACK. length of rx queue
+#define RPI_TX_BUF_SIZE 256
+#define RPI_RX_DMA_SIZE 256 // USART2 RX DMA channel MUST be in circular mode(CubeMX: DMA Request USART2_RX, Mode Circular)
+
+// result codes of ACK/NAK payload
+#define RPI_RES_OK 0 // ACK: queued for app
+#define RPI_RES_DUP 1 // ACK: received before, ACK was probably lost
+#define RPI_RES_BUSY 2 // NAK: rx queue full, send again later
+#define RPI_RES_ORDER 3 // NAK: sequence gap. seq of NAK is the expected one, send again from there
+#define RPI_RES_CRC 4 // NAK: corrupted. seq of NAK is unreliable
 
 #define RPI_PINCODE_I_FOUNDCAT 0x01
 #define RPI_PINCODE_O_SCHEDULE_EXE 0x01
@@ -47,8 +64,206 @@
 #define TYPE_SCHEDULE_DURATION 'D'
 #define TYPE_SCHEDULE_START '<'
 #define TYPE_SCHEDULE_END '>'
+#define TYPE_SCHEDULE 'S' // binary only. whole schedule in one frame, see RPI_SKD_xxx
+#define TYPE_FOUNDCAT 'I'
+#define TYPE_LINK_RESET 'R' // binary only. sequence restarts from seq of this frame
+#define TYPE_ACK 'a' // MCU to Pi. payload: seq, result code
+#define TYPE_NAK 'n' // MCU to Pi. payload: seq, result code
+#define TYPE_LINK_STAT_REQ 'L' // binary only. no payload, MCU answers with TYPE_LINK_STAT
+#define TYPE_LINK_STAT 'l' // MCU to Pi. payload: see RPI_LST_xxx
+#define TYPE_TELEMETRY 't' // MCU to Pi, every telemetry interval. payload: see RPI_TLM_xxx. not acknowledged
+#define TYPE_TELEMETRY_CFG 'Y' // binary only. payload: uint16_t interval in ms, 0 stops telemetry
+#define TYPE_BAUD 'B' // binary only. no payload: capability query. uint32_t payload: switch to this rate
+#define TYPE_BAUD_INFO 'b' // MCU to Pi. payload: RPI_BAUD_RES_xxx, uint32_t baud[, uint32_t supported rates...]
+#define TYPE_BAUD_TEST 'X' // binary only. test pattern(RPI_BAUD_TEST_BYTE) sent after switching
+#define TYPE_BAUD_ECHO 'x' // MCU to Pi. payload: 0 if pattern was intact else 1, then the received pattern
+#define TYPE_STATUS_REQ 'Q' // binary only. no payload, app answers with TYPE_TELEMETRY at once
+#define TYPE_CMD_STAT_REQ 'H' // binary only. payload: command type. app answers with TYPE_CMD_STAT
+#define TYPE_CMD_STAT 'h' // MCU to Pi. payload: see RPI_CST_xxx
+#define TYPE_MANUAL_STREAM 'J' // binary only. payload: see RPI_MST_xxx. queued frames of this type are merged: only the newest is handled
+#define TYPE_MANUAL_CFG 'K' // binary only. payload: see RPI_MCF_xxx
+#define TYPE_SNACK_EVT 'k' // MCU to Pi, on every state change of snack dispensing. payload: see RPI_SNK_xxx. not acknowledged
+#define TYPE_SCHEDULE_SLOT 'W' // between '<' and '>'. ASCII: calendar slot digit, then period in minutes(0: once)
+#define TYPE_CAL_SET 'C' // binary only. schedule into a calendar slot. payload: see RPI_CAL_xxx
+#define TYPE_CAL_DEL 'E' // payload: slot(number or ASCII digit), RPI_CAL_ALL or '*': every slot
+#define TYPE_CAL_LIST_REQ 'G' // no payload, app answers with TYPE_CAL_LIST
+#define TYPE_CAL_LIST 'g' // MCU to Pi. payload: count, then count entries of RPI_CLS_xxx in slot order
+#define TYPE_CLOCK_SYNC 'Z' // binary only. payload: see RPI_CLK_xxx, empty: query. app answers with TYPE_CLOCK_STAT
+#define TYPE_CLOCK_STAT 'z' // MCU to Pi. payload: see RPI_CKS_xxx
+#define TYPE_MOTION_SET 'O' // binary only. payload: see RPI_MOT_xxx, code only: delete, empty: query. app answers with TYPE_MOTION_STAT
+#define TYPE_MOTION_STAT 'o' // MCU to Pi. payload: see RPI_MTS_xxx
+#define TYPE_PLAY_REPORT 'p' // MCU to Pi, when play of a schedule ends. payload: see RPI_PLR_xxx. not acknowledged
 //#define TYPE_RESP 0xFF
 
+// payload layout of TYPE_SCHEDULE(little endian)
+#define RPI_SKD_WAIT_TIME 0 // uint32_t, seconds until play
+#define RPI_SKD_DURATION 4 // uint16_t, play time
+#define RPI_SKD_SPEED 6 // uint8_t, 0 ~ 2
+#define RPI_SKD_SNACK_INTV 7 // uint8_t, patterns per snack. RPI_SKD_SNACK_OFF: only snack ops of program
+#define RPI_SKD_PATTERN_CNT 8 // uint8_t, bytes of program
+#define RPI_SKD_PATTERNS 9 // uint8_t[PATTERN_CNT], pattern program(skdprog.h). plain pattern codes are a valid program
+#define RPI_SKD_MAX_PROG (RPI_MAX_PAYLOAD - RPI_SKD_PATTERNS)
+#define RPI_SKD_SNACK_OFF 0xFF
+
+// payload layout of TYPE_CAL_SET. TYPE_SCHEDULE and ASCII uploads without 'W' go to slot 0, played once
+#define RPI_CAL_SLOT 0 // uint8_t, 0 ~ RPI_CAL_SIZE - 1
+#define RPI_CAL_PERIOD 1 // uint32_t, seconds between plays. 0: once
+#define RPI_CAL_AT 5 // uint32_t, first play in local time(seconds since 2000-01-01, see rtclock.h). 0: wait time of schedule
+#define RPI_CAL_SKD 9 // TYPE_SCHEDULE payload, program up to RPI_SKD_MAX_PROG - RPI_CAL_SKD bytes
+#define RPI_CAL_SIZE 6 // schedules kept at once
+#define RPI_CAL_ALL 0xFF
+
+// entry of TYPE_CAL_LIST(little endian)
+#define RPI_CLS_SLOT 0 // uint8_t
+#define RPI_CLS_FLAGS 1 // uint8_t, RPI_CLS_FLAG_xxx
+#define RPI_CLS_FIRE_IN 2 // uint32_t, seconds until next play. 0 if not armed or due
+#define RPI_CLS_PERIOD 6 // uint32_t, seconds
+#define RPI_CLS_DURATION 10 // uint16_t
+#define RPI_CLS_SPEED 12 // uint8_t
+#define RPI_CLS_SNACK_INTV 13 // uint8_t
+#define RPI_CLS_PROG_LEN 14 // uint8_t
+#define RPI_CLS_PLAYS 15 // uint32_t, patterns of program
+#define RPI_CLS_SIZE 19 // RPI_CAL_SIZE entries and count fit in one frame
+#define RPI_CLS_FLAG_ARMED 0x01 // has a next play
+#define RPI_CLS_FLAG_ACTIVE 0x02 // played now or last, telemetry pattern count belongs to it
+#define RPI_CLS_FLAG_WALL_CLOCK 0x04 // plays at a local time: kept when the clock is stepped
+
+// payload layout of TYPE_LINK_STAT(little endian)
+#define RPI_LST_QUALITY 0 // uint8_t, 0 ~ 100
+#define RPI_LST_ORE 1 // uint32_t x 4: overrun, framing, noise, parity error count
+#define RPI_LST_FE 5
+#define RPI_LST_NE 9
+#define RPI_LST_PE 13
+#define RPI_LST_RESTARTS 17 // uint32_t, reception restarted after error
+#define RPI_LST_CRC 21 // uint32_t
+#define RPI_LST_LEN_ERR 25 // uint32_t
+#define RPI_LST_DISCARDED 29 // uint32_t
+#define RPI_LST_FRAMES 33 // uint32_t
+#define RPI_LST_ORE_AGE 37 // uint32_t x 4: ms since last ORE, FE, NE, PE. RPI_LST_NEVER if none
+#define RPI_LST_FE_AGE 41
+#define RPI_LST_NE_AGE 45
+#define RPI_LST_PE_AGE 49
+#define RPI_LST_SIZE 53
+#define RPI_LST_NEVER 0xFFFFFFFF
+
+// payload layout of TYPE_TELEMETRY(little endian)
+#define RPI_TLM_PHASE 0 // uint8_t, APP_PHASE_xxx of app.h
+#define RPI_TLM_PATTERN 1 // uint8_t, running pattern code. RPI_TLM_NO_PATTERN if none
+#define RPI_TLM_FLAGS 2 // uint8_t, RPI_TLM_FLAG_xxx
+#define RPI_TLM_SKD_WAIT 3 // uint32_t, seconds until next play of calendar
+#define RPI_TLM_MOTOR 7 // uint8_t x 6: rotA, spdA, rotB, spdB, tgtA, tgtB(l298n_getStat)
+#define RPI_TLM_SERVO 13 // uint8_t, angle of snack door servo
+#define RPI_TLM_IR_DIST 14 // uint16_t, last IR distance in mm. 0 if not measured yet
+#define RPI_TLM_VIB_CNT 16 // uint16_t, vibration events since boot
+#define RPI_TLM_PATTERN_Q 18 // uint8_t, patterns left in schedule being played or played last
+#define RPI_TLM_RX_Q 19 // uint8_t, frames waiting for app
+#define RPI_TLM_MOTION_Q 20 // uint8_t, motion segments queued in l298n
+#define RPI_TLM_TICK 21 // uint32_t, HAL_GetTick(). goes back on MCU reset
+#define RPI_TLM_SIZE 25
+#define RPI_TLM_NO_PATTERN 0xFF
+#define RPI_TLM_FLAG_SKD_SET 0x01 // a schedule of calendar is armed
+#define RPI_TLM_FLAG_SKD_RECV 0x02 // receiving ASCII schedule packets
+#define RPI_TLM_FLAG_CANCELLED 0x04 // autoplay cancelled, waiting for vibration
+#define RPI_TLM_FLAG_MOTOR_ENA 0x08
+#define RPI_TLM_FLAG_VIB 0x10 // vibration sensor active now
+#define RPI_TLM_FLAG_ABORTED 0x20 // autoplay aborted by command, resumable
+#define RPI_TLM_FLAG_DEADMAN 0x40 // manual drive stopped by dead-man, until next manual update
+#define RPI_TLM_FLAG_SKD_PENDING 0x80 // uploaded schedule replaces the active one when autoplay ends
+#define RPI_TLM_DEF_INTV 500 // ms. 25 + 6 bytes take 32ms at 9600 baud
+
+// payload layout of TYPE_MANUAL_STREAM
+#define RPI_MST_THROTTLE 0 // int8_t, -100(backward) ~ 100(forward)
+#define RPI_MST_TURN 1 // int8_t, -100(left) ~ 100(right)
+#define RPI_MST_SIZE 2
+
+// payload layout of TYPE_MANUAL_CFG(little endian)
+#define RPI_MCF_EXPO 0 // uint8_t, response curve of stick values: 0 linear ~ 100 cubic
+#define RPI_MCF_DEADMAN 1 // uint16_t, ms without a manual update until wheels stop. 0: off
+#define RPI_MCF_MAX_SPD 3 // uint8_t, wheel speed at full stick. 0: keep current
+#define RPI_MCF_FLAGS 4 // uint8_t, RPI_MCF_FLAG_xxx
+#define RPI_MCF_SIZE 5
+#define RPI_MCF_FLAG_DISCRETE 0x01 // dead-man also stops M01 ~ M04: app must repeat them
+
+// payload layout of TYPE_SNACK_EVT(little endian)
+#define RPI_SNK_STATE 0 // uint8_t, SNACK_ST_xxx of app.h. state the snack ended in if result is not RUNNING
+#define RPI_SNK_PROGRESS 1 // uint8_t, percent of nominal snack time. 100 only when done
+#define RPI_SNK_RESULT 2 // uint8_t, RPI_SNK_RES_xxx
+#define RPI_SNK_ELAPSED 3 // uint16_t, ms since snack started
+#define RPI_SNK_SIZE 5
+#define RPI_SNK_RES_RUNNING 0
+#define RPI_SNK_RES_DONE 1
+#define RPI_SNK_RES_CANCELLED 2
+
+// payload layout of TYPE_CLOCK_SYNC(little endian). Pi's local time when the frame was queued for sending
+#define RPI_CLK_SEC 0 // uint32_t, seconds since 2000-01-01 00:00:00 local
+#define RPI_CLK_MS 4 // uint16_t, 0 ~ 999
+#define RPI_CLK_SIZE 6
+
+// payload layout of TYPE_CLOCK_STAT(little endian), see struct RtclockStats
+#define RPI_CKS_NOW 0 // uint32_t, local time of MCU after the sync
+#define RPI_CKS_FLAGS 4 // uint8_t, RTCLOCK_FLAG_xxx
+#define RPI_CKS_SYNCS 5 // uint32_t
+#define RPI_CKS_STEPS 9 // uint32_t
+#define RPI_CKS_LAST_OFS 13 // int32_t, ms, Pi minus MCU before the sync
+#define RPI_CKS_MAX_SLEW 17 // uint32_t, ms
+#define RPI_CKS_DRIFT 21 // int32_t, ppm x 100, crystal without calibration. + = fast
+#define RPI_CKS_CALIB 25 // int32_t, ppm x 100, applied
+#define RPI_CKS_SIZE 29
+
+// payload layout of TYPE_MOTION_SET
+#define RPI_MOT_CODE 0 // uint8_t, pattern code of an upload slot(MOTPROG_USER_FIRST ~ )
+#define RPI_MOT_PROG 1 // motion program, see motprog.h. up to MOTPROG_MAX_LEN bytes
+
+// payload layout of TYPE_MOTION_STAT(little endian)
+#define RPI_MTS_LEN 0 // uint8_t x MOTPROG_USER_SLOTS, program length of each upload slot. 0: empty
+#define RPI_MTS_RUNS 4 // uint32_t, patterns run since boot
+#define RPI_MTS_STEPS 8 // uint32_t, interpreter steps since boot
+#define RPI_MTS_CYC_AVG 12 // uint16_t, CPU cycles per step, average
+#define RPI_MTS_CYC_MAX 14 // uint16_t, CPU cycles of the slowest step
+#define RPI_MTS_SIZE 16
+
+// payload layout of TYPE_PLAY_REPORT(little endian): time budget of the session against what was played, see playplan.h
+#define RPI_PLR_RESULT 0 // uint8_t, RPI_PLR_RES_xxx
+#define RPI_PLR_SLOT 1 // uint8_t, calendar slot of the schedule
+#define RPI_PLR_BUDGET 2 // uint32_t, ms. duration of the schedule, or what was left of it when resumed
+#define RPI_PLR_ELAPSED 6 // uint32_t, ms since play started
+#define RPI_PLR_PLANNED 10 // uint32_t, ms planned for the patterns and snacks played
+#define RPI_PLR_ACTUAL 14 // uint32_t, ms they took
+#define RPI_PLR_WORST 18 // int32_t, ms, actual - planned of the item furthest off
+#define RPI_PLR_ITEMS 22 // uint16_t, patterns and snacks played
+#define RPI_PLR_OVERRUNS 24 // uint16_t, items over their plan by PLAYPLAN_OVERRUN_MS
+#define RPI_PLR_SIZE 26
+#define RPI_PLR_RES_DONE 0
+#define RPI_PLR_RES_ABORTED 1 // resumable. the resumed part reports again
+
+// payload layout of TYPE_CMD_STAT(little endian): dispatch latency of one command type, frame received to handler called
+#define RPI_CST_TYPE 0 // uint8_t, command type
+#define RPI_CST_CNT 1 // uint32_t, handled
+#define RPI_CST_DROPPED 5 // uint32_t, not accepted in phase of app
+#define RPI_CST_MAX 9 // uint32_t, ms
+#define RPI_CST_HIST 13 // uint16_t x RPI_CST_BINS. bin 0: under 1ms, bin n: 2^(n-1) ~ 2^n - 1 ms, last bin: open ended
+#define RPI_CST_BINS 12
+#define RPI_CST_SIZE 37
+
+// link speed negotiation: both sides start at RPI_BAUD_DEFAULT
+// Pi: TYPE_BAUD query -> caps, TYPE_BAUD(rate) -> SWITCH, MCU switches when tx is drained,
+// Pi sends RPI_BAUD_TEST_CNT test patterns at new rate -> VERIFIED, or MCU reverts after RPI_BAUD_VERIFY_TIME
+#define RPI_BAUD_DEFAULT 9600
+#define RPI_BAUD_LIST { 9600, 115200, 230400, 460800, 921600 } // USART2 on PCLK1 80MHz, oversampling 16: under 0.2% error
+#define RPI_BAUD_VERIFY_TIME 1000 // ms
+#define RPI_BAUD_TEST_CNT 3 // good test patterns needed to keep new rate
+#define RPI_BAUD_ERR_BURST 8 // UART, CRC and LEN errors in one second that make MCU fall back to RPI_BAUD_DEFAULT
+#define RPI_BAUD_IDLE_FALLBACK 30 // s without a valid frame above RPI_BAUD_DEFAULT, then fall back. ccb.py polls every 10s
+#define RPI_BAUD_TEST_BYTE(i) ((uint8_t)(0x55 ^ ((i) * 29))) // test pattern: every bit flips across bytes
+#define RPI_BAUD_RES_CAPS 0 // answer to query
+#define RPI_BAUD_RES_SWITCH 1 // switching right after this frame and its ACK
+#define RPI_BAUD_RES_UNSUPPORTED 2
+#define RPI_BAUD_RES_VERIFIED 3 // test patterns received: new rate kept
+#define RPI_BAUD_RES_FALLBACK 4 // back to previous rate(verify timeout) or RPI_BAUD_DEFAULT(error burst, idle)
+
+// link quality: 0 ~ RPI_QUALITY_MAX, +1/32 of the distance to max per good frame, -1/8 per error
+#define RPI_QUALITY_MAX 10000 // reported as percent
+
 // pin code
 #define RPI_PIN_IN_PORT GPIOA
 #define RPI_PIN_IN_FOUNDCAT GPIO_PIN_10
@@ -61,7 +276,47 @@
 struct SerialDta {
 	uint8_t available;
 	uint8_t type;
-	uint8_t container[8];
+	uint8_t len; // payload length. 7 for ASCII frames
+	uint8_t seq; // sequence number. 0 for ASCII frames
+	uint32_t tick; // HAL_GetTick() when received
+	uint8_t container[RPI_MAX_PAYLOAD + 1]; // payload, zero terminated
+};
+
+struct RpiLinkStats {
+	uint32_t bytesRx;
+	uint32_t bytesDiscarded; // skipped while looking for a frame boundary
+	uint32_t frames; // frames parsed with valid CRC(or ASCII frames), including duplicates
+	uint32_t rxEvents; // DMA idle/half/full interrupts
+	uint32_t binFrames; // accepted binary frames
+	uint32_t asciiFrames; // accepted ASCII frames
+	uint32_t crcErrs;
+	uint32_t lenErrs; // LEN over RPI_MAX_PAYLOAD
+	uint32_t dupFrames; // retransmitted frames received again, dropped
+	uint32_t orderErrs; // sequence gaps
+	uint32_t busyNaks; // rx queue was full
+	uint32_t coalesced; // TYPE_MANUAL_STREAM frames merged into a queued one
+	uint32_t acks;
+	uint32_t naks;
+	uint32_t txDrops; // frames not sent because tx buffer was full
+	uint32_t latMin; // queue latency in ms: frame received to taken by app
+	uint32_t latMax;
+	uint32_t latSum;
+	uint32_t latCnt;
+	uint32_t oreErrs; // UART overrun
+	uint32_t feErrs; // UART framing error
+	uint32_t neErrs; // UART noise
+	uint32_t peErrs; // UART parity error
+	uint32_t dmaErrs;
+	uint32_t rxRestarts; // reception restarted by error handler or watchdog
+	uint32_t lastOreTick; // HAL_GetTick() of last error. valid if count is not zero
+	uint32_t lastFeTick;
+	uint32_t lastNeTick;
+	uint32_t lastPeTick;
+	uint32_t tlmFrames; // telemetry frames sent
+	uint32_t tlmSkipped; // telemetry periods skipped because tx was busy
+	uint32_t baud; // current rate
+	uint32_t baudSwitches; // negotiated rates kept after verification
+	uint32_t baudFallbacks;
 };
 
 /* exported vars */
@@ -74,8 +329,19 @@ int rpi_getSerialDta(struct SerialDta* pDest); // returns zero if no data is ava
 _Bool rpi_foundCat();
 void rpi_sendPin(int code);
 int rpi_serialDtaAvailable(); // returns zero if not available
+struct RpiLinkStats rpi_getLinkStat();
+uint8_t rpi_getLinkQuality(); // 0 ~ 100
+uint16_t rpi_crc16(const uint8_t* pDta, uint16_t len, uint16_t crc); // pass 0xFFFF as crc to start
+_Bool rpi_sendFrame(uint8_t type, const uint8_t* pPayload, uint8_t len); // queue a binary frame, sent by interrupt. returns FALSE if tx buffer is full
+void rpi_txCpltHandler(UART_HandleTypeDef *huart); // call this from HAL_UART_TxCpltCallback
+void rpi_rxEventHandler(UART_HandleTypeDef *huart, uint16_t size); // call this from HAL_UARTEx_RxEventCallback
+void rpi_errorHandler(UART_HandleTypeDef *huart); // call this from HAL_UART_ErrorCallback
+uint8_t rpi_rxQueueDepth(); // frames waiting for app
+void rpi_setTelemetryFunc(uint8_t (*pFunc)(uint8_t* pPayload)); // pFunc fills TYPE_TELEMETRY payload and returns its length. called from 1ms timer interrupt
+void rpi_setTelemetryInterval(uint16_t ms); // 0: off. initial value is RPI_TLM_DEF_INTV
+uint32_t rpi_getBaud(); // current rate of the link
 //int rpi_tcpipRespond(uint8_t isErr); // send RESP pkt to client app. returns 0 on success
 
-void rpi_msTimeoutHandler();
+void rpi_msTimeoutHandler(); // call this from 1ms timer interrupt. sends telemetry
 
 #endif
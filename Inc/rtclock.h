@@ -0,0 +1,66 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : rtclock.h
+  * BRIEF INFORMATION: wall clock on the RTC, synced from the Raspberry Pi
+  * 				   Keeps local time in the RTC(LSE 32.768kHz), counted in seconds since
+  * 				   2000-01-01 00:00:00 local time. The Pi pushes its clock with
+  * 				   TYPE_CLOCK_SYNC: big offsets are stepped, small ones are slewed with the
+  * 				   sub-second shift, and the drift measured between syncs is trimmed out
+  * 				   with the smooth calibration. Alarm A wakes the scheduler.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#ifndef RTCLOCK_H
+#define RTCLOCK_H
+
+#include "main.h"
+
+/*
+ * RTC: LSE, asynchronous prescaler 128, synchronous prescaler 256(1Hz calendar, 1/256s sub-seconds).
+ * MX_RTC_Init must not set time and date when RTCLOCK_BKP_MAGIC is in backup register 0:
+ * the RTC keeps running over resets, only a power loss clears it.
+ *
+ * initialization order: setHandle -> init
+ */
+
+/* definitions */
+#define RTCLOCK_BKP_MAGIC 0x32F2A5C3 // backup register 0: time was set by the Pi
+#define RTCLOCK_STEP_MS 1000 // offsets at or over this are stepped, smaller ones slewed
+#define RTCLOCK_CAL_MIN_SEC 3600 // drift is measured over at least this long before calibration changes
+#define RTCLOCK_CAL_MAX 48800 // ppm x 100, reach of the smooth calibration(+488.3 ~ -487.3 ppm)
+#define RTCLOCK_NO_ALARM 0xFFFFFFFF
+
+#define RTCLOCK_FLAG_SET 0x01 // time was set by the Pi(kept over resets)
+#define RTCLOCK_FLAG_CALIBRATED 0x02 // drift was measured at least once
+#define RTCLOCK_FLAG_ALARM 0x04 // alarm armed
+
+/* exported struct */
+struct RtclockStats {
+	uint32_t syncs;
+	uint32_t steps; // syncs that set the time outright
+	int32_t lastOfs; // ms, Pi minus RTC at the last sync. + = RTC was behind
+	uint32_t maxSlew; // ms, largest |offset| of syncs that were slewed
+	int32_t drift; // ppm x 100, estimated drift of the crystal without calibration. + = fast
+	int32_t calib; // ppm x 100, smooth calibration applied. - = slowed down
+	uint32_t lastSync; // rtclock time of the last sync
+	uint8_t flags; // RTCLOCK_FLAG_xxx
+};
+
+/* exported func prototypes */
+void rtclock_setHandle(RTC_HandleTypeDef* ph);
+void rtclock_init();
+uint32_t rtclock_now(); // seconds since 2000-01-01 local. safe to call from interrupts
+uint32_t rtclock_nowMs(uint16_t* pMs); // same, with milliseconds
+_Bool rtclock_isSet();
+int32_t rtclock_sync(uint32_t sec, uint16_t ms); // set to the Pi's time. returns seconds the clock was stepped, 0 if slewed
+void rtclock_setAlarm(uint32_t t, void (*pFunc)()); // call pFunc from the RTC interrupt at t. RTCLOCK_NO_ALARM cancels
+struct RtclockStats rtclock_getStat();
+void rtclock_alarmHandler(RTC_HandleTypeDef* hrtc); // call this from HAL_RTC_AlarmAEventCallback
+
+#endif
@@ -33,14 +33,34 @@
 #define SG90_MOTOR_D 3
 #define SG90_MIN_DUTY 5
 #define SG90_MAX_DUTY 10
+#define SG90_MAX_ANGLE 180
+
+// edit here if timer configuration is changed, then run tools/gen_fxtables.py
+#define SG90_TIM_ARR 50000 // TIM2 ARR. 20Hz at 1MHz timer clock
 
 // edit here if system configuration is changed
 #define SG90_MOTOR_CNT 1 // order: A B C D. ex: MOTOR CNT == 2 then A and B will be used
+#define SG90_TIM_FREQ 20 // TIM2 update frequency in Hz. trajectory frames are counted with this value
+#define SG90_MAX_WAYPOINTS 8 // waypoints per trajectory
+
+// easing curves of sg90_moveTo and waypoints
+#define SG90_EASE_LINEAR 0
+#define SG90_EASE_IN 1 // y = x^2
+#define SG90_EASE_OUT 2 // y = 1 - (1 - x)^2
+#define SG90_EASE_INOUT 3 // smoothstep(3x^2 - 2x^3)
 
 /* exported struct */
 struct SG90Stats {
 	uint8_t ena[SG90_MOTOR_CNT];
-	uint8_t angle[SG90_MOTOR_CNT];
+	uint8_t angle[SG90_MOTOR_CNT]; // current angle. follows the trajectory while moving
+	uint8_t moving[SG90_MOTOR_CNT];
+	uint8_t attached[SG90_MOTOR_CNT]; // FALSE while PWM is paused by auto-detach
+};
+
+struct SG90Waypoint { // move to angle in ms with easing curve. same angle as the previous point makes a hold
+	uint8_t angle;
+	uint8_t easing;
+	uint16_t ms;
 };
 
 /* exported vars */
@@ -50,7 +70,18 @@ void sg90_setHandle(TIM_HandleTypeDef* ph);
 void sg90_init();
 void sg90_enable(uint8_t motorNum, uint8_t angle); // start giving PWM signal
 void sg90_disable(uint8_t motorNum); // disable motor by stop giving PWM signal
-void sg90_setAngle(uint8_t motorNum, uint8_t angle); // set angle
+void sg90_setAngle(uint8_t motorNum, uint8_t angle); // set angle. clamped to SG90_MAX_ANGLE. cancels trajectory of the motor
 struct SG90Stats sg90_getStat(uint8_t motor); // get status struct data
 
+// trajectory: TIM update interrupt advances CCR every frame(1 / SG90_TIM_FREQ s)
+_Bool sg90_moveTo(uint8_t motorNum, uint8_t angle, uint16_t durationMs, uint8_t easing); // returns FALSE if motor is disabled
+_Bool sg90_trajectory(uint8_t motorNum, const struct SG90Waypoint* pPts, uint8_t cnt); // cnt <= SG90_MAX_WAYPOINTS
+_Bool sg90_moveSync(const uint8_t* pAngles, uint16_t durationMs, uint8_t easing); // move every motor, starting and ending on the same frame
+_Bool sg90_isMoving(uint8_t motorNum);
+void sg90_waitMove(uint8_t motorNum); // block until trajectory of the motor ends
+void sg90_stop(uint8_t motorNum); // hold current angle and drop the rest of trajectory
+void sg90_setAutoDetach(uint8_t motorNum, uint16_t settleMs); // pause PWM settleMs after a trajectory ends. 0: never(initial value)
+void sg90_setMoveDoneCallback(void (*pFunc)(uint8_t motorNum)); // called from TIM update interrupt when a trajectory ends
+void sg90_periodElapsedHandler(TIM_HandleTypeDef *htim); // call this from HAL_TIM_PeriodElapsedCallback
+
 #endif
@@ -0,0 +1,77 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : skdprog.h
+  * BRIEF INFORMATION: pattern program of a schedule
+  * 				   Compact byte code of the pattern list: repeats, nested loops, per-entry
+  * 				   speed and interval overrides, snack markers. Decoded one entry at a time,
+  * 				   so a long session takes a few bytes of program and a small iterator.
+  * 				   A flat list of pattern codes(0 ~ 9) is a valid program: old schedules
+  * 				   and ASCII P packets need no conversion.
+  * 				   Encoder and round-trip check: rpi/skdprog.py, tools/skdprog_check.py
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#ifndef SKDPROG_H
+#define SKDPROG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+/* definitions */
+// opcodes: high nibble, operand in low nibble
+#define SKDPROG_OP_PLAY 0x00 // 0x0n: play pattern n(0: auto-decide, 1 ~ 9 built in, 10 ~ 13 uploaded, see motprog.h)
+#define SKDPROG_OP_REPEAT 0x10 // 0x1n cnt: play pattern n cnt times(2 ~ 255)
+#define SKDPROG_OP_LOOP 0x20 // 0x20 cnt: run body up to matching END cnt times(1 ~ 255)
+#define SKDPROG_OP_END 0x30 // 0x30: end of loop body
+#define SKDPROG_OP_SPEED 0x40 // 0x4s: speed s(0 ~ 2) for next PLAY or REPEAT
+#define SKDPROG_OP_INTV 0x50 // 0x5h lo: interval (h << 8 | lo) seconds(0 ~ 4095) for next PLAY or REPEAT
+#define SKDPROG_OP_SNACK 0x60 // 0x60: give snack here
+
+#define SKDPROG_MAX_DEPTH 4 // nesting of loops
+#define SKDPROG_MAX_CODE 13 // MOTPROG_USER_FIRST + MOTPROG_USER_SLOTS - 1
+#define SKDPROG_NO_SPD 0xFF // entry has no speed override
+#define SKDPROG_NO_INTV 0xFFFF // entry has no interval override
+#define SKDPROG_PLAYS_MAX 0xFFFFFFFF // play count saturates here
+
+#define SKDPROG_ENTRY_PLAY 0
+#define SKDPROG_ENTRY_SNACK 1
+
+/* exported typedef */
+struct SkdProgEntry {
+	uint8_t kind; // SKDPROG_ENTRY_xxx
+	uint8_t code; // pattern code of PLAY
+	uint8_t spd; // SKDPROG_NO_SPD or 0 ~ 2
+	uint16_t intv; // SKDPROG_NO_INTV or seconds
+};
+
+struct SkdProgIter { // 14 bytes. program itself is not copied
+	uint8_t pc;
+	uint8_t depth;
+	uint8_t repLeft; // plays left of REPEAT in progress
+	uint8_t pendSpd; // overrides read for the next entry
+	uint16_t pendIntv;
+	struct {
+		uint8_t body; // pc of first op in loop
+		uint8_t left; // runs left, including current one
+	} loop[SKDPROG_MAX_DEPTH];
+};
+
+/* exported functions */
+_Bool skdprog_check(const uint8_t* p, uint8_t len, uint32_t* pPlays); // validate. plays: patterns the program plays, saturating
+void skdprog_begin(struct SkdProgIter* it);
+_Bool skdprog_next(struct SkdProgIter* it, const uint8_t* p, uint8_t len, struct SkdProgEntry* pEntry); // FALSE at end. program must pass skdprog_check
+
+#endif
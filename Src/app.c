@@ -18,6 +18,11 @@
 #include "l298n.h"
 #include "sg90.h"
 #include "buzzer.h"
+#include "skdprog.h"
+#include "rtclock.h"
+#include "motprog.h"
+#include "playplan.h"
+#include "pattime.h"
 
 struct SerialDta rpidta;
 
@@ -30,6 +35,7 @@ struct SerialDta rpidta;
 
 #define SEARCH_SUCCESS 0
 #define SEARCH_TIMEOUT 1
+#define SEARCH_ABORTED 2
 
 /* TEST MODE can be disabled by commenting some lines at: carebotCore.h */
 
@@ -46,11 +52,27 @@ const uint8_t SPD_ADDEND = 3; // THIS NUMBER MUST NOT EXCEED: 100 - MANUAL SPEED
 const uint8_t SPD_SUBTRAHEND = 6; // THIS NUMBER MUST BE LESS THAN: MANUAL SPEED / 4
 const uint8_t DEF_ANG_A = 30; // default angle of snack motor
 //const uint8_t DEF_ANG_B = ; // reserve servo b
-const uint16_t OP_SNACK_RET_MOTOR_WAITING_TIME = 650; // in milliseconds
+const uint16_t OP_SNACK_RET_MOTOR_WAITING_TIME = 650; // in milliseconds. door is held open this long
+const uint16_t SNACK_DOOR_OPEN_TIME = 250; // in milliseconds. eased to avoid jamming the door
+const uint16_t SNACK_DOOR_CLOSE_TIME = 400; // in milliseconds
+const uint16_t SNACK_SERVO_DETACH_TIME = 500; // in milliseconds. servo PWM is paused this long after a move ends
 const int32_t CAT_SEARCH_INITIAL_WAIT_TIME = 20 * 1000; // in milliseconds
 const int32_t CAT_SEARCH_TOTAL_WAIT_TIME = 5 * 60; // in seconds
 const int32_t VIB_WAIT_TIME = 600; // in seconds
 const int32_t PATTERN_WAIT_AND_FLEE_WAIT_TIME = 20; // RANGE: 1 ~ 60, in seconds
+const uint16_t PATTERN_GAP_TIME = 300; // in milliseconds. slight delay between patterns
+const uint16_t PLAY_PLAN_SCAN_MAX = 1000; // entries of program costed when play starts. the rest is taken as more of the same
+const uint8_t MOTOR_RAMP_PROFILE = L298N_RAMP_SCURVE; // L298N_RAMP_NONE disables ramping
+const uint16_t MOTOR_SLEW_RATE = 800; // speed units per second. 0 to 76 takes about 140ms with S-curve
+const uint16_t ROT_CAL_SAMPLE_PERIOD = 50; // in milliseconds. IR sampling period of rotation calibration
+const uint16_t ROT_CAL_SIG_LEN = 16; // number of samples in IR signature window
+const uint8_t ROT_CAL_MIN_SIG_RANGE = 15; // in cm. signature must vary at least this much to be distinctive
+const uint8_t ROT_CAL_MAX_MATCH_ERR = 4; // in cm. max. mean abs. error of signature match
+const uint16_t CMD_DISPATCH_TICK = 10; // in milliseconds. wait points of long routines handle commands this often
+const uint8_t SKD_RECV_TIMEOUT = 5; // in seconds. partial schedule upload is discarded after this long without a schedule packet
+const uint8_t MAN_STREAM_EXPO = 30; // RANGE: 0 ~ 100. response curve of manual stream, 0 linear ~ 100 cubic
+const uint16_t MAN_STREAM_DEADMAN_TIME = 300; // in milliseconds. wheels stop if manual stream stops this long, 0: off
+const uint8_t MAN_STREAM_DEADBAND = 5; // stick values under this are zero
 
 // SOME OF PROPERTIES BELOW ARE DERIVED. DERIVED PROPERTIES MUST NOT BE EDITED
 const uint8_t AUTO_DEF_ROT_SPD = MAN_ROT_SPD;
@@ -62,44 +84,161 @@ const uint8_t AUTO_DEF_DRV_SPD = MAN_DRV_SPD;
 // therefore, i manually set minimum value, and it won't be affected by user settings.
 const uint8_t AUTO_MIN_ROT_SPD = 38;
 const uint8_t AUTO_MIN_DRV_SPD = 38;
+const uint8_t MAN_STREAM_MIN_SPD = AUTO_MIN_DRV_SPD; // smallest stick deflection maps here
 const uint8_t ROOM_SEARCH_ROT_SPD = AUTO_MIN_ROT_SPD * 2;
 const uint8_t ROOM_SEARCH_DRV_SPD = 95;
-const int32_t ROOM_SEARCH_ROT_TIME_18DEG = 250; // in milliseconds
+const uint16_t ROOM_SEARCH_STEP_ANGLE = 18; // in degrees. 20 steps make a full turn
+const uint16_t CAT_FOUND_CORRECTION_ANGLE = 10; // in degrees. rotate back this much when cat is found to correct delay
 //const int32_t ROOM_SEARCH_ROT_TIME_30DEG = 890; // in milliseconds
 const uint8_t SPD_OVERSHOOT_ADDEND = ((AUTO_DEF_ROT_SPD >= 50 || AUTO_DEF_DRV_SPD >= 50) ? 0 : (AUTO_DEF_ROT_SPD > AUTO_DEF_DRV_SPD) ? (100 - AUTO_DEF_DRV_SPD * 2) : (100 - AUTO_DEF_ROT_SPD * 2));
 
 const uint8_t SNACK_ANG_RDY = DEF_ANG_A;
 const uint8_t SNACK_ANG_GIVE = DEF_ANG_A + 110;
 
+// melodies(flash). played in background by buzzer TIM update interrupt
+#define MEL_PRIO_ACK 0 // schedule packet acknowledgement
+#define MEL_PRIO_INFO 1 // progress of autoplay
+#define MEL_PRIO_ALERT 2 // needs attention of user
+#define MEL(notes, loop) { (notes), sizeof(notes) / sizeof(struct BuzzerNote), (loop) }
+static const struct BuzzerNote notesBoot[] = { BUZZER_NOTE(toneA5, 50, 250) };
+static const struct BuzzerNote notesSearchTimeout[] = { BUZZER_NOTE(toneF6, 10, 150), BUZZER_NOTE(BUZZER_REST, 0, 150) };
+static const struct BuzzerNote notesFoundCat[] = { BUZZER_NOTE(toneC6, 50, 300), BUZZER_NOTE(BUZZER_REST, 0, 300) };
+static const struct BuzzerNote notesVibWait[] = { BUZZER_NOTE(toneF6, 25, 1000), BUZZER_NOTE(BUZZER_REST, 0, 1000) };
+static const struct BuzzerNote notesCancel[] = { BUZZER_NOTE(toneA4, 50, 500), BUZZER_NOTE(BUZZER_REST, 0, 500) };
+static const struct BuzzerNote notesSnack[] = { BUZZER_NOTE(toneFS6, 50, 60), BUZZER_NOTE(BUZZER_REST, 0, 60) };
+static const struct BuzzerNote notesPattern[] = { BUZZER_NOTE(toneD4, 50, 100), BUZZER_NOTE(toneDS4, 50, 100), BUZZER_NOTE(toneF4, 50, 100) };
+static const struct BuzzerNote notesAutoplayEnd[] = { BUZZER_NOTE(toneE6, 50, 250), BUZZER_NOTE(toneG6, 50, 250), BUZZER_NOTE(toneC7, 50, 250) };
+static const struct BuzzerNote notesSkdAlarm[] = { BUZZER_NOTE(toneC6, 50, 500), BUZZER_NOTE(toneE6, 50, 500), BUZZER_NOTE(toneG6, 50, 2000) };
+static const struct BuzzerNote notesAckTime[] = { BUZZER_NOTE(toneG6, 50, 250), BUZZER_NOTE(BUZZER_REST, 0, 250) };
+static const struct BuzzerNote notesAckPattern[] = { BUZZER_NOTE(toneA6, 50, 250), BUZZER_NOTE(BUZZER_REST, 0, 250) };
+static const struct BuzzerNote notesAckSnack[] = { BUZZER_NOTE(toneB6, 50, 250), BUZZER_NOTE(BUZZER_REST, 0, 250) };
+static const struct BuzzerNote notesAckSpeed[] = { BUZZER_NOTE(toneC7, 50, 250), BUZZER_NOTE(BUZZER_REST, 0, 250) };
+static const struct BuzzerNote notesAckStart[] = { BUZZER_NOTE(toneE6, 50, 250), BUZZER_NOTE(BUZZER_REST, 0, 250) };
+static const struct BuzzerNote notesAckEnd[] = { BUZZER_NOTE(toneE6, 50, 200), BUZZER_NOTE(BUZZER_REST, 0, 200) };
+static const struct BuzzerMelody melBoot = MEL(notesBoot, 0);
+static const struct BuzzerMelody melSearchTimeout = MEL(notesSearchTimeout, 0);
+static const struct BuzzerMelody melFoundCat = MEL(notesFoundCat, 2); // 3 beeps
+static const struct BuzzerMelody melVibWait = MEL(notesVibWait, BUZZER_LOOP_FOREVER); // beep every 2 seconds until vibration
+static const struct BuzzerMelody melCancel = MEL(notesCancel, 4); // 5 beeps
+static const struct BuzzerMelody melSnack = MEL(notesSnack, 4);
+static const struct BuzzerMelody melPattern = MEL(notesPattern, 1);
+static const struct BuzzerMelody melAutoplayEnd = MEL(notesAutoplayEnd, 0);
+static const struct BuzzerMelody melSkdAlarm = MEL(notesSkdAlarm, 1);
+static const struct BuzzerMelody melAckTime = MEL(notesAckTime, 0);
+static const struct BuzzerMelody melAckPattern = MEL(notesAckPattern, 0);
+static const struct BuzzerMelody melAckSnack = MEL(notesAckSnack, 0);
+static const struct BuzzerMelody melAckSpeed = MEL(notesAckSpeed, 0);
+static const struct BuzzerMelody melAckStart = MEL(notesAckStart, 0);
+static const struct BuzzerMelody melAckEnd = MEL(notesAckEnd, 2);
 
 // system variables
 static volatile uint8_t flagSkdTimeElapsed = FALSE;
 static volatile uint8_t flagVibWaitTimeout = FALSE;
 static volatile uint8_t flagCatSearchTimeout = FALSE;
 static volatile uint8_t flagAutorun = FALSE;
-static volatile uint8_t recvScheduleMode = FALSE;
+static volatile uint8_t recvScheduleMode = FALSE; // filling staging schedule
 static volatile uint8_t initState = FALSE;
 static volatile uint8_t autoplayStatus = AUTOPLAY_STATUS_BEGIN;
 
-static struct dtaStructQueueU8 patternQueue;
-static uint8_t speed = 0; // 0 ~ 2.
+static uint8_t speed = 0; // 0 ~ 2. play speed of schedule, entries may override it for one pattern
+static struct SkdProgEntry skdEntry; // program entry being played
+static int32_t entryIntv = -1; // interval override of entry in seconds, -1: none
+static uint16_t entryReps = 0; // repeats of interval loops given by play plan, 0: none
 static uint8_t rotSpd = AUTO_DEF_ROT_SPD * 2;
 static uint8_t drvSpd = AUTO_DEF_DRV_SPD * 2;
-static volatile int32_t skdWaitTime = 0;
 static volatile int32_t vibWaitTime = 0;
 static volatile int32_t catSearchWaitTime = 0;
-static volatile int32_t skdDuration = 0;
-static volatile _Bool sndRptOutputStat = FALSE; // sound repeat: output on or off
-static int skdSpd = 0;
-static int skdSnackIntv = 0;
-static volatile _Bool skdIsSet = FALSE;
 static volatile _Bool catSearchIsSet = FALSE;
 static volatile _Bool vibWaitIsSet = FALSE;
-static volatile _Bool sndRptIsSet = FALSE;
 static _Bool isAutoplayCancelled = FALSE;
+static volatile uint8_t appPhase = APP_PHASE_IDLE; // APP_PHASE_xxx, read by telemetry
+static volatile uint8_t curPattern = RPI_TLM_NO_PATTERN;
+
+// motion programs of patterns
+static uint8_t motUser[MOTPROG_USER_SLOTS][MOTPROG_MAX_LEN]; // uploaded patterns 10 ~ 13. not kept over reset
+static uint8_t motUserLen[MOTPROG_USER_SLOTS]; // 0: empty slot
+static struct MotProgEnv motEnv;
+static uint32_t motRuns = 0;
+static uint32_t motSteps = 0;
+static uint64_t motCycSum = 0; // CPU cycles in motprog_step
+static uint32_t motCycMax = 0;
+static const struct BuzzerMelody* const motMelodies[] = { &melPattern, &melFoundCat, &melSnack, &melSkdAlarm, &melAckPattern }; // SOUND ids
+
+// play time budget of autoplay session. only for a schedule played by its timer or resumed(flagAutorun)
+static struct PlayPlan plan;
+static _Bool planOn = FALSE;
+
+/*
+ * auto-decide: pattern after the previous one(index). active ones are followed by more static ones and vice versa
+ * every pattern will be executed with auto-decide mode only, although it's not recommended
+ * pattern execution order for full-auto mode: 5-6-1-4-9-8-3-2-7-5-...
+ * 0: first scheduled pattern is auto decide, do code 5(shake)
+ */
+static const uint8_t autoNext[MOTPROG_BUILTIN_CNT + 1] = { 5, 4, 7, 2, 9, 6, 1, 5, 3, 8 };
+
+// autoplay stopped by abort command. resumed from the interrupted pattern, cleared by a new schedule
+struct AutoplayResume {
+	_Bool valid;
+	_Bool searched; // cat search was done: resume skips it
+	uint8_t pattern; // interrupted pattern code, played again from its start. RPI_TLM_NO_PATTERN if none
+	uint8_t patternPrev; // for auto-decide
+	int snackIntvCnt;
+	uint32_t planLeft; // ms of play time budget left
+};
+static struct AutoplayResume resumeState = { FALSE, FALSE, RPI_TLM_NO_PATTERN, 0, 0, 0 };
+
+// schedules. upload fills staging, commit validates it and flips pointers: a schedule in calendar is never written in place
+struct Schedule {
+	int32_t waitTime; // seconds until first play, as uploaded
+	uint32_t fireAt; // skdClock of next play
+	uint32_t period; // seconds between plays, 0: once
+	_Bool wallClock; // fireAt is a local time from the app: kept when the clock is stepped
+	_Bool armed; // has a next play: queued in skdHeap while in calendar
+	uint8_t slot; // calendar slot, 0 ~ RPI_CAL_SIZE - 1
+	int32_t duration;
+	uint8_t spd; // 0 ~ 2
+	uint8_t snackIntv; // patterns per snack
+	uint8_t progLen;
+	_Bool invalid; // upload error: rejected on commit
+	uint32_t plays; // patterns the program plays
+	uint32_t played;
+	struct SkdProgIter it; // next entry of program
+	uint8_t prog[RPI_SKD_MAX_PROG]; // pattern program, see skdprog.h
+};
+static struct Schedule skdSlot[RPI_CAL_SIZE + 3]; // calendar, staging, rollback and one held until autoplay ends
+static struct Schedule skdNone; // no schedule played yet: nothing left
+static struct Schedule* skdCal[RPI_CAL_SIZE]; // calendar by slot. NULL: empty
+static struct Schedule* volatile pSkdActive = &skdNone; // being played or played last. read by telemetry
+static struct Schedule* pSkdStaging = &skdSlot[0];
+static struct Schedule* pSkdPrev = &skdSlot[1]; // replaced or deleted one, for rollback(!U)
+static _Bool skdPrevValid = FALSE;
+// min-heap of armed slots by fireAt: second timer looks at the earliest one only. changed with interrupts off
+#define SKD_NOT_QUEUED 0xFF
+static uint8_t skdHeap[RPI_CAL_SIZE];
+static uint8_t skdHeapPos[RPI_CAL_SIZE]; // index in skdHeap by slot, SKD_NOT_QUEUED if not armed
+static volatile uint8_t skdHeapCnt = 0;
+static volatile uint32_t skdClock = 0; // rtclock time, refreshed by second timer
+static struct Schedule* volatile pSkdPending = NULL; // validated upload for the slot being played, committed when autoplay ends
+static volatile uint8_t skdRecvIdle = 0; // seconds since last schedule packet
+
+// manual stream(TYPE_MANUAL_STREAM), configured by TYPE_MANUAL_CFG
+static uint8_t manExpo = 0;
+static uint16_t manDeadman = 0; // ms, 0: off
+static uint8_t manMaxSpd = 0;
+static uint8_t manFlags = 0; // RPI_MCF_FLAG_xxx
+static _Bool manMoving = FALSE; // wheels driven by a manual update, watched by dead-man
+static _Bool manDeadmanStopped = FALSE; // stopped by dead-man, until next update
+static uint32_t manLastTick = 0; // arrival of last manual update
 
 static uint8_t opcodePendingOp = 0;
 
+// rotation rate table: speed -> deg/s * 10. defaults are hand-measured values(18deg per 250ms at speed 76)
+#define ROT_CAL_POINTS 4
+#define ROT_CAL_MAX_SAMPLES 768
+static const uint8_t rotCalSpd[ROT_CAL_POINTS] = { 38, 50, 76, 100 };
+static uint16_t rotCalRate[ROT_CAL_POINTS] = { 125, 313, 720, 1096 };
+static uint8_t rotCalBuf[ROT_CAL_MAX_SAMPLES]; // IR distance samples in cm
+
 /* basic functions */
 int32_t atoi32(uint8_t* str) {
     int32_t result, positive;
@@ -123,9 +262,1212 @@ int32_t atoi32(uint8_t* str) {
 
 /* schedule related functions */
 
+static void setPlaySpeed(int spd) { // 0 ~ 2. motion segments queued from now on use new speed
+	if (spd) {
+		rotSpd = AUTO_DEF_ROT_SPD * spd;
+		drvSpd = AUTO_DEF_DRV_SPD * spd;
+	}
+	else {
+		rotSpd = AUTO_MIN_ROT_SPD;
+		drvSpd = AUTO_MIN_DRV_SPD;
+	}
+}
+
+static uint8_t fillTelemetry(uint8_t* p) { // TYPE_TELEMETRY payload. also runs in 1ms timer interrupt: no ADC or blocking calls
+	struct L298nStats mot = l298n_getStat();
+	struct Schedule* pSkd = pSkdActive;
+	uint32_t skdWait = 0;
+	uint32_t tick = HAL_GetTick();
+	uint16_t distMM = (uint16_t)(periph_irSnsrLast() * 10.0f);
+	uint16_t vibCnt;
+	uint8_t flags = 0;
+
+	if (skdHeapCnt) { // heap is changed with interrupts off: consistent here
+		uint32_t fireAt = skdCal[skdHeap[0]]->fireAt;
+		flags |= RPI_TLM_FLAG_SKD_SET;
+		skdWait = (fireAt > skdClock) ? fireAt - skdClock : 0;
+	}
+	if (recvScheduleMode) flags |= RPI_TLM_FLAG_SKD_RECV;
+	if (isAutoplayCancelled) flags |= RPI_TLM_FLAG_CANCELLED;
+	if (mot.ena) flags |= RPI_TLM_FLAG_MOTOR_ENA;
+	if (periph_isVibration()) flags |= RPI_TLM_FLAG_VIB; // level only, edges are counted by EXTI
+	if (resumeState.valid) flags |= RPI_TLM_FLAG_ABORTED;
+	if (manDeadmanStopped) flags |= RPI_TLM_FLAG_DEADMAN;
+	if (pSkdPending != NULL) flags |= RPI_TLM_FLAG_SKD_PENDING;
+	vibCnt = periph_vibEventCnt();
+
+	p[RPI_TLM_PHASE] = appPhase;
+	p[RPI_TLM_PATTERN] = curPattern;
+	p[RPI_TLM_FLAGS] = flags;
+	for (int i = 0; i < 4; i++) {
+		p[RPI_TLM_SKD_WAIT + i] = (uint8_t)(skdWait >> (8 * i));
+		p[RPI_TLM_TICK + i] = (uint8_t)(tick >> (8 * i));
+	}
+	p[RPI_TLM_MOTOR] = mot.rotA;
+	p[RPI_TLM_MOTOR + 1] = mot.spdA;
+	p[RPI_TLM_MOTOR + 2] = mot.rotB;
+	p[RPI_TLM_MOTOR + 3] = mot.spdB;
+	p[RPI_TLM_MOTOR + 4] = mot.tgtA;
+	p[RPI_TLM_MOTOR + 5] = mot.tgtB;
+	p[RPI_TLM_SERVO] = sg90_getStat(SG90_MOTOR_A).angle[SG90_MOTOR_A];
+	p[RPI_TLM_IR_DIST] = (uint8_t)distMM;
+	p[RPI_TLM_IR_DIST + 1] = (uint8_t)(distMM >> 8);
+	p[RPI_TLM_VIB_CNT] = (uint8_t)vibCnt;
+	p[RPI_TLM_VIB_CNT + 1] = (uint8_t)(vibCnt >> 8);
+	p[RPI_TLM_PATTERN_Q] = (pSkd->plays - pSkd->played > 0xFF) ? 0xFF : (uint8_t)(pSkd->plays - pSkd->played);
+	p[RPI_TLM_RX_Q] = rpi_rxQueueDepth();
+	p[RPI_TLM_MOTION_Q] = (uint8_t)l298n_queueDepth();
+	return RPI_TLM_SIZE;
+}
+
+/* command dispatch */
+
+/*
+ * every received frame goes through cmdTable, indexed by its type byte. cmdDispatch() is called from the main loops
+ * and from appWait(), which long routines use instead of core_call_delayms(), so commands work during autoplay too.
+ * handlers must not block: long activities are requested with APP_REQ_xxx and run by the loop that owns them.
+ * a command received in a phase outside its mask is dropped. schedule uploads are taken in every phase: they fill the
+ * staging schedule, and a played one is replaced only after its autoplay(skdValidate).
+ */
+
+#define PH(phase) (1U << (phase))
+#define CMD_PH_ALL 0xFFFF
+#define CMD_PH_AUTOPLAY (PH(APP_PHASE_SEARCH) | PH(APP_PHASE_VIB_WAIT) | PH(APP_PHASE_PLAY) | PH(APP_PHASE_SNACK) | PH(APP_PHASE_PARK))
+#ifdef _AUDIBLE_EXECUTION_ENABLED
+#define CMD_ACK(mel) (&(mel))
+#else
+#define CMD_ACK(mel) NULL
+#endif
+
+// requests from handlers, carried out by the loop that owns the activity
+#define APP_REQ_MANUAL 0x01 // appMain: start manual drive
+#define APP_REQ_MANUAL_END 0x02 // manualDrive: return
+#define APP_REQ_CALIBRATE 0x04 // appMain: calibrate rotation rate table
+#define APP_REQ_SNACK 0x08 // manualDrive: give snack
+#define APP_REQ_PATTERN 0x10 // manualDrive: execute reqPattern
+#define APP_REQ_ABORT 0x20 // running routine: end at next check. motors are already stopped by the handler
+#define APP_REQ_RESUME 0x40 // appMain: resume aborted autoplay
+
+struct AppCmd {
+	_Bool (*pHandler)(const struct SerialDta* pDta); // returns TRUE if command took effect
+	uint16_t phases; // PH(APP_PHASE_xxx) bits the command is handled in
+	const struct BuzzerMelody* pAck; // played when command took effect. NULL: none
+	// dispatch latency(frame received to handler called), reported by TYPE_CMD_STAT
+	uint32_t cnt;
+	uint32_t dropped;
+	uint32_t latMax;
+	uint16_t hist[RPI_CST_BINS];
+};
+
+static uint8_t appReq = 0; // APP_REQ_xxx
+static uint8_t reqPattern = 0; // pattern code of APP_REQ_PATTERN
+static _Bool isManual = FALSE; // manualDrive is running, including its snack and pattern
+static _Bool isDispatching = FALSE;
+
+static void abortRoutine() { // safe stop now. the running routine ends at its next check of APP_REQ_ABORT
+	struct SG90Stats servo = sg90_getStat(SG90_MOTOR_A);
+	appReq |= APP_REQ_ABORT;
+	l298n_queueAbort(); // motors stop on this call
+	buzzer_stop();
+	periph_laser_off();
+	if (servo.ena[SG90_MOTOR_A]) {
+		if (servo.moving[SG90_MOTOR_A] || servo.angle[SG90_MOTOR_A] != SNACK_ANG_RDY) { // close snack door, PWM pauses when closed
+			sg90_setAutoDetach(SG90_MOTOR_A, SNACK_SERVO_DETACH_TIME);
+			sg90_moveTo(SG90_MOTOR_A, SNACK_ANG_RDY, SNACK_DOOR_CLOSE_TIME, SG90_EASE_INOUT);
+		}
+		else sg90_disable(SG90_MOTOR_A);
+	}
+}
+
+// schedule calendar: slots of committed schedules, armed ones in a min-heap by next play
+
+static _Bool skdHeapLess(uint8_t a, uint8_t b) {
+	return skdCal[skdHeap[a]]->fireAt < skdCal[skdHeap[b]]->fireAt;
+}
+
+static void skdHeapSwap(uint8_t a, uint8_t b) {
+	uint8_t t = skdHeap[a];
+	skdHeap[a] = skdHeap[b];
+	skdHeap[b] = t;
+	skdHeapPos[skdHeap[a]] = a;
+	skdHeapPos[skdHeap[b]] = b;
+}
+
+static void skdHeapFix(uint8_t i) { // move entry i up or down to its place
+	while (i && skdHeapLess(i, (i - 1) / 2)) {
+		skdHeapSwap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	while (1) {
+		uint8_t m = i;
+		uint8_t l = 2 * i + 1;
+		if (l < skdHeapCnt && skdHeapLess(l, m)) m = l;
+		if (l + 1 < skdHeapCnt && skdHeapLess(l + 1, m)) m = l + 1;
+		if (m == i) break;
+		skdHeapSwap(i, m);
+		i = m;
+	}
+}
+
+static void skdAlarmHandler() { // RTC interrupt. skdFire() checks the time: alarms over a month ahead come early
+	flagSkdTimeElapsed = TRUE;
+}
+
+static void skdArm() { // RTC alarm follows the earliest schedule
+	rtclock_setAlarm(skdHeapCnt ? skdCal[skdHeap[0]]->fireAt : RTCLOCK_NO_ALARM, &skdAlarmHandler);
+}
+
+static void skdQueue(uint8_t slot) { // O(log n): armed schedule of slot enters heap, or takes its new fireAt
+	__disable_irq();
+	if (skdHeapPos[slot] == SKD_NOT_QUEUED) {
+		skdHeap[skdHeapCnt] = slot;
+		skdHeapPos[slot] = skdHeapCnt++;
+	}
+	skdHeapFix(skdHeapPos[slot]);
+	__enable_irq();
+	skdArm();
+}
+
+static void skdUnqueue(uint8_t slot) { // O(log n)
+	uint8_t i = skdHeapPos[slot];
+	if (i == SKD_NOT_QUEUED) return;
+	__disable_irq();
+	skdHeapSwap(i, skdHeapCnt - 1);
+	skdHeapCnt--;
+	skdHeapPos[slot] = SKD_NOT_QUEUED;
+	if (i < skdHeapCnt) skdHeapFix(i);
+	__enable_irq();
+	skdArm();
+}
+
+static struct Schedule* skdFreeSlot() { // one is always left: calendar, staging, rollback and held one never need more
+	for (int i = 0; i < RPI_CAL_SIZE + 3; i++) {
+		struct Schedule* p = &skdSlot[i];
+		_Bool used = (p == pSkdStaging || p == pSkdPrev || p == pSkdActive || p == pSkdPending);
+		for (int j = 0; j < RPI_CAL_SIZE && !used; j++) {
+			used = (skdCal[j] == p);
+		}
+		if (!used) return p;
+	}
+	return pSkdPrev; // not reached
+}
+
+static void skdPut(uint8_t slot, struct Schedule* pNew) { // pNew(NULL: empty) takes slot. replaced one is kept for rollback
+	struct Schedule* pOld = skdCal[slot];
+	skdUnqueue(slot);
+	skdCal[slot] = pNew;
+	if (pNew != NULL && pNew->armed) skdQueue(slot);
+	if (pOld == pSkdActive) { // its autoplay state is gone with it
+		pSkdActive = &skdNone;
+		isAutoplayCancelled = FALSE;
+		resumeState.valid = FALSE;
+	}
+	if (pOld != NULL) {
+		pSkdPrev = pOld;
+		skdPrevValid = TRUE;
+	}
+	else skdPrevValid = FALSE; // new slot: undone by delete
+}
+
+static void skdStage() { // start filling staging schedule. calendar keeps running
+	pSkdStaging->waitTime = 0;
+	pSkdStaging->period = 0;
+	pSkdStaging->wallClock = FALSE;
+	pSkdStaging->slot = 0;
+	pSkdStaging->armed = FALSE;
+	pSkdStaging->duration = 1; // if no input, play only once
+	pSkdStaging->spd = 2; // normal, if no input
+	pSkdStaging->snackIntv = 0;
+	pSkdStaging->progLen = 0;
+	pSkdStaging->invalid = FALSE;
+	skdRecvIdle = 0;
+	recvScheduleMode = TRUE;
+}
+
+static void skdAddPattern(uint8_t code) {
+	if (code > SKDPROG_MAX_CODE || pSkdStaging->progLen >= RPI_SKD_MAX_PROG) pSkdStaging->invalid = TRUE; // 0: auto-decide, 1 ~ 13
+	else pSkdStaging->prog[pSkdStaging->progLen++] = SKDPROG_OP_PLAY | code;
+}
+
+static void skdCommit(struct Schedule* pNew) { // pointer flip into calendar slot and O(log n) heap update. pNew was validated by skdValidate()
+	if (pNew == pSkdPending) pSkdPending = NULL;
+	pNew->armed = TRUE;
+	skdPut(pNew->slot, pNew);
+	if (pNew == pSkdStaging) pSkdStaging = skdFreeSlot();
+}
+
+static _Bool skdValidate() { // end of upload: commit now, or after autoplay. FALSE: discarded, calendar untouched
+	_Bool ok = recvScheduleMode && !pSkdStaging->invalid && pSkdStaging->waitTime >= 0 && pSkdStaging->duration >= 0
+			&& pSkdStaging->slot < RPI_CAL_SIZE;
+	recvScheduleMode = FALSE;
+	if (!ok || !skdprog_check(pSkdStaging->prog, pSkdStaging->progLen, &pSkdStaging->plays)) return FALSE;
+	if (pSkdStaging->wallClock) { // fireAt was uploaded. needs the clock set by the Pi
+		if (!rtclock_isSet()) return FALSE;
+		if (pSkdStaging->fireAt <= skdClock) {
+			if (!pSkdStaging->period) return FALSE; // already over
+			pSkdStaging->fireAt += ((skdClock - pSkdStaging->fireAt) / pSkdStaging->period + 1) * pSkdStaging->period;
+		}
+	}
+	else pSkdStaging->fireAt = skdClock + (uint32_t)pSkdStaging->waitTime; // wait starts now, also if commit is held
+	if (pSkdStaging->duration == 0) pSkdStaging->duration = 1;
+	if ((PH(appPhase) & CMD_PH_AUTOPLAY) && skdCal[pSkdStaging->slot] == pSkdActive) { // played schedule is not replaced under its feet
+		pSkdPending = pSkdStaging; // replaces one held before for the slot
+		pSkdStaging = skdFreeSlot();
+	}
+	else skdCommit(pSkdStaging); // other slots change at once
+	return TRUE;
+}
+
+static _Bool skdRollback() { // replaced or deleted schedule goes back to its slot. played one can not be rolled back to
+	struct Schedule* pBack = pSkdPrev;
+	if (!skdPrevValid || !pBack->armed || (PH(appPhase) & CMD_PH_AUTOPLAY)) return FALSE;
+	skdPut(pBack->slot, pBack); // overdue: plays at once
+	return TRUE;
+}
+
+static _Bool skdDelete(uint8_t slot) {
+	if (slot >= RPI_CAL_SIZE || skdCal[slot] == NULL) return FALSE;
+	if (skdCal[slot] == pSkdActive && (PH(appPhase) & CMD_PH_AUTOPLAY)) return FALSE; // being played: abort it first
+	skdPut(slot, NULL);
+	return TRUE;
+}
+
+static struct Schedule* skdFire() { // earliest schedule is due: next play goes back to heap. NULL if none is due
+	struct Schedule* pSkd;
+	uint8_t slot;
+	if (!skdHeapCnt) return NULL;
+	skdClock = rtclock_now(); // RTC alarm comes between second timer ticks
+	slot = skdHeap[0];
+	pSkd = skdCal[slot];
+	if (pSkd->fireAt > skdClock) { // replaced or deleted since timer saw it, or early alarm
+		skdArm();
+		return NULL;
+	}
+	if (pSkd->period) {
+		pSkd->fireAt += ((skdClock - pSkd->fireAt) / pSkd->period + 1) * pSkd->period; // plays missed during a long autoplay are skipped
+		skdQueue(slot);
+	}
+	else {
+		pSkd->armed = FALSE;
+		skdUnqueue(slot);
+	}
+	skdprog_begin(&pSkd->it);
+	pSkd->played = 0;
+	pSkdActive = pSkd;
+	speed = pSkd->spd;
+	setPlaySpeed(speed);
+	isAutoplayCancelled = FALSE; // new session replaces cancelled or aborted one
+	resumeState.valid = FALSE;
+	return pSkd;
+}
+
+static void skdShift(int32_t step) { // clock was stepped: waits keep their length, local times stay
+	for (uint8_t i = 0; i <= RPI_CAL_SIZE; i++) { // and the one held until autoplay ends
+		struct Schedule* pSkd = (i < RPI_CAL_SIZE) ? skdCal[i] : pSkdPending;
+		if (pSkd == NULL || (i < RPI_CAL_SIZE && !pSkd->armed) || pSkd->wallClock) continue;
+		pSkd->fireAt = (step < 0 && pSkd->fireAt < (uint32_t)-step) ? 0 : pSkd->fireAt + step;
+		if (i < RPI_CAL_SIZE) skdQueue(i);
+	}
+}
+
+static _Bool loadSchedule(const uint8_t* p, uint8_t len, uint8_t slot, uint32_t period, uint32_t at) { // TYPE_SCHEDULE payload. whole schedule, committed like '>'. at: local time or 0
+	uint8_t cnt;
+	if (len < RPI_SKD_PATTERNS) return FALSE;
+	cnt = p[RPI_SKD_PATTERN_CNT];
+	if (cnt > RPI_SKD_MAX_PROG || len < RPI_SKD_PATTERNS + cnt) return FALSE;
+
+	skdStage();
+	pSkdStaging->slot = slot;
+	pSkdStaging->period = period;
+	pSkdStaging->wallClock = (at != 0);
+	pSkdStaging->fireAt = at;
+	pSkdStaging->waitTime = (int32_t)((uint32_t)p[RPI_SKD_WAIT_TIME] | ((uint32_t)p[RPI_SKD_WAIT_TIME + 1] << 8)
+			| ((uint32_t)p[RPI_SKD_WAIT_TIME + 2] << 16) | ((uint32_t)p[RPI_SKD_WAIT_TIME + 3] << 24));
+	pSkdStaging->duration = (int32_t)((uint16_t)p[RPI_SKD_DURATION] | ((uint16_t)p[RPI_SKD_DURATION + 1] << 8));
+	pSkdStaging->spd = (p[RPI_SKD_SPEED] > 2) ? 2 : p[RPI_SKD_SPEED];
+	pSkdStaging->snackIntv = p[RPI_SKD_SNACK_INTV];
+	for (uint8_t i = 0; i < cnt; i++) {
+		pSkdStaging->prog[i] = p[RPI_SKD_PATTERNS + i];
+	}
+	pSkdStaging->progLen = cnt;
+	return skdValidate();
+}
+
+static _Bool onSkdTime(const struct SerialDta* pDta) {
+	if (!recvScheduleMode) return FALSE;
+	pSkdStaging->waitTime = atoi32((uint8_t*)pDta->container);
+	skdRecvIdle = 0;
+	return TRUE;
+}
+
+static _Bool onSkdPattern(const struct SerialDta* pDta) {
+	if (!recvScheduleMode) return FALSE;
+	for (int i = 0; i < pDta->len; i++) { // 7 for ASCII frames
+		if (pDta->container[i]) {
+			if (pDta->container[i] != '.') skdAddPattern(pDta->container[i] - 0x30);
+		}
+		else break;
+	}
+	skdRecvIdle = 0;
+	return TRUE;
+}
+
+static _Bool onSkdSnackIntv(const struct SerialDta* pDta) {
+	if (!recvScheduleMode) return FALSE;
+	pSkdStaging->snackIntv = pDta->container[0] - 0x30;
+	skdRecvIdle = 0;
+	return TRUE;
+}
+
+static _Bool onSpeed(const struct SerialDta* pDta) { // schedule speed while receiving schedule, live speed during autoplay
+	int spd = pDta->container[0];
+	if (spd >= '0') spd -= '0'; // ASCII digit from app
+	if (spd > 2) spd = 2;
+	if (recvScheduleMode) { // applied on commit
+		pSkdStaging->spd = spd;
+		skdRecvIdle = 0;
+		return TRUE;
+	}
+	if (PH(appPhase) & CMD_PH_AUTOPLAY) {
+		speed = spd;
+		setPlaySpeed(spd);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static _Bool onSkdDuration(const struct SerialDta* pDta) {
+	if (!recvScheduleMode) return FALSE;
+	pSkdStaging->duration = atoi32((uint8_t*)pDta->container);
+	skdRecvIdle = 0;
+	return TRUE;
+}
+
+static _Bool onSkdStart(const struct SerialDta* pDta) { // autoplay cancel and resume states are reset on commit
+	skdStage();
+	return TRUE;
+}
+
+static _Bool onSkdEnd(const struct SerialDta* pDta) {
+	return skdValidate();
+}
+
+static _Bool onSchedule(const struct SerialDta* pDta) { // binary link: whole schedule in one frame
+	return loadSchedule(pDta->container, pDta->len, 0, 0, 0);
+}
+
+static _Bool onSkdSlot(const struct SerialDta* pDta) { // calendar slot and period of schedule being received
+	int32_t minutes;
+	if (!recvScheduleMode) return FALSE;
+	minutes = atoi32((uint8_t*)pDta->container + 1);
+	pSkdStaging->slot = pDta->container[0] - 0x30; // checked by skdValidate()
+	pSkdStaging->period = (uint32_t)minutes * 60;
+	if (minutes < 0) pSkdStaging->invalid = TRUE;
+	skdRecvIdle = 0;
+	return TRUE;
+}
+
+static _Bool onCalSet(const struct SerialDta* pDta) {
+	const uint8_t* p = pDta->container;
+	if (pDta->len < RPI_CAL_SKD) return FALSE;
+	return loadSchedule(p + RPI_CAL_SKD, pDta->len - RPI_CAL_SKD, p[RPI_CAL_SLOT], (uint32_t)p[RPI_CAL_PERIOD]
+			| ((uint32_t)p[RPI_CAL_PERIOD + 1] << 8) | ((uint32_t)p[RPI_CAL_PERIOD + 2] << 16) | ((uint32_t)p[RPI_CAL_PERIOD + 3] << 24),
+			(uint32_t)p[RPI_CAL_AT] | ((uint32_t)p[RPI_CAL_AT + 1] << 8) | ((uint32_t)p[RPI_CAL_AT + 2] << 16) | ((uint32_t)p[RPI_CAL_AT + 3] << 24));
+}
+
+static _Bool onCalDel(const struct SerialDta* pDta) {
+	uint8_t slot = pDta->container[0];
+	_Bool ok = FALSE;
+	if (pDta->len < 1) return FALSE;
+	if (slot == '*') slot = RPI_CAL_ALL;
+	else if (slot >= '0' && slot <= '9') slot -= '0'; // ASCII digit from app
+	if (slot != RPI_CAL_ALL) return skdDelete(slot);
+	for (uint8_t i = 0; i < RPI_CAL_SIZE; i++) { // except the one being played
+		if (skdDelete(i)) ok = TRUE;
+	}
+	return ok;
+}
+
+static _Bool onCalList(const struct SerialDta* pDta) {
+	uint8_t buf[1 + RPI_CAL_SIZE * RPI_CLS_SIZE];
+	uint8_t n = 0;
+	for (uint8_t i = 0; i < RPI_CAL_SIZE; i++) {
+		struct Schedule* pSkd = skdCal[i];
+		uint8_t* e = buf + 1 + n * RPI_CLS_SIZE;
+		uint32_t fireIn;
+		if (pSkd == NULL) continue;
+		fireIn = (pSkd->armed && pSkd->fireAt > skdClock) ? pSkd->fireAt - skdClock : 0;
+		e[RPI_CLS_SLOT] = i;
+		e[RPI_CLS_FLAGS] = (pSkd->armed ? RPI_CLS_FLAG_ARMED : 0) | ((pSkd == pSkdActive) ? RPI_CLS_FLAG_ACTIVE : 0)
+				| (pSkd->wallClock ? RPI_CLS_FLAG_WALL_CLOCK : 0);
+		for (int j = 0; j < 4; j++) {
+			e[RPI_CLS_FIRE_IN + j] = (uint8_t)(fireIn >> (8 * j));
+			e[RPI_CLS_PERIOD + j] = (uint8_t)(pSkd->period >> (8 * j));
+			e[RPI_CLS_PLAYS + j] = (uint8_t)(pSkd->plays >> (8 * j));
+		}
+		e[RPI_CLS_DURATION] = (uint8_t)pSkd->duration;
+		e[RPI_CLS_DURATION + 1] = (uint8_t)(pSkd->duration >> 8);
+		e[RPI_CLS_SPEED] = pSkd->spd;
+		e[RPI_CLS_SNACK_INTV] = pSkd->snackIntv;
+		e[RPI_CLS_PROG_LEN] = pSkd->progLen;
+		n++;
+	}
+	buf[0] = n;
+	return rpi_sendFrame(TYPE_CAL_LIST, buf, 1 + n * RPI_CLS_SIZE);
+}
+
+static _Bool onClockSync(const struct SerialDta* pDta) { // set RTC to the Pi's time, answer with TYPE_CLOCK_STAT
+	const uint8_t* p = pDta->container;
+	uint8_t buf[RPI_CKS_SIZE];
+	struct RtclockStats st;
+	if (pDta->len >= RPI_CLK_SIZE) {
+		uint32_t sec = (uint32_t)p[RPI_CLK_SEC] | ((uint32_t)p[RPI_CLK_SEC + 1] << 8) | ((uint32_t)p[RPI_CLK_SEC + 2] << 16)
+				| ((uint32_t)p[RPI_CLK_SEC + 3] << 24);
+		uint32_t ms = ((uint32_t)p[RPI_CLK_MS] | ((uint32_t)p[RPI_CLK_MS + 1] << 8)) + (HAL_GetTick() - pDta->tick); // frame waited in rx queue
+		int32_t step = rtclock_sync(sec + ms / 1000, ms % 1000);
+		skdClock = rtclock_now();
+		if (step) skdShift(step);
+	}
+	st = rtclock_getStat();
+	for (int i = 0; i < 4; i++) {
+		buf[RPI_CKS_NOW + i] = (uint8_t)(skdClock >> (8 * i));
+		buf[RPI_CKS_SYNCS + i] = (uint8_t)(st.syncs >> (8 * i));
+		buf[RPI_CKS_STEPS + i] = (uint8_t)(st.steps >> (8 * i));
+		buf[RPI_CKS_LAST_OFS + i] = (uint8_t)((uint32_t)st.lastOfs >> (8 * i));
+		buf[RPI_CKS_MAX_SLEW + i] = (uint8_t)(st.maxSlew >> (8 * i));
+		buf[RPI_CKS_DRIFT + i] = (uint8_t)((uint32_t)st.drift >> (8 * i));
+		buf[RPI_CKS_CALIB + i] = (uint8_t)((uint32_t)st.calib >> (8 * i));
+	}
+	buf[RPI_CKS_FLAGS] = st.flags;
+	return rpi_sendFrame(TYPE_CLOCK_STAT, buf, RPI_CKS_SIZE);
+}
+
+static _Bool onMotionSet(const struct SerialDta* pDta) { // upload or delete a pattern slot, answer with TYPE_MOTION_STAT
+	const uint8_t* p = pDta->container;
+	uint8_t buf[RPI_MTS_SIZE];
+	uint32_t avg = motSteps ? (uint32_t)(motCycSum / motSteps) : 0;
+	if (pDta->len >= 1) {
+		uint8_t code = p[RPI_MOT_CODE];
+		uint8_t len = pDta->len - RPI_MOT_PROG;
+		if (code < MOTPROG_USER_FIRST || code >= MOTPROG_USER_FIRST + MOTPROG_USER_SLOTS || code == curPattern) return FALSE; // slot being played is read by the interpreter
+		if (len > MOTPROG_MAX_LEN || !motprog_check(p + RPI_MOT_PROG, len)) return FALSE;
+		for (uint8_t i = 0; i < len; i++) motUser[code - MOTPROG_USER_FIRST][i] = p[RPI_MOT_PROG + i];
+		motUserLen[code - MOTPROG_USER_FIRST] = len; // 0 deletes
+	}
+	for (int i = 0; i < MOTPROG_USER_SLOTS; i++) buf[RPI_MTS_LEN + i] = motUserLen[i];
+	for (int i = 0; i < 4; i++) {
+		buf[RPI_MTS_RUNS + i] = (uint8_t)(motRuns >> (8 * i));
+		buf[RPI_MTS_STEPS + i] = (uint8_t)(motSteps >> (8 * i));
+	}
+	if (avg > 0xFFFF) avg = 0xFFFF;
+	buf[RPI_MTS_CYC_AVG] = (uint8_t)avg;
+	buf[RPI_MTS_CYC_AVG + 1] = (uint8_t)(avg >> 8);
+	buf[RPI_MTS_CYC_MAX] = (uint8_t)((motCycMax > 0xFFFF) ? 0xFFFF : motCycMax);
+	buf[RPI_MTS_CYC_MAX + 1] = (uint8_t)(((motCycMax > 0xFFFF) ? 0xFFFF : motCycMax) >> 8);
+	return rpi_sendFrame(TYPE_MOTION_STAT, buf, RPI_MTS_SIZE);
+}
+
+static _Bool onSys(const struct SerialDta* pDta) {
+#ifdef _TEST_MODE_ENABLED
+	core_dbgTx("SYS CMD: ");
+#endif
+	switch (pDta->container[0]) {
+	case '1': // start manual drive. takes over autoplay, pattern or calibration
+		if (isManual) return FALSE;
+		appReq |= APP_REQ_MANUAL;
+		if (appPhase != APP_PHASE_IDLE && appPhase != APP_PHASE_CANCELLED) abortRoutine();
+		return TRUE;
+	case '2': // stop manual drive
+		if (!isManual) return FALSE;
+		appReq |= APP_REQ_MANUAL_END;
+		if (appPhase != APP_PHASE_MANUAL) abortRoutine(); // snack or pattern of manual drive
+		return TRUE;
+	case '0': // abort autoplay, pattern or calibration
+		if (appPhase == APP_PHASE_IDLE || appPhase == APP_PHASE_CANCELLED) return FALSE;
+		abortRoutine();
+		return TRUE;
+	case 'U': // roll back to previous schedule
+		return skdRollback();
+	case 'R': // resume aborted autoplay
+		if (!resumeState.valid || (appPhase != APP_PHASE_IDLE && appPhase != APP_PHASE_CANCELLED)) return FALSE;
+		appReq |= APP_REQ_RESUME;
+		return TRUE;
+	case '8': // calibrate rotation rate table. run near a wall or furniture
+		if (appPhase != APP_PHASE_IDLE && appPhase != APP_PHASE_CANCELLED) return FALSE;
+		appReq |= APP_REQ_CALIBRATE;
+		return TRUE;
+	case '9': // initialize whole system
+		// not yet implemented
+		//core_restart();
+		break;
+	}
+	return FALSE;
+}
+
+static _Bool snackCancel(); // snack related functions below
+
+static void manUpdated(const struct SerialDta* pDta, _Bool moving) { // start dead-man window of a manual update
+	manMoving = moving;
+	manDeadmanStopped = FALSE;
+	manLastTick = pDta->tick;
+}
+
+static int16_t manCurve(int8_t v) { // -100 ~ 100 stick value through response curve
+	int32_t x = (v < -100) ? -100 : (v > 100) ? 100 : v;
+	if (x > -MAN_STREAM_DEADBAND && x < MAN_STREAM_DEADBAND) return 0;
+	return (int16_t)((x * (100 - manExpo) * 10000 + x * x * x * manExpo) / 1000000);
+}
+
+static uint8_t manWheelSpd(int16_t v) { // -100 ~ 100 -> 0, MAN_STREAM_MIN_SPD ~ manMaxSpd
+	if (v < 0) v = -v;
+	if (v == 0) return 0;
+	return (uint8_t)(MAN_STREAM_MIN_SPD + (uint32_t)v * (manMaxSpd - MAN_STREAM_MIN_SPD) / 100);
+}
+
+static void manDeadmanChk() { // call from manual drive loop
+	if (!manMoving || manDeadman == 0 || HAL_GetTick() - manLastTick < manDeadman) return;
+	l298n_drive(L298N_STOP, 0, L298N_STOP, 0); // no update from Pi: link or phone is gone
+	manMoving = FALSE;
+	manDeadmanStopped = TRUE;
+}
+
+static _Bool onManualStream(const struct SerialDta* pDta) { // signed throttle and turn to differential wheel speeds
+	int16_t thr, turn, left, right, big;
+	if (!isManual || pDta->len < RPI_MST_SIZE) return FALSE; // snack phase of autoplay
+	snackCancel(); // steering takes over from snack
+	thr = manCurve((int8_t)pDta->container[RPI_MST_THROTTLE]);
+	turn = manCurve((int8_t)pDta->container[RPI_MST_TURN]);
+	left = thr + turn;
+	right = thr - turn;
+	big = (left < 0 ? -left : left) > (right < 0 ? -right : right) ? (left < 0 ? -left : left) : (right < 0 ? -right : right);
+	if (big > 100) { // keep ratio of wheels at full stick
+		left = left * 100 / big;
+		right = right * 100 / big;
+	}
+	l298n_drive((left > 0) ? L298N_FWD_A : (left < 0) ? L298N_BWD_A : L298N_STOP, manWheelSpd(left),
+			(right > 0) ? L298N_FWD_B : (right < 0) ? L298N_BWD_B : L298N_STOP, manWheelSpd(right));
+	manUpdated(pDta, left != 0 || right != 0);
+	return TRUE;
+}
+
+static _Bool onManualCfg(const struct SerialDta* pDta) {
+	if (pDta->len < RPI_MCF_SIZE) return FALSE;
+	manExpo = (pDta->container[RPI_MCF_EXPO] > 100) ? 100 : pDta->container[RPI_MCF_EXPO];
+	manDeadman = (uint16_t)(pDta->container[RPI_MCF_DEADMAN] | ((uint16_t)pDta->container[RPI_MCF_DEADMAN + 1] << 8));
+	if (pDta->container[RPI_MCF_MAX_SPD] != 0) {
+		manMaxSpd = pDta->container[RPI_MCF_MAX_SPD];
+		if (manMaxSpd > L298N_MAX_SPD) manMaxSpd = L298N_MAX_SPD;
+		if (manMaxSpd < MAN_STREAM_MIN_SPD) manMaxSpd = MAN_STREAM_MIN_SPD;
+	}
+	manFlags = pDta->container[RPI_MCF_FLAGS];
+	return TRUE;
+}
+
+static _Bool onManual(const struct SerialDta* pDta) { // manual drive only
+	if (!isManual) return FALSE; // snack phase of autoplay
+	if (pDta->container[0] == '0') {
+		snackCancel(); // steering takes over from snack
+		switch (pDta->container[1]) {
+		case '0': // stop
+			l298n_drive(L298N_STOP, 0, L298N_STOP, 0);
+			break;
+		case '3': // left
+			l298n_drive(L298N_CW, MAN_ROT_SPD, L298N_CW, MAN_ROT_SPD);
+			break;
+		case '4': // right
+			l298n_drive(L298N_CCW, MAN_ROT_SPD, L298N_CCW, MAN_ROT_SPD);
+			break;
+#ifdef _2X_MAN_DRV_SPD
+		case '1': // forward
+			l298n_drive(L298N_CCW, MAN_DRV_SPD * 2, L298N_CW, MAN_DRV_SPD * 2);
+			break;
+		case '2': // reverse
+			l298n_drive(L298N_CW, MAN_DRV_SPD * 2, L298N_CCW, MAN_DRV_SPD * 2);
+			break;
+#else
+		case '1': // forward
+			l298n_drive(L298N_CCW, MAN_DRV_SPD, L298N_CW, MAN_DRV_SPD);
+			break;
+		case '2': // reverse
+			l298n_drive(L298N_CW, MAN_DRV_SPD, L298N_CCW, MAN_DRV_SPD);
+			break;
+#endif
+		default:
+			return FALSE;
+		}
+		// dead-man watches discrete codes only if app repeats them
+		manUpdated(pDta, (manFlags & RPI_MCF_FLAG_DISCRETE) && pDta->container[1] != '0');
+		return TRUE;
+	}
+	if (pDta->container[0] == '1' && pDta->container[1] == '0') {
+		appReq |= APP_REQ_SNACK;
+		return TRUE;
+	}
+	if (pDta->container[0] == '1' && pDta->container[1] == '1') { // cancel snack
+		return snackCancel();
+	}
+	if (pDta->container[0] == 'P') {
+#ifdef _TEST_MODE_ENABLED
+		core_dbgTx("RECEIVED PATTERN CODE!\r\n");
+#endif
+		reqPattern = pDta->container[1] - 0x30;
+		appReq |= APP_REQ_PATTERN;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static _Bool onStatus(const struct SerialDta* pDta) {
+	uint8_t buf[RPI_TLM_SIZE];
+	return rpi_sendFrame(TYPE_TELEMETRY, buf, fillTelemetry(buf));
+}
+
+static _Bool onCmdStat(const struct SerialDta* pDta); // reads cmdTable below
+
+static struct AppCmd cmdSkdTime = { &onSkdTime, CMD_PH_ALL, CMD_ACK(melAckTime) };
+static struct AppCmd cmdSkdPattern = { &onSkdPattern, CMD_PH_ALL, CMD_ACK(melAckPattern) };
+static struct AppCmd cmdSkdSnackIntv = { &onSkdSnackIntv, CMD_PH_ALL, CMD_ACK(melAckSnack) };
+static struct AppCmd cmdSpeed = { &onSpeed, CMD_PH_ALL, CMD_ACK(melAckSpeed) };
+static struct AppCmd cmdSkdDuration = { &onSkdDuration, CMD_PH_ALL, NULL };
+static struct AppCmd cmdSkdStart = { &onSkdStart, CMD_PH_ALL, CMD_ACK(melAckStart) };
+static struct AppCmd cmdSkdEnd = { &onSkdEnd, CMD_PH_ALL, CMD_ACK(melAckEnd) };
+static struct AppCmd cmdSchedule = { &onSchedule, CMD_PH_ALL, CMD_ACK(melAckEnd) };
+static struct AppCmd cmdSkdSlot = { &onSkdSlot, CMD_PH_ALL, NULL };
+static struct AppCmd cmdCalSet = { &onCalSet, CMD_PH_ALL, CMD_ACK(melAckEnd) };
+static struct AppCmd cmdCalDel = { &onCalDel, CMD_PH_ALL, NULL };
+static struct AppCmd cmdCalList = { &onCalList, CMD_PH_ALL, NULL };
+static struct AppCmd cmdClockSync = { &onClockSync, CMD_PH_ALL, NULL };
+static struct AppCmd cmdMotionSet = { &onMotionSet, CMD_PH_ALL, NULL };
+static struct AppCmd cmdSys = { &onSys, CMD_PH_ALL, NULL };
+static struct AppCmd cmdManual = { &onManual, PH(APP_PHASE_MANUAL) | PH(APP_PHASE_SNACK), NULL };
+static struct AppCmd cmdStatus = { &onStatus, CMD_PH_ALL, NULL };
+static struct AppCmd cmdCmdStat = { &onCmdStat, CMD_PH_ALL, NULL };
+static struct AppCmd cmdManualStream = { &onManualStream, PH(APP_PHASE_MANUAL) | PH(APP_PHASE_SNACK), NULL };
+static struct AppCmd cmdManualCfg = { &onManualCfg, CMD_PH_ALL, NULL };
+
+static struct AppCmd* const cmdTable[256] = { // indexed by frame type. NULL: ignored
+	[TYPE_SCHEDULE_TIME] = &cmdSkdTime,
+	[TYPE_SCHEDULE_PATTERN] = &cmdSkdPattern,
+	[TYPE_SCHEDULE_SNACK_INTERVAL] = &cmdSkdSnackIntv,
+	[TYPE_SCHEDULE_SPEED] = &cmdSpeed,
+	[TYPE_SCHEDULE_DURATION] = &cmdSkdDuration,
+	[TYPE_SCHEDULE_START] = &cmdSkdStart,
+	[TYPE_SCHEDULE_END] = &cmdSkdEnd,
+	[TYPE_SCHEDULE] = &cmdSchedule,
+	[TYPE_SCHEDULE_SLOT] = &cmdSkdSlot,
+	[TYPE_CAL_SET] = &cmdCalSet,
+	[TYPE_CAL_DEL] = &cmdCalDel,
+	[TYPE_CAL_LIST_REQ] = &cmdCalList,
+	[TYPE_CLOCK_SYNC] = &cmdClockSync,
+	[TYPE_MOTION_SET] = &cmdMotionSet,
+	[TYPE_SYS] = &cmdSys,
+	[TYPE_MANUAL_CTRL] = &cmdManual,
+	[TYPE_STATUS_REQ] = &cmdStatus,
+	[TYPE_CMD_STAT_REQ] = &cmdCmdStat,
+	[TYPE_MANUAL_STREAM] = &cmdManualStream,
+	[TYPE_MANUAL_CFG] = &cmdManualCfg,
+};
+
+static _Bool onCmdStat(const struct SerialDta* pDta) { // TYPE_CMD_STAT of one command type. all zero if type has no handler
+	uint8_t buf[RPI_CST_SIZE] = { 0, };
+	const struct AppCmd* pCmd;
+	if (pDta->len < 1) return FALSE;
+	pCmd = cmdTable[pDta->container[0]];
+	buf[RPI_CST_TYPE] = pDta->container[0];
+	if (pCmd != NULL) {
+		for (int i = 0; i < 4; i++) {
+			buf[RPI_CST_CNT + i] = (uint8_t)(pCmd->cnt >> (8 * i));
+			buf[RPI_CST_DROPPED + i] = (uint8_t)(pCmd->dropped >> (8 * i));
+			buf[RPI_CST_MAX + i] = (uint8_t)(pCmd->latMax >> (8 * i));
+		}
+		for (int i = 0; i < RPI_CST_BINS; i++) {
+			buf[RPI_CST_HIST + i * 2] = (uint8_t)pCmd->hist[i];
+			buf[RPI_CST_HIST + i * 2 + 1] = (uint8_t)(pCmd->hist[i] >> 8);
+		}
+	}
+	return rpi_sendFrame(TYPE_CMD_STAT, buf, RPI_CST_SIZE);
+}
+
+static void cmdRun(struct AppCmd* pCmd, const struct SerialDta* pDta) {
+	uint32_t lat = HAL_GetTick() - pDta->tick;
+	uint32_t v = lat;
+	uint8_t bin = 0;
+	while (v && bin < RPI_CST_BINS - 1) { // bin n: 2^(n-1) ~ 2^n - 1 ms
+		v >>= 1;
+		bin++;
+	}
+	if (pCmd->hist[bin] != 0xFFFF) pCmd->hist[bin]++;
+	if (lat > pCmd->latMax) pCmd->latMax = lat;
+	pCmd->cnt++;
+	if (pCmd->pHandler(pDta) && pCmd->pAck != NULL) buzzer_play(pCmd->pAck, MEL_PRIO_ACK);
+}
+
+static void cmdDispatch() { // handle every received frame
+	struct AppCmd* pCmd;
+	if (isDispatching) return;
+	isDispatching = TRUE;
+	while (rpi_getSerialDta(&rpidta)) {
+#ifdef _TEST_MODE_ENABLED
+		uint8_t buf[9] = { 0, };
+		buf[0] = rpidta.type;
+		for (int i = 0; i < 7; i++) {
+			buf[i + 1] = rpidta.container[i];
+		}
+		buf[8] = 0;
+		core_dbgTx((char*)buf);
+		core_dbgTx("\r\n");
+#endif
+		pCmd = cmdTable[rpidta.type];
+		if (pCmd == NULL) continue;
+		if (pCmd->phases & PH(appPhase)) cmdRun(pCmd, &rpidta);
+		else pCmd->dropped++;
+	}
+	isDispatching = FALSE;
+}
+
+static void appWait(uint32_t ms) { // wait point of long routines: delay while handling commands every CMD_DISPATCH_TICK
+	uint32_t start = HAL_GetTick();
+	uint32_t elapsed;
+	cmdDispatch();
+	while ((elapsed = HAL_GetTick() - start) < ms && !(appReq & APP_REQ_ABORT)) { // abort ends the wait early
+		core_call_delayms((ms - elapsed < CMD_DISPATCH_TICK) ? ms - elapsed : CMD_DISPATCH_TICK);
+		cmdDispatch();
+	}
+}
+
+static void motionSet(uint8_t dirA, uint8_t spdA, uint8_t dirB, uint8_t spdB) { // drive now. ignored after abort: an aborted routine never restarts motors
+	if (appReq & APP_REQ_ABORT) return;
+	l298n_drive(dirA, spdA, dirB, spdB);
+}
+
+/* rotation related functions */
+
+static uint32_t rotRate(uint8_t spd) { // interpolated rotation rate at spd, in deg/s * 10
+	if (spd <= rotCalSpd[0]) return rotCalRate[0];
+	for (int i = 1; i < ROT_CAL_POINTS; i++) {
+		if (spd <= rotCalSpd[i]) {
+			return rotCalRate[i - 1] + (uint32_t)(rotCalRate[i] - rotCalRate[i - 1]) * (spd - rotCalSpd[i - 1]) / (rotCalSpd[i] - rotCalSpd[i - 1]);
+		}
+	}
+	return rotCalRate[ROT_CAL_POINTS - 1];
+}
+
+static uint32_t rotTimeMs(uint8_t spd, uint16_t deg) { // time to rotate deg degrees in place at spd
+	uint32_t rate = rotRate(spd);
+	uint32_t rampMs;
+	if (rate == 0) rate = 1;
+	// the robot covers half of the angle it would during the ramp-up time at full rate. stop is immediate
+	rampMs = (uint32_t)spd * 1000 / MOTOR_SLEW_RATE;
+	if (MOTOR_RAMP_PROFILE == L298N_RAMP_TRAPEZOID) rampMs = rampMs * 4 / 3;
+	else if (MOTOR_RAMP_PROFILE == L298N_RAMP_SCURVE) rampMs = rampMs * 3 / 2;
+	else if (MOTOR_RAMP_PROFILE == L298N_RAMP_NONE) rampMs = 0;
+	return (uint32_t)deg * 10000 / rate + rampMs / 2;
+}
+
+static uint16_t rotCalMeasure(uint8_t spd) { // spin at spd and find period of IR signature. returns deg/s * 10, 0 on failure
+	uint32_t expectedRev = 3600000 / rotRate(spd); // expected ms per revolution from current table
+	int nSamples = (int)(expectedRev * 2 / ROT_CAL_SAMPLE_PERIOD); // observe two revolutions
+	int minLag = (int)(expectedRev / 2 / ROT_CAL_SAMPLE_PERIOD); // reject matches shorter than half a turn
+	uint8_t sigMin, sigMax, sigRange = 0;
+	uint32_t err, bestErr = 0xFFFFFFFF;
+	int bestLag = 0, sig = 0;
+	float dist;
+
+	if (nSamples > ROT_CAL_MAX_SAMPLES) nSamples = ROT_CAL_MAX_SAMPLES;
+	if (minLag < ROT_CAL_SIG_LEN) minLag = ROT_CAL_SIG_LEN;
+
+	motionSet(L298N_CW, spd, L298N_CW, spd); // rotate left
+	l298n_waitSettled();
+	appWait(200); // let the robot reach steady rate
+	for (int i = 0; i < nSamples; i++) {
+		if (appReq & APP_REQ_ABORT) return 0;
+		dist = periph_irSnsrRaw();
+		rotCalBuf[i] = (dist > 150.0) ? 150 : (uint8_t)dist;
+		appWait(ROT_CAL_SAMPLE_PERIOD);
+	}
+	motionSet(L298N_STOP, 0, L298N_STOP, 0);
+
+	// signature: most distinctive window of the first half turn, like a nearby wall edge
+	for (int s = 0; s < minLag && s + minLag + ROT_CAL_SIG_LEN <= nSamples; s++) {
+		sigMin = 255;
+		sigMax = 0;
+		for (int i = s; i < s + ROT_CAL_SIG_LEN; i++) {
+			if (rotCalBuf[i] < sigMin) sigMin = rotCalBuf[i];
+			if (rotCalBuf[i] > sigMax) sigMax = rotCalBuf[i];
+		}
+		if (sigMax - sigMin > sigRange) {
+			sigRange = sigMax - sigMin;
+			sig = s;
+		}
+	}
+	if (sigRange < ROT_CAL_MIN_SIG_RANGE) return 0;
+
+	// find lag with minimum sum of abs. differences. the first matching turn ends the search, later ones are its multiples
+	for (int lag = minLag; sig + lag + ROT_CAL_SIG_LEN <= nSamples; lag++) {
+		err = 0;
+		for (int i = sig; i < sig + ROT_CAL_SIG_LEN; i++) {
+			err += (rotCalBuf[i] > rotCalBuf[lag + i]) ? (rotCalBuf[i] - rotCalBuf[lag + i]) : (rotCalBuf[lag + i] - rotCalBuf[i]);
+		}
+		if (err < bestErr) {
+			bestErr = err;
+			bestLag = lag;
+		}
+		else if (bestErr <= (uint32_t)ROT_CAL_MAX_MATCH_ERR * ROT_CAL_SIG_LEN && err > (uint32_t)ROT_CAL_MAX_MATCH_ERR * ROT_CAL_SIG_LEN) break;
+	}
+	if (bestLag == 0 || bestErr > (uint32_t)ROT_CAL_MAX_MATCH_ERR * ROT_CAL_SIG_LEN) return 0;
+	return (uint16_t)(3600000 / ((uint32_t)bestLag * ROT_CAL_SAMPLE_PERIOD));
+}
+
+static int calibrateRotation() { // measure rotation rate at every table speed. returns number of updated points
+	uint16_t rate;
+	int updated = 0;
+	appPhase = APP_PHASE_CALIBRATE;
+	l298n_enable();
+	for (int i = 0; i < ROT_CAL_POINTS && !(appReq & APP_REQ_ABORT); i++) {
+		rate = rotCalMeasure(rotCalSpd[i]);
+		if (rate) { // keep previous value if signature was not found
+			rotCalRate[i] = rate;
+			updated++;
+		}
+		appWait(500);
+	}
+	// keep the table monotonic so interpolation never reverses
+	for (int i = 1; i < ROT_CAL_POINTS; i++) {
+		if (rotCalRate[i] < rotCalRate[i - 1]) rotCalRate[i] = rotCalRate[i - 1];
+	}
+	l298n_disable();
+	appReq &= ~APP_REQ_ABORT;
+	appPhase = APP_PHASE_IDLE;
+	return updated;
+}
+
+/* snack related functions */
+
+/*
+ * snack dispensing is a state machine, so the loop giving a snack keeps handling commands and steering.
+ * snackStart() begins it, snackStep() moves to the next state when the time of the current one is over and
+ * snackCancel() ends it early. every state change is reported to the Pi with TYPE_SNACK_EVT.
+ * melody and door run from buzzer and servo TIM interrupts, nothing here waits.
+ */
+
+struct SnackState {
+	uint8_t dirA; // wheels during the state
+	uint8_t spdA;
+	uint8_t dirB;
+	uint8_t spdB;
+	uint16_t ms; // 0: until door is closed
+};
+
+static const struct SnackState snackStates[] = { // indexed by SNACK_ST_xxx
+	[SNACK_ST_LURE] = { L298N_CW, L298N_MAX_SPD, L298N_CW, L298N_MAX_SPD, 4500 }, // rotate to right, laser on
+	[SNACK_ST_SETTLE] = { L298N_STOP, 0, L298N_STOP, 0, 500 },
+	[SNACK_ST_APPROACH] = { L298N_CCW, L298N_MAX_SPD, L298N_CW, L298N_MAX_SPD, 1000 }, // forward
+	[SNACK_ST_STOP] = { L298N_STOP, 0, L298N_STOP, 0, 1000 }, // stop and wait for a sec
+	[SNACK_ST_DOOR] = { L298N_STOP, 0, L298N_STOP, 0, 0 }, // open, hold, close
+};
+
+static uint8_t snackSt = SNACK_ST_IDLE;
+static uint8_t snackPhasePrev = APP_PHASE_IDLE; // play or manual
+static uint32_t snackStartTick = 0;
+static uint32_t snackStTick = 0; // entered current state
+
+static uint32_t snackTotal() { // nominal ms of a whole snack
+	uint32_t total = (uint32_t)SNACK_DOOR_OPEN_TIME + OP_SNACK_RET_MOTOR_WAITING_TIME + SNACK_DOOR_CLOSE_TIME;
+	for (int i = SNACK_ST_LURE; i < SNACK_ST_DOOR; i++) total += snackStates[i].ms;
+	return total;
+}
+
+static void snackReport(uint8_t res) { // TYPE_SNACK_EVT
+	uint8_t buf[RPI_SNK_SIZE];
+	uint32_t total = snackTotal();
+	uint32_t elapsed = HAL_GetTick() - snackStartTick;
+	buf[RPI_SNK_STATE] = snackSt;
+	buf[RPI_SNK_PROGRESS] = (res == RPI_SNK_RES_DONE) ? 100 : (elapsed >= total) ? 99 : (uint8_t)(elapsed * 100 / total);
+	buf[RPI_SNK_RESULT] = res;
+	if (elapsed > 0xFFFF) elapsed = 0xFFFF;
+	buf[RPI_SNK_ELAPSED] = (uint8_t)elapsed;
+	buf[RPI_SNK_ELAPSED + 1] = (uint8_t)(elapsed >> 8);
+	rpi_sendFrame(TYPE_SNACK_EVT, buf, RPI_SNK_SIZE);
+}
+
+static void snackEnter(uint8_t st) {
+	const struct SnackState* pSt = &snackStates[st];
+	snackSt = st;
+	snackStTick = HAL_GetTick();
+	if (st == SNACK_ST_LURE) periph_laser_on(); // use laser
+	else periph_laser_off();
+	motionSet(pSt->dirA, pSt->spdA, pSt->dirB, pSt->spdB);
+	if (st == SNACK_ST_DOOR) {
+		const struct SG90Waypoint snackDoor[3] = {
+			{ SNACK_ANG_GIVE, SG90_EASE_OUT, SNACK_DOOR_OPEN_TIME },
+			{ SNACK_ANG_GIVE, SG90_EASE_LINEAR, OP_SNACK_RET_MOTOR_WAITING_TIME },
+			{ SNACK_ANG_RDY, SG90_EASE_INOUT, SNACK_DOOR_CLOSE_TIME }
+		};
+		sg90_trajectory(SG90_MOTOR_A, snackDoor, 3);
+	}
+	snackReport(RPI_SNK_RES_RUNNING);
+}
+
+static void snackEnd(uint8_t res) {
+	snackReport(res);
+	snackSt = SNACK_ST_IDLE;
+	appPhase = snackPhasePrev;
+}
+
+static void snackStart() { // no-op if a snack is being given
+	if (snackSt != SNACK_ST_IDLE) return;
+	snackPhasePrev = appPhase;
+	appPhase = APP_PHASE_SNACK;
+	snackStartTick = HAL_GetTick();
+	buzzer_play(&melSnack, MEL_PRIO_INFO);
+	snackEnter(SNACK_ST_LURE);
+}
+
+static uint8_t snackStep() { // call from the loop that started the snack. returns RPI_SNK_RES_RUNNING until door is closed
+	if (snackSt == SNACK_ST_IDLE) return RPI_SNK_RES_DONE;
+	if (snackSt == SNACK_ST_DOOR) {
+		if (sg90_isMoving(SG90_MOTOR_A)) return RPI_SNK_RES_RUNNING;
+		snackEnd(RPI_SNK_RES_DONE);
+		return RPI_SNK_RES_DONE;
+	}
+	if (HAL_GetTick() - snackStTick >= snackStates[snackSt].ms) snackEnter(snackSt + 1);
+	return RPI_SNK_RES_RUNNING;
+}
+
+static _Bool snackCancel() { // stop wheels and laser, close door if open. returns FALSE if no snack is being given
+	if (snackSt == SNACK_ST_IDLE) return FALSE;
+	periph_laser_off();
+	motionSet(L298N_STOP, 0, L298N_STOP, 0);
+	buzzer_stop();
+	if (snackSt == SNACK_ST_DOOR && !(appReq & APP_REQ_ABORT)) { // abortRoutine() closes it on abort
+		sg90_moveTo(SG90_MOTOR_A, SNACK_ANG_RDY, SNACK_DOOR_CLOSE_TIME, SG90_EASE_INOUT);
+	}
+	snackEnd(RPI_SNK_RES_CANCELLED);
+	return TRUE;
+}
+
+static uint8_t snackRun() { // whole snack, handling commands. returns RPI_SNK_RES_xxx
+	uint8_t res;
+	snackStart();
+	while ((res = snackStep()) == RPI_SNK_RES_RUNNING) {
+		appWait(CMD_DISPATCH_TICK);
+		if (appReq & APP_REQ_ABORT) {
+			snackCancel();
+			return RPI_SNK_RES_CANCELLED;
+		}
+	}
+	return res;
+}
+
 /* play related functions */
 
-static int searchCat() { // returns SEARCH_SUCCESS or SEARCH_TIMEOUT
+static void motionPush(uint8_t dirA, uint8_t spdA, uint8_t dirB, uint8_t spdB, uint32_t ms) { // queue a motion segment, wait if queue is full
+	struct L298nSegment seg = { dirA, spdA, dirB, spdB, ms };
+	if (appReq & APP_REQ_ABORT) return; // aborted pattern must not restart motors
+	while (l298n_queuePush(&seg) == FALSE) {
+		if (l298n_getStat().ena == FALSE || (appReq & APP_REQ_ABORT)) return;
+		appWait(1);
+	}
+}
+
+static void motionWait() { // wait until every queued segment is executed
+	while (l298n_queueDepth() && !(appReq & APP_REQ_ABORT)) {
+		appWait(1);
+	}
+}
+
+static _Bool motCond(uint8_t cond) { // BR conditions of motion programs
+	switch (cond) {
+	case MOTPROG_COND_IR_NEAR:
+		return periph_irSnsrChk(IR_SNSR_MODE_OP) == IR_SNSR_NEAR;
+	case MOTPROG_COND_IR_FAR:
+		return periph_irSnsrChk(IR_SNSR_MODE_OP) == IR_SNSR_FAR;
+	case MOTPROG_COND_VIB:
+		return periph_isVibration();
+	case MOTPROG_COND_NO_VIB:
+		return !periph_isVibration();
+	}
+	return FALSE;
+}
+
+static void motionRun(const uint8_t* p, uint8_t len, int32_t interval, uint16_t reps) { // play a motion program, one step per tick. speeds of now are used
+	struct MotProgVm vm;
+	struct MotProgAct act;
+	_Bool servoMoved = FALSE;
+	motEnv.base[MOTPROG_SPD_DRV] = drvSpd;
+	motEnv.base[MOTPROG_SPD_ROT] = rotSpd;
+	motEnv.base[MOTPROG_SPD_MIN_ROT] = AUTO_MIN_ROT_SPD;
+	motEnv.base[MOTPROG_SPD_DEF_ROT] = AUTO_DEF_ROT_SPD;
+	motEnv.add[MOTPROG_ADD_NONE] = 0;
+	motEnv.add[MOTPROG_ADD_OVERSHOOT] = SPD_OVERSHOOT_ADDEND;
+	motEnv.add[MOTPROG_ADD_HALF_OVERSHOOT] = SPD_OVERSHOOT_ADDEND / 2;
+	motEnv.add[MOTPROG_ADD_CIRCLE] = SPD_ADDEND;
+	motEnv.param[MOTPROG_PARAM_INTV] = interval;
+	motEnv.param[MOTPROG_PARAM_WAIT] = PATTERN_WAIT_AND_FLEE_WAIT_TIME;
+	motEnv.reps = reps;
+	motEnv.pCond = &motCond;
+	motprog_begin(&vm, &motEnv);
+	motRuns++;
+	while (!(appReq & APP_REQ_ABORT)) {
+		uint32_t cyc = DWT->CYCCNT;
+		_Bool more = motprog_step(&vm, p, len, &act);
+		cyc = DWT->CYCCNT - cyc;
+		motSteps++;
+		motCycSum += cyc;
+		if (cyc > motCycMax) motCycMax = cyc;
+		if (!more) break;
+		switch (act.kind) {
+		case MOTPROG_ACT_DRIVE:
+			motionPush(act.dirA, act.spdA, act.dirB, act.spdB, act.ms); // waits only if queue is full
+			break;
+		case MOTPROG_ACT_WAIT:
+			motionWait();
+			appWait(act.ms);
+			continue; // the wait was the tick
+		case MOTPROG_ACT_SOUND:
+			if (act.id < sizeof(motMelodies) / sizeof(motMelodies[0])) buzzer_play(motMelodies[act.id], MEL_PRIO_INFO);
+			break;
+		case MOTPROG_ACT_LASER:
+			if (act.id) periph_laser_on();
+			else periph_laser_off();
+			break;
+		case MOTPROG_ACT_SERVO:
+			if (act.id < SG90_MOTOR_CNT && sg90_moveTo(act.id, act.angle, act.ms, SG90_EASE_INOUT)) servoMoved = TRUE;
+			break;
+		}
+		appWait(1);
+	}
+	periph_laser_off();
+	if (servoMoved) sg90_moveTo(SG90_MOTOR_A, DEF_ANG_A, 300, SG90_EASE_INOUT); // motor A is the snack door: closed again
+}
+
+static const uint8_t* motProgOf(uint8_t code, uint8_t* pLen) { // NULL or empty if pattern has no program
+	if (code >= MOTPROG_USER_FIRST && code < MOTPROG_USER_FIRST + MOTPROG_USER_SLOTS) {
+		*pLen = motUserLen[code - MOTPROG_USER_FIRST];
+		return motUser[code - MOTPROG_USER_FIRST];
+	}
+	return motprog_builtin(code, pLen);
+}
+
+static void progCost(const uint8_t* prog, uint8_t len, uint16_t intv, struct PlayPlanCost* pc) { // play time of a motion program, gap not included
+	struct MotProgEnv env; // speeds and sensors do not change the time
+	env.param[MOTPROG_PARAM_INTV] = intv;
+	env.param[MOTPROG_PARAM_WAIT] = PATTERN_WAIT_AND_FLEE_WAIT_TIME; // full wait of pattern 7: a cat coming early only frees time
+	env.reps = 0;
+	pc->maxReps = 0;
+	if (intv != SKDPROG_NO_INTV) { // interval set by program: not repeated by the plan
+		pc->baseMs = motprog_time(prog, len, &env);
+		pc->repMs = 0;
+		return;
+	}
+	env.reps = 1;
+	uint32_t t1 = motprog_time(prog, len, &env);
+	env.reps = 2;
+	pc->repMs = motprog_time(prog, len, &env) - t1; // 0 if pattern has no interval loop
+	pc->baseMs = t1 - pc->repMs;
+}
+
+static void patternCost(uint8_t code, uint16_t intv, struct PlayPlanCost* pc) { // play time of pattern with interval override of entry(SKDPROG_NO_INTV: none)
+	uint8_t len = 0;
+	const uint8_t* prog;
+	pc->baseMs = 0;
+	pc->repMs = 0;
+	pc->maxReps = 0;
+	if (code >= 1 && code <= PATTIME_CNT) { // built in: generated table
+		const struct PatTime* pt = &pattime[code];
+		pc->baseMs = pt->baseMs;
+		if (intv == SKDPROG_NO_INTV) {
+			pc->repMs = pt->repMs;
+			pc->maxReps = pt->maxRuns;
+		}
+		else if (pt->div) {
+			uint32_t runs = intv / pt->div;
+			if (runs < pt->min) runs = pt->dflt;
+			pc->baseMs += pt->repMs * ((runs > pt->maxRuns) ? pt->maxRuns : runs);
+		}
+	}
+	else if ((prog = motProgOf(code, &len)) != NULL && len) progCost(prog, len, intv, pc); // uploaded
+	pc->baseMs += PATTERN_GAP_TIME;
+}
+
+static void planSession(uint32_t budgetMs, uint8_t resumeCode, uint8_t codePrev, int snackIntvCnt) { // cost of the session ahead, read from a copy of the program iterator
+	struct SkdProgIter it = pSkdActive->it;
+	struct SkdProgEntry e;
+	struct PlayPlanCost pc;
+	struct PlayPlanCost snack = { snackTotal(), 0, 0 };
+	uint64_t sumBase = 0, sumRep = 0;
+	uint32_t scanned = 0; // entries read from program
+	uint16_t n = 0; // patterns costed
+	_Bool more = TRUE;
+	playplan_begin(&plan, HAL_GetTick(), budgetMs);
+	while (n < PLAY_PLAN_SCAN_MAX) { // same order as autoDrive()
+		uint8_t code;
+		if (pSkdActive->snackIntv != RPI_SKD_SNACK_OFF && ++snackIntvCnt >= pSkdActive->snackIntv) {
+			snackIntvCnt = 0;
+			playplan_add(&plan, &snack, 1);
+		}
+		if (resumeCode != RPI_TLM_NO_PATTERN) {
+			code = resumeCode;
+			resumeCode = RPI_TLM_NO_PATTERN;
+			patternCost(code, skdEntry.intv, &pc);
+		}
+		else {
+			if (!(more = skdprog_next(&it, pSkdActive->prog, pSkdActive->progLen, &e))) break;
+			if (e.kind == SKDPROG_ENTRY_SNACK) {
+				snackIntvCnt--;
+				playplan_add(&plan, &snack, 1);
+				continue;
+			}
+			scanned++;
+			code = e.code ? e.code : autoNext[codePrev < MOTPROG_USER_FIRST ? codePrev : 0];
+			patternCost(code, e.intv, &pc);
+		}
+		codePrev = code;
+		playplan_add(&plan, &pc, 1);
+		sumBase += pc.baseMs;
+		sumRep += pc.repMs;
+		n++;
+	}
+	if (more && n) { // long program: the rest costs what the scanned part did on average
+		uint32_t rest = pSkdActive->plays - pSkdActive->played;
+		rest = (rest > scanned) ? rest - scanned : 0;
+		pc.baseMs = (uint32_t)(sumBase / n);
+		pc.repMs = (uint32_t)(sumRep / n);
+		playplan_add(&plan, &pc, rest);
+		if (pSkdActive->snackIntv != RPI_SKD_SNACK_OFF) playplan_add(&plan, &snack, rest / pSkdActive->snackIntv);
+	}
+	planOn = TRUE;
+}
+
+static uint8_t planSnackRun() { // snackRun() as an item of play plan
+	struct PlayPlanCost snack = { snackTotal(), 0, 0 };
+	uint8_t res;
+	if (planOn) playplan_start(&plan, HAL_GetTick(), &snack);
+	res = snackRun();
+	if (planOn) playplan_end(&plan, HAL_GetTick());
+	return res;
+}
+
+static void planReport(uint8_t res) { // TYPE_PLAY_REPORT
+	uint8_t buf[RPI_PLR_SIZE];
+	uint32_t elapsed = HAL_GetTick() - plan.start;
+	buf[RPI_PLR_RESULT] = res;
+	buf[RPI_PLR_SLOT] = pSkdActive->slot;
+	for (int i = 0; i < 4; i++) {
+		buf[RPI_PLR_BUDGET + i] = (uint8_t)(plan.budget >> (8 * i));
+		buf[RPI_PLR_ELAPSED + i] = (uint8_t)(elapsed >> (8 * i));
+		buf[RPI_PLR_PLANNED + i] = (uint8_t)(plan.plannedMs >> (8 * i));
+		buf[RPI_PLR_ACTUAL + i] = (uint8_t)(plan.actualMs >> (8 * i));
+		buf[RPI_PLR_WORST + i] = (uint8_t)((uint32_t)plan.worstMs >> (8 * i));
+	}
+	for (int i = 0; i < 2; i++) {
+		buf[RPI_PLR_ITEMS + i] = (uint8_t)(plan.items >> (8 * i));
+		buf[RPI_PLR_OVERRUNS + i] = (uint8_t)(plan.overruns >> (8 * i));
+	}
+	rpi_sendFrame(TYPE_PLAY_REPORT, buf, RPI_PLR_SIZE);
+}
+
+static int searchCat() { // returns SEARCH_SUCCESS, SEARCH_TIMEOUT or SEARCH_ABORTED
 	//float arrDist30[12] = { 0.0, };
 	float arrDist18[20] = { 0.0, };
 	float longestDist = 0.0;
@@ -134,13 +1476,14 @@ static int searchCat() { // returns SEARCH_SUCCESS or SEARCH_TIMEOUT
 	_Bool isFirstRot = TRUE;
 
 	// set cat searching flag
+	appPhase = APP_PHASE_SEARCH;
 	catSearchWaitTime = CAT_SEARCH_TOTAL_WAIT_TIME;
 	catSearchIsSet = TRUE;
 	flagCatSearchTimeout = FALSE;
 
 	// init
 	rpi_sendPin(RPI_PINCODE_O_SCHEDULE_EXE);
-	core_call_delayms(1000);
+	appWait(1000);
 	for (int i = 0; i < 20; i++) {
 		arrDist18[i] = 0.0;
 	}
@@ -149,39 +1492,26 @@ static int searchCat() { // returns SEARCH_SUCCESS or SEARCH_TIMEOUT
 	msElapsedCnt = 0;
 	isFirstRot = TRUE;
 
-	l298n_setRotation(L298N_MOTOR_A, L298N_CW); // rotate left slowly to find obstacles
-	l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-	l298n_setSpeed(L298N_MOTOR_A, AUTO_MIN_ROT_SPD);
-	l298n_setSpeed(L298N_MOTOR_B, AUTO_MIN_ROT_SPD);
+	motionSet(L298N_CW, AUTO_MIN_ROT_SPD, L298N_CW, AUTO_MIN_ROT_SPD); // rotate left slowly to find obstacles
 	rpi_foundCat(); // clears age-old flag
 
 	// stage: initial search
 
 	while (1) {
+		if (appReq & APP_REQ_ABORT) goto lbl_aborted;
 		if (rpi_foundCat() == TRUE) {
-			l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-			l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-			core_call_delayms(200);
-			l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // rotate CW slowly for 800ms to correct delay
-			l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-			l298n_setSpeed(L298N_MOTOR_A, AUTO_MIN_ROT_SPD);
-			l298n_setSpeed(L298N_MOTOR_B, AUTO_MIN_ROT_SPD);
-			core_call_delayms(800);
-			l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-			l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
+			motionSet(L298N_STOP, 0, L298N_STOP, 0);
+			appWait(200);
+			motionSet(L298N_CCW, AUTO_MIN_ROT_SPD, L298N_CCW, AUTO_MIN_ROT_SPD); // rotate CW slowly to correct delay
+			appWait(rotTimeMs(AUTO_MIN_ROT_SPD, CAT_FOUND_CORRECTION_ANGLE));
+			motionSet(L298N_STOP, 0, L298N_STOP, 0);
 			goto lbl_found;
 		}
-		core_call_delayms(100);
+		appWait(100);
 		msElapsedCnt += 100;
 		if (msElapsedCnt >= CAT_SEARCH_INITIAL_WAIT_TIME) { // initial search timeout
-			l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-			l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-			buzzer_setTone(toneF6);
-			buzzer_setDuty(10);
-			buzzer_unmute();
-			core_call_delayms(150);
-			buzzer_mute();
-			core_call_delayms(150);
+			motionSet(L298N_STOP, 0, L298N_STOP, 0);
+			buzzer_play(&melSearchTimeout, MEL_PRIO_INFO);
 			break;
 		}
 	}
@@ -189,25 +1519,20 @@ static int searchCat() { // returns SEARCH_SUCCESS or SEARCH_TIMEOUT
 	// stage: search room
 	msElapsedCnt = 0;
 
-	l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-	l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
+	motionSet(L298N_STOP, 0, L298N_STOP, 0);
 
 	while (1) {
 		// rotate 18 deg 20 times to find angle, rotate CW
 		for (int i = 0; i < 20; i++) {
-			l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
-			l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
+			motionSet(L298N_CCW, ROOM_SEARCH_ROT_SPD, L298N_CCW, ROOM_SEARCH_ROT_SPD);
 
-			l298n_setSpeed(L298N_MOTOR_A, ROOM_SEARCH_ROT_SPD);
-			l298n_setSpeed(L298N_MOTOR_B, ROOM_SEARCH_ROT_SPD);
+			appWait(rotTimeMs(ROOM_SEARCH_ROT_SPD, ROOM_SEARCH_STEP_ANGLE));
 
-			core_call_delayms(ROOM_SEARCH_ROT_TIME_18DEG);
-
-			l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-			l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-			core_call_delayms(50);
+			motionSet(L298N_STOP, 0, L298N_STOP, 0);
+			appWait(50);
 
 			// check cat and timeout
+			if (appReq & APP_REQ_ABORT) goto lbl_aborted;
 			if (rpi_foundCat() == TRUE) goto lbl_found;
 			if (flagCatSearchTimeout) { // couldn't find cat, start wait-calling mode
 				goto lbl_timeoutWait;
@@ -224,15 +1549,12 @@ static int searchCat() { // returns SEARCH_SUCCESS or SEARCH_TIMEOUT
 			if (i > 2) {
 				if (arrDist18[i-1] > arrDist18[i] && arrDist18[i-1] > arrDist18[i-2] && arrDist18[i-1] >= 35.0) {
 					// found a direction that is possibly open
-					l298n_setRotation(L298N_MOTOR_A, L298N_CW); // return to prev angle
-					l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-					l298n_setSpeed(L298N_MOTOR_A, ROOM_SEARCH_ROT_SPD);
-					l298n_setSpeed(L298N_MOTOR_B, ROOM_SEARCH_ROT_SPD);
-					core_call_delayms(ROOM_SEARCH_ROT_TIME_18DEG);
-					l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-					l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-					core_call_delayms(50);
+					motionSet(L298N_CW, ROOM_SEARCH_ROT_SPD, L298N_CW, ROOM_SEARCH_ROT_SPD); // return to prev angle
+					appWait(rotTimeMs(ROOM_SEARCH_ROT_SPD, ROOM_SEARCH_STEP_ANGLE));
+					motionSet(L298N_STOP, 0, L298N_STOP, 0);
+					appWait(50);
 					// check cat and timeout
+					if (appReq & APP_REQ_ABORT) goto lbl_aborted;
 					if (rpi_foundCat() == TRUE) goto lbl_found;
 					if (flagCatSearchTimeout) { // couldn't find cat, start wait-calling mode
 						goto lbl_timeoutWait;
@@ -251,48 +1573,43 @@ static int searchCat() { // returns SEARCH_SUCCESS or SEARCH_TIMEOUT
 					}
 				}
 				// head to best direction
-				l298n_setRotation(L298N_MOTOR_A, L298N_CW); // return to prev angle
-				l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-				l298n_setSpeed(L298N_MOTOR_A, ROOM_SEARCH_ROT_SPD);
-				l298n_setSpeed(L298N_MOTOR_B, ROOM_SEARCH_ROT_SPD);
-				core_call_delayms(ROOM_SEARCH_ROT_TIME_18DEG * (19 - longestDist));
-				l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-				l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-				core_call_delayms(50);
+				motionSet(L298N_CW, ROOM_SEARCH_ROT_SPD, L298N_CW, ROOM_SEARCH_ROT_SPD); // return to prev angle
+				appWait(rotTimeMs(ROOM_SEARCH_ROT_SPD, ROOM_SEARCH_STEP_ANGLE * (19 - longestCnt)));
+				motionSet(L298N_STOP, 0, L298N_STOP, 0);
+				appWait(50);
 			}
 		}
 
 		isFirstRot = FALSE;
 
 		// check cat and timeout
+		if (appReq & APP_REQ_ABORT) goto lbl_aborted;
 		if (rpi_foundCat() == TRUE) goto lbl_found;
 		if (flagCatSearchTimeout) { // couldn't find cat, start wait-calling mode
 			goto lbl_timeoutWait;
 		}
 
 		// go forward until obstacle detection(trig: 20cm) or 20 seconds timeout
-		l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
-		l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-		l298n_setSpeed(L298N_MOTOR_A, ROOM_SEARCH_DRV_SPD);
-		l298n_setSpeed(L298N_MOTOR_B, ROOM_SEARCH_DRV_SPD);
+		motionSet(L298N_CCW, ROOM_SEARCH_DRV_SPD, L298N_CW, ROOM_SEARCH_DRV_SPD);
 		msElapsedCnt = 0;
 		while (1) {
 			// check cat and timeout
+			if (appReq & APP_REQ_ABORT) goto lbl_aborted;
 			if (rpi_foundCat() == TRUE) goto lbl_found;
 			if (flagCatSearchTimeout) { // couldn't find cat, start wait-calling mode
 				goto lbl_timeoutWait;
 			}
 			// check dist
 			if (periph_irSnsrRaw() <= 20.0 || periph_irSnsrChk(IR_SNSR_MODE_OP) == IR_SNSR_NEAR || msElapsedCnt >= 20 * 1000) { // obstacle ahead or timeout
-				l298n_setRotation(L298N_MOTOR_A, L298N_STOP); // stop
-				l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
+				motionSet(L298N_STOP, 0, L298N_STOP, 0); // stop
 				break; // do rotation again
 			}
-			core_call_delayms(500);
+			appWait(500);
 			msElapsedCnt += 500;
 		}
 
 		// check cat and timeout
+		if (appReq & APP_REQ_ABORT) goto lbl_aborted;
 		if (rpi_foundCat() == TRUE) goto lbl_found;
 		if (flagCatSearchTimeout) { // couldn't find cat, start wait-calling mode
 			goto lbl_timeoutWait;
@@ -302,55 +1619,37 @@ static int searchCat() { // returns SEARCH_SUCCESS or SEARCH_TIMEOUT
 	return SEARCH_TIMEOUT;
 
 	lbl_found:
-	l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-	l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-	sndRptIsSet = FALSE;
-	sndRptOutputStat = FALSE;
-	buzzer_mute();
-	core_call_delayms(1000); // wait for a second
-
-	buzzer_setTone(toneC6);
-	buzzer_setDuty(50);
-	for (int i = 0; i < 3; i++) { // beep 3 times
-		buzzer_unmute();
-		core_call_delayms(300);
-		buzzer_mute();
-		core_call_delayms(300);
-	}
+	motionSet(L298N_STOP, 0, L298N_STOP, 0);
+	buzzer_stop();
+	appWait(1000); // wait for a second
+	if (appReq & APP_REQ_ABORT) goto lbl_aborted;
+
+	buzzer_play(&melFoundCat, MEL_PRIO_INFO); // beep 3 times
 
 	// move forward for 4 seconds.
 
-	l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
-	l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-	l298n_setSpeed(L298N_MOTOR_A, ROOM_SEARCH_DRV_SPD);
-	l298n_setSpeed(L298N_MOTOR_B, ROOM_SEARCH_DRV_SPD);
-	core_call_delayms(4000);
-	l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-	l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-	core_call_delayms(1500); // wait for 1500ms
+	motionSet(L298N_CCW, ROOM_SEARCH_DRV_SPD, L298N_CW, ROOM_SEARCH_DRV_SPD);
+	appWait(4000);
+	if (appReq & APP_REQ_ABORT) goto lbl_aborted;
+	motionSet(L298N_STOP, 0, L298N_STOP, 0);
+	appWait(1500); // wait for 1500ms
 	return SEARCH_SUCCESS; // search complete
 
 	lbl_timeoutWait:
-	l298n_setRotation(L298N_MOTOR_A, L298N_STOP); // stop first
-	l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-	// set tone
-	buzzer_setTone(toneF6);
-	buzzer_setDuty(25);
-	// set sound on/off to true
-	buzzer_unmute();
-	sndRptOutputStat = TRUE;
-	sndRptIsSet = TRUE;
+	appPhase = APP_PHASE_VIB_WAIT;
+	motionSet(L298N_STOP, 0, L298N_STOP, 0); // stop first
+	// beep until vibration or timeout
+	buzzer_play(&melVibWait, MEL_PRIO_INFO);
 	// set timeout time and marker
 	vibWaitTime = VIB_WAIT_TIME;
 	vibWaitIsSet = TRUE;
 	while (1) {
+		if (appReq & APP_REQ_ABORT) goto lbl_aborted;
 		// check for vibration every 100ms
 		if (periph_isVibration() == TRUE) { // detected vibration
 			vibWaitIsSet = FALSE;
 			vibWaitTime = 0;
-			sndRptIsSet = FALSE;
-			sndRptOutputStat = FALSE;
-			buzzer_mute();
+			buzzer_stop();
 			return SEARCH_SUCCESS;
 		}
 		// check for timeout
@@ -358,382 +1657,50 @@ static int searchCat() { // returns SEARCH_SUCCESS or SEARCH_TIMEOUT
 			// notify autoplay is cancelled, and make robot silent.
 			vibWaitIsSet = FALSE;
 			vibWaitTime = 0;
-			buzzer_setTone(toneA4);
-			buzzer_setDuty(50);
-			for (int i = 0; i < 5; i++) {
-				buzzer_unmute();
-				core_call_delayms(500);
-				buzzer_mute();
-				core_call_delayms(500);
-			}
+			buzzer_play(&melCancel, MEL_PRIO_ALERT); // preempts repeating beep
 			isAutoplayCancelled = TRUE; // mark cancelled
 			l298n_disable(); // disable motors
 			sg90_disable(SG90_MOTOR_A);
-			sndRptIsSet = FALSE;
-			sndRptOutputStat = FALSE;
-			buzzer_mute();
 			return SEARCH_TIMEOUT;
 		}
-		core_call_delayms(25);
-	}
-}
-
-static void giveSnack() {
-	buzzer_setTone(toneFS6);
-	buzzer_setDuty(50);
-	for (int i = 0; i < 5; i++) {
-		buzzer_unmute();
-		core_call_delayms(60);
-		buzzer_mute();
-		core_call_delayms(60);
-	}
-	periph_laser_on(); // use laser
-	l298n_setRotation(L298N_MOTOR_A, L298N_CW); // rotate to right
-	l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-	l298n_setSpeed(L298N_MOTOR_A, L298N_MAX_SPD);
-	l298n_setSpeed(L298N_MOTOR_B, L298N_MAX_SPD);
-	core_call_delayms(4500);
-	l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-	l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-	periph_laser_off();
-	core_call_delayms(500);
-
-	l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // forward
-	l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-	l298n_setSpeed(L298N_MOTOR_A, L298N_MAX_SPD);
-	l298n_setSpeed(L298N_MOTOR_B, L298N_MAX_SPD);
-	core_call_delayms(1000);
-	l298n_setRotation(L298N_MOTOR_A, L298N_STOP); // stop and wait for a sec
-	l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-	core_call_delayms(1000);
-
-	sg90_setAngle(SG90_MOTOR_A, SNACK_ANG_GIVE);
-	core_call_delayms(OP_SNACK_RET_MOTOR_WAITING_TIME);
-	sg90_setAngle(SG90_MOTOR_A, SNACK_ANG_RDY);
-	core_call_delayms(1000);
-	/*
-	core_call_pendingOpAdd(opcodePendingOp, OP_SNACK_RET_MOTOR_WAITING_TIME);
-	l298n_setRotation(L298N_MOTOR_A, L298N_CW); // backwards, fast speed to use inertia of snack
-	l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-	l298n_setSpeed(L298N_MOTOR_A, L298N_MAX_SPD);
-	l298n_setSpeed(L298N_MOTOR_B, L298N_MAX_SPD);
-	core_call_delayms(2500);
-	l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-	l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-	core_call_delayms(1000);
-	*/
+		appWait(25);
+	}
+
+	lbl_aborted: // motors and buzzer are stopped by abortRoutine()
+	vibWaitIsSet = FALSE;
+	vibWaitTime = 0;
+	return SEARCH_ABORTED;
 }
 
 static void exePattern(int code, int mode) {
 #ifdef _TEST_MODE_ENABLED
 	core_dbgTx("BEGIN PATTERN ");
 #endif
-	int32_t interval = 0; // seconds
-	int32_t rptNum = 1;
-	int32_t rptTime = 1;
-	int32_t cnt = 0;
+	int32_t interval = 1; // seconds. interval loops run their minimum unless play plan repeats them(entryReps)
+	uint16_t reps = 0;
+	const uint8_t* prog = NULL;
+	uint8_t len = 0;
+	curPattern = (uint8_t)code;
 	if (mode == PATTERN_EXE_MODE_AUTO) {
-		if (autoplayStatus == AUTOPLAY_STATUS_BEGIN) { // to avoid hard fault: div by 0. to avoid some logical bugs
-			interval = skdDuration / patternQueue.index;
-			if (!flagAutorun) interval = 1;
-			autoplayStatus = AUTOPLAY_STATUS_DO;
-		}
-		core_call_delayms(300); // give a slight delay between patterns
+		autoplayStatus = AUTOPLAY_STATUS_DO;
+		if (entryIntv >= 0) interval = entryIntv; // set by program
+		else reps = entryReps;
+		appWait(PATTERN_GAP_TIME); // give a slight delay between patterns
 	}
 	else if (mode == PATTERN_EXE_MODE_MAN) {
 		rotSpd = AUTO_DEF_ROT_SPD * 2;
 		drvSpd = AUTO_DEF_DRV_SPD * 2;
-		interval = 1;
-		cnt = 0;
 	}
 
 #ifdef _AUDIBLE_EXECUTION_ENABLED
-	buzzer_mute();
-	buzzer_setDuty(50);
-	buzzer_setTone(toneD4);
-	buzzer_unmute();
-	for (int audibleExeForCountVar = 0; audibleExeForCountVar < 2; audibleExeForCountVar++) {
-		buzzer_setTone(toneD4);
-		core_call_delayms(100);
-		buzzer_setTone(toneDS4);
-		core_call_delayms(100);
-		buzzer_setTone(toneF4);
-		core_call_delayms(100);
-	}
-	buzzer_mute();
+	buzzer_play(&melPattern, MEL_PRIO_INFO);
 #endif
 
-	switch (code) {
-	case 1: // Waltz(S-shaped route zig-zaging)
-		rptNum = interval / 3;
-		if (rptNum < 2) rptNum = 1; // execute at least one time
-		l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // initial rotation
-		l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-		l298n_setSpeed(L298N_MOTOR_A, AUTO_DEF_ROT_SPD); // rotation speed will not be affected by speed multiplier
-		l298n_setSpeed(L298N_MOTOR_B, AUTO_MIN_ROT_SPD);
-		core_call_delayms(500);
-		for (int32_t i32 = 0; i32 < rptNum; i32++) {
-			// forward
-			l298n_setSpeed(L298N_MOTOR_A, drvSpd);
-			l298n_setSpeed(L298N_MOTOR_B, drvSpd);
-			core_call_delayms(500);
-			l298n_setSpeed(L298N_MOTOR_A, AUTO_MIN_ROT_SPD); // rotation speed will not be affected by speed multiplier
-			l298n_setSpeed(L298N_MOTOR_B, AUTO_DEF_ROT_SPD);
-			core_call_delayms(1500);
-			l298n_setSpeed(L298N_MOTOR_A, drvSpd);
-			l298n_setSpeed(L298N_MOTOR_B, drvSpd);
-			core_call_delayms(500);
-			l298n_setSpeed(L298N_MOTOR_A, AUTO_DEF_ROT_SPD); // rotation speed will not be affected by speed multiplier
-			l298n_setSpeed(L298N_MOTOR_B, AUTO_MIN_ROT_SPD);
-			core_call_delayms(1500);
-		}
-		break;
-	case 2: // loop of Sudden accel., decel.
-		rptNum = interval / 20;
-		if (rptNum < 2) rptNum = 1; // execute at least one time
-		for (int32_t i32 = 0; i32 < rptNum; i32++) {
-			// forward
-			l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
-			l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-			for (int i = 0; i < 4; i++) {
-				l298n_setSpeed(L298N_MOTOR_A, drvSpd + SPD_OVERSHOOT_ADDEND);
-				l298n_setSpeed(L298N_MOTOR_B, drvSpd + SPD_OVERSHOOT_ADDEND);
-				core_call_delayms(800);
-				l298n_setSpeed(L298N_MOTOR_A, drvSpd);
-				l298n_setSpeed(L298N_MOTOR_B, drvSpd);
-				core_call_delayms(700);
-				l298n_setSpeed(L298N_MOTOR_A, 0);
-				l298n_setSpeed(L298N_MOTOR_B, 0);
-				core_call_delayms(1000);
-			}
-			// backward
-			l298n_setRotation(L298N_MOTOR_A, L298N_CW);
-			l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-			for (int i = 0; i < 4; i++) {
-				l298n_setSpeed(L298N_MOTOR_A, drvSpd + SPD_OVERSHOOT_ADDEND);
-				l298n_setSpeed(L298N_MOTOR_B, drvSpd + SPD_OVERSHOOT_ADDEND);
-				core_call_delayms(800);
-				l298n_setSpeed(L298N_MOTOR_A, drvSpd);
-				l298n_setSpeed(L298N_MOTOR_B, drvSpd);
-				core_call_delayms(700);
-				l298n_setSpeed(L298N_MOTOR_A, 0);
-				l298n_setSpeed(L298N_MOTOR_B, 0);
-				core_call_delayms(1000);
-			}
-
-		}
-		break;
-	case 3: // crawling, left wheel forwards a little bit, right goes next, then left goes again...
-		rptNum = interval / 10;
-		if (rptNum < 2) rptNum = 1; /// execute at least one time
-		for (int32_t i32 = 0; i32 < rptNum; i32++) {
-			for (int i = 0; i < 5; i++) {
-				l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
-				l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-				l298n_setSpeed(L298N_MOTOR_A, drvSpd);
-				l298n_setSpeed(L298N_MOTOR_B, AUTO_MIN_ROT_SPD);
-				core_call_delayms(1000);
-				l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
-				l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-				l298n_setSpeed(L298N_MOTOR_A, AUTO_MIN_ROT_SPD);
-				l298n_setSpeed(L298N_MOTOR_B, drvSpd);
-				core_call_delayms(1000);
-			}
-			for (int i = 0; i < 5; i++) {
-				l298n_setRotation(L298N_MOTOR_A, L298N_CW);
-				l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-				l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-				core_call_delayms(1000);
-				l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-				l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-				l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-				core_call_delayms(1000);
-			}
-		}
-		break;
-	case 4: // draw circle fast
-		rptTime = interval;
-		if (rptTime < 2) rptTime = 10; // ensure execution
-		l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // right
-		l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-		l298n_setSpeed(L298N_MOTOR_A, drvSpd + SPD_ADDEND);
-		l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-		core_call_delayms(rptTime * 1000);
-		break;
-	case 5: // shake the toy left and right but doesn't go anywhere
-		// this pattern will rotate the robot faster than pattern 8
-		rptNum = interval;
-		if (rptNum < 2) rptNum = 10; // execute at least one time
-		for (int32_t i32 = 0; i32 < rptNum; i32++) {
-			l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // right
-			l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-			l298n_setSpeed(L298N_MOTOR_A, rotSpd + SPD_OVERSHOOT_ADDEND);
-			l298n_setSpeed(L298N_MOTOR_B, rotSpd + SPD_OVERSHOOT_ADDEND);
-			core_call_delayms(400);
-			l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-			l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-			core_call_delayms(600);
-			l298n_setSpeed(L298N_MOTOR_A, 0);
-			l298n_setSpeed(L298N_MOTOR_B, 0);
-			core_call_delayms(250);
-			l298n_setRotation(L298N_MOTOR_A, L298N_CW); // left
-			l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-			l298n_setSpeed(L298N_MOTOR_A, rotSpd + SPD_OVERSHOOT_ADDEND);
-			l298n_setSpeed(L298N_MOTOR_B, rotSpd + SPD_OVERSHOOT_ADDEND);
-			core_call_delayms(400);
-			l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-			l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-			core_call_delayms(600);
-			l298n_setSpeed(L298N_MOTOR_A, 0);
-			l298n_setSpeed(L298N_MOTOR_B, 0);
-			core_call_delayms(250);
-		}
-		break;
-	case 6: // rotate, go to somewhere else, then rotate again
-		rptNum = interval / 6;
-		if (rptNum < 2) rptNum = 1; // execute at least one time
-		for (int32_t i32 = 0; i32 < rptNum; i32++) {
-			l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // right
-			l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-			l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-			l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-			core_call_delayms(7000);
-			l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // forward
-			l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-			l298n_setSpeed(L298N_MOTOR_A, drvSpd);
-			l298n_setSpeed(L298N_MOTOR_B, drvSpd);
-			core_call_delayms(5000);
-			l298n_setRotation(L298N_MOTOR_A, L298N_CW); // left
-			l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-			l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-			l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-			core_call_delayms(7000);
-			l298n_setRotation(L298N_MOTOR_A, L298N_CW); // backward
-			l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-			l298n_setSpeed(L298N_MOTOR_A, drvSpd);
-			l298n_setSpeed(L298N_MOTOR_B, drvSpd);
-			core_call_delayms(5000);
-		}
-		break;
-	case 7: // wait until something reaches in front of IR sensor, then flee backwards
-		// this pattern is not affected by interval time and it'll be executed only one time
-		// if pre defined time has been elapsed, the robot will do nothing
-		cnt = PATTERN_WAIT_AND_FLEE_WAIT_TIME;
-		int i = 0;
-		while (1) {
-			if (i == 10) {
-				if (cnt <= 0) break;
-				i = 0;
-				cnt--;
-			}
-			if (periph_irSnsrChk(IR_SNSR_MODE_OP) == IR_SNSR_NEAR) {
-				l298n_setRotation(L298N_MOTOR_A, L298N_CW); // backward
-				l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-				l298n_setSpeed(L298N_MOTOR_A, drvSpd + SPD_OVERSHOOT_ADDEND);
-				l298n_setSpeed(L298N_MOTOR_B, drvSpd + SPD_OVERSHOOT_ADDEND);
-				core_call_delayms(500);
-				l298n_setSpeed(L298N_MOTOR_A, drvSpd);
-				l298n_setSpeed(L298N_MOTOR_B, drvSpd);
-				core_call_delayms(1000);
-				l298n_setSpeed(L298N_MOTOR_A, 0);
-				l298n_setSpeed(L298N_MOTOR_B, 0);
-				break;
-			}
-			core_call_delayms(100);
-		}
-		break;
-	case 8: // shake the toy left and right, flee to somewhere else, then shake the toy again
-		rptNum = interval / 2;
-		if (rptNum < 2) rptNum = 2; // execute at least one time
-		for (int32_t i32 = 0; i32 < rptNum; i32++) {
-			for (int i = 0; i < 5; i++) { // shake
-				l298n_setRotation(L298N_MOTOR_A, L298N_CW); // left
-				l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-				l298n_setSpeed(L298N_MOTOR_A, rotSpd + SPD_OVERSHOOT_ADDEND / 2);
-				l298n_setSpeed(L298N_MOTOR_B, rotSpd + SPD_OVERSHOOT_ADDEND / 2);
-				core_call_delayms(400);
-				l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-				l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-				core_call_delayms(600);
-				l298n_setSpeed(L298N_MOTOR_A, 0);
-				l298n_setSpeed(L298N_MOTOR_B, 0);
-				core_call_delayms(100);
-				l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // right
-				l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-				l298n_setSpeed(L298N_MOTOR_A, rotSpd + SPD_OVERSHOOT_ADDEND / 2);
-				l298n_setSpeed(L298N_MOTOR_B, rotSpd + SPD_OVERSHOOT_ADDEND / 2);
-				core_call_delayms(400);
-				l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-				l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-				core_call_delayms(600);
-				l298n_setSpeed(L298N_MOTOR_A, 0);
-				l298n_setSpeed(L298N_MOTOR_B, 0);
-				core_call_delayms(100);
-			}
-			l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // forward
-			l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-			l298n_setSpeed(L298N_MOTOR_A, drvSpd + SPD_OVERSHOOT_ADDEND / 2);
-			l298n_setSpeed(L298N_MOTOR_B, drvSpd + SPD_OVERSHOOT_ADDEND / 2);
-			core_call_delayms(200);
-			l298n_setSpeed(L298N_MOTOR_A, drvSpd);
-			l298n_setSpeed(L298N_MOTOR_B, drvSpd);
-			core_call_delayms(300);
-			l298n_setSpeed(L298N_MOTOR_A, 0);
-			l298n_setSpeed(L298N_MOTOR_B, 0);
-			core_call_delayms(200);
-			for (int i = 0; i < 5; i++) { // shake again
-				l298n_setRotation(L298N_MOTOR_A, L298N_CW); // left
-				l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-				l298n_setSpeed(L298N_MOTOR_A, rotSpd + SPD_OVERSHOOT_ADDEND / 2);
-				l298n_setSpeed(L298N_MOTOR_B, rotSpd + SPD_OVERSHOOT_ADDEND / 2);
-				core_call_delayms(400);
-				l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-				l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-				core_call_delayms(600);
-				l298n_setSpeed(L298N_MOTOR_A, 0);
-				l298n_setSpeed(L298N_MOTOR_B, 0);
-				core_call_delayms(100);
-				l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // right
-				l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-				l298n_setSpeed(L298N_MOTOR_A, rotSpd + SPD_OVERSHOOT_ADDEND / 2);
-				l298n_setSpeed(L298N_MOTOR_B, rotSpd + SPD_OVERSHOOT_ADDEND / 2);
-				core_call_delayms(400);
-				l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-				l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-				core_call_delayms(600);
-				l298n_setSpeed(L298N_MOTOR_A, 0);
-				l298n_setSpeed(L298N_MOTOR_B, 0);
-				core_call_delayms(100);
-			}
-		}
-		break;
-	case 9: // stand still, move toy left and right like the robot is fishing horizontally
-		rptNum = interval / 2;
-		if (rptNum < 4) rptNum = 3; // execute at least 3 times
-		core_call_delayms(400);
-		for (int32_t i32 = 0; i32 < rptNum; i32++) {
-			// implementation here
-			l298n_setRotation(L298N_MOTOR_A, L298N_CW); // left slow
-			l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-			l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-			l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-			core_call_delayms(1000);
-			l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-			l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-			core_call_delayms(500);
-			l298n_setRotation(L298N_MOTOR_A, L298N_CW); // right fast
-			l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-			l298n_setSpeed(L298N_MOTOR_A, rotSpd);
-			l298n_setSpeed(L298N_MOTOR_B, rotSpd);
-			core_call_delayms(500);
-			l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-			l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-			core_call_delayms(500);
-		}
-		break;
-	}
-	l298n_setRotation(L298N_MOTOR_A, L298N_STOP); // stop motor rotation after each pattern exe
-	l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
+	prog = motProgOf((uint8_t)code, &len);
+	if (prog != NULL && len) motionRun(prog, len, interval, reps);
+	motionWait(); // queue stops motors when drained
+	motionSet(L298N_STOP, 0, L298N_STOP, 0); // stop motor rotation after each pattern exe
+	curPattern = RPI_TLM_NO_PATTERN;
 #ifdef _TEST_MODE_ENABLED
 	core_dbgTx("END PATTERN\r\n");
 #endif
@@ -743,98 +1710,66 @@ static void manualDrive() {
 #ifdef _TEST_MODE_ENABLED
 	core_dbgTx("BEGIN MANUAL MODE\r\n");
 #endif
+	appPhase = APP_PHASE_MANUAL;
+	isManual = TRUE;
+	appReq &= ~(APP_REQ_MANUAL | APP_REQ_MANUAL_END | APP_REQ_SNACK | APP_REQ_PATTERN | APP_REQ_ABORT);
 	// enable motor first
 	l298n_enable();
 	sg90_enable(SG90_MOTOR_A, DEF_ANG_A);
-	while (1) {
-		if (rpi_serialDtaAvailable()) {
-			if (rpi_getSerialDta(&rpidta)) {
-#ifdef _TEST_MODE_ENABLED
-				uint8_t buf[9] = { 0, };
-				buf[0] = rpidta.type;
-				for (int i = 0; i < 7; i++) {
-					buf[i + 1] = rpidta.container[i];
-				}
-				buf[8] = 0;
-				core_dbgTx((char*)buf);
-				core_dbgTx("\r\n");
-#endif
-				if (rpidta.type == TYPE_MANUAL_CTRL && rpidta.container[0] == '0') {
-					switch (rpidta.container[1]) {
-					case '0': // stop
-						l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-						l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-						break;
-					case '3': // left
-						l298n_setRotation(L298N_MOTOR_A, L298N_CW);
-						l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-						l298n_setSpeed(L298N_MOTOR_A, MAN_ROT_SPD);
-						l298n_setSpeed(L298N_MOTOR_B, MAN_ROT_SPD);
-						break;
-					case '4': // right
-						l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
-						l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-						l298n_setSpeed(L298N_MOTOR_A, MAN_ROT_SPD);
-						l298n_setSpeed(L298N_MOTOR_B, MAN_ROT_SPD);
-						break;
-#ifdef _2X_MAN_DRV_SPD
-					case '1': // forward
-						l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
-						l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-						l298n_setSpeed(L298N_MOTOR_A, MAN_DRV_SPD * 2);
-						l298n_setSpeed(L298N_MOTOR_B, MAN_DRV_SPD * 2);
-						break;
-					case '2': // reverse
-						l298n_setRotation(L298N_MOTOR_A, L298N_CW);
-						l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-						l298n_setSpeed(L298N_MOTOR_A, MAN_DRV_SPD * 2);
-						l298n_setSpeed(L298N_MOTOR_B, MAN_DRV_SPD * 2);
-						break;
-#else
-					case '1': // forward
-						l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
-						l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-						l298n_setSpeed(L298N_MOTOR_A, MAN_DRV_SPD);
-						l298n_setSpeed(L298N_MOTOR_B, MAN_DRV_SPD);
-						break;
-					case '2': // reverse
-						l298n_setRotation(L298N_MOTOR_A, L298N_CW);
-						l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
-						l298n_setSpeed(L298N_MOTOR_A, MAN_DRV_SPD);
-						l298n_setSpeed(L298N_MOTOR_B, MAN_DRV_SPD);
-						break;
-#endif
-					}
-				}
-				else if (rpidta.type == TYPE_MANUAL_CTRL && rpidta.container[0] == '1' && rpidta.container[1] == '0') {
-					giveSnack();
-				}
-				else if (rpidta.type == TYPE_MANUAL_CTRL && rpidta.container[0] != '0') {
-					if (rpidta.container[0] == 'P') {
-#ifdef _TEST_MODE_ENABLED
-						core_dbgTx("RECEIVED PATTERN CODE!\r\n");
-#endif
-						exePattern((rpidta.container[1] - 0x30), PATTERN_EXE_MODE_MAN);
-					}
-				}
-				else if (rpidta.type == TYPE_SYS && rpidta.container[0] == '2') {
-					// stop manual drive
-					l298n_disable();
-					sg90_disable(SG90_MOTOR_A);
+	while (!(appReq & APP_REQ_MANUAL_END)) { // steering is done by onManual()
+		cmdDispatch();
+		if (appReq & APP_REQ_SNACK) {
+			appReq &= ~APP_REQ_SNACK;
+			manMoving = FALSE; // snack drives the wheels now
+			snackStart();
+		}
+		if (appReq & APP_REQ_ABORT) snackCancel();
+		snackStep(); // steering works during snack, and cancels it
+		manDeadmanChk();
+		if ((appReq & APP_REQ_PATTERN) && snackSt == SNACK_ST_IDLE) { // pattern waits until snack ends
+			appReq &= ~APP_REQ_PATTERN;
+			manMoving = FALSE;
+			appPhase = APP_PHASE_PLAY; // steering commands wait until pattern ends
+			exePattern(reqPattern, PATTERN_EXE_MODE_MAN);
+			appPhase = APP_PHASE_MANUAL;
+		}
+		appReq &= ~APP_REQ_ABORT; // only snack or pattern can be aborted here
+	}
+	// stop manual drive
+	snackCancel();
+	manMoving = FALSE;
+	appReq &= ~(APP_REQ_MANUAL_END | APP_REQ_SNACK | APP_REQ_PATTERN);
+	l298n_disable();
+	sg90_disable(SG90_MOTOR_A);
+	isManual = FALSE;
+	appPhase = APP_PHASE_IDLE;
 #ifdef _TEST_MODE_ENABLED
-					core_dbgTx("END MANUAL MODE\r\n");
+	core_dbgTx("END MANUAL MODE\r\n");
 #endif
-					return;
-				}
-			}
-		}
+}
+
+static void playEntry(uint8_t code) { // pattern of skdEntry with its overrides, repeated as play plan says
+	struct PlayPlanCost pc;
+	if (skdEntry.spd != SKDPROG_NO_SPD) setPlaySpeed(skdEntry.spd);
+	entryIntv = (skdEntry.intv != SKDPROG_NO_INTV) ? skdEntry.intv : -1;
+	if (planOn) {
+		patternCost(code, skdEntry.intv, &pc);
+		entryReps = playplan_start(&plan, HAL_GetTick(), &pc);
 	}
+	exePattern(code, PATTERN_EXE_MODE_AUTO);
+	if (planOn) playplan_end(&plan, HAL_GetTick());
+	entryIntv = -1;
+	entryReps = 0;
+	setPlaySpeed(speed);
 }
 
-static void autoDrive() {
+static void autoDrive(_Bool resume) { // resume: continue autoplay aborted by command, see resumeState
 	//uint8_t rpiPinDta = 0;
+	struct SkdProgIter itPrev;
 	uint8_t patternCode, patternCodePrev;
+	uint8_t resumePattern = RPI_TLM_NO_PATTERN;
 	int snackIntvCnt;
+	_Bool searched = FALSE;
 
 	autoplayStatus = AUTOPLAY_STATUS_BEGIN;
 	patternCode = 0;
@@ -844,6 +1779,18 @@ static void autoDrive() {
 	// enable motor
 	l298n_enable();
 	sg90_enable(SG90_MOTOR_A, DEF_ANG_A);
+	sg90_setAutoDetach(SG90_MOTOR_A, SNACK_SERVO_DETACH_TIME);
+
+	if (resume && resumeState.searched) { // continue from interrupted pattern
+		resumeState.valid = FALSE;
+		autoplayStatus = AUTOPLAY_STATUS_DO;
+		patternCode = resumeState.patternPrev;
+		resumePattern = resumeState.pattern;
+		snackIntvCnt = resumeState.snackIntvCnt;
+		if (flagAutorun) planSession(resumeState.planLeft, resumePattern, patternCode, snackIntvCnt);
+		goto lbl_autoDrive_resume;
+	}
+	resumeState.valid = FALSE;
 
 	// skip searching if the schedule was cancelled previously
 	if (isAutoplayCancelled) {
@@ -851,111 +1798,89 @@ static void autoDrive() {
 		goto lbl_autoDrive_play;
 	}
 
-	if (searchCat() == SEARCH_TIMEOUT)
+	if (searchCat() == SEARCH_ABORTED) goto lbl_autoDrive_end;
 
 	// play
 	lbl_autoDrive_play:
-
 	snackIntvCnt = -1;
+	if (flagAutorun) planSession((uint32_t)pSkdActive->duration * 1000, RPI_TLM_NO_PATTERN, 0, snackIntvCnt);
+
+	lbl_autoDrive_resume:
+	searched = TRUE;
+	appPhase = APP_PHASE_PLAY;
 	while (1) {
+		if (appReq & APP_REQ_ABORT) break; // stopped by command
 		// get pattern code and move robot according to dequeued code
 		patternCodePrev = patternCode;
-		if (++snackIntvCnt >= skdSnackIntv) { // give snack
+		if (pSkdActive->snackIntv != RPI_SKD_SNACK_OFF && ++snackIntvCnt >= pSkdActive->snackIntv) { // give snack
 			snackIntvCnt = 0;
-			giveSnack();
-		}
-		if (core_dtaStruct_queueU8isEmpty(&patternQueue)) break;
-		if (core_dtaStruct_dequeueU8(&patternQueue, &patternCode) == ERR) break; // empty
-		if (!patternCode) { // Auto-decide
-			/*
-			 * if active pattern was executed previously, do more static ones
-			 * if not, do more active ones
-			 * every pattern will be executed with auto-decide mode only, although it's not recommended
-			 * pattern execution order for full-auto mode: 5-6-1-4-9-8-3-2-7-5-...
-			 */
-			switch (patternCodePrev) {
-			case 1: // Waltz(S-shaped route zig-zaging)
-				patternCode = 4;
-				exePattern(4, PATTERN_EXE_MODE_AUTO);
-				break;
-			case 2: // loop of Sudden accel., decel.
-				patternCode = 7;
-				exePattern(7, PATTERN_EXE_MODE_AUTO);
-				break;
-			case 3: // crawling, left wheel forwards a little bit, right goes next, then left goes again...
-				patternCode = 2;
-				exePattern(2, PATTERN_EXE_MODE_AUTO);
-				break;
-			case 4: // draw circle fast
-				patternCode = 9;
-				exePattern(9, PATTERN_EXE_MODE_AUTO);
-				break;
-			case 5: // shake the toy left and right but doesn't go anywhere
-				patternCode = 6;
-				exePattern(6, PATTERN_EXE_MODE_AUTO);
-				break;
-			case 6: // rotate, go to somewhere else, then rotate again
-				patternCode = 1;
-				exePattern(1, PATTERN_EXE_MODE_AUTO);
-				break;
-			case 7: // wait until something reaches in front of IR sensor, then flee backwards
-				patternCode = 5;
-				exePattern(5, PATTERN_EXE_MODE_AUTO);
-				break;
-			case 8: // shake the toy left and right, flee to somewhere else, then shake the toy again
-				patternCode = 3;
-				exePattern(3, PATTERN_EXE_MODE_AUTO);
-				break;
-			case 9: // stand still, move toy up and down like the robot is fishing
-				patternCode = 8;
-				exePattern(8, PATTERN_EXE_MODE_AUTO);
-				break;
-			case 0: // if first scheduled pattern is auto decide, do code 5(shake)
-				patternCode = 5;
-				exePattern(5, PATTERN_EXE_MODE_AUTO);
+			if (planSnackRun() == RPI_SNK_RES_CANCELLED) { // give it again on resume
+				snackIntvCnt = pSkdActive->snackIntv - 1;
 				break;
 			}
 		}
-		else {
-			exePattern(patternCode, PATTERN_EXE_MODE_AUTO);
+		if (resumePattern != RPI_TLM_NO_PATTERN) { // pattern interrupted by abort, from its start
+			patternCode = resumePattern;
+			resumePattern = RPI_TLM_NO_PATTERN;
+			playEntry(patternCode);
+			if (appReq & APP_REQ_ABORT) resumePattern = patternCode;
+			continue;
 		}
+		itPrev = pSkdActive->it;
+		if (!skdprog_next(&pSkdActive->it, pSkdActive->prog, pSkdActive->progLen, &skdEntry)) break; // all played
+		if (skdEntry.kind == SKDPROG_ENTRY_SNACK) { // snack op: not a pattern, interval count unchanged
+			snackIntvCnt--;
+			if (planSnackRun() == RPI_SNK_RES_CANCELLED) {
+				pSkdActive->it = itPrev; // give it again on resume
+				break;
+			}
+			continue;
+		}
+		pSkdActive->played++;
+		patternCode = skdEntry.code;
+		if (!patternCode) patternCode = autoNext[patternCodePrev < MOTPROG_USER_FIRST ? patternCodePrev : 0]; // Auto-decide
+		playEntry(patternCode);
+		if (appReq & APP_REQ_ABORT) resumePattern = patternCode; // interrupted: play again on resume
 	}
+	if (planOn) planReport((appReq & APP_REQ_ABORT) ? RPI_PLR_RES_ABORTED : RPI_PLR_RES_DONE);
 
-	// disable servo
-	sg90_disable(SG90_MOTOR_A);
+	// disable servo. after abort, abortRoutine() closes the door and PWM pauses by itself
+	if (!(appReq & APP_REQ_ABORT)) sg90_disable(SG90_MOTOR_A);
 
 	// move away from cat(park near a wall)
+	appPhase = APP_PHASE_PARK;
 	// for safety, if robot couldn't find an object with ir prox snsr for more than 15 sec,
 	// abort wall-searching and park
-	l298n_setRotation(L298N_MOTOR_A, L298N_CCW); // forward, slow
-	l298n_setRotation(L298N_MOTOR_B, L298N_CW);
-	l298n_setSpeed(L298N_MOTOR_A, AUTO_MIN_DRV_SPD);
-	l298n_setSpeed(L298N_MOTOR_B, AUTO_MIN_DRV_SPD);
+	if (!(appReq & APP_REQ_ABORT)) motionSet(L298N_CCW, AUTO_MIN_DRV_SPD, L298N_CW, AUTO_MIN_DRV_SPD); // forward, slow
 
 	unsigned parkPeriodCnt;
 	parkPeriodCnt = 0;
-	while (1) {
+	while (!(appReq & APP_REQ_ABORT)) {
 		if (periph_irSnsrChk(IR_SNSR_MODE_OP) == IR_SNSR_NEAR || parkPeriodCnt >= 150) {
-			l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
-			l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
+			motionSet(L298N_STOP, 0, L298N_STOP, 0);
 			break;
 		}
-		core_call_delayms(100);
+		appWait(100);
 		parkPeriodCnt++;
 	}
 
 	// after parking, turn off motor
+	lbl_autoDrive_end:
 	l298n_disable();
 	autoplayStatus = AUTOPLAY_STATUS_END;
-	buzzer_setTone(toneE6);
-	buzzer_setDuty(50);
-	buzzer_unmute();
-	core_call_delayms(250);
-	buzzer_setTone(toneG6);
-	core_call_delayms(250);
-	buzzer_setTone(toneC7);
-	core_call_delayms(250);
-	buzzer_mute();
+	appPhase = isAutoplayCancelled ? APP_PHASE_CANCELLED : APP_PHASE_IDLE;
+	if (appReq & APP_REQ_ABORT) { // silent: user stopped it. resumable with !R
+		appReq &= ~APP_REQ_ABORT;
+		resumeState.valid = TRUE;
+		resumeState.searched = searched;
+		resumeState.pattern = resumePattern;
+		resumeState.patternPrev = patternCodePrev;
+		// counter was already advanced for the interrupted pattern
+		resumeState.snackIntvCnt = (resumePattern != RPI_TLM_NO_PATTERN) ? snackIntvCnt - 1 : snackIntvCnt;
+		resumeState.planLeft = planOn ? playplan_left(&plan, HAL_GetTick()) : (uint32_t)pSkdActive->duration * 1000;
+	}
+	else buzzer_play(&melAutoplayEnd, MEL_PRIO_INFO);
+	planOn = FALSE;
 }
 
 /* main */
@@ -967,183 +1892,44 @@ static void appMain() {
 #endif
 	// check for rpi data
 	while (1) {
-		if (rpi_serialDtaAvailable()) { // process data if available
-			if (rpi_getSerialDta(&rpidta)) { // get data
-
-#ifdef _TEST_MODE_ENABLED
-				uint8_t buf[9] = { 0, };
-				buf[0] = rpidta.type;
-				for (int i = 0; i < 7; i++) {
-					buf[i + 1] = rpidta.container[i];
-				}
-				buf[8] = 0;
-				core_dbgTx((char*)buf);
-				core_dbgTx("\r\n");
-#endif
-
-				switch (rpidta.type) {
-				case TYPE_SCHEDULE_TIME:
-					if (!recvScheduleMode) break;
-					skdWaitTime = atoi32(rpidta.container);
-#ifdef _AUDIBLE_EXECUTION_ENABLED
-					buzzer_mute();
-					buzzer_setTone(toneG6);
-					buzzer_setDuty(50);
-					buzzer_unmute();
-					core_call_delayms(250);
-					buzzer_mute();
-					core_call_delayms(250);
-#endif
-					break;
-				case TYPE_SCHEDULE_PATTERN:
-					if (!recvScheduleMode) break;
-					for (int i = 0; i < 7; i++) {
-						if (rpidta.container[i]) {
-							if (rpidta.container[i] != '.') core_dtaStruct_enqueueU8(&patternQueue, rpidta.container[i] - 0x30);
-						}
-						else break;
-					}
-#ifdef _AUDIBLE_EXECUTION_ENABLED
-					buzzer_mute();
-					buzzer_setTone(toneA6);
-					buzzer_setDuty(50);
-					buzzer_unmute();
-					core_call_delayms(250);
-					buzzer_mute();
-					core_call_delayms(250);
-#endif
-					break;
-				case TYPE_SCHEDULE_SNACK_INTERVAL:
-					if (!recvScheduleMode) break;
-					skdSnackIntv = rpidta.container[0] - 0x30;
-#ifdef _AUDIBLE_EXECUTION_ENABLED
-					buzzer_mute();
-					buzzer_setTone(toneB6);
-					buzzer_setDuty(50);
-					buzzer_unmute();
-					core_call_delayms(250);
-					buzzer_mute();
-					core_call_delayms(250);
-#endif
-					break;
-				case TYPE_SCHEDULE_SPEED:
-					if (!recvScheduleMode) break;
-					skdSpd = rpidta.container[0];
-					if (skdSpd < 0) skdSpd = 0;
-					else if (skdSpd > 2) skdSpd = 2;
-
-					if (skdSpd) {
-						rotSpd = AUTO_DEF_ROT_SPD * skdSpd;
-						drvSpd = AUTO_DEF_DRV_SPD * skdSpd;
-					}
-					else {
-						rotSpd = AUTO_MIN_ROT_SPD;
-						drvSpd = AUTO_MIN_DRV_SPD;
-					}
-
-#ifdef _AUDIBLE_EXECUTION_ENABLED
-					buzzer_mute();
-					buzzer_setTone(toneC7);
-					buzzer_setDuty(50);
-					buzzer_unmute();
-					core_call_delayms(250);
-					buzzer_mute();
-					core_call_delayms(250);
-#endif
-					break;
-				case TYPE_SYS:
-#ifdef _TEST_MODE_ENABLED
-					core_dbgTx("SYS CMD: ");
-#endif
-					switch (rpidta.container[0]) {
-					case '1': // start manual drive
-						manualDrive();
-						break;
-					case '9': // initialize whole system
-						// not yet implemented
-						//core_restart();
-						break;
-					}
-					break;
-				case TYPE_SCHEDULE_DURATION:
-					if (!recvScheduleMode) break;
-					skdDuration = atoi32(rpidta.container);
-					break;
-				case TYPE_SCHEDULE_START:
-					skdDuration = 1; // if no input, play only once
-
-					recvScheduleMode = TRUE;
-					isAutoplayCancelled = FALSE; // reset autoplay cancel status to FALSE, since new schedule is being input.
-#ifdef _AUDIBLE_EXECUTION_ENABLED
-					buzzer_mute();
-					buzzer_setTone(toneE6);
-					buzzer_setDuty(50);
-					buzzer_unmute();
-					core_call_delayms(250);
-					buzzer_mute();
-					core_call_delayms(250);
-#endif
-					break;
-				case TYPE_SCHEDULE_END:
-					recvScheduleMode = FALSE;
-#ifdef _AUDIBLE_EXECUTION_ENABLED
-					buzzer_mute();
-					buzzer_setTone(toneE6);
-					buzzer_setDuty(50);
-					for (int audibleExeForCountVar = 0; audibleExeForCountVar < 3; audibleExeForCountVar++) {
-						buzzer_unmute();
-						core_call_delayms(200);
-						buzzer_mute();
-						core_call_delayms(200);
-					}
-#endif
-					skdIsSet = TRUE;
-				}
-			}
+		cmdDispatch(); // process data if available
+		appReq &= ~APP_REQ_ABORT; // nothing running here to abort
+		if (pSkdPending != NULL) skdCommit(pSkdPending); // uploaded during autoplay
+		if (appReq & APP_REQ_MANUAL) {
+			manualDrive();
 		}
-		else { // if no data is available, do something else
-
+		if (appReq & APP_REQ_CALIBRATE) {
+			appReq &= ~APP_REQ_CALIBRATE;
+			calibrateRotation();
 		}
 		// check if schedule is set
 		// check for schedule. process schedule if time has been elapsed
 		if (flagSkdTimeElapsed) {
 			flagSkdTimeElapsed = FALSE; // reset flag first
-			skdIsSet = FALSE;
-			flagAutorun = TRUE;
-
-			for (int i = 0; i < 2; i++) {
-				buzzer_setTone(toneC6);
-				buzzer_setDuty(50);
-				buzzer_unmute();
-				core_call_delayms(500);
-				buzzer_setTone(toneE6);
-				core_call_delayms(500);
-				buzzer_setTone(toneG6);
-				core_call_delayms(2000);
+			if (skdFire() != NULL) {
+				flagAutorun = TRUE;
+				buzzer_play(&melSkdAlarm, MEL_PRIO_INFO); // later progress sounds take over
+				autoDrive(FALSE);
+				flagAutorun = FALSE;
 			}
-
-			buzzer_mute();
-			autoDrive();
+		}
+		if (appReq & APP_REQ_RESUME) {
+			appReq &= ~APP_REQ_RESUME;
+			flagAutorun = TRUE;
+			autoDrive(TRUE);
 			flagAutorun = FALSE;
 		}
 		// check if autoplay is cancelled
 		if (isAutoplayCancelled) {
 			// re-run autoplay if vibration
 #ifdef _AUDIBLE_EXECUTION_ENABLED
-			buzzer_mute();
-			buzzer_setTone(toneA4);
-			buzzer_setDuty(50);
-			for (int audibleExeForCountVar = 0; audibleExeForCountVar < 5; audibleExeForCountVar++) {
-				buzzer_unmute();
-				core_call_delayms(500);
-				buzzer_mute();
-				core_call_delayms(500);
-			}
+			buzzer_play(&melCancel, MEL_PRIO_ALERT); // replays when finished, no-op while playing
 #endif
 			if (periph_isVibration()) {
-				autoDrive();
+				buzzer_stop();
+				autoDrive(FALSE);
 			}
-			else core_call_delayms(50);
+			else appWait(50);
 		}
 	}
 }
@@ -1155,13 +1941,9 @@ static core_statRetTypeDef app_pendingOpTimeoutHandler() {
 }
 
 core_statRetTypeDef app_secTimCallbackHandler() {
-	if (skdIsSet) {
-		if (--skdWaitTime <= 0) {
-			flagSkdTimeElapsed = TRUE;
-			skdWaitTime = 0;
-		}
-		else flagSkdTimeElapsed = FALSE;
-	}
+	skdClock = rtclock_now();
+	if (skdHeapCnt && skdCal[skdHeap[0]]->fireAt <= skdClock) flagSkdTimeElapsed = TRUE; // backs up RTC alarm. earliest one only, O(1)
+	if (recvScheduleMode && ++skdRecvIdle >= SKD_RECV_TIMEOUT) recvScheduleMode = FALSE; // '>' lost: discard partial upload
 	if (catSearchIsSet) {
 		if (--catSearchWaitTime <= 0) {
 			flagCatSearchTimeout = TRUE;
@@ -1176,16 +1958,6 @@ core_statRetTypeDef app_secTimCallbackHandler() {
 		}
 		else flagVibWaitTimeout = FALSE;
 	}
-	if (sndRptIsSet) {
-		if (sndRptOutputStat == TRUE) {
-			buzzer_mute();
-			sndRptOutputStat = FALSE;
-		}
-		else {
-			buzzer_unmute();
-			sndRptOutputStat = TRUE;
-		}
-	}
 	return OK;
 }
 
@@ -1218,13 +1990,49 @@ void app_start() {
 	core_call_pendingOpRegister(pu8, phf);
 	core_call_secTimIntrRegister(&app_secTimCallbackHandler);
 #endif
-	core_dtaStruct_queueU8init(&patternQueue);
+	l298n_setRamp(MOTOR_RAMP_PROFILE, MOTOR_SLEW_RATE);
+#ifdef _TEST_MODE_ENABLED
+	for (uint8_t code = 1; code <= PATTIME_CNT; code++) { // table is generated from the patterns and constants of this build
+		struct PlayPlanCost pc;
+		uint8_t len = 0;
+		const uint8_t* prog = motprog_builtin(code, &len);
+		progCost(prog, len, SKDPROG_NO_INTV, &pc);
+		if (pc.baseMs != pattime[code].baseMs || pc.repMs != pattime[code].repMs || PATTIME_GAP_MS != PATTERN_GAP_TIME
+				|| PATTIME_WAIT_S != PATTERN_WAIT_AND_FLEE_WAIT_TIME || PATTIME_SNACK_MS != snackTotal()) {
+			core_dbgTx("\r\n?PATTIME OUT OF DATE: RUN tools/gen_pattime.py\r\n");
+			break;
+		}
+	}
+#endif
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // cycle counter: interpreter cost in TYPE_MOTION_STAT
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 	speed = 2; // initial value is normal
-	skdSpd = 0;
-	skdDuration = 0;
-	skdSnackIntv = 0;
-	skdIsSet = FALSE;
+	manExpo = MAN_STREAM_EXPO;
+	manDeadman = MAN_STREAM_DEADMAN_TIME;
+#ifdef _2X_MAN_DRV_SPD
+	manMaxSpd = MAN_DRV_SPD * 2;
+#else
+	manMaxSpd = MAN_DRV_SPD;
+#endif
+	for (int i = 0; i < RPI_CAL_SIZE; i++) { // calendar is not kept over reset
+		skdCal[i] = NULL;
+		skdHeapPos[i] = SKD_NOT_QUEUED;
+	}
+	skdHeapCnt = 0;
+	skdClock = rtclock_now();
+	skdArm(); // cancels alarm of a calendar lost in reset
+	skdNone.progLen = 0;
+	skdNone.plays = 0;
+	skdNone.played = 0;
+	skdprog_begin(&skdNone.it);
+	pSkdActive = &skdNone;
+	pSkdStaging = &skdSlot[0];
+	pSkdPrev = &skdSlot[1];
+	skdPrevValid = FALSE;
+	pSkdPending = NULL;
 	initState = TRUE;
+	rpi_setTelemetryFunc(&fillTelemetry);
 
 	for (int i = 0; i < 20; i++) { // call ir sensor func and rpi pin recv 20 times to avoid error
 		rpi_foundCat();
@@ -1233,11 +2041,7 @@ void app_start() {
 	}
 
 	core_call_delayms(300);
-	buzzer_setTone(toneA5); // notify boot success
-	buzzer_setDuty(50);
-	buzzer_unmute();
-	core_call_delayms(250);
-	buzzer_mute();
+	buzzer_play(&melBoot, MEL_PRIO_INFO); // notify boot success
 
 	/*
 	// motor speed test: PASS
@@ -15,6 +15,9 @@
   */
 
 #include "buzzer.h"
+#include "port.h"
+#include "fixedpt.h"
+#include "fxtables.h"
 
 #ifndef FALSE
 #define FALSE 0
@@ -23,12 +26,73 @@
 #define TRUE 1
 #endif
 
+#if FXT_BUZZER_STD_DUTY_CNT != 3 || FXT_BUZZER_STD_DUTY_0 != BUZZER_STD_DUTY_0 || FXT_BUZZER_STD_DUTY_1 != BUZZER_STD_DUTY_1 || FXT_BUZZER_STD_DUTY_2 != BUZZER_STD_DUTY_2
+#error "fxtables out of date: run tools/gen_fxtables.py"
+#endif
+
 static TIM_HandleTypeDef* pTimHandle = NULL;
 static TIM_TypeDef* pTimInstance = NULL;
 static uint8_t duty;
+static q16_t dutyQ16; // duty / 100
+static int8_t dutyIdx; // index of duty in the std duty table, -1 if not a std duty
+static int8_t toneIdx; // index of current ARR in fxtToneARR, -1 if set by buzzer_setFreq
 static _Bool timEna = FALSE;
-static _Bool pwmEna = FALSE;
+static volatile _Bool pwmEna = FALSE;
 static _Bool initStat = FALSE;
+static const struct BuzzerMelody* volatile pMelody = NULL; // NULL: no melody
+static volatile uint8_t melPrio;
+static volatile uint8_t melIdx; // running note
+static volatile uint8_t melLoopLeft;
+static volatile int32_t melRemainUs; // time left of running note
+static void (*pMelodyDoneCallback)(const struct BuzzerMelody*) = NULL;
+
+static int8_t findStdDuty(uint8_t d) {
+	if (d == BUZZER_STD_DUTY_0) return 0;
+	else if (d == BUZZER_STD_DUTY_1) return 1;
+	else if (d == BUZZER_STD_DUTY_2) return 2;
+	else return -1;
+}
+
+static int8_t findTone(uint16_t arr) { // binary search on the ascending ARR table
+	int lo = 0, hi = FXT_TONE_CNT - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (fxtToneARR[mid] == arr) return (int8_t)mid;
+		else if (fxtToneARR[mid] < arr) lo = mid + 1;
+		else hi = mid - 1;
+	}
+	return -1;
+}
+
+static void updateCCR() {
+	if (dutyIdx >= 0 && toneIdx >= 0) pTimInstance->CCR1 = fxtToneCCR[dutyIdx][toneIdx];
+	else pTimInstance->CCR1 = fx_scaleU(pTimInstance->ARR, dutyQ16);
+}
+
+static uint16_t noteCCR(uint16_t arr, uint8_t d) {
+	int8_t di = findStdDuty(d);
+	int8_t ti = (di >= 0) ? findTone(arr) : -1;
+	if (ti >= 0) return fxtToneCCR[di][ti];
+	else return (uint16_t)fx_scaleU(arr, fx_fromRatio(d, 100));
+}
+
+static void loadNote() { // write ARR/CCR of the running note. timer counter has just restarted
+	const struct BuzzerNote* pn = &pMelody->pNotes[melIdx];
+	if (pn->tone == BUZZER_REST) {
+		pTimInstance->ARR = BUZZER_REST_ARR;
+		pTimInstance->CCR1 = 0;
+	}
+	else {
+		pTimInstance->ARR = pn->tone;
+		pTimInstance->CCR1 = noteCCR(pn->tone, pn->duty);
+	}
+	melRemainUs = (int32_t)pn->len * BUZZER_NOTE_UNIT_MS * 1000;
+}
+
+static void cancelMelody() { // direct tone control takes over from melody
+	pMelody = NULL;
+	toneIdx = -1; // ARR was changed by the melody
+}
 
 void buzzer_setHandle(TIM_HandleTypeDef* ph) {
 	pTimHandle = ph;
@@ -38,47 +102,117 @@ void buzzer_setHandle(TIM_HandleTypeDef* ph) {
 void buzzer_init() {
 	if (pTimHandle == NULL) return;
 	duty = 25;
+	dutyQ16 = fx_fromRatio(duty, 100);
+	dutyIdx = findStdDuty(duty);
 	pwmEna = FALSE;
 
 	if (timEna == FALSE) {
-		HAL_TIM_Base_Start_IT(pTimHandle);
+		port_tim_start_it(pTimHandle);
 		timEna = TRUE;
 	}
 
 	// init PWM: set to 440Hz 25%
-	pTimInstance->ARR = 2273;
-	pTimInstance->CCR1 = pTimInstance->ARR / 4;
+	pTimInstance->ARR = toneA4;
+	toneIdx = findTone(toneA4);
+	updateCCR();
 
 	initStat = TRUE;
 }
 
 void buzzer_mute() {
-	if (initStat == FALSE || pwmEna == FALSE) return;
-	HAL_TIM_PWM_Stop(pTimHandle, TIM_CHANNEL_1);
+	if (initStat == FALSE) return;
+	cancelMelody();
+	if (pwmEna == FALSE) return;
+	port_pwm_disable(pTimHandle, TIM_CHANNEL_1);
 	pwmEna = FALSE;
 }
 
 void buzzer_unmute() {
-	if (initStat == FALSE || pwmEna == TRUE) return;
-	HAL_TIM_PWM_Start(pTimHandle, TIM_CHANNEL_1);
+	if (initStat == FALSE) return;
+	cancelMelody();
+	if (pwmEna == TRUE) return;
+	port_pwm_enable(pTimHandle, TIM_CHANNEL_1);
 	pwmEna = TRUE;
 }
 
 void buzzer_setTone(buzzerToneARRvalTypeDef toneCode) {
 	if (initStat == FALSE) return;
+	cancelMelody();
 	pTimInstance->ARR = toneCode;
-	pTimInstance->CCR1 = (uint16_t)((float)pTimInstance->ARR * ((float)duty / 100.0));
+	toneIdx = findTone((uint16_t)toneCode);
+	updateCCR();
 }
 
 void buzzer_setFreq(uint16_t freq) {
 	if (freq > 10000 || freq < 60) return;
+	cancelMelody();
 	// arr = 1,000,000 / freq
-	pTimInstance->ARR = (uint16_t)(1000000 / (uint16_t)((float)freq + 0.5));
-	pTimInstance->CCR1 = (uint16_t)((float)pTimInstance->ARR * ((float)duty / 100.0));
+	pTimInstance->ARR = 1000000 / (uint32_t)freq;
+	toneIdx = -1;
+	updateCCR();
 }
 
 void buzzer_setDuty(uint8_t dutyRatio) {
 	if (dutyRatio < 5 || dutyRatio > 50) return;
+	cancelMelody();
 	duty = dutyRatio;
-	pTimInstance->CCR1 = (uint16_t)((float)pTimInstance->ARR * ((float)duty / 100.0));
+	dutyQ16 = fx_fromRatio(duty, 100);
+	dutyIdx = findStdDuty(duty);
+	updateCCR();
+}
+
+_Bool buzzer_play(const struct BuzzerMelody* pMel, uint8_t priority) { // preempts melody of same or lower priority. returns FALSE if rejected
+	if (initStat == FALSE || pMel == NULL || pMel->cnt == 0) return FALSE;
+	if (pMelody == pMel) return TRUE; // already playing
+	if (pMelody != NULL && priority < melPrio) return FALSE;
+
+	__disable_irq();
+	pMelody = pMel;
+	melPrio = priority;
+	melIdx = 0;
+	melLoopLeft = pMel->loop;
+	loadNote();
+	pTimInstance->CNT = 0; // counter may be above the new ARR
+	toneIdx = -1;
+	__enable_irq();
+	if (pwmEna == FALSE) {
+		port_pwm_enable(pTimHandle, TIM_CHANNEL_1);
+		pwmEna = TRUE;
+	}
+	return TRUE;
+}
+
+void buzzer_stop() { // stop melody and mute
+	buzzer_mute();
+}
+
+_Bool buzzer_isPlaying() {
+	return (pMelody != NULL) ? TRUE : FALSE;
+}
+
+void buzzer_setMelodyDoneCallback(void (*pFunc)(const struct BuzzerMelody* pMel)) { // called from TIM update interrupt when a melody ends
+	pMelodyDoneCallback = pFunc;
+}
+
+void buzzer_periodElapsedHandler(TIM_HandleTypeDef *htim) { // call this from HAL_TIM_PeriodElapsedCallback
+	const struct BuzzerMelody* pDone;
+	if (pTimHandle == NULL || htim->Instance != pTimInstance) return;
+	if (pMelody == NULL) return;
+
+	melRemainUs -= (int32_t)pTimInstance->ARR + 1; // one timer period at 1MHz
+	if (melRemainUs > 0) return;
+
+	if (++melIdx >= pMelody->cnt) {
+		if (melLoopLeft == 0) { // finished: stop PWM, which also stops the counter until next play
+			pDone = pMelody;
+			pMelody = NULL;
+			port_pwm_disable(pTimHandle, TIM_CHANNEL_1);
+			pwmEna = FALSE;
+			if (pMelodyDoneCallback != NULL) pMelodyDoneCallback(pDone);
+			return;
+		}
+		if (melLoopLeft != BUZZER_LOOP_FOREVER) melLoopLeft--;
+		melIdx = 0;
+	}
+	loadNote();
 }
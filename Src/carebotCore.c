@@ -18,6 +18,7 @@
 #include "l298n.h"
 #include "buzzer.h"
 #include "sg90.h"
+#include "rtclock.h"
 
 #if defined _TEST_MODE_SEND_VIA_STLINK_SWO
 const _Bool isDebugModeDef = TRUE;
@@ -287,6 +288,7 @@ void core_start() {
 	l298n_init();
 	sg90_init();
 	buzzer_init();
+	rtclock_init();
 	initState = TRUE;
 
 	pendedOpcodeMem = 0;
@@ -303,6 +305,10 @@ void core_start() {
 		HAL_TIM_Base_Start_IT(pSecTimHandle);
 		secTimEna = TRUE;
 	}
+	if (timEna == FALSE) { // 1ms timer runs always: rpi telemetry is sent from it
+		HAL_TIM_Base_Start_IT(pMillisecTimHandle);
+		timEna = TRUE;
+	}
 	app_start();
 }
 
@@ -356,6 +362,26 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
 	}
 }
 
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+	rpi_txCpltHandler(huart);
+}
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size) { // rpi link: circular DMA reception
+	rpi_rxEventHandler(huart, Size);
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) { // ORE, FE, NE, PE: DMA reception is aborted by HAL
+	rpi_errorHandler(huart);
+}
+
+void HAL_RTC_AlarmAEventCallback(RTC_HandleTypeDef *hrtc) { // schedule alarm
+	rtclock_alarmHandler(hrtc);
+}
+
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) { // vibration sensor
+	periph_vibEdgeHandler(GPIO_Pin);
+}
+
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim){
 	if (htim->Instance == pSecTimHandle->Instance) { // 1s sys tim
 		for (int i = 0; i < 8; i++) {
@@ -364,5 +390,11 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim){
 	}
 	else if (htim->Instance == pMillisecTimHandle->Instance) { // 1ms sys tim(for postponed ops)
 		millisecTimCallbackHandler();
+		rpi_msTimeoutHandler();
+	}
+	else { // driver timers. each handler ignores other instances
+		l298n_periodElapsedHandler(htim);
+		sg90_periodElapsedHandler(htim);
+		buzzer_periodElapsedHandler(htim);
 	}
 }
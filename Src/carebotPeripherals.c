@@ -13,42 +13,57 @@
 
 #include "main.h"
 #include "carebotPeripherals.h"
+#include "port.h"
 #include <math.h> // to use pow()
 
 static ADC_HandleTypeDef* pAdcHandle;
 static uint32_t adcDta = 0;
 static float distCM = 0.0; // Cortex-M4 has single precision FPU
-static HAL_StatusTypeDef halStat;
+static volatile float lastDistCM = 0.0; // last measured distance, read by telemetry
+static volatile uint16_t vibEventCnt = 0; // counted by periph_vibEdgeHandler only
+static uint32_t vibEdgeTick = 0; // last counted edge
 
 void periph_setHandle(ADC_HandleTypeDef* ph) {
 	pAdcHandle = ph;
 }
 
 void periph_init() {
-	HAL_GPIO_WritePin(LASER_PORT, LASER_PIN, GPIO_PIN_RESET);
-	//HAL_GPIO_WritePin(LED_PORT, LED_PIN, GPIO_PIN_SET);
-	HAL_ADC_Start(pAdcHandle);
+	port_gpio_reset(LASER_PORT, LASER_PIN);
+	//port_gpio_set(LED_PORT, LED_PIN);
+	port_adc_start(pAdcHandle);
 }
 
 void periph_laser_on() {
-	HAL_GPIO_WritePin(LASER_PORT, LASER_PIN, GPIO_PIN_SET);
+	port_gpio_set(LASER_PORT, LASER_PIN);
 }
 
 void periph_laser_off() {
-	HAL_GPIO_WritePin(LASER_PORT, LASER_PIN, GPIO_PIN_RESET);
+	port_gpio_reset(LASER_PORT, LASER_PIN);
 }
 
-_Bool periph_isVibration() {
-	return (HAL_GPIO_ReadPin(VIB_SNSR_PORT, VIB_SNSR_PIN) == GPIO_PIN_SET ? FALSE : TRUE);
+_Bool periph_isVibration() { // sensor level now(active low). no side effect, safe to call from interrupts
+	return (port_gpio_read(VIB_SNSR_PORT, VIB_SNSR_PIN) ? FALSE : TRUE);
+}
+
+uint16_t periph_vibEventCnt() { // vibrations counted by periph_vibEdgeHandler since boot
+	return vibEventCnt;
+}
+
+void periph_vibEdgeHandler(uint16_t pin) { // falling edge of the sensor pin. chatter of one shake counts once
+	uint32_t now;
+	if (pin != VIB_SNSR_PIN) return;
+	now = HAL_GetTick();
+	if (vibEventCnt && now - vibEdgeTick < VIB_SNSR_DEBOUNCE) return;
+	vibEdgeTick = now;
+	vibEventCnt++;
+}
+
+float periph_irSnsrLast() { // last distance measured by irSnsrChk or irSnsrRaw. no ADC access, 0 if never measured
+	return lastDistCM;
 }
 
 int periph_irSnsrChk(int mode) {
-	HAL_ADC_Start(pAdcHandle);
-	halStat = HAL_ADC_PollForConversion(pAdcHandle, IR_SNSR_POLL_TIMEOUT);
-	//if (halStat != HAL_OK) // couldn't poll
-	//	return IR_SNSR_ERR;
-	adcDta = HAL_ADC_GetValue(pAdcHandle); // get data
-	HAL_ADC_Stop(pAdcHandle);
+	adcDta = port_adc_read(pAdcHandle, IR_SNSR_POLL_TIMEOUT); // get data
 	/* equation for GP2Y0A02 (y: voltage, x = cm)
 	 * y = 32.467x^-0.8504
 	 * x = 59.88676548 / (y^1.17591721)
@@ -59,6 +74,7 @@ int periph_irSnsrChk(int mode) {
 	if (adcDta == 0) return IR_SNSR_FAR; // safety
 
 	distCM = 59.88676548 / pow(((float)adcDta / 4095.0 * 3.3), 1.17591721); // calculate distance
+	lastDistCM = distCM;
 
 	switch (mode) { // decide near/far according to pre-set distance of a mode
 	case IR_SNSR_MODE_OP:
@@ -82,10 +98,7 @@ int periph_irSnsrChk(int mode) {
 }
 
 float periph_irSnsrRaw() {
-	HAL_ADC_Start(pAdcHandle);
-	halStat = HAL_ADC_PollForConversion(pAdcHandle, IR_SNSR_POLL_TIMEOUT);
-	adcDta = HAL_ADC_GetValue(pAdcHandle); // get data
-	HAL_ADC_Stop(pAdcHandle);
+	adcDta = port_adc_read(pAdcHandle, IR_SNSR_POLL_TIMEOUT); // get data
 	/* equation for GP2Y0A02 (y: voltage, x = cm)
 	 * y = 32.467x^-0.8504
 	 * x = 59.88676548 / (y^1.17591721)
@@ -95,5 +108,6 @@ float periph_irSnsrRaw() {
 
 	if (adcDta == 0) return 150.0; // safety. 150 is max distance
 
-	return 59.88676548 / pow(((float)adcDta / 4095.0 * 3.3), 1.17591721); // return calculated distance
+	lastDistCM = 59.88676548 / pow(((float)adcDta / 4095.0 * 3.3), 1.17591721);
+	return lastDistCM; // return calculated distance
 }
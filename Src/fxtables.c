@@ -0,0 +1,175 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : fxtables.c
+  * BRIEF INFORMATION: GENERATED BY tools/gen_fxtables.py. DO NOT EDIT.
+  * 				   CCR lookup tables for sg90, l298n and buzzer.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#include "fxtables.h"
+#include "buzzer.h"
+
+// tone enum must match the values the tables were generated from
+#define FXT_TONE(name, val) _Static_assert(name == val, "fxtables out of date: run tools/gen_fxtables.py");
+FXT_TONE(toneB8, 127)
+FXT_TONE(toneAS8, 134)
+FXT_TONE(toneA8, 142)
+FXT_TONE(toneGS8, 150)
+FXT_TONE(toneG8, 159)
+FXT_TONE(toneFS8, 169)
+FXT_TONE(toneF8, 179)
+FXT_TONE(toneE8, 190)
+FXT_TONE(toneDS8, 201)
+FXT_TONE(toneD8, 213)
+FXT_TONE(toneCS8, 225)
+FXT_TONE(toneC8, 239)
+FXT_TONE(toneB7, 253)
+FXT_TONE(toneAS7, 268)
+FXT_TONE(toneA7, 284)
+FXT_TONE(toneGS7, 301)
+FXT_TONE(toneG7, 319)
+FXT_TONE(toneFS7, 338)
+FXT_TONE(toneF7, 358)
+FXT_TONE(toneE7, 379)
+FXT_TONE(toneDS7, 402)
+FXT_TONE(toneD7, 426)
+FXT_TONE(toneCS7, 451)
+FXT_TONE(toneC7, 478)
+FXT_TONE(toneB6, 506)
+FXT_TONE(toneAS6, 536)
+FXT_TONE(toneA6, 568)
+FXT_TONE(toneGS6, 602)
+FXT_TONE(toneG6, 638)
+FXT_TONE(toneFS6, 678)
+FXT_TONE(toneF6, 716)
+FXT_TONE(toneE6, 758)
+FXT_TONE(toneDS6, 803)
+FXT_TONE(toneD6, 851)
+FXT_TONE(toneCS6, 902)
+FXT_TONE(toneC6, 955)
+FXT_TONE(toneB5, 1012)
+FXT_TONE(toneAS5, 1073)
+FXT_TONE(toneA5, 1136)
+FXT_TONE(toneGS5, 1203)
+FXT_TONE(toneG5, 1276)
+FXT_TONE(toneFS5, 1351)
+FXT_TONE(toneF5, 1431)
+FXT_TONE(toneE5, 1517)
+FXT_TONE(toneDS5, 1608)
+FXT_TONE(toneD5, 1704)
+FXT_TONE(toneCS5, 1805)
+FXT_TONE(toneC5, 1912)
+FXT_TONE(toneB4, 2024)
+FXT_TONE(toneAS4, 2146)
+FXT_TONE(toneA4, 2273)
+FXT_TONE(toneGS4, 2410)
+FXT_TONE(toneG4, 2551)
+FXT_TONE(toneFS4, 2703)
+FXT_TONE(toneF4, 2865)
+FXT_TONE(toneE4, 3030)
+FXT_TONE(toneDS4, 3215)
+FXT_TONE(toneD4, 3401)
+FXT_TONE(toneCS4, 3597)
+FXT_TONE(toneC4, 3817)
+FXT_TONE(toneB3, 4049)
+FXT_TONE(toneAS3, 4292)
+FXT_TONE(toneA3, 4545)
+FXT_TONE(toneGS3, 4808)
+FXT_TONE(toneG3, 5102)
+FXT_TONE(toneFS3, 5405)
+FXT_TONE(toneF3, 5714)
+FXT_TONE(toneE3, 6061)
+FXT_TONE(toneDS3, 6410)
+FXT_TONE(toneD3, 6803)
+FXT_TONE(toneCS3, 7194)
+FXT_TONE(toneC3, 7634)
+FXT_TONE(toneB2, 8065)
+FXT_TONE(toneAS2, 8547)
+FXT_TONE(toneA2, 9091)
+FXT_TONE(toneGS2, 9615)
+FXT_TONE(toneG2, 10204)
+FXT_TONE(toneFS2, 10753)
+FXT_TONE(toneF2, 11494)
+FXT_TONE(toneE2, 12195)
+FXT_TONE(toneDS2, 12821)
+FXT_TONE(toneD2, 13699)
+FXT_TONE(toneCS2, 14493)
+FXT_TONE(toneC2, 15385)
+#undef FXT_TONE
+
+const uint16_t fxtSg90AngleCCR[181] = {
+	2500, 2513, 2527, 2541, 2555, 2569, 2583, 2597, 2611, 2625, 2638, 2652,
+	2666, 2680, 2694, 2708, 2722, 2736, 2750, 2763, 2777, 2791, 2805, 2819,
+	2833, 2847, 2861, 2875, 2888, 2902, 2916, 2930, 2944, 2958, 2972, 2986,
+	3000, 3013, 3027, 3041, 3055, 3069, 3083, 3097, 3111, 3125, 3138, 3152,
+	3166, 3180, 3194, 3208, 3222, 3236, 3250, 3263, 3277, 3291, 3305, 3319,
+	3333, 3347, 3361, 3375, 3388, 3402, 3416, 3430, 3444, 3458, 3472, 3486,
+	3500, 3513, 3527, 3541, 3555, 3569, 3583, 3597, 3611, 3625, 3638, 3652,
+	3666, 3680, 3694, 3708, 3722, 3736, 3750, 3763, 3777, 3791, 3805, 3819,
+	3833, 3847, 3861, 3875, 3888, 3902, 3916, 3930, 3944, 3958, 3972, 3986,
+	4000, 4013, 4027, 4041, 4055, 4069, 4083, 4097, 4111, 4125, 4138, 4152,
+	4166, 4180, 4194, 4208, 4222, 4236, 4250, 4263, 4277, 4291, 4305, 4319,
+	4333, 4347, 4361, 4375, 4388, 4402, 4416, 4430, 4444, 4458, 4472, 4486,
+	4500, 4513, 4527, 4541, 4555, 4569, 4583, 4597, 4611, 4625, 4638, 4652,
+	4666, 4680, 4694, 4708, 4722, 4736, 4750, 4763, 4777, 4791, 4805, 4819,
+	4833, 4847, 4861, 4875, 4888, 4902, 4916, 4930, 4944, 4958, 4972, 4986,
+	5000,
+};
+
+const uint16_t fxtL298nSpdCCR[FXT_L298N_MAX_SPD + 1] = {
+	0, 20, 40, 60, 80, 100, 120, 140, 160, 180, 200, 220,
+	240, 260, 280, 300, 320, 340, 360, 380, 400, 420, 440, 460,
+	480, 500, 520, 540, 560, 580, 600, 620, 640, 660, 680, 700,
+	720, 740, 760, 780, 800, 820, 840, 860, 880, 900, 920, 940,
+	960, 980, 1000, 1020, 1040, 1060, 1080, 1100, 1120, 1140, 1160, 1180,
+	1200, 1220, 1240, 1260, 1280, 1300, 1320, 1340, 1360, 1380, 1400, 1420,
+	1440, 1460, 1480, 1500, 1520, 1540, 1560, 1580, 1600, 1620, 1640, 1660,
+	1680, 1700, 1720, 1740, 1760, 1780, 1800, 1820, 1840, 1860, 1880, 1900,
+	1920, 1940, 1960, 1980, 2000,
+};
+
+const uint16_t fxtToneARR[FXT_TONE_CNT] = {
+	127, 134, 142, 150, 159, 169, 179, 190, 201, 213, 225, 239,
+	253, 268, 284, 301, 319, 338, 358, 379, 402, 426, 451, 478,
+	506, 536, 568, 602, 638, 678, 716, 758, 803, 851, 902, 955,
+	1012, 1073, 1136, 1203, 1276, 1351, 1431, 1517, 1608, 1704, 1805, 1912,
+	2024, 2146, 2273, 2410, 2551, 2703, 2865, 3030, 3215, 3401, 3597, 3817,
+	4049, 4292, 4545, 4808, 5102, 5405, 5714, 6061, 6410, 6803, 7194, 7634,
+	8065, 8547, 9091, 9615, 10204, 10753, 11494, 12195, 12821, 13699, 14493, 15385,
+};
+
+const uint16_t fxtToneCCR[FXT_BUZZER_STD_DUTY_CNT][FXT_TONE_CNT] = {
+	{ // 10%
+		12, 13, 14, 15, 15, 16, 17, 19, 20, 21, 22, 23,
+		25, 26, 28, 30, 31, 33, 35, 37, 40, 42, 45, 47,
+		50, 53, 56, 60, 63, 67, 71, 75, 80, 85, 90, 95,
+		101, 107, 113, 120, 127, 135, 143, 151, 160, 170, 180, 191,
+		202, 214, 227, 241, 255, 270, 286, 303, 321, 340, 359, 381,
+		404, 429, 454, 480, 510, 540, 571, 606, 641, 680, 719, 763,
+		806, 854, 909, 961, 1020, 1075, 1149, 1219, 1282, 1369, 1449, 1538,
+	},
+	{ // 25%
+		31, 33, 35, 37, 39, 42, 44, 47, 50, 53, 56, 59,
+		63, 67, 71, 75, 79, 84, 89, 94, 100, 106, 112, 119,
+		126, 134, 142, 150, 159, 169, 179, 189, 200, 212, 225, 238,
+		253, 268, 284, 300, 319, 337, 357, 379, 402, 426, 451, 478,
+		506, 536, 568, 602, 637, 675, 716, 757, 803, 850, 899, 954,
+		1012, 1073, 1136, 1202, 1275, 1351, 1428, 1515, 1602, 1700, 1798, 1908,
+		2016, 2136, 2272, 2403, 2551, 2688, 2873, 3048, 3205, 3424, 3623, 3846,
+	},
+	{ // 50%
+		63, 67, 71, 75, 79, 84, 89, 95, 100, 106, 112, 119,
+		126, 134, 142, 150, 159, 169, 179, 189, 201, 213, 225, 239,
+		253, 268, 284, 301, 319, 339, 358, 379, 401, 425, 451, 477,
+		506, 536, 568, 601, 638, 675, 715, 758, 804, 852, 902, 956,
+		1012, 1073, 1136, 1205, 1275, 1351, 1432, 1515, 1607, 1700, 1798, 1908,
+		2024, 2146, 2272, 2404, 2551, 2702, 2857, 3030, 3205, 3401, 3597, 3817,
+		4032, 4273, 4545, 4807, 5102, 5376, 5747, 6097, 6410, 6849, 7246, 7692,
+	},
+};
@@ -13,12 +13,41 @@
   */
 
 #include "l298n.h"
+#include "port.h"
+#include "fxtables.h"
+
+#if FXT_L298N_TIM_ARR != L298N_TIM_ARR || FXT_L298N_MAX_SPD != L298N_MAX_SPD
+#error "fxtables out of date: run tools/gen_fxtables.py"
+#endif
+
+struct L298nRamp {
+	volatile _Bool active;
+	uint16_t startCCR;
+	uint16_t targetCCR;
+	uint16_t tick; // elapsed ramp ticks
+	uint16_t ticks; // total ramp ticks
+};
 
 static struct L298nStats L298Nstat;
 static uint16_t spdMultr;
+static _Bool useTable = FALSE;
 static uint16_t spd16a;
 static uint16_t spd16b;
 static _Bool timEna = FALSE;
+static struct L298nRamp ramp[2];
+static uint8_t rampProfile = L298N_RAMP_NONE;
+static uint16_t slew = L298N_DEF_SLEW_RATE;
+static void (*pSettledCallback)(uint8_t) = NULL;
+static volatile uint32_t pendingBSRRa = 0; // direction pin words, written by update interrupt
+static volatile uint32_t pendingBSRRb = 0;
+
+// motion queue. single producer(thread) and single consumer(update interrupt)
+static struct L298nSegment segQueue[L298N_QUEUE_SIZE];
+static volatile unsigned segHead = 0; // next segment to load, written by interrupt
+static volatile unsigned segTail = 0; // next free slot, written by thread
+static volatile _Bool segRunning = FALSE;
+static int32_t segRemaining = 0; // remaining time of running segment in 1/L298N_TIM_FREQ ms
+static void (*pQueueDoneCallback)() = NULL;
 
 static TIM_HandleTypeDef* pTimHandle = NULL;
 static TIM_TypeDef* pTimInstance = NULL;
@@ -28,6 +57,121 @@ void l298n_setHandle(TIM_HandleTypeDef* ph) {
 	pTimInstance = ph->Instance;
 }
 
+/* basic functions */
+
+static uint32_t rampShape(uint32_t x) { // x, return value: 0 ~ 1024
+	switch (rampProfile) {
+	case L298N_RAMP_TRAPEZOID: // a = 1/4: y = x^2 / (2a(1-a)) on both ends, linear in the middle
+		if (x < 256) return x * x / 384;
+		else if (x > 768) return 1024 - (1024 - x) * (1024 - x) / 384;
+		else return (x - 128) * 4 / 3;
+	case L298N_RAMP_SCURVE: // y = 3x^2 - 2x^3
+		return (x * x / 1024) * (3072 - 2 * x) / 1024;
+	default:
+		return x;
+	}
+}
+
+static uint16_t spdToCCR(uint8_t speed) {
+	return (useTable == TRUE) ? fxtL298nSpdCCR[speed] : (uint16_t)(speed * spdMultr);
+}
+
+static void writeCCR(uint8_t motorNum, uint16_t ccr) {
+	if (motorNum == L298N_MOTOR_A) {
+		spd16a = ccr;
+		pTimInstance->CCR1 = (uint32_t)ccr;
+		L298Nstat.spdA = (uint8_t)(ccr / spdMultr);
+	}
+	else {
+		spd16b = ccr;
+		pTimInstance->CCR2 = (uint32_t)ccr;
+		L298Nstat.spdB = (uint8_t)(ccr / spdMultr);
+	}
+}
+
+static void setSpeedImmediate(uint8_t motorNum, uint8_t speed) {
+	ramp[motorNum].active = FALSE;
+	if (motorNum == L298N_MOTOR_A) L298Nstat.tgtA = speed;
+	else L298Nstat.tgtB = speed;
+	writeCCR(motorNum, spdToCCR(speed));
+}
+
+static uint32_t dirToBSRR(uint8_t motorNum, uint8_t dir) { // BSRR word: set bits on lower half, reset bits on upper half
+	uint16_t pin1 = (motorNum == L298N_MOTOR_A) ? L298N_IN_1 : L298N_IN_3;
+	uint16_t pin2 = (motorNum == L298N_MOTOR_A) ? L298N_IN_2 : L298N_IN_4;
+	switch (dir) {
+	case L298N_CW:
+		return (uint32_t)pin1 | ((uint32_t)pin2 << 16);
+	case L298N_CCW:
+		return (uint32_t)pin2 | ((uint32_t)pin1 << 16);
+	default: // stop
+		return ((uint32_t)pin1 | (uint32_t)pin2) << 16;
+	}
+}
+
+static void dropPendingDir(uint8_t motorNum) {
+	uint32_t mask = dirToBSRR(motorNum, L298N_CW) | dirToBSRR(motorNum, L298N_CCW);
+	if (motorNum == L298N_MOTOR_B && L298N_IN_PORT_A != L298N_IN_PORT_B) pendingBSRRb = 0;
+	else pendingBSRRa &= ~mask;
+}
+
+static void writePendingDir() { // direction words staged by l298n_drive and setRotation
+	if (pendingBSRRa) {
+		port_gpio_bsrr(L298N_IN_PORT_A, pendingBSRRa);
+		pendingBSRRa = 0;
+	}
+	if (pendingBSRRb) {
+		port_gpio_bsrr(L298N_IN_PORT_B, pendingBSRRb);
+		pendingBSRRb = 0;
+	}
+}
+
+static void rampTick(uint8_t motorNum) {
+	struct L298nRamp* pr = &ramp[motorNum];
+	int32_t y;
+	if (pr->active == FALSE) return;
+
+	if (++pr->tick >= pr->ticks) { // ramp finished
+		pr->active = FALSE;
+		writeCCR(motorNum, pr->targetCCR);
+		if (pSettledCallback != NULL) pSettledCallback(motorNum);
+		return;
+	}
+	y = (int32_t)rampShape((uint32_t)pr->tick * 1024 / pr->ticks);
+	writeCCR(motorNum, (uint16_t)((int32_t)pr->startCCR + ((int32_t)pr->targetCCR - (int32_t)pr->startCCR) * y / 1024));
+}
+
+static void queueTick() {
+	if (segRunning == FALSE) {
+		if (segHead == segTail) return; // empty
+		segRemaining = 0;
+	}
+	else {
+		segRemaining -= 1000; // 1 tick = 1000 / L298N_TIM_FREQ ms
+		if (segRemaining > 0) return;
+	}
+
+	// boundary: load next segment. leftover of previous one is carried to keep boundaries exact
+	while (segHead != segTail) {
+		struct L298nSegment* ps = &segQueue[segHead];
+		segHead = (segHead + 1) % L298N_QUEUE_SIZE;
+		segRemaining += (int32_t)(ps->ms * L298N_TIM_FREQ);
+		if (segRemaining > 0) {
+			l298n_drive(ps->dirA, ps->spdA, ps->dirB, ps->spdB);
+			segRunning = TRUE;
+			return;
+		}
+	}
+
+	// drained
+	segRunning = FALSE;
+	segRemaining = 0;
+	l298n_drive(L298N_STOP, 0, L298N_STOP, 0);
+	if (pQueueDoneCallback != NULL) pQueueDoneCallback();
+}
+
+/* driver functions */
+
 void l298n_init() {
 	// init status struct
 	L298Nstat.ena = FALSE;
@@ -35,111 +179,244 @@ void l298n_init() {
 	L298Nstat.rotB = L298N_STOP;
 	L298Nstat.spdA = 0;
 	L298Nstat.spdB = 0;
+	L298Nstat.tgtA = 0;
+	L298Nstat.tgtB = 0;
 	spd16a = 0;
 	spd16b = 0;
+	ramp[L298N_MOTOR_A].active = FALSE;
+	ramp[L298N_MOTOR_B].active = FALSE;
 
 	// init GPIO
-	HAL_GPIO_WritePin(L298N_IN_PORT_A, L298N_IN_1, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(L298N_IN_PORT_A, L298N_IN_2, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(L298N_IN_PORT_B, L298N_IN_3, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(L298N_IN_PORT_B, L298N_IN_4, GPIO_PIN_RESET);
+	port_gpio_reset(L298N_IN_PORT_A, L298N_IN_1 | L298N_IN_2);
+	port_gpio_reset(L298N_IN_PORT_B, L298N_IN_3 | L298N_IN_4);
 
 	// start timer
 	if (timEna == FALSE) {
-		HAL_TIM_Base_Start_IT(pTimHandle);
+		port_tim_start_it(pTimHandle);
 		timEna = TRUE;
 	}
 
 	// calculate timer period
 	spdMultr = (uint16_t)(pTimInstance->ARR / 100);
+	useTable = (pTimInstance->ARR == L298N_TIM_ARR) ? TRUE : FALSE;
 
 	// init PWM: set to LOW
 	pTimInstance->CCR1 = 0;
 	pTimInstance->CCR2 = 0;
+
+	// CCR preload: new duty is latched on update event, so l298n_drive can switch both channels together
+	pTimInstance->CCMR1 |= TIM_CCMR1_OC1PE | TIM_CCMR1_OC2PE;
+	pendingBSRRa = 0;
+	pendingBSRRb = 0;
+	segHead = 0;
+	segTail = 0;
+	segRunning = FALSE;
 }
 
 void l298n_enable() { // enable motor operation. This starts PWM generation.
 	if (L298Nstat.ena == TRUE) return;
-	HAL_TIM_PWM_Start(pTimHandle, TIM_CHANNEL_1);
-	HAL_TIM_PWM_Start(pTimHandle, TIM_CHANNEL_2);
+	port_pwm_enable(pTimHandle, TIM_CHANNEL_1);
+	port_pwm_enable(pTimHandle, TIM_CHANNEL_2);
 	L298Nstat.ena = TRUE;
 }
 
 void l298n_disable() { // implies setRotation( , STOP): disable motor operation. This stops PWM generation.
 	if (L298Nstat.ena == FALSE) return;
 
+	l298n_queueAbort();
 	l298n_setRotation(L298N_MOTOR_A, L298N_STOP);
 	l298n_setRotation(L298N_MOTOR_B, L298N_STOP);
-	HAL_TIM_PWM_Stop(pTimHandle, TIM_CHANNEL_1);
-	HAL_TIM_PWM_Stop(pTimHandle, TIM_CHANNEL_2);
+	port_pwm_disable(pTimHandle, TIM_CHANNEL_1);
+	port_pwm_disable(pTimHandle, TIM_CHANNEL_2);
+	// counter stops with the last channel: no update event will write the stop pins, outputs are off already
+	__disable_irq();
+	writePendingDir();
+	__enable_irq();
 	L298Nstat.ena = FALSE;
 }
 
 void l298n_setSpeed(uint8_t motorNum, uint8_t spd) { // speed scale: 0(stop) to 100(max.)
 	uint8_t speed;
+	uint16_t curCCR, tgtCCR, deltaCCR;
+	uint32_t ticks;
 	if (L298Nstat.ena == FALSE) return;
 	if (motorNum > L298N_MOTOR_B) return;
 	//if (spd > 100) return; // limit max inp val to 100
 	if (spd > 100) speed = 100;
 	else speed = spd;
 
-	if (motorNum == L298N_MOTOR_A) {
-		L298Nstat.spdA = speed;
-		spd16a = (uint16_t)(speed * spdMultr);
-		pTimInstance->CCR1 = (uint32_t)spd16a;
+	if (rampProfile == L298N_RAMP_NONE || slew == 0) {
+		setSpeedImmediate(motorNum, speed);
+		return;
 	}
-	else if (motorNum == L298N_MOTOR_B) {
-		L298Nstat.spdB = speed;
-		spd16b = (uint16_t)(speed * spdMultr);
-		pTimInstance->CCR2 = (uint32_t)spd16b;
+
+	// ramp: the update interrupt advances duty from current to target
+	curCCR = (motorNum == L298N_MOTOR_A) ? spd16a : spd16b;
+	tgtCCR = spdToCCR(speed);
+	deltaCCR = (tgtCCR > curCCR) ? (tgtCCR - curCCR) : (curCCR - tgtCCR);
+	ticks = (uint32_t)deltaCCR * L298N_TIM_FREQ / ((uint32_t)slew * spdMultr);
+	// slew rate is the peak rate: stretch the ramp for profiles whose peak exceeds the average
+	if (rampProfile == L298N_RAMP_TRAPEZOID) ticks = ticks * 4 / 3;
+	else if (rampProfile == L298N_RAMP_SCURVE) ticks = ticks * 3 / 2;
+	if (ticks < 2) { // too small to ramp
+		setSpeedImmediate(motorNum, speed);
+		return;
 	}
+	if (ticks > 0xFFFF) ticks = 0xFFFF;
+
+	ramp[motorNum].active = FALSE; // ISR skips this motor while parameters are being changed
+	ramp[motorNum].startCCR = curCCR;
+	ramp[motorNum].targetCCR = tgtCCR;
+	ramp[motorNum].tick = 0;
+	ramp[motorNum].ticks = (uint16_t)ticks;
+	if (motorNum == L298N_MOTOR_A) L298Nstat.tgtA = speed;
+	else L298Nstat.tgtB = speed;
+	ramp[motorNum].active = TRUE;
 }
 
-void l298n_setRotation(uint8_t motorNum, uint8_t dir) { // implies setSpeed(motorNum, 0): set rotation CW or CCW.
+void l298n_setRotation(uint8_t motorNum, uint8_t dir) { // implies setSpeed(motorNum, 0): set rotation CW or CCW. applied on the next PWM period edge
 	if (L298Nstat.ena == FALSE) return;
 	if (motorNum > L298N_MOTOR_B) return;
 
-	l298n_setSpeed(motorNum, 0);
-	if (motorNum == L298N_MOTOR_A) {
-		switch (dir) {
-		case L298N_STOP:
-			HAL_GPIO_WritePin(L298N_IN_PORT_A, L298N_IN_1, GPIO_PIN_RESET);
-			HAL_GPIO_WritePin(L298N_IN_PORT_A, L298N_IN_2, GPIO_PIN_RESET);
-			L298Nstat.rotA = L298N_STOP;
-			break;
-		case L298N_CW:
-			HAL_GPIO_WritePin(L298N_IN_PORT_A, L298N_IN_1, GPIO_PIN_SET);
-			HAL_GPIO_WritePin(L298N_IN_PORT_A, L298N_IN_2, GPIO_PIN_RESET);
-			L298Nstat.rotA = L298N_CW;
-			break;
-		case L298N_CCW:
-			HAL_GPIO_WritePin(L298N_IN_PORT_A, L298N_IN_1, GPIO_PIN_RESET);
-			HAL_GPIO_WritePin(L298N_IN_PORT_A, L298N_IN_2, GPIO_PIN_SET);
-			L298Nstat.rotA = L298N_CCW;
-			break;
-		}
+	// zero duty is latched on the update event: stage the direction pins for the same one, like l298n_drive
+	pTimInstance->CR1 |= TIM_CR1_UDIS;
+	setSpeedImmediate(motorNum, 0); // never ramp down here: direction pins change on the same edge
+	dropPendingDir(motorNum); // replaces pins of this wheel staged by l298n_drive
+	if (dir <= L298N_CCW) {
+		if (motorNum == L298N_MOTOR_B && L298N_IN_PORT_A != L298N_IN_PORT_B) pendingBSRRb |= dirToBSRR(motorNum, dir);
+		else pendingBSRRa |= dirToBSRR(motorNum, dir);
+		if (motorNum == L298N_MOTOR_A) L298Nstat.rotA = dir;
+		else L298Nstat.rotB = dir;
 	}
-	else if (motorNum == L298N_MOTOR_B) {
-		switch (dir) {
-		case L298N_STOP:
-			HAL_GPIO_WritePin(L298N_IN_PORT_B, L298N_IN_3, GPIO_PIN_RESET);
-			HAL_GPIO_WritePin(L298N_IN_PORT_B, L298N_IN_4, GPIO_PIN_RESET);
-			L298Nstat.rotB = L298N_STOP;
-			break;
-		case L298N_CW:
-			HAL_GPIO_WritePin(L298N_IN_PORT_B, L298N_IN_3, GPIO_PIN_SET);
-			HAL_GPIO_WritePin(L298N_IN_PORT_B, L298N_IN_4, GPIO_PIN_RESET);
-			L298Nstat.rotB = L298N_CW;
-			break;
-		case L298N_CCW:
-			HAL_GPIO_WritePin(L298N_IN_PORT_B, L298N_IN_3, GPIO_PIN_RESET);
-			HAL_GPIO_WritePin(L298N_IN_PORT_B, L298N_IN_4, GPIO_PIN_SET);
-			L298Nstat.rotB = L298N_CCW;
-			break;
-		}
+	pTimInstance->CR1 &= ~TIM_CR1_UDIS;
+}
+
+void l298n_drive(uint8_t dirA, uint8_t spdA, uint8_t dirB, uint8_t spdB) { // set both wheels. applied on the same PWM period edge
+	uint32_t bsrrA, bsrrB;
+	if (L298Nstat.ena == FALSE) return;
+	if (dirA > L298N_CCW || dirB > L298N_CCW) return;
+	if (dirA == L298N_STOP) spdA = 0;
+	if (dirB == L298N_STOP) spdB = 0;
+
+	// hold preload transfer until both channels and direction words are staged
+	pTimInstance->CR1 |= TIM_CR1_UDIS;
+
+	// direction change restarts that wheel from zero duty, same as setRotation
+	if (dirA != L298Nstat.rotA) {
+		setSpeedImmediate(L298N_MOTOR_A, 0);
+		L298Nstat.rotA = dirA;
+	}
+	if (dirB != L298Nstat.rotB) {
+		setSpeedImmediate(L298N_MOTOR_B, 0);
+		L298Nstat.rotB = dirB;
+	}
+	l298n_setSpeed(L298N_MOTOR_A, spdA);
+	l298n_setSpeed(L298N_MOTOR_B, spdB);
+
+	bsrrA = dirToBSRR(L298N_MOTOR_A, dirA);
+	bsrrB = dirToBSRR(L298N_MOTOR_B, dirB);
+	if (L298N_IN_PORT_A == L298N_IN_PORT_B) { // same port: one write for all four pins
+		pendingBSRRa = bsrrA | bsrrB;
+		pendingBSRRb = 0;
+	}
+	else {
+		pendingBSRRa = bsrrA;
+		pendingBSRRb = bsrrB;
 	}
+
+	pTimInstance->CR1 &= ~TIM_CR1_UDIS;
 }
 
 struct L298nStats l298n_getStat() { // get status struct data
 	return L298Nstat;
 }
+
+void l298n_setRamp(uint8_t profile, uint16_t slewRate) { // set ramp profile used by setSpeed. slew rate: speed units per second
+	if (profile > L298N_RAMP_SCURVE) return;
+	if (profile == L298N_RAMP_NONE) { // finish running ramps immediately
+		if (ramp[L298N_MOTOR_A].active) setSpeedImmediate(L298N_MOTOR_A, L298Nstat.tgtA);
+		if (ramp[L298N_MOTOR_B].active) setSpeedImmediate(L298N_MOTOR_B, L298Nstat.tgtB);
+	}
+	rampProfile = profile;
+	slew = slewRate;
+}
+
+_Bool l298n_isSettled() { // returns TRUE if both motors reached target speed
+	return (ramp[L298N_MOTOR_A].active == FALSE && ramp[L298N_MOTOR_B].active == FALSE);
+}
+
+void l298n_waitSettled() { // block until both motors reached target speed
+	while (l298n_isSettled() == FALSE) {
+		HAL_Delay(1);
+	}
+}
+
+void l298n_setSettledCallback(void (*pFunc)(uint8_t motorNum)) { // called from TIM update interrupt when a ramp finishes
+	pSettledCallback = pFunc;
+}
+
+void l298n_periodElapsedHandler(TIM_HandleTypeDef *htim) { // call this from HAL_TIM_PeriodElapsedCallback
+	if (pTimHandle == NULL || htim->Instance != pTimInstance) return;
+	writePendingDir(); // direction pins follow the CCR preload transfer of this update event
+	queueTick();
+	rampTick(L298N_MOTOR_A);
+	rampTick(L298N_MOTOR_B);
+}
+
+_Bool l298n_queuePush(const struct L298nSegment* pSeg) { // returns FALSE if queue is full or motor is disabled
+	unsigned next = (segTail + 1) % L298N_QUEUE_SIZE;
+	if (L298Nstat.ena == FALSE) return FALSE;
+	if (next == segHead) return FALSE; // full
+	segQueue[segTail] = *pSeg;
+	if (segQueue[segTail].ms > 0x7FFFFFFF / L298N_TIM_FREQ) segQueue[segTail].ms = 0x7FFFFFFF / L298N_TIM_FREQ;
+	segTail = next; // publish after copy
+	return TRUE;
+}
+
+_Bool l298n_queueDrive(uint8_t dir, uint8_t spd, uint32_t ms) { // dir: L298N_FORWARD or L298N_BACKWARD
+	struct L298nSegment seg = { L298N_FWD_A, spd, L298N_FWD_B, spd, ms };
+	if (dir == L298N_BACKWARD) {
+		seg.dirA = L298N_BWD_A;
+		seg.dirB = L298N_BWD_B;
+	}
+	return l298n_queuePush(&seg);
+}
+
+_Bool l298n_queueRotate(uint8_t dir, uint8_t spd, uint32_t ms) { // rotate in place. dir: L298N_LEFT or L298N_RIGHT
+	// left: left wheel backward, right wheel forward
+	struct L298nSegment seg = { L298N_BWD_A, spd, L298N_FWD_B, spd, ms };
+	if (dir == L298N_RIGHT) {
+		seg.dirA = L298N_FWD_A;
+		seg.dirB = L298N_BWD_B;
+	}
+	return l298n_queuePush(&seg);
+}
+
+_Bool l298n_queueArc(uint8_t spdA, uint8_t spdB, uint32_t ms) { // forward with different wheel speeds
+	struct L298nSegment seg = { L298N_FWD_A, spdA, L298N_FWD_B, spdB, ms };
+	return l298n_queuePush(&seg);
+}
+
+_Bool l298n_queuePause(uint32_t ms) { // stop for ms
+	struct L298nSegment seg = { L298N_STOP, 0, L298N_STOP, 0, ms };
+	return l298n_queuePush(&seg);
+}
+
+unsigned l298n_queueDepth() { // number of queued segments including the running one
+	unsigned depth = (segTail + L298N_QUEUE_SIZE - segHead) % L298N_QUEUE_SIZE;
+	return depth + (segRunning ? 1 : 0);
+}
+
+void l298n_queueAbort() { // drop every segment and stop motors
+	__disable_irq();
+	segHead = segTail;
+	segRunning = FALSE;
+	segRemaining = 0;
+	__enable_irq();
+	if (L298Nstat.ena == FALSE) return;
+	l298n_drive(L298N_STOP, 0, L298N_STOP, 0);
+}
+
+void l298n_setQueueDoneCallback(void (*pFunc)()) { // called from TIM update interrupt when queue drains
+	pQueueDoneCallback = pFunc;
+}
@@ -0,0 +1,347 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : motprog.c
+  * BRIEF INFORMATION: motion program of a play pattern: validation, interpreter, built-in patterns
+  * 				   No hardware access: also built on host by tools/motprog_check.py.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#include "motprog.h"
+
+// operand bytes after the opcode
+static const uint8_t opLen[] = {
+	[MOTPROG_OP_END] = 0,
+	[MOTPROG_OP_DRIVE] = 5,
+	[MOTPROG_OP_WAIT] = 2,
+	[MOTPROG_OP_LOOP] = 1,
+	[MOTPROG_OP_LOOPV] = 4,
+	[MOTPROG_OP_NEXT] = 0,
+	[MOTPROG_OP_BR] = 2,
+	[MOTPROG_OP_SOUND] = 1,
+	[MOTPROG_OP_LASER] = 1,
+	[MOTPROG_OP_SERVO] = 4,
+};
+
+static _Bool spdOk(uint8_t s) {
+	return s <= MOTPROG_MAX_SPD || (s & 0xF0) == MOTPROG_SPD_SYM;
+}
+
+static uint8_t spdOf(const struct MotProgEnv* pEnv, uint8_t s) {
+	if (!(s & MOTPROG_SPD_SYM)) return s;
+	uint32_t v = (uint32_t)pEnv->base[(s >> 2) & 0x03] + pEnv->add[s & 0x03];
+	return (v > MOTPROG_MAX_SPD) ? MOTPROG_MAX_SPD : (uint8_t)v;
+}
+
+static uint16_t u16(const uint8_t* p) {
+	return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint16_t loopCnt(const struct MotProgEnv* pEnv, uint8_t op, const uint8_t* a) { // runs of LOOP or LOOPV, 1 ~ 0xFFFF
+	if (op == MOTPROG_OP_LOOP) return a[0];
+	if (a[0] == MOTPROG_PARAM_INTV && pEnv->reps) return pEnv->reps;
+	int32_t v = pEnv->param[a[0]];
+	uint32_t cnt = (v > 0) ? (uint32_t)v / a[1] : 0;
+	if (cnt < a[2]) cnt = a[3];
+	return (cnt > 0xFFFF) ? 0xFFFF : (uint16_t)cnt;
+}
+
+/*
+ * rejects unknown ops, missing operands, operands out of range, unbalanced or too deep loops
+ * and branches that land outside the program or inside an op.
+ * a branch may leave loops(pattern 7 does): the interpreter drops them at END
+ */
+_Bool motprog_check(const uint8_t* p, uint8_t len) {
+	uint8_t opStart[32] = { 0, }; // bit per pc: an op starts here
+	uint8_t depth = 0;
+	uint8_t pc = 0;
+	while (pc < len) {
+		uint8_t op = p[pc];
+		if (op >= sizeof(opLen) || (uint16_t)pc + 1 + opLen[op] > len) return FALSE;
+		const uint8_t* a = &p[pc + 1];
+		opStart[pc >> 3] |= 1 << (pc & 7);
+		switch (op) {
+		case MOTPROG_OP_DRIVE:
+			if ((a[0] & 0x0F) > 2 || (a[0] >> 4) > 2 || !spdOk(a[1]) || !spdOk(a[2])) return FALSE;
+			break;
+		case MOTPROG_OP_LOOP:
+		case MOTPROG_OP_LOOPV:
+			if (depth >= MOTPROG_MAX_DEPTH) return FALSE;
+			if (op == MOTPROG_OP_LOOP && a[0] == 0) return FALSE;
+			if (op == MOTPROG_OP_LOOPV && (a[0] >= MOTPROG_PARAM_CNT || a[1] == 0 || a[2] == 0 || a[3] == 0)) return FALSE;
+			depth++;
+			break;
+		case MOTPROG_OP_NEXT:
+			if (depth == 0) return FALSE;
+			depth--;
+			break;
+		case MOTPROG_OP_BR:
+			if (a[0] >= MOTPROG_COND_CNT) return FALSE;
+			break;
+		case MOTPROG_OP_LASER:
+			if (a[0] > 1) return FALSE;
+			break;
+		}
+		pc += 1 + opLen[op];
+	}
+	if (depth != 0) return FALSE;
+	for (pc = 0; pc < len; pc += 1 + opLen[p[pc]]) { // targets: op boundary or the end
+		if (p[pc] != MOTPROG_OP_BR) continue;
+		int16_t t = pc + 3 + (int8_t)p[pc + 2];
+		if (t < 0 || t > len || (t < len && !(opStart[t >> 3] & (1 << (t & 7))))) return FALSE;
+	}
+	return TRUE;
+}
+
+void motprog_begin(struct MotProgVm* vm, const struct MotProgEnv* pEnv) {
+	vm->pEnv = pEnv;
+	vm->steps = 0;
+	vm->pc = 0;
+	vm->depth = 0;
+}
+
+_Bool motprog_step(struct MotProgVm* vm, const uint8_t* p, uint8_t len, struct MotProgAct* pAct) {
+	// control ops run on until an action: at most len of them, then the app gets a NONE and a tick passes
+	for (uint16_t ctl = 0; ctl <= len; ctl++) {
+		if (vm->pc >= len || vm->steps >= MOTPROG_STEP_LIMIT) break;
+		vm->steps++;
+		const uint8_t* a = &p[vm->pc + 1];
+		uint8_t op = p[vm->pc];
+		vm->pc += 1 + opLen[op];
+		switch (op) {
+		case MOTPROG_OP_DRIVE:
+			pAct->kind = MOTPROG_ACT_DRIVE;
+			pAct->dirA = a[0] & 0x0F;
+			pAct->dirB = a[0] >> 4;
+			pAct->spdA = spdOf(vm->pEnv, a[1]);
+			pAct->spdB = spdOf(vm->pEnv, a[2]);
+			pAct->ms = u16(&a[3]);
+			return TRUE;
+		case MOTPROG_OP_WAIT:
+			pAct->kind = MOTPROG_ACT_WAIT;
+			pAct->ms = u16(a);
+			return TRUE;
+		case MOTPROG_OP_LOOP:
+		case MOTPROG_OP_LOOPV:
+			if (vm->depth >= MOTPROG_MAX_DEPTH) { // entered again after a branch out of it
+				vm->pc = len;
+				break;
+			}
+			vm->loop[vm->depth].body = vm->pc;
+			vm->loop[vm->depth].left = loopCnt(vm->pEnv, op, a);
+			vm->depth++;
+			break;
+		case MOTPROG_OP_NEXT:
+			if (vm->depth == 0) { // branched into a loop body
+				vm->pc = len;
+				break;
+			}
+			if (--vm->loop[vm->depth - 1].left) vm->pc = vm->loop[vm->depth - 1].body;
+			else vm->depth--;
+			break;
+		case MOTPROG_OP_BR:
+			if (a[0] == MOTPROG_COND_ALWAYS || vm->pEnv->pCond(a[0])) vm->pc += (int8_t)a[1];
+			break;
+		case MOTPROG_OP_SOUND:
+			pAct->kind = MOTPROG_ACT_SOUND;
+			pAct->id = a[0];
+			return TRUE;
+		case MOTPROG_OP_LASER:
+			pAct->kind = MOTPROG_ACT_LASER;
+			pAct->id = a[0];
+			return TRUE;
+		case MOTPROG_OP_SERVO:
+			pAct->kind = MOTPROG_ACT_SERVO;
+			pAct->id = a[0];
+			pAct->angle = a[1];
+			pAct->ms = u16(&a[2]);
+			return TRUE;
+		default: // END
+			vm->pc = len;
+			break;
+		}
+	}
+	pAct->kind = (vm->pc >= len || vm->steps >= MOTPROG_STEP_LIMIT) ? MOTPROG_ACT_END : MOTPROG_ACT_NONE;
+	return pAct->kind != MOTPROG_ACT_END;
+}
+
+uint32_t motprog_time(const uint8_t* p, uint8_t len, const struct MotProgEnv* pEnv) {
+	uint64_t mult[MOTPROG_MAX_DEPTH + 1]; // runs of the op at each depth
+	uint64_t ms = 0;
+	uint8_t depth = 0;
+	mult[0] = 1;
+	for (uint8_t pc = 0; pc < len && p[pc] != MOTPROG_OP_END; pc += 1 + opLen[p[pc]]) {
+		const uint8_t* a = &p[pc + 1];
+		switch (p[pc]) {
+		case MOTPROG_OP_DRIVE:
+			ms += mult[depth] * u16(&a[3]);
+			break;
+		case MOTPROG_OP_WAIT:
+			ms += mult[depth] * u16(a);
+			break;
+		case MOTPROG_OP_LOOP:
+		case MOTPROG_OP_LOOPV:
+			mult[depth + 1] = mult[depth] * loopCnt(pEnv, p[pc], a); // 4 levels of 16 bits: no overflow
+			depth++;
+			break;
+		case MOTPROG_OP_NEXT:
+			depth--;
+			break;
+		}
+	}
+	return (ms > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)ms;
+}
+
+/* built-in patterns 1 ~ 9 */
+#define CW 1 // L298N_CW
+#define CCW 2 // L298N_CCW
+#define STP 0 // L298N_STOP
+#define MS(ms) ((ms) & 0xFF), ((ms) >> 8)
+#define DRIVE(dirA, spdA, dirB, spdB, ms) MOTPROG_OP_DRIVE, (dirA) | (dirB) << 4, (spdA), (spdB), MS(ms)
+#define WAIT(ms) MOTPROG_OP_WAIT, MS(ms)
+#define LOOP(cnt) MOTPROG_OP_LOOP, (cnt)
+#define LOOPV(param, div, min, dflt) MOTPROG_OP_LOOPV, (param), (div), (min), (dflt)
+#define NEXT MOTPROG_OP_NEXT
+#define BR(cond, rel) MOTPROG_OP_BR, (cond), (uint8_t)(rel)
+#define END MOTPROG_OP_END
+
+#define DRV MOTPROG_SPD(MOTPROG_SPD_DRV, MOTPROG_ADD_NONE)
+#define DRV_OS MOTPROG_SPD(MOTPROG_SPD_DRV, MOTPROG_ADD_OVERSHOOT)
+#define DRV_HOS MOTPROG_SPD(MOTPROG_SPD_DRV, MOTPROG_ADD_HALF_OVERSHOOT)
+#define DRV_CIR MOTPROG_SPD(MOTPROG_SPD_DRV, MOTPROG_ADD_CIRCLE)
+#define ROT MOTPROG_SPD(MOTPROG_SPD_ROT, MOTPROG_ADD_NONE)
+#define ROT_OS MOTPROG_SPD(MOTPROG_SPD_ROT, MOTPROG_ADD_OVERSHOOT)
+#define ROT_HOS MOTPROG_SPD(MOTPROG_SPD_ROT, MOTPROG_ADD_HALF_OVERSHOOT)
+#define MIN_ROT MOTPROG_SPD(MOTPROG_SPD_MIN_ROT, MOTPROG_ADD_NONE) // not affected by speed multiplier
+#define DEF_ROT MOTPROG_SPD(MOTPROG_SPD_DEF_ROT, MOTPROG_ADD_NONE)
+#define INTV MOTPROG_PARAM_INTV
+
+static const uint8_t pat1[] = { // Waltz(S-shaped route zig-zaging)
+	DRIVE(CCW, DEF_ROT, CW, MIN_ROT, 500), // initial rotation
+	LOOPV(INTV, 3, 2, 1),
+		DRIVE(CCW, DRV, CW, DRV, 500), // forward
+		DRIVE(CCW, MIN_ROT, CW, DEF_ROT, 1500),
+		DRIVE(CCW, DRV, CW, DRV, 500),
+		DRIVE(CCW, DEF_ROT, CW, MIN_ROT, 1500),
+	NEXT, END
+};
+
+static const uint8_t pat2[] = { // loop of sudden accel., decel.
+	LOOPV(INTV, 20, 2, 1),
+		LOOP(4), // forward
+			DRIVE(CCW, DRV_OS, CW, DRV_OS, 800),
+			DRIVE(CCW, DRV, CW, DRV, 700),
+			DRIVE(CCW, 0, CW, 0, 1000),
+		NEXT,
+		LOOP(4), // backward
+			DRIVE(CW, DRV_OS, CCW, DRV_OS, 800),
+			DRIVE(CW, DRV, CCW, DRV, 700),
+			DRIVE(CW, 0, CCW, 0, 1000),
+		NEXT,
+	NEXT, END
+};
+
+static const uint8_t pat3[] = { // crawling, left wheel forwards a little bit, right goes next, then left goes again...
+	LOOPV(INTV, 10, 2, 1),
+		LOOP(5),
+			DRIVE(CCW, DRV, CW, MIN_ROT, 1000),
+			DRIVE(CCW, MIN_ROT, CW, DRV, 1000),
+		NEXT,
+		LOOP(5),
+			DRIVE(CW, ROT, STP, 0, 1000),
+			DRIVE(STP, 0, CCW, ROT, 1000),
+		NEXT,
+	NEXT, END
+};
+
+static const uint8_t pat4[] = { // draw circle fast: interval seconds, 10 if under 2
+	LOOPV(INTV, 1, 2, 10),
+		DRIVE(CCW, DRV_CIR, CCW, ROT, 1000), // right
+	NEXT, END
+};
+
+static const uint8_t pat5[] = { // shake the toy left and right but doesn't go anywhere. faster than pattern 8
+	LOOPV(INTV, 1, 2, 10),
+		DRIVE(CCW, ROT_OS, CCW, ROT_OS, 400), // right
+		DRIVE(CCW, ROT, CCW, ROT, 600),
+		DRIVE(CCW, 0, CCW, 0, 250),
+		DRIVE(CW, ROT_OS, CW, ROT_OS, 400), // left
+		DRIVE(CW, ROT, CW, ROT, 600),
+		DRIVE(CW, 0, CW, 0, 250),
+	NEXT, END
+};
+
+static const uint8_t pat6[] = { // rotate, go to somewhere else, then rotate again
+	LOOPV(INTV, 6, 2, 1),
+		DRIVE(CCW, ROT, CCW, ROT, 7000), // right
+		DRIVE(CCW, DRV, CW, DRV, 5000), // forward
+		DRIVE(CW, ROT, CW, ROT, 7000), // left
+		DRIVE(CW, DRV, CCW, DRV, 5000), // backward
+	NEXT, END
+};
+
+static const uint8_t pat7[] = { // wait until something reaches in front of IR sensor, then flee backwards. gives up after the wait time
+	LOOPV(MOTPROG_PARAM_WAIT, 1, 1, 1), // seconds
+		LOOP(10),
+			BR(MOTPROG_COND_IR_NEAR, 6), // to flee
+			WAIT(100),
+		NEXT,
+	NEXT, END,
+	DRIVE(CW, DRV_OS, CCW, DRV_OS, 500), // flee: backward
+	DRIVE(CW, DRV, CCW, DRV, 1000),
+	END
+};
+
+static const uint8_t pat8[] = { // shake the toy left and right, flee to somewhere else, then shake the toy again
+	LOOPV(INTV, 2, 2, 2),
+		LOOP(5), // shake
+			DRIVE(CW, ROT_HOS, CW, ROT_HOS, 400), // left
+			DRIVE(CW, ROT, CW, ROT, 600),
+			DRIVE(CW, 0, CW, 0, 100),
+			DRIVE(CCW, ROT_HOS, CCW, ROT_HOS, 400), // right
+			DRIVE(CCW, ROT, CCW, ROT, 600),
+			DRIVE(CCW, 0, CCW, 0, 100),
+		NEXT,
+		DRIVE(CCW, DRV_HOS, CW, DRV_HOS, 200), // forward
+		DRIVE(CCW, DRV, CW, DRV, 300),
+		DRIVE(CCW, 0, CW, 0, 200),
+		LOOP(5), // shake again
+			DRIVE(CW, ROT_HOS, CW, ROT_HOS, 400), // left
+			DRIVE(CW, ROT, CW, ROT, 600),
+			DRIVE(CW, 0, CW, 0, 100),
+			DRIVE(CCW, ROT_HOS, CCW, ROT_HOS, 400), // right
+			DRIVE(CCW, ROT, CCW, ROT, 600),
+			DRIVE(CCW, 0, CCW, 0, 100),
+		NEXT,
+	NEXT, END
+};
+
+static const uint8_t pat9[] = { // stand still, move toy left and right like the robot is fishing horizontally
+	WAIT(400),
+	LOOPV(INTV, 2, 4, 3), // at least 3 times
+		DRIVE(CW, ROT, CW, ROT, 1000), // left slow
+		DRIVE(STP, 0, STP, 0, 500),
+		DRIVE(CW, ROT, CW, ROT, 500), // right fast
+		DRIVE(STP, 0, STP, 0, 500),
+	NEXT, END
+};
+
+static const struct {
+	const uint8_t* p;
+	uint8_t len;
+} builtin[MOTPROG_BUILTIN_CNT] = {
+	{ pat1, sizeof(pat1) }, { pat2, sizeof(pat2) }, { pat3, sizeof(pat3) },
+	{ pat4, sizeof(pat4) }, { pat5, sizeof(pat5) }, { pat6, sizeof(pat6) },
+	{ pat7, sizeof(pat7) }, { pat8, sizeof(pat8) }, { pat9, sizeof(pat9) },
+};
+
+const uint8_t* motprog_builtin(uint8_t code, uint8_t* pLen) {
+	if (code < 1 || code > MOTPROG_BUILTIN_CNT) return NULL;
+	*pLen = builtin[code - 1].len;
+	return builtin[code - 1].p;
+}
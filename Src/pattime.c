@@ -0,0 +1,32 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : pattime.c
+  * BRIEF INFORMATION: GENERATED BY tools/gen_pattime.py. DO NOT EDIT.
+  * 				   Play time of built-in patterns 1 ~ 9, also in rpi/pattime.json.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#include "pattime.h"
+#include "motprog.h"
+
+_Static_assert(PATTIME_STEP_LIMIT == MOTPROG_STEP_LIMIT, "pattime out of date: run tools/gen_pattime.py");
+_Static_assert(PATTIME_CNT == MOTPROG_BUILTIN_CNT, "pattime out of date: run tools/gen_pattime.py");
+
+const struct PatTime pattime[PATTIME_CNT + 1] = {
+	{ 0, 0, 0, 0, 0, 0 },
+	{ 500, 4000, 3, 2, 1, 19999 }, // 1: Waltz(S-shaped route zig-zaging)
+	{ 0, 20000, 20, 2, 1, 2857 }, // 2: loop of sudden accel., decel.
+	{ 0, 20000, 10, 2, 1, 3030 }, // 3: crawling, left wheel forwards a little bit, right goes next, then left goes again...
+	{ 0, 1000, 1, 2, 10, 49999 }, // 4: draw circle fast: interval seconds, 10 if under 2
+	{ 0, 2500, 1, 2, 10, 14285 }, // 5: shake the toy left and right but doesn't go anywhere. faster than pattern 8
+	{ 0, 24000, 6, 2, 1, 19999 }, // 6: rotate, go to somewhere else, then rotate again
+	{ 20000, 0, 0, 0, 0, 0 }, // 7: wait until something reaches in front of IR sensor, then flee backwards. gives up after the wait time
+	{ 0, 22700, 2, 2, 2, 1315 }, // 8: shake the toy left and right, flee to somewhere else, then shake the toy again
+	{ 400, 2500, 2, 4, 3, 19999 }, // 9: stand still, move toy left and right like the robot is fishing horizontally
+};
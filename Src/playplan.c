@@ -0,0 +1,81 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : playplan.c
+  * BRIEF INFORMATION: play time budget of an autoplay session
+  * 				   No hardware access: also built on host by tools/playplan_check.py.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#include "playplan.h"
+
+static uint32_t minCost(const struct PlayPlanCost* pc) {
+	uint64_t ms = (uint64_t)pc->baseMs + pc->repMs;
+	return (ms > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)ms;
+}
+
+void playplan_begin(struct PlayPlan* pl, uint32_t now, uint32_t budgetMs) {
+	pl->start = now;
+	pl->budget = budgetMs;
+	pl->aheadMs = 0;
+	pl->flexAhead = 0;
+	pl->itemStart = now;
+	pl->itemPlan = 0;
+	pl->inItem = FALSE;
+	pl->plannedMs = 0;
+	pl->actualMs = 0;
+	pl->worstMs = 0;
+	pl->items = 0;
+	pl->overruns = 0;
+}
+
+void playplan_add(struct PlayPlan* pl, const struct PlayPlanCost* pc, uint32_t cnt) {
+	uint64_t ms = (uint64_t)pl->aheadMs + (uint64_t)minCost(pc) * cnt;
+	pl->aheadMs = (ms > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)ms;
+	if (pc->repMs) pl->flexAhead = (pl->flexAhead + cnt < pl->flexAhead) ? 0xFFFFFFFF : pl->flexAhead + cnt;
+}
+
+uint16_t playplan_start(struct PlayPlan* pl, uint32_t now, const struct PlayPlanCost* pc) {
+	uint32_t min = minCost(pc);
+	uint16_t reps = 0;
+	pl->aheadMs = (pl->aheadMs > min) ? pl->aheadMs - min : 0;
+	pl->itemPlan = pc->baseMs;
+	if (pc->repMs) {
+		if (pl->flexAhead) pl->flexAhead--;
+		// slack: budget left after every item ahead played once. this item takes its share, the rest waits for the others
+		int64_t slack = (int64_t)playplan_left(pl, now) - pl->aheadMs - min;
+		uint64_t r = 1;
+		if (slack > 0) r += ((uint64_t)slack / ((uint64_t)pl->flexAhead + 1) + pc->repMs / 2) / pc->repMs;
+		uint16_t max = pc->maxReps ? pc->maxReps : PLAYPLAN_MAX_REPS;
+		reps = (r > max) ? max : (uint16_t)r;
+		uint64_t ms = (uint64_t)pc->baseMs + (uint64_t)pc->repMs * reps;
+		pl->itemPlan = (ms > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)ms;
+	}
+	pl->itemStart = now;
+	pl->inItem = TRUE;
+	return reps;
+}
+
+void playplan_end(struct PlayPlan* pl, uint32_t now) {
+	if (!pl->inItem) return;
+	uint32_t actual = now - pl->itemStart;
+	int64_t err = (int64_t)actual - pl->itemPlan;
+	pl->inItem = FALSE;
+	pl->plannedMs += pl->itemPlan;
+	pl->actualMs += actual;
+	if ((err >= 0 ? err : -err) > (pl->worstMs >= 0 ? pl->worstMs : -(int64_t)pl->worstMs)) {
+		pl->worstMs = (err > INT32_MAX) ? INT32_MAX : (err < -INT32_MAX) ? -INT32_MAX : (int32_t)err;
+	}
+	if (err > PLAYPLAN_OVERRUN_MS && pl->overruns < 0xFFFF) pl->overruns++;
+	if (pl->items < 0xFFFF) pl->items++;
+}
+
+uint32_t playplan_left(const struct PlayPlan* pl, uint32_t now) {
+	uint32_t elapsed = now - pl->start;
+	return (elapsed < pl->budget) ? pl->budget - elapsed : 0;
+}
@@ -0,0 +1,32 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : port.c
+  * BRIEF INFORMATION: call recorder of host backend of port layer.
+  * 				   Other backends are header only; this file compiles to nothing for them.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#include "port.h"
+
+#if PORT_BACKEND == PORT_BACKEND_HOST
+
+struct PortHostCall portHostLog[PORT_HOST_LOG_LEN];
+unsigned portHostLogCnt = 0;
+uint16_t portHostGpioIn = 0xFFFF; // inputs idle high(rpi pins and vibration sensor are active low)
+uint32_t portHostAdcVal = 0;
+
+void port_host_record(portOpTypeDef op, void* target, uint32_t arg) {
+	struct PortHostCall* pc = &portHostLog[portHostLogCnt % PORT_HOST_LOG_LEN];
+	pc->op = op;
+	pc->target = target;
+	pc->arg = arg;
+	portHostLogCnt++;
+}
+
+#endif
@@ -14,11 +14,48 @@
 
 #include "carebotCore.h"
 #include "rpicomm.h"
+#include "port.h"
 
 static UART_HandleTypeDef* pUartHandle = NULL;
 
-static struct SerialDta UARTdta;
-static uint8_t rxBuf[DTA_LEN + 1] = { 0, };
+#define RX_QUEUE_LEN (RPI_WINDOW + 1) // ring buffer: one slot is kept empty
+
+static struct SerialDta rxQueue[RX_QUEUE_LEN]; // frames waiting for app
+static uint32_t rxQueueTick[RX_QUEUE_LEN]; // arrival time of each frame
+static volatile uint8_t rxqHead = 0; // written by rx interrupt
+static volatile uint8_t rxqTail = 0; // read by app
+static struct RpiLinkStats linkStat;
+static uint8_t txBuf[RPI_TX_BUF_SIZE];
+static volatile uint16_t txHead = 0;
+static volatile uint16_t txTail = 0;
+static volatile uint16_t txBusyLen = 0; // bytes handed to UART, 0 if idle
+static uint8_t dmaBuf[RPI_RX_DMA_SIZE]; // written by circular DMA
+static uint16_t dmaPos = 0; // next unparsed byte in dmaBuf
+static uint8_t acc[RPI_MAX_PAYLOAD + RPI_FRAME_OVERHEAD]; // bytes of a frame candidate. fits the longest frame
+static uint16_t accLen = 0;
+static _Bool crcNakSent; // one NAK CRC per rx event: resync may hit false syncs inside the bad frame
+static uint16_t crcBadSpan = 0; // bytes left of the last frame with bad CRC. no ASCII frame may start inside it
+static _Bool asciiOff = FALSE; // TRUE after a valid binary frame: a binary Pi never sends ASCII. cleared by baud fallback or silence
+static uint8_t expectedSeq;
+static _Bool seqSynced = FALSE; // FALSE until first binary frame: accept any seq
+static uint16_t quality = RPI_QUALITY_MAX;
+static uint8_t (*pTelemetryFunc)(uint8_t* pPayload) = NULL;
+static volatile uint16_t tlmIntv = RPI_TLM_DEF_INTV;
+static uint16_t tlmCnt = 0;
+
+#define BAUD_STABLE 0
+#define BAUD_SWITCH 1 // switch to baudPending when tx is drained, then verify
+#define BAUD_FALLBACK 2 // fall back to baudPending when tx is drained
+#define BAUD_VERIFYING 3 // waiting for test patterns at new rate
+
+static const uint32_t baudList[] = RPI_BAUD_LIST;
+static volatile uint8_t baudState = BAUD_STABLE;
+static uint32_t baudPending;
+static uint32_t baudPrev; // rate to revert to if verification fails
+static uint32_t baudVerifyStart;
+static uint8_t baudGoodTests;
+static volatile uint32_t lastValidTick; // last frame with valid CRC
+static uint32_t errCntPrev; // line errors counted until last second
 //static uint8_t txBuf[8] = { 0, };
 
 static uint8_t opcode = 0;
@@ -29,14 +66,49 @@ void rpi_setHandle(UART_HandleTypeDef* ph) {
 }
 
 int rpi_getSerialDta(struct SerialDta* pDest) {
-	if (UARTdta.available) { // has new received data
-		*pDest = UARTdta; // copy from internal var to dest var
-		UARTdta.available = 0; // mark unavailable
+	uint32_t lat;
+	if (rxqHead != rxqTail) { // has new received data
+		*pDest = rxQueue[rxqTail]; // copy from internal var to dest var
+		pDest->tick = rxQueueTick[rxqTail];
+		lat = HAL_GetTick() - rxQueueTick[rxqTail];
+		rxqTail = (rxqTail + 1) % RX_QUEUE_LEN; // mark unavailable
+		if (linkStat.latCnt == 0 || lat < linkStat.latMin) linkStat.latMin = lat;
+		if (lat > linkStat.latMax) linkStat.latMax = lat;
+		linkStat.latSum += lat;
+		linkStat.latCnt++;
 		return 1;
 	}
 	else return 0;
 }
 
+struct RpiLinkStats rpi_getLinkStat() {
+	return linkStat;
+}
+
+uint8_t rpi_getLinkQuality() { // 0 ~ 100
+	return (uint8_t)((quality + RPI_QUALITY_MAX / 200) / (RPI_QUALITY_MAX / 100));
+}
+
+static void qualityGood() {
+	quality += (RPI_QUALITY_MAX - quality + 31) / 32;
+}
+
+static void qualityBad() {
+	quality -= quality / 8;
+}
+
+uint16_t rpi_crc16(const uint8_t* pDta, uint16_t len, uint16_t crc) { // pass 0xFFFF as crc to start
+	static const uint16_t nibbleTbl[16] = {
+		0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+		0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+	};
+	for (uint16_t i = 0; i < len; i++) {
+		crc = (uint16_t)(crc << 4) ^ nibbleTbl[(crc >> 12) ^ (pDta[i] >> 4)];
+		crc = (uint16_t)(crc << 4) ^ nibbleTbl[(crc >> 12) ^ (pDta[i] & 0x0F)];
+	}
+	return crc;
+}
+
 _Bool rpi_foundCat() {
 	if (isCatFound == TRUE) {
 		isCatFound = FALSE; // clear flag
@@ -47,10 +119,96 @@ _Bool rpi_foundCat() {
 }
 
 int rpi_serialDtaAvailable() { // returns zero if not available
-	if (UARTdta.available) return 1;
+	if (rxqHead != rxqTail) return 1;
 	else return 0;
 }
 
+uint8_t rpi_rxQueueDepth() { // frames waiting for app
+	return (uint8_t)((rxqHead + RX_QUEUE_LEN - rxqTail) % RX_QUEUE_LEN);
+}
+
+static void startTx() { // send contiguous part of tx ring. call with interrupts disabled
+	uint16_t len;
+	if (txBusyLen != 0 || txHead == txTail) return;
+	len = (txHead > txTail) ? (txHead - txTail) : (RPI_TX_BUF_SIZE - txTail);
+	txBusyLen = len;
+	if (pUartHandle->hdmatx != NULL) HAL_UART_Transmit_DMA(pUartHandle, &txBuf[txTail], len); // CubeMX: DMA Request USART2_TX, Mode Normal
+	else HAL_UART_Transmit_IT(pUartHandle, &txBuf[txTail], len); // one interrupt per byte
+}
+
+_Bool rpi_sendFrame(uint8_t type, const uint8_t* pPayload, uint8_t len) { // queue a binary frame, sent by interrupt. returns FALSE if tx buffer is full
+	static uint8_t txSeq = 0;
+	uint8_t hdr[4];
+	uint16_t crc, used, pos;
+	uint32_t primask;
+	if (len > RPI_MAX_PAYLOAD || pUartHandle == NULL) return FALSE;
+
+	primask = __get_PRIMASK(); // called from rx interrupt for ACK and from app
+	__disable_irq();
+	used = (txHead + RPI_TX_BUF_SIZE - txTail) % RPI_TX_BUF_SIZE;
+	if (RPI_TX_BUF_SIZE - 1 - used < (uint16_t)len + RPI_FRAME_OVERHEAD) {
+		linkStat.txDrops++;
+		__set_PRIMASK(primask);
+		return FALSE;
+	}
+	hdr[0] = RPI_FRAME_SYNC;
+	hdr[1] = type;
+	hdr[2] = len;
+	hdr[3] = txSeq++;
+	crc = rpi_crc16(&hdr[1], 3, 0xFFFF);
+	crc = rpi_crc16(pPayload, len, crc);
+	pos = txHead;
+	for (int i = 0; i < 4; i++, pos = (pos + 1) % RPI_TX_BUF_SIZE) txBuf[pos] = hdr[i];
+	for (int i = 0; i < len; i++, pos = (pos + 1) % RPI_TX_BUF_SIZE) txBuf[pos] = pPayload[i];
+	txBuf[pos] = (uint8_t)crc;
+	pos = (pos + 1) % RPI_TX_BUF_SIZE;
+	txBuf[pos] = (uint8_t)(crc >> 8);
+	txHead = (pos + 1) % RPI_TX_BUF_SIZE;
+	startTx();
+	__set_PRIMASK(primask);
+	return TRUE;
+}
+
+static void sendResp(uint8_t type, uint8_t seq, uint8_t res) {
+	uint8_t payload[2] = { seq, res };
+	if (rpi_sendFrame(type, payload, 2)) {
+		if (type == TYPE_ACK) linkStat.acks++;
+		else linkStat.naks++;
+	}
+}
+
+static void putU32(uint8_t* p, uint32_t v) {
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t errAge(uint32_t cnt, uint32_t tick, uint32_t now) {
+	if (cnt == 0) return RPI_LST_NEVER;
+	return now - tick;
+}
+
+static void sendLinkStat() { // answer to TYPE_LINK_STAT_REQ
+	uint8_t p[RPI_LST_SIZE];
+	uint32_t now = HAL_GetTick();
+	p[RPI_LST_QUALITY] = rpi_getLinkQuality();
+	putU32(&p[RPI_LST_ORE], linkStat.oreErrs);
+	putU32(&p[RPI_LST_FE], linkStat.feErrs);
+	putU32(&p[RPI_LST_NE], linkStat.neErrs);
+	putU32(&p[RPI_LST_PE], linkStat.peErrs);
+	putU32(&p[RPI_LST_RESTARTS], linkStat.rxRestarts);
+	putU32(&p[RPI_LST_CRC], linkStat.crcErrs);
+	putU32(&p[RPI_LST_LEN_ERR], linkStat.lenErrs);
+	putU32(&p[RPI_LST_DISCARDED], linkStat.bytesDiscarded);
+	putU32(&p[RPI_LST_FRAMES], linkStat.frames);
+	putU32(&p[RPI_LST_ORE_AGE], errAge(linkStat.oreErrs, linkStat.lastOreTick, now));
+	putU32(&p[RPI_LST_FE_AGE], errAge(linkStat.feErrs, linkStat.lastFeTick, now));
+	putU32(&p[RPI_LST_NE_AGE], errAge(linkStat.neErrs, linkStat.lastNeTick, now));
+	putU32(&p[RPI_LST_PE_AGE], errAge(linkStat.peErrs, linkStat.lastPeTick, now));
+	rpi_sendFrame(TYPE_LINK_STAT, p, RPI_LST_SIZE);
+}
+
 /*
 int rpi_tcpipRespond(uint8_t isErr) { // send RESP pkt to client app. returns OK on success
 	uint8_t buf[8] = { 0, };
@@ -67,45 +225,391 @@ void rpi_sendPin(int code) {
 	core_call_pendingOpCancel(opcode);
 	switch (code) {
 	case RPI_PINCODE_O_SCHEDULE_EXE:
-		HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_EXE, GPIO_PIN_RESET);
+		port_gpio_reset(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_EXE);
 		break;
 		/*
 	case RPI_PINCODE_O_SCHEDULE_END:
-		HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_END, GPIO_PIN_SET);
+		port_gpio_set(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_END);
 		break;
 		*/
 	case RPI_PINCODE_O_FIND_CAT_TIMEOUT:
-		HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT, GPIO_PIN_RESET);
+		port_gpio_reset(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT);
 		break;
 	}
 	core_call_pendingOpAdd(opcode, RPI_PIN_SEND_WAITING_TIME);
 }
 
 core_statRetTypeDef rpi_pendingOpTimeoutHandler() {
-	HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_EXE, GPIO_PIN_SET);
+	port_gpio_set(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_EXE);
 	//HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_END, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT, GPIO_PIN_SET);
+	port_gpio_set(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT);
 	return OK;
 }
 
-static core_statRetTypeDef rpi_RxCpltCallbackHandler(UART_HandleTypeDef *huart) {
-	//if (huart->Instance != pUartHandle->Instance) return ERR;
-	//if (huart->Instance != USART2) return ERR;
+static void setBaud(uint32_t baud) { // change rate of running UART. tx must be idle, rx DMA keeps running
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	__HAL_UART_DISABLE(pUartHandle); // BRR is writable only while UE is 0
+	pUartHandle->Init.BaudRate = baud;
+	pUartHandle->Instance->BRR = (HAL_RCC_GetPCLK1Freq() + baud / 2) / baud; // oversampling 16
+	__HAL_UART_CLEAR_OREFLAG(pUartHandle);
+	__HAL_UART_CLEAR_FEFLAG(pUartHandle);
+	__HAL_UART_CLEAR_NEFLAG(pUartHandle);
+	__HAL_UART_ENABLE(pUartHandle);
+	accLen = 0; // bytes received at the old rate
+	crcBadSpan = 0;
+	linkStat.baud = baud;
+	lastValidTick = HAL_GetTick();
+	__set_PRIMASK(primask);
+}
+
+static void sendBaudInfo(uint8_t res, uint32_t baud, _Bool withList) {
+	uint8_t p[5 + sizeof(baudList)];
+	uint8_t len = 5;
+	p[0] = res;
+	putU32(&p[1], baud);
+	if (withList) {
+		for (unsigned i = 0; i < sizeof(baudList) / sizeof(baudList[0]); i++, len += 4)
+			putU32(&p[len], baudList[i]);
+	}
+	rpi_sendFrame(TYPE_BAUD_INFO, p, len);
+}
+
+static void applyPendingBaud() { // call with tx ring empty
+	if (baudState == BAUD_SWITCH) {
+		baudPrev = linkStat.baud;
+		setBaud(baudPending);
+		baudGoodTests = 0;
+		baudVerifyStart = HAL_GetTick();
+		baudState = BAUD_VERIFYING;
+	}
+	else if (baudState == BAUD_FALLBACK) {
+		setBaud(baudPending);
+		baudState = BAUD_STABLE;
+		asciiOff = FALSE; // Pi may have restarted in ASCII mode
+		linkStat.baudFallbacks++;
+		sendBaudInfo(RPI_BAUD_RES_FALLBACK, baudPending, FALSE);
+	}
+}
+
+static void baudFallback(uint32_t baud) { // applied when tx is drained
+	baudPending = baud;
+	baudState = BAUD_FALLBACK;
+}
+
+static void baudRequest(const uint8_t* p, uint8_t len) { // TYPE_BAUD
+	uint32_t baud;
+	unsigned i;
+	if (len < 4) {
+		sendBaudInfo(RPI_BAUD_RES_CAPS, linkStat.baud, TRUE);
+		return;
+	}
+	baud = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	for (i = 0; i < sizeof(baudList) / sizeof(baudList[0]); i++) {
+		if (baudList[i] == baud) break;
+	}
+	if (i == sizeof(baudList) / sizeof(baudList[0]) || baudState != BAUD_STABLE) {
+		sendBaudInfo(RPI_BAUD_RES_UNSUPPORTED, baud, FALSE);
+		return;
+	}
+	sendBaudInfo(RPI_BAUD_RES_SWITCH, baud, FALSE);
+	baudPending = baud;
+	baudState = BAUD_SWITCH; // ACK of this frame is queued next. switch in rpi_txCpltHandler after both are sent
+}
+
+static void baudTest(const uint8_t* p, uint8_t len) { // TYPE_BAUD_TEST: echo and count good patterns
+	uint8_t echo[RPI_MAX_PAYLOAD];
+	uint8_t bad = 0;
+	if (len > RPI_MAX_PAYLOAD - 1) len = RPI_MAX_PAYLOAD - 1;
+	for (uint8_t i = 0; i < len; i++) {
+		if (p[i] != RPI_BAUD_TEST_BYTE(i)) bad = 1;
+		echo[i + 1] = p[i];
+	}
+	echo[0] = bad;
+	rpi_sendFrame(TYPE_BAUD_ECHO, echo, len + 1);
+	if (baudState == BAUD_VERIFYING && !bad && ++baudGoodTests >= RPI_BAUD_TEST_CNT) {
+		baudState = BAUD_STABLE;
+		linkStat.baudSwitches++;
+		sendBaudInfo(RPI_BAUD_RES_VERIFIED, linkStat.baud, FALSE);
+	}
+}
+
+void rpi_txCpltHandler(UART_HandleTypeDef *huart) { // call this from HAL_UART_TxCpltCallback
+	if (pUartHandle == NULL || huart->Instance != pUartHandle->Instance) return;
+	txTail = (txTail + txBusyLen) % RPI_TX_BUF_SIZE;
+	txBusyLen = 0;
+	if (txHead == txTail && (baudState == BAUD_SWITCH || baudState == BAUD_FALLBACK)) applyPendingBaud();
+	startTx();
+}
 
+static _Bool frameDone(uint8_t type, uint8_t len, uint8_t seq, const uint8_t* pPayload) { // returns FALSE if rx queue is full
+	struct SerialDta* pd;
+	uint8_t next = (rxqHead + 1) % RX_QUEUE_LEN;
 	// check if found cat message
-	if (rxBuf[0] == 'I' && rxBuf[1] == '1') {
+	if (type == TYPE_FOUNDCAT && len >= 1 && pPayload[0] == '1') {
 		isCatFound = TRUE; // doesn't copy data from buffer; set flag only
+		return TRUE;
 	}
-	else {
-		UARTdta.available = 1; // mark data is available
-		UARTdta.type = rxBuf[0]; // copy data from buffer to internal var
-		for (int i = 0; i < DTA_LEN - 1; i++)
-			UARTdta.container[i] = rxBuf[i + 1];
-		UARTdta.container[7] = 0;
+	if (type == TYPE_LINK_RESET) return TRUE;
+	if (type == TYPE_LINK_STAT_REQ) {
+		sendLinkStat();
+		return TRUE;
+	}
+	if (type == TYPE_BAUD) {
+		baudRequest(pPayload, len);
+		return TRUE;
 	}
-	for (int i = 0; i < DTA_LEN + 1; i++) // clr buf
-		rxBuf[i] = 0;
-	HAL_UART_Receive_IT(pUartHandle, rxBuf, DTA_LEN); // restart rx
+	if (type == TYPE_BAUD_TEST) {
+		baudTest(pPayload, len);
+		return TRUE;
+	}
+	if (type == TYPE_TELEMETRY_CFG) {
+		if (len >= 2) rpi_setTelemetryInterval((uint16_t)(pPayload[0] | ((uint16_t)pPayload[1] << 8)));
+		return TRUE;
+	}
+	if (type == TYPE_MANUAL_STREAM && len <= RPI_MST_SIZE) { // only the newest stick position matters
+		uint8_t last = (rxqHead + RX_QUEUE_LEN - 1) % RX_QUEUE_LEN;
+		// merge into newest queued frame. never the one at tail: app may be copying it
+		if (rxqHead != rxqTail && last != rxqTail && rxQueue[last].type == TYPE_MANUAL_STREAM) {
+			pd = &rxQueue[last];
+			pd->len = len;
+			pd->seq = seq;
+			for (int i = 0; i < len; i++)
+				pd->container[i] = pPayload[i];
+			pd->container[len] = 0;
+			rxQueueTick[last] = HAL_GetTick();
+			linkStat.coalesced++;
+			return TRUE;
+		}
+	}
+	if (next == rxqTail) return FALSE;
+	pd = &rxQueue[rxqHead];
+	pd->available = 1;
+	pd->type = type; // copy data from buffer to internal var
+	pd->len = len;
+	pd->seq = seq;
+	for (int i = 0; i < len; i++)
+		pd->container[i] = pPayload[i];
+	pd->container[len] = 0;
+	rxQueueTick[rxqHead] = HAL_GetTick();
+	rxqHead = next; // mark data is available
+	return TRUE;
+}
+
+static void binFrameDone(uint8_t rxType, uint8_t rxLen, uint8_t rxSeq, const uint8_t* pPayload) { // in-order delivery: only expectedSeq is accepted
+	uint8_t behind = (uint8_t)(expectedSeq - rxSeq);
+	if (rxType == TYPE_LINK_RESET || seqSynced == FALSE) {
+		expectedSeq = rxSeq;
+		seqSynced = TRUE;
+	}
+	else if (rxSeq != expectedSeq) {
+		if (behind >= 1 && behind <= RPI_WINDOW * 2) { // retransmitted: our ACK was lost
+			linkStat.dupFrames++;
+			sendResp(TYPE_ACK, rxSeq, RPI_RES_DUP);
+		}
+		else {
+			linkStat.orderErrs++;
+			sendResp(TYPE_NAK, expectedSeq, RPI_RES_ORDER);
+		}
+		return;
+	}
+	if (frameDone(rxType, rxLen, rxSeq, pPayload) == FALSE) {
+		linkStat.busyNaks++;
+		sendResp(TYPE_NAK, rxSeq, RPI_RES_BUSY);
+		return;
+	}
+	expectedSeq++;
+	linkStat.binFrames++;
+	sendResp(TYPE_ACK, rxSeq, RPI_RES_OK);
+}
+
+#if RPI_ASCII_COMPAT
+static _Bool isAsciiType(uint8_t c) {
+	switch (c) {
+	case TYPE_SCHEDULE_TIME:
+	case TYPE_SCHEDULE_PATTERN:
+	case TYPE_SCHEDULE_SNACK_INTERVAL:
+	case TYPE_SCHEDULE_SPEED:
+	case TYPE_SYS:
+	case TYPE_MANUAL_CTRL:
+	case TYPE_SCHEDULE_DURATION:
+	case TYPE_SCHEDULE_START:
+	case TYPE_SCHEDULE_END:
+	case TYPE_FOUNDCAT:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+#endif
+
+static uint16_t tryFrame() { // decode frame at start of acc. returns bytes consumed, 0 if more bytes are needed
+	uint16_t total, crc;
+	if (acc[0] == RPI_FRAME_SYNC) {
+		if (accLen < 3) return 0;
+		if (acc[2] > RPI_MAX_PAYLOAD) { // cannot be a frame
+			linkStat.lenErrs++;
+			qualityBad();
+			goto lbl_discard;
+		}
+		total = (uint16_t)acc[2] + RPI_FRAME_OVERHEAD;
+		if (accLen < total) return 0;
+		crc = rpi_crc16(&acc[1], (uint16_t)acc[2] + 3, 0xFFFF);
+		if (crc != (uint16_t)(acc[total - 2] | ((uint16_t)acc[total - 1] << 8))) {
+			if (crcNakSent == FALSE) {
+				linkStat.crcErrs++;
+				qualityBad();
+				sendResp(TYPE_NAK, acc[3], RPI_RES_CRC);
+				crcNakSent = TRUE;
+			}
+			if (total > crcBadSpan) crcBadSpan = total; // SEQ and payload of the bad frame may look like an ASCII frame
+			goto lbl_discard; // drop sync byte only: a good frame may start inside
+		}
+		linkStat.frames++;
+		lastValidTick = HAL_GetTick();
+		asciiOff = TRUE;
+		qualityGood();
+		binFrameDone(acc[1], acc[2], acc[3], &acc[4]);
+		return total;
+	}
+#if RPI_ASCII_COMPAT
+	if (asciiOff == FALSE && crcBadSpan == 0 && isAsciiType(acc[0])) { // 8-character frame: type + 7 printable characters
+		if (accLen < DTA_LEN) return 0;
+		for (int i = 1; i < DTA_LEN; i++) {
+			if (acc[i] < 0x20 || acc[i] > 0x7E) goto lbl_discard;
+		}
+		linkStat.frames++;
+		if (frameDone(acc[0], DTA_LEN - 1, 0, &acc[1]) == TRUE) linkStat.asciiFrames++; // dropped if queue is full. ASCII frames are not acknowledged
+		return DTA_LEN;
+	}
+#endif
+	lbl_discard:
+	linkStat.bytesDiscarded++;
+	return 1;
+}
+
+static void parseBytes(const uint8_t* p, uint16_t n) {
+	uint16_t cnt, used;
+	while (n > 0) {
+		cnt = sizeof(acc) - accLen;
+		if (cnt > n) cnt = n;
+		for (uint16_t i = 0; i < cnt; i++) acc[accLen++] = p[i];
+		p += cnt;
+		n -= cnt;
+		while (accLen > 0 && (used = tryFrame()) > 0) { // full acc always decodes or discards
+			accLen -= used;
+			crcBadSpan = (crcBadSpan > used) ? crcBadSpan - used : 0;
+			for (uint16_t i = 0; i < accLen; i++) acc[i] = acc[i + used];
+		}
+	}
+}
+
+void rpi_rxEventHandler(UART_HandleTypeDef *huart, uint16_t size) { // call this from HAL_UARTEx_RxEventCallback
+	if (pUartHandle == NULL || huart->Instance != pUartHandle->Instance) return;
+	// size: DMA write position. called on idle line, half and full transfer
+	linkStat.rxEvents++;
+	crcNakSent = FALSE;
+	if (size < dmaPos) { // wrapped
+		linkStat.bytesRx += RPI_RX_DMA_SIZE - dmaPos;
+		parseBytes(&dmaBuf[dmaPos], RPI_RX_DMA_SIZE - dmaPos);
+		dmaPos = 0;
+	}
+	if (size > dmaPos) {
+		linkStat.bytesRx += size - dmaPos;
+		parseBytes(&dmaBuf[dmaPos], size - dmaPos);
+		dmaPos = size;
+	}
+	if (dmaPos >= RPI_RX_DMA_SIZE) dmaPos = 0;
+}
+
+static void restartRx() { // restart DMA reception if it has stopped. rx queue and sequence state are kept
+	uint32_t primask;
+	if (pUartHandle->RxState == HAL_UART_STATE_BUSY_RX) return;
+	primask = __get_PRIMASK(); // called from UART error interrupt and sec timer
+	__disable_irq();
+	__HAL_UART_CLEAR_OREFLAG(pUartHandle);
+	__HAL_UART_CLEAR_FEFLAG(pUartHandle);
+	__HAL_UART_CLEAR_NEFLAG(pUartHandle);
+	__HAL_UART_CLEAR_PEFLAG(pUartHandle);
+	accLen = 0; // partial frame is lost: Pi retransmits on CRC NAK or timeout
+	crcBadSpan = 0;
+	dmaPos = 0; // DMA starts again from dmaBuf[0]
+	if (HAL_UARTEx_ReceiveToIdle_DMA(pUartHandle, dmaBuf, RPI_RX_DMA_SIZE) == HAL_OK) linkStat.rxRestarts++;
+	__set_PRIMASK(primask);
+}
+
+void rpi_errorHandler(UART_HandleTypeDef *huart) { // call this from HAL_UART_ErrorCallback
+	uint32_t err, now;
+	if (pUartHandle == NULL || huart->Instance != pUartHandle->Instance) return;
+	err = huart->ErrorCode;
+	now = HAL_GetTick();
+	if (err & HAL_UART_ERROR_ORE) {
+		linkStat.oreErrs++;
+		linkStat.lastOreTick = now;
+	}
+	if (err & HAL_UART_ERROR_FE) {
+		linkStat.feErrs++;
+		linkStat.lastFeTick = now;
+	}
+	if (err & HAL_UART_ERROR_NE) {
+		linkStat.neErrs++;
+		linkStat.lastNeTick = now;
+	}
+	if (err & HAL_UART_ERROR_PE) {
+		linkStat.peErrs++;
+		linkStat.lastPeTick = now;
+	}
+	if (err & HAL_UART_ERROR_DMA) linkStat.dmaErrs++;
+	if (err != HAL_UART_ERROR_NONE) qualityBad();
+	// with DMA reception every error is blocking: HAL has cleared the flag and stopped reception
+	restartRx(); // within the same interrupt: at most the byte in error and the partial frame are lost
+}
+
+void rpi_setTelemetryFunc(uint8_t (*pFunc)(uint8_t* pPayload)) { // pFunc fills TYPE_TELEMETRY payload and returns its length. called from 1ms timer interrupt
+	pTelemetryFunc = pFunc;
+}
+
+void rpi_setTelemetryInterval(uint16_t ms) { // 0: off. initial value is RPI_TLM_DEF_INTV
+	tlmIntv = ms;
+	tlmCnt = 0;
+}
+
+void rpi_msTimeoutHandler() { // call this from 1ms timer interrupt. sends telemetry
+	uint8_t payload[RPI_MAX_PAYLOAD];
+	uint8_t len;
+	if (pUartHandle == NULL) return;
+	if (baudState == BAUD_VERIFYING && HAL_GetTick() - baudVerifyStart >= RPI_BAUD_VERIFY_TIME) baudFallback(baudPrev); // not enough test patterns
+	if ((baudState == BAUD_SWITCH || baudState == BAUD_FALLBACK) && txBusyLen == 0 && txHead == txTail) applyPendingBaud();
+	if (tlmIntv == 0 || pTelemetryFunc == NULL || baudState != BAUD_STABLE) return;
+	if (++tlmCnt < tlmIntv) return;
+	tlmCnt = 0;
+	if (txHead != txTail) { // latest state only: never queue telemetry behind ACKs or older telemetry
+		linkStat.tlmSkipped++;
+		return;
+	}
+	len = pTelemetryFunc(payload);
+	if (len > RPI_MAX_PAYLOAD) return;
+	if (rpi_sendFrame(TYPE_TELEMETRY, payload, len)) linkStat.tlmFrames++;
+}
+
+uint32_t rpi_getBaud() { // current rate of the link
+	return linkStat.baud;
+}
+
+static core_statRetTypeDef rpi_secTimHandler() { // watchdog: reception stopped without error callback. baud fallback
+	uint32_t errCnt, primask;
+	if (pUartHandle == NULL) return OK;
+	restartRx();
+	errCnt = linkStat.oreErrs + linkStat.feErrs + linkStat.neErrs + linkStat.peErrs + linkStat.crcErrs + linkStat.lenErrs;
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (baudState == BAUD_STABLE && linkStat.baud != RPI_BAUD_DEFAULT) {
+		if (errCnt - errCntPrev >= RPI_BAUD_ERR_BURST) baudFallback(RPI_BAUD_DEFAULT); // Pi falls back on missing ACKs
+		else if (HAL_GetTick() - lastValidTick >= RPI_BAUD_IDLE_FALLBACK * 1000UL) baudFallback(RPI_BAUD_DEFAULT); // Pi may have restarted at default rate
+	}
+	if (HAL_GetTick() - lastValidTick >= RPI_BAUD_IDLE_FALLBACK * 1000UL) asciiOff = FALSE; // Pi may have restarted in ASCII mode, also at the default rate
+	__set_PRIMASK(primask);
+	errCntPrev = errCnt;
 	return OK;
 }
 
@@ -120,11 +624,10 @@ void rpi_init() {
 		}
 #endif
 	}
-	// register UART intr handler
-	retval = core_call_uartHandlerRegister(&rpi_RxCpltCallbackHandler);
+	retval = core_call_secTimIntrRegister(&rpi_secTimHandler);
 	if (retval != OK) {
 #ifdef _TEST_MODE_ENABLED
-		core_dbgTx("\r\n?FAILED TO REGISTER RPI UART INTR HANDLER FUNCTION OF RPICOMM\r\n");
+		core_dbgTx("\r\n?FAILED TO REGISTER SECOND TIMER INTR HANDLER FUNCTION OF RPICOMM\r\n");
 		while (1) {
 
 		}
@@ -132,19 +635,28 @@ void rpi_init() {
 	}
 
 	// send pin data once, start and then timeout, set all the pins to HIGH(rpi conf: pull up to init
-	HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT, GPIO_PIN_SET);
-	HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_EXE, GPIO_PIN_RESET);
+	port_gpio_set(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT);
+	port_gpio_reset(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_EXE);
 	HAL_Delay(1000);
-	HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_EXE, GPIO_PIN_SET);
+	port_gpio_set(RPI_PIN_OUT_PORT, RPI_PIN_OUT_SCHEDULE_EXE);
 	HAL_Delay(500);
-	HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT, GPIO_PIN_RESET);
+	port_gpio_reset(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT);
 	HAL_Delay(500);
-	HAL_GPIO_WritePin(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT, GPIO_PIN_SET);
+	port_gpio_set(RPI_PIN_OUT_PORT, RPI_PIN_OUT_FIND_CAT_TIMEOUT);
 
 
-	UARTdta.available = 0;
-	for (int i = 0; i < 9; i++)
-		rxBuf[i] = 0;
+	rxqHead = 0;
+	rxqTail = 0;
+	accLen = 0;
+	crcBadSpan = 0;
+	dmaPos = 0;
+	seqSynced = FALSE;
+	asciiOff = FALSE;
+	quality = RPI_QUALITY_MAX;
+	baudState = BAUD_STABLE;
+	linkStat.baud = pUartHandle->Init.BaudRate; // RPI_BAUD_DEFAULT in CubeMX
+	lastValidTick = HAL_GetTick();
 	//pinDta = 0;
-	HAL_UART_Receive_IT(pUartHandle, rxBuf, DTA_LEN);
+	HAL_UARTEx_ReceiveToIdle_DMA(pUartHandle, dmaBuf, RPI_RX_DMA_SIZE); // circular: runs until stopped
+
 }
@@ -0,0 +1,239 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : rtclock.c
+  * BRIEF INFORMATION: wall clock on the RTC, synced from the Raspberry Pi
+  * 				   This program uses the RTC calendar, sub-second shift, smooth calibration,
+  * 				   alarm A and backup registers 0 ~ 3.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#include "rtclock.h"
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+// backup registers, kept over resets with the RTC itself
+#define BKP_MAGIC RTC_BKP_DR0
+#define BKP_DRIFT RTC_BKP_DR1
+#define BKP_CALIB RTC_BKP_DR2
+#define BKP_FLAGS RTC_BKP_DR3
+
+#define CAL_PULSE 9537 // ppm x 10000 of one CALM pulse(1 / 2^20)
+#define CAL_MIN (-511 * CAL_PULSE / 100)
+#define DAY_SEC 86400
+
+static RTC_HandleTypeDef* pRtcHandle = NULL;
+static uint32_t prediv; // synchronous prescaler + 1: sub-second steps per second
+static struct RtclockStats stat;
+static void (*pAlarmFunc)() = NULL;
+
+// drift measurement since the last step or calibration change
+static int64_t refMs; // Pi time of the last sync, ms
+static int32_t accOfs; // ms, sum of slews applied
+static int64_t accTime; // ms
+
+static const uint16_t cumDays[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+/* time conversion: RTC years 00 ~ 99 are 2000 ~ 2099, every 4th year is a leap year */
+static uint32_t toSec(const RTC_TimeTypeDef* pt, const RTC_DateTypeDef* pd) {
+	uint32_t yy = pd->Year;
+	uint32_t days = yy * 365 + (yy + 3) / 4 + cumDays[(pd->Month - 1) % 12] + pd->Date - 1;
+	if (pd->Month > 2 && (yy % 4) == 0) days++;
+	return days * DAY_SEC + pt->Hours * 3600 + pt->Minutes * 60 + pt->Seconds;
+}
+
+static void fromSec(uint32_t t, RTC_TimeTypeDef* pt, RTC_DateTypeDef* pd) {
+	uint32_t days = t / DAY_SEC;
+	uint32_t s = t % DAY_SEC;
+	pt->Hours = s / 3600;
+	pt->Minutes = (s / 60) % 60;
+	pt->Seconds = s % 60;
+	pt->SubSeconds = 0;
+	pt->TimeFormat = RTC_HOURFORMAT12_AM;
+	pt->DayLightSaving = RTC_DAYLIGHTSAVING_NONE;
+	pt->StoreOperation = RTC_STOREOPERATION_RESET;
+	pd->WeekDay = (days + 5) % 7 + 1; // 2000-01-01 was a Saturday. RTC: Monday is 1
+
+	uint32_t yy = days / 1461 * 4; // 4 year blocks, leap year first
+	days %= 1461;
+	if (days >= 366) {
+		days -= 366;
+		yy += 1 + days / 365;
+		days %= 365;
+	}
+	uint8_t leap = (yy % 4) == 0;
+	uint8_t m = 12;
+	while (m > 1 && days < cumDays[m - 1] + (leap && m > 2)) m--;
+	pd->Year = yy;
+	pd->Month = m;
+	pd->Date = days - cumDays[m - 1] - (leap && m > 2) + 1;
+}
+
+static uint32_t readTime(uint16_t* pMs) {
+	RTC_TimeTypeDef t;
+	RTC_DateTypeDef d;
+	__disable_irq(); // GetTime locks the shadow registers until GetDate: keep the pair together
+	HAL_RTC_GetTime(pRtcHandle, &t, RTC_FORMAT_BIN);
+	HAL_RTC_GetDate(pRtcHandle, &d, RTC_FORMAT_BIN);
+	__enable_irq();
+	if (pMs != NULL) { // sub-second counter counts down. middle of the step: no bias in drift. over the prescaler right after a shift: still in the last second
+		*pMs = (t.SubSeconds <= t.SecondFraction) ? ((t.SecondFraction - t.SubSeconds) * 2 + 1) * 500 / (t.SecondFraction + 1) : 0;
+	}
+	return toSec(&t, &d);
+}
+
+static int32_t shiftMs(int32_t ms) { // -999 ~ 999. returns ms actually shifted: whole sub-second steps
+	int32_t n = (ms * (int32_t)prediv + (ms >= 0 ? 500 : -500)) / 1000;
+	if (n > 0) HAL_RTCEx_SetSynchroShift(pRtcHandle, RTC_SHIFTADD1S_SET, prediv - n);
+	else if (n < 0) HAL_RTCEx_SetSynchroShift(pRtcHandle, RTC_SHIFTADD1S_RESET, -n);
+	return n * 1000 / (int32_t)prediv;
+}
+
+static void applyCalib(int32_t c) { // ppm x 100, + = speed up. CALP inserts 512 pulses, CALM masks up to 511 per 32s
+	int32_t n = (c * 100 + (c >= 0 ? CAL_PULSE / 2 : -CAL_PULSE / 2)) / CAL_PULSE;
+	if (n > 512) n = 512;
+	if (n < -511) n = -511;
+	if (n > 0) HAL_RTCEx_SetSmoothCalib(pRtcHandle, RTC_SMOOTHCALIB_PERIOD_32SEC, RTC_SMOOTHCALIB_PLUSPULSES_SET, 512 - n);
+	else HAL_RTCEx_SetSmoothCalib(pRtcHandle, RTC_SMOOTHCALIB_PERIOD_32SEC, RTC_SMOOTHCALIB_PLUSPULSES_RESET, -n);
+	stat.calib = n * CAL_PULSE / 100;
+}
+
+static void saveStat() {
+	HAL_RTCEx_BKUPWrite(pRtcHandle, BKP_DRIFT, (uint32_t)stat.drift);
+	HAL_RTCEx_BKUPWrite(pRtcHandle, BKP_CALIB, (uint32_t)stat.calib);
+	HAL_RTCEx_BKUPWrite(pRtcHandle, BKP_FLAGS, stat.flags & (RTCLOCK_FLAG_SET | RTCLOCK_FLAG_CALIBRATED));
+	HAL_RTCEx_BKUPWrite(pRtcHandle, BKP_MAGIC, RTCLOCK_BKP_MAGIC);
+}
+
+void rtclock_setHandle(RTC_HandleTypeDef* ph) {
+	pRtcHandle = ph;
+}
+
+void rtclock_init() {
+	prediv = pRtcHandle->Init.SynchPrediv + 1;
+	stat.syncs = 0;
+	stat.steps = 0;
+	stat.lastOfs = 0;
+	stat.maxSlew = 0;
+	stat.lastSync = 0;
+	if (HAL_RTCEx_BKUPRead(pRtcHandle, BKP_MAGIC) == RTCLOCK_BKP_MAGIC) { // reset with the RTC running: keep time and calibration
+		stat.drift = (int32_t)HAL_RTCEx_BKUPRead(pRtcHandle, BKP_DRIFT);
+		stat.calib = (int32_t)HAL_RTCEx_BKUPRead(pRtcHandle, BKP_CALIB);
+		stat.flags = HAL_RTCEx_BKUPRead(pRtcHandle, BKP_FLAGS) & (RTCLOCK_FLAG_SET | RTCLOCK_FLAG_CALIBRATED);
+	}
+	else {
+		stat.drift = 0;
+		stat.flags = 0;
+		applyCalib(0);
+	}
+	accOfs = 0;
+	accTime = 0;
+	refMs = -1;
+	rtclock_setAlarm(RTCLOCK_NO_ALARM, NULL);
+}
+
+uint32_t rtclock_now() {
+	return readTime(NULL);
+}
+
+uint32_t rtclock_nowMs(uint16_t* pMs) {
+	return readTime(pMs);
+}
+
+_Bool rtclock_isSet() {
+	return (stat.flags & RTCLOCK_FLAG_SET) != 0;
+}
+
+int32_t rtclock_sync(uint32_t sec, uint16_t ms) {
+	uint16_t rtcMs;
+	uint32_t rtcSec = readTime(&rtcMs);
+	int64_t piMs = (int64_t)sec * 1000 + ms;
+	int64_t ofs = piMs - ((int64_t)rtcSec * 1000 + rtcMs);
+	stat.syncs++;
+	stat.lastOfs = (ofs > INT32_MAX) ? INT32_MAX : (ofs < INT32_MIN) ? INT32_MIN : (int32_t)ofs;
+	stat.lastSync = sec;
+
+	if (!(stat.flags & RTCLOCK_FLAG_SET) || ofs >= RTCLOCK_STEP_MS || ofs <= -RTCLOCK_STEP_MS) { // step: first sync, power loss, time zone or manual change
+		RTC_TimeTypeDef t;
+		RTC_DateTypeDef d;
+		fromSec(sec, &t, &d);
+		HAL_RTC_SetTime(pRtcHandle, &t, RTC_FORMAT_BIN); // sub-seconds restart at the beginning of the second
+		HAL_RTC_SetDate(pRtcHandle, &d, RTC_FORMAT_BIN);
+		shiftMs(ms);
+		stat.steps++;
+		stat.flags |= RTCLOCK_FLAG_SET;
+		accOfs = 0; // the step says nothing about drift
+		accTime = 0;
+		refMs = piMs;
+		saveStat();
+		return (int32_t)((ofs + (ofs >= 0 ? 500 : -500)) / 1000);
+	}
+
+	// slew: the offset built up since the last sync is drift of the calibrated crystal.
+	// what is left under one sub-second step is measured again next time
+	int32_t slew = shiftMs((int32_t)ofs);
+	uint32_t absOfs = (ofs >= 0) ? (uint32_t)ofs : (uint32_t)-ofs;
+	if (absOfs > stat.maxSlew) stat.maxSlew = absOfs;
+	if (refMs >= 0) {
+		accOfs += slew;
+		accTime += piMs - refMs;
+	}
+	refMs = piMs;
+	if (accTime >= (int64_t)RTCLOCK_CAL_MIN_SEC * 1000) {
+		int32_t residual = (int32_t)(-(int64_t)accOfs * 100000000 / accTime); // ppm x 100 the clock ran fast with calibration
+		int32_t raw = residual - stat.calib;
+		stat.drift = (stat.flags & RTCLOCK_FLAG_CALIBRATED) ? (stat.drift + raw) / 2 : raw; // temperature moves it: keep averaging
+		stat.flags |= RTCLOCK_FLAG_CALIBRATED;
+		int32_t c = -stat.drift;
+		if (c > RTCLOCK_CAL_MAX) c = RTCLOCK_CAL_MAX;
+		if (c < CAL_MIN) c = CAL_MIN;
+		applyCalib(c);
+		accOfs = 0;
+		accTime = 0;
+		saveStat();
+	}
+	return 0;
+}
+
+void rtclock_setAlarm(uint32_t t, void (*pFunc)()) {
+	HAL_RTC_DeactivateAlarm(pRtcHandle, RTC_ALARM_A);
+	pAlarmFunc = NULL;
+	stat.flags &= ~RTCLOCK_FLAG_ALARM;
+	if (t == RTCLOCK_NO_ALARM || pFunc == NULL) return;
+	if (t <= readTime(NULL)) { // already due: the alarm would only match next month
+		pFunc();
+		return;
+	}
+	// date, hour, minute and second are matched: an alarm over a month ahead fires early, pFunc checks the time
+	RTC_AlarmTypeDef a;
+	RTC_DateTypeDef d;
+	fromSec(t, &a.AlarmTime, &d);
+	a.AlarmMask = RTC_ALARMMASK_NONE;
+	a.AlarmSubSecondMask = RTC_ALARMSUBSECONDMASK_ALL;
+	a.AlarmDateWeekDaySel = RTC_ALARMDATEWEEKDAYSEL_DATE;
+	a.AlarmDateWeekDay = d.Date;
+	a.Alarm = RTC_ALARM_A;
+	pAlarmFunc = pFunc;
+	stat.flags |= RTCLOCK_FLAG_ALARM;
+	HAL_RTC_SetAlarm_IT(pRtcHandle, &a, RTC_FORMAT_BIN);
+}
+
+struct RtclockStats rtclock_getStat() {
+	return stat;
+}
+
+void rtclock_alarmHandler(RTC_HandleTypeDef* hrtc) {
+	if (hrtc != pRtcHandle) return;
+	stat.flags &= ~RTCLOCK_FLAG_ALARM;
+	if (pAlarmFunc != NULL) pAlarmFunc();
+}
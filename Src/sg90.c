@@ -14,16 +14,134 @@
   */
 
 #include "sg90.h"
+#include "port.h"
+#include "fixedpt.h"
+#include "fxtables.h"
+
+#if FXT_SG90_TIM_ARR != SG90_TIM_ARR || FXT_SG90_MIN_DUTY != SG90_MIN_DUTY || FXT_SG90_MAX_DUTY != SG90_MAX_DUTY
+#error "fxtables out of date: run tools/gen_fxtables.py"
+#endif
+
+struct SG90Track {
+	volatile _Bool active;
+	struct SG90Waypoint pts[SG90_MAX_WAYPOINTS];
+	uint8_t cnt;
+	uint8_t idx; // running waypoint
+	uint8_t startAng;
+	uint16_t startCCR;
+	uint16_t targetCCR;
+	uint16_t frame; // elapsed frames of running waypoint
+	uint16_t frames; // total frames of running waypoint
+	uint16_t settleFrames; // auto-detach delay. 0: never
+	volatile uint16_t settleLeft;
+};
+
+static const uint32_t channel[4] = { TIM_CHANNEL_1, TIM_CHANNEL_2, TIM_CHANNEL_3, TIM_CHANNEL_4 };
 
 static struct SG90Stats SG;
-static float angleMultr;
+static struct SG90Track track[SG90_MOTOR_CNT];
+static uint16_t curCCR[SG90_MOTOR_CNT];
+static void (*pMoveDoneCallback)(uint8_t) = NULL;
+static q16_t angleMultr; // used only if timer ARR differs from SG90_TIM_ARR
 static uint16_t CCRmin;
 static uint16_t CCRmax;
+static _Bool useTable = FALSE;
 static _Bool timEna = FALSE;
 
 static TIM_HandleTypeDef* pTimHandle = NULL;
 static TIM_TypeDef* pTimInstance = NULL;
 
+/* basic functions */
+
+static uint16_t angleToCCR(uint8_t angle) {
+	if (angle > SG90_MAX_ANGLE) angle = SG90_MAX_ANGLE;
+	return (useTable == TRUE) ? fxtSg90AngleCCR[angle] : (uint16_t)(CCRmin + fx_scaleU(angle, angleMultr));
+}
+
+static void writeCCR(uint8_t motorNum, uint16_t ccr) {
+	curCCR[motorNum] = ccr;
+	switch (motorNum) {
+	case SG90_MOTOR_A: pTimInstance->CCR1 = (uint32_t)ccr; break;
+	case SG90_MOTOR_B: pTimInstance->CCR2 = (uint32_t)ccr; break;
+	case SG90_MOTOR_C: pTimInstance->CCR3 = (uint32_t)ccr; break;
+	case SG90_MOTOR_D: pTimInstance->CCR4 = (uint32_t)ccr; break;
+	}
+}
+
+static void attach(uint8_t motorNum) { // resume PWM paused by auto-detach
+	if (SG.attached[motorNum] == TRUE) return;
+	port_pwm_enable(pTimHandle, channel[motorNum]);
+	SG.attached[motorNum] = TRUE;
+}
+
+static uint32_t easeShape(uint8_t easing, uint32_t x) { // x, return value: 0 ~ 1024
+	switch (easing) {
+	case SG90_EASE_IN:
+		return x * x / 1024;
+	case SG90_EASE_OUT:
+		return 1024 - (1024 - x) * (1024 - x) / 1024;
+	case SG90_EASE_INOUT:
+		return (x * x / 1024) * (3072 - 2 * x) / 1024;
+	default:
+		return x;
+	}
+}
+
+static void startWaypoint(uint8_t motorNum) {
+	struct SG90Track* pt = &track[motorNum];
+	uint32_t frames = (uint32_t)pt->pts[pt->idx].ms * SG90_TIM_FREQ / 1000;
+	pt->startAng = SG.angle[motorNum];
+	pt->startCCR = curCCR[motorNum];
+	pt->targetCCR = angleToCCR(pt->pts[pt->idx].angle);
+	pt->frame = 0;
+	pt->frames = (frames < 1) ? 1 : (frames > 0xFFFF) ? 0xFFFF : (uint16_t)frames;
+}
+
+static void arm(uint8_t motorNum, const struct SG90Waypoint* pPts, uint8_t cnt) { // call with interrupts disabled
+	struct SG90Track* pt = &track[motorNum];
+	for (uint8_t i = 0; i < cnt; i++) {
+		pt->pts[i] = pPts[i];
+		if (pt->pts[i].angle > SG90_MAX_ANGLE) pt->pts[i].angle = SG90_MAX_ANGLE;
+	}
+	pt->cnt = cnt;
+	pt->idx = 0;
+	pt->settleLeft = 0;
+	startWaypoint(motorNum);
+	attach(motorNum);
+	pt->active = TRUE;
+	SG.moving[motorNum] = TRUE;
+}
+
+static void trackTick(uint8_t motorNum) {
+	struct SG90Track* pt = &track[motorNum];
+	uint32_t y;
+	int32_t tgtAng;
+
+	if (pt->active == FALSE) {
+		if (pt->settleLeft > 0 && --pt->settleLeft == 0) { // settled: detach to save power
+			port_pwm_disable(pTimHandle, channel[motorNum]);
+			SG.attached[motorNum] = FALSE;
+		}
+		return;
+	}
+
+	pt->frame++;
+	y = easeShape(pt->pts[pt->idx].easing, (uint32_t)pt->frame * 1024 / pt->frames);
+	tgtAng = pt->pts[pt->idx].angle;
+	writeCCR(motorNum, (uint16_t)((int32_t)pt->startCCR + ((int32_t)pt->targetCCR - (int32_t)pt->startCCR) * (int32_t)y / 1024));
+	SG.angle[motorNum] = (uint8_t)((int32_t)pt->startAng + (tgtAng - (int32_t)pt->startAng) * (int32_t)y / 1024);
+	if (pt->frame < pt->frames) return;
+
+	if (++pt->idx < pt->cnt) { // next waypoint starts from where this one ended
+		startWaypoint(motorNum);
+		return;
+	}
+	pt->active = FALSE;
+	SG.moving[motorNum] = FALSE;
+	pt->settleLeft = pt->settleFrames;
+	if (pMoveDoneCallback != NULL) pMoveDoneCallback(motorNum);
+}
+
 void sg90_setHandle(TIM_HandleTypeDef* ph) {
 	pTimHandle = ph;
 	pTimInstance = ph->Instance;
@@ -32,20 +150,30 @@ void sg90_setHandle(TIM_HandleTypeDef* ph) {
 void sg90_init() {
 	if (SG90_MOTOR_CNT < 1) return; // incorrect config
 	if (timEna == FALSE) {
-		HAL_TIM_Base_Start_IT(pTimHandle);
+		port_tim_start_it(pTimHandle);
 		timEna = TRUE;
 	}
 	CCRmin = (uint16_t)(pTimInstance->ARR * SG90_MIN_DUTY / 100);
 	CCRmax = (uint16_t)(pTimInstance->ARR * SG90_MAX_DUTY / 100);
-	angleMultr = (CCRmax - CCRmin) / 180.0;
+	angleMultr = fx_fromRatio(CCRmax - CCRmin, SG90_MAX_ANGLE);
+	useTable = (pTimInstance->ARR == SG90_TIM_ARR) ? TRUE : FALSE;
 	pTimInstance->CCR1 = (uint32_t)CCRmin;
 	if (SG90_MOTOR_CNT >= 2) pTimInstance->CCR2 = (uint32_t)CCRmin;
 	if (SG90_MOTOR_CNT >= 3) pTimInstance->CCR3 = (uint32_t)CCRmin;
 	if (SG90_MOTOR_CNT >= 4) pTimInstance->CCR4 = (uint32_t)CCRmin;
+	// CCR preload: trajectory frames are written by update interrupt and latched on the next period
+	pTimInstance->CCMR1 |= TIM_CCMR1_OC1PE | TIM_CCMR1_OC2PE;
+	pTimInstance->CCMR2 |= TIM_CCMR2_OC3PE | TIM_CCMR2_OC4PE;
 
 	for (int i = 0; i < SG90_MOTOR_CNT; i++) {
 		SG.angle[i] = 0;
 		SG.ena[i] = 0;
+		SG.moving[i] = FALSE;
+		SG.attached[i] = FALSE;
+		curCCR[i] = CCRmin;
+		track[i].active = FALSE;
+		track[i].settleFrames = 0;
+		track[i].settleLeft = 0;
 	}
 }
 
@@ -55,20 +183,24 @@ void sg90_enable(uint8_t motorNum, uint8_t angle) { // start giving PWM signal
 
 	switch (motorNum) {
 	case SG90_MOTOR_A:
-		HAL_TIM_PWM_Start(pTimHandle, TIM_CHANNEL_1);
+		port_pwm_enable(pTimHandle, TIM_CHANNEL_1);
 		SG.ena[SG90_MOTOR_A] = 1;
+		SG.attached[SG90_MOTOR_A] = TRUE;
 		break;
 	case SG90_MOTOR_B:
-		HAL_TIM_PWM_Start(pTimHandle, TIM_CHANNEL_2);
+		port_pwm_enable(pTimHandle, TIM_CHANNEL_2);
 		SG.ena[SG90_MOTOR_B] = 1;
+		SG.attached[SG90_MOTOR_B] = TRUE;
 		break;
 	case SG90_MOTOR_C:
-		HAL_TIM_PWM_Start(pTimHandle, TIM_CHANNEL_3);
+		port_pwm_enable(pTimHandle, TIM_CHANNEL_3);
 		SG.ena[SG90_MOTOR_C] = 1;
+		SG.attached[SG90_MOTOR_C] = TRUE;
 		break;
 	case SG90_MOTOR_D:
-		HAL_TIM_PWM_Start(pTimHandle, TIM_CHANNEL_4);
+		port_pwm_enable(pTimHandle, TIM_CHANNEL_4);
 		SG.ena[SG90_MOTOR_D] = 1;
+		SG.attached[SG90_MOTOR_D] = TRUE;
 		break;
 	}
 
@@ -79,22 +211,29 @@ void sg90_disable(uint8_t motorNum) { // disable motor by stop giving PWM signal
 	if (motorNum >= SG90_MOTOR_CNT) return;
 	else if (SG.ena[motorNum] == FALSE) return;
 
+	track[motorNum].active = FALSE;
+	track[motorNum].settleLeft = 0;
+	SG.moving[motorNum] = FALSE;
 	switch (motorNum) {
 	case SG90_MOTOR_A:
-		HAL_TIM_PWM_Stop(pTimHandle, TIM_CHANNEL_1);
+		port_pwm_disable(pTimHandle, TIM_CHANNEL_1);
 		SG.ena[SG90_MOTOR_A] = 0;
+		SG.attached[SG90_MOTOR_A] = FALSE;
 		break;
 	case SG90_MOTOR_B:
-		HAL_TIM_PWM_Stop(pTimHandle, TIM_CHANNEL_2);
+		port_pwm_disable(pTimHandle, TIM_CHANNEL_2);
 		SG.ena[SG90_MOTOR_B] = 0;
+		SG.attached[SG90_MOTOR_B] = FALSE;
 		break;
 	case SG90_MOTOR_C:
-		HAL_TIM_PWM_Stop(pTimHandle, TIM_CHANNEL_3);
+		port_pwm_disable(pTimHandle, TIM_CHANNEL_3);
 		SG.ena[SG90_MOTOR_C] = 0;
+		SG.attached[SG90_MOTOR_C] = FALSE;
 		break;
 	case SG90_MOTOR_D:
-		HAL_TIM_PWM_Stop(pTimHandle, TIM_CHANNEL_4);
+		port_pwm_disable(pTimHandle, TIM_CHANNEL_4);
 		SG.ena[SG90_MOTOR_D] = 0;
+		SG.attached[SG90_MOTOR_D] = FALSE;
 		break;
 	}
 }
@@ -103,28 +242,87 @@ void sg90_setAngle(uint8_t motorNum, uint8_t angle) { // set angle
 	if (motorNum >= SG90_MOTOR_CNT) return;
 	else if (SG.ena[motorNum] == FALSE) return;
 
-	uint32_t ccrval = (uint32_t)(CCRmin + (uint16_t)((float)angle * angleMultr));
+	if (angle > SG90_MAX_ANGLE) angle = SG90_MAX_ANGLE;
 
-	switch (motorNum) {
-	case SG90_MOTOR_A:
-		pTimInstance->CCR1 = ccrval;
-		SG.angle[SG90_MOTOR_A] = angle;
-		break;
-	case SG90_MOTOR_B:
-		pTimInstance->CCR2 = ccrval;
-		SG.angle[SG90_MOTOR_B] = angle;
-		break;
-	case SG90_MOTOR_C:
-		pTimInstance->CCR3 = ccrval;
-		SG.angle[SG90_MOTOR_C] = angle;
-		break;
-	case SG90_MOTOR_D:
-		pTimInstance->CCR4 = ccrval;
-		SG.angle[SG90_MOTOR_D] = angle;
-		break;
-	}
+	__disable_irq();
+	track[motorNum].active = FALSE;
+	track[motorNum].settleLeft = 0;
+	SG.moving[motorNum] = FALSE;
+	__enable_irq();
+	attach(motorNum);
+	writeCCR(motorNum, angleToCCR(angle));
+	SG.angle[motorNum] = angle;
 }
 
 struct SG90Stats sg90_getStat(uint8_t motor) { // get status struct data
 	return SG;
 }
+
+_Bool sg90_moveTo(uint8_t motorNum, uint8_t angle, uint16_t durationMs, uint8_t easing) { // returns FALSE if motor is disabled
+	struct SG90Waypoint pt = { angle, easing, durationMs };
+	return sg90_trajectory(motorNum, &pt, 1);
+}
+
+_Bool sg90_trajectory(uint8_t motorNum, const struct SG90Waypoint* pPts, uint8_t cnt) { // cnt <= SG90_MAX_WAYPOINTS
+	if (motorNum >= SG90_MOTOR_CNT || SG.ena[motorNum] == FALSE) return FALSE;
+	if (cnt == 0 || cnt > SG90_MAX_WAYPOINTS) return FALSE;
+	__disable_irq();
+	arm(motorNum, pPts, cnt);
+	__enable_irq();
+	return TRUE;
+}
+
+_Bool sg90_moveSync(const uint8_t* pAngles, uint16_t durationMs, uint8_t easing) { // move every motor, starting and ending on the same frame
+	struct SG90Waypoint pt = { 0, easing, durationMs };
+	for (int i = 0; i < SG90_MOTOR_CNT; i++) {
+		if (SG.ena[i] == FALSE) return FALSE;
+	}
+	// same frame count for every motor and armed between two update interrupts
+	__disable_irq();
+	for (uint8_t i = 0; i < SG90_MOTOR_CNT; i++) {
+		pt.angle = pAngles[i];
+		arm(i, &pt, 1);
+	}
+	__enable_irq();
+	return TRUE;
+}
+
+_Bool sg90_isMoving(uint8_t motorNum) {
+	if (motorNum >= SG90_MOTOR_CNT) return FALSE;
+	return track[motorNum].active;
+}
+
+void sg90_waitMove(uint8_t motorNum) { // block until trajectory of the motor ends
+	while (sg90_isMoving(motorNum) == TRUE) {
+		HAL_Delay(1);
+	}
+}
+
+void sg90_stop(uint8_t motorNum) { // hold current angle and drop the rest of trajectory
+	if (motorNum >= SG90_MOTOR_CNT) return;
+	__disable_irq();
+	if (track[motorNum].active == TRUE) {
+		track[motorNum].active = FALSE;
+		track[motorNum].settleLeft = track[motorNum].settleFrames;
+		SG.moving[motorNum] = FALSE;
+	}
+	__enable_irq();
+}
+
+void sg90_setAutoDetach(uint8_t motorNum, uint16_t settleMs) { // pause PWM settleMs after a trajectory ends. 0: never(initial value)
+	uint32_t frames;
+	if (motorNum >= SG90_MOTOR_CNT) return;
+	frames = ((uint32_t)settleMs * SG90_TIM_FREQ + 999) / 1000;
+	track[motorNum].settleFrames = (frames > 0xFFFF) ? 0xFFFF : (uint16_t)frames;
+}
+
+void sg90_setMoveDoneCallback(void (*pFunc)(uint8_t motorNum)) { // called from TIM update interrupt when a trajectory ends
+	pMoveDoneCallback = pFunc;
+}
+
+void sg90_periodElapsedHandler(TIM_HandleTypeDef *htim) { // call this from HAL_TIM_PeriodElapsedCallback
+	if (pTimHandle == NULL || htim->Instance != pTimInstance) return;
+	for (uint8_t i = 0; i < SG90_MOTOR_CNT; i++) {
+		trackTick(i);
+	}
+}
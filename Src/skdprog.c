@@ -0,0 +1,166 @@
+/**
+  *********************************************************************************************
+  * NAME OF THE FILE : skdprog.c
+  * BRIEF INFORMATION: pattern program of a schedule: validation and lazy decoding
+  * 				   No hardware access: also built on host by tools/skdprog_check.py.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+
+#include "skdprog.h"
+
+static uint32_t satMul(uint32_t a, uint32_t b) {
+	if (a != 0 && b > SKDPROG_PLAYS_MAX / a) return SKDPROG_PLAYS_MAX;
+	return a * b;
+}
+
+static uint32_t satAdd(uint32_t a, uint32_t b) {
+	return (a > SKDPROG_PLAYS_MAX - b) ? SKDPROG_PLAYS_MAX : a + b;
+}
+
+/*
+ * rejects unknown ops, missing operands, operands out of range, unbalanced or too deep loops,
+ * loops without a PLAY, REPEAT or SNACK(decoder would spin through them) and overrides not followed by a play.
+ */
+_Bool skdprog_check(const uint8_t* p, uint8_t len, uint32_t* pPlays) {
+	uint32_t mult[SKDPROG_MAX_DEPTH + 1];
+	_Bool hasEntry[SKDPROG_MAX_DEPTH + 1];
+	uint32_t plays = 0;
+	uint8_t depth = 0;
+	_Bool pendOvr = FALSE;
+	uint8_t pc = 0;
+	mult[0] = 1;
+	hasEntry[0] = TRUE;
+	while (pc < len) {
+		uint8_t op = p[pc] & 0xF0;
+		uint8_t arg = p[pc] & 0x0F;
+		switch (op) {
+		case SKDPROG_OP_PLAY:
+			if (arg > SKDPROG_MAX_CODE) return FALSE;
+			plays = satAdd(plays, mult[depth]);
+			hasEntry[depth] = TRUE;
+			pendOvr = FALSE;
+			pc += 1;
+			break;
+		case SKDPROG_OP_REPEAT:
+			if (arg > SKDPROG_MAX_CODE || pc + 1 >= len || p[pc + 1] < 2) return FALSE;
+			plays = satAdd(plays, satMul(mult[depth], p[pc + 1]));
+			hasEntry[depth] = TRUE;
+			pendOvr = FALSE;
+			pc += 2;
+			break;
+		case SKDPROG_OP_LOOP:
+			if (arg != 0 || pc + 1 >= len || p[pc + 1] == 0 || depth >= SKDPROG_MAX_DEPTH || pendOvr) return FALSE;
+			depth++;
+			mult[depth] = satMul(mult[depth - 1], p[pc + 1]);
+			hasEntry[depth] = FALSE;
+			pc += 2;
+			break;
+		case SKDPROG_OP_END:
+			if (arg != 0 || depth == 0 || !hasEntry[depth] || pendOvr) return FALSE;
+			depth--;
+			hasEntry[depth] = TRUE;
+			pc += 1;
+			break;
+		case SKDPROG_OP_SPEED:
+			if (arg > 2) return FALSE;
+			pendOvr = TRUE;
+			pc += 1;
+			break;
+		case SKDPROG_OP_INTV:
+			if (pc + 1 >= len) return FALSE;
+			pendOvr = TRUE;
+			pc += 2;
+			break;
+		case SKDPROG_OP_SNACK:
+			if (arg != 0 || pendOvr) return FALSE;
+			hasEntry[depth] = TRUE;
+			pc += 1;
+			break;
+		default:
+			return FALSE;
+		}
+	}
+	if (depth != 0 || pendOvr) return FALSE;
+	if (pPlays != NULL) *pPlays = plays;
+	return TRUE;
+}
+
+void skdprog_begin(struct SkdProgIter* it) {
+	it->pc = 0;
+	it->depth = 0;
+	it->repLeft = 0;
+	it->pendSpd = SKDPROG_NO_SPD;
+	it->pendIntv = SKDPROG_NO_INTV;
+}
+
+_Bool skdprog_next(struct SkdProgIter* it, const uint8_t* p, uint8_t len, struct SkdProgEntry* pEntry) {
+	// every loop body holds an entry(skdprog_check), so one call walks the program at most about once
+	while (1) {
+		if (it->repLeft) { // REPEAT in progress: pc is still on it, overrides kept for all of its plays
+			pEntry->kind = SKDPROG_ENTRY_PLAY;
+			pEntry->code = p[it->pc] & 0x0F;
+			pEntry->spd = it->pendSpd;
+			pEntry->intv = it->pendIntv;
+			if (--it->repLeft == 0) {
+				it->pc += 2;
+				it->pendSpd = SKDPROG_NO_SPD;
+				it->pendIntv = SKDPROG_NO_INTV;
+			}
+			return TRUE;
+		}
+		if (it->pc >= len) return FALSE;
+		uint8_t op = p[it->pc] & 0xF0;
+		uint8_t arg = p[it->pc] & 0x0F;
+		switch (op) {
+		case SKDPROG_OP_PLAY:
+			pEntry->kind = SKDPROG_ENTRY_PLAY;
+			pEntry->code = arg;
+			pEntry->spd = it->pendSpd;
+			pEntry->intv = it->pendIntv;
+			it->pendSpd = SKDPROG_NO_SPD;
+			it->pendIntv = SKDPROG_NO_INTV;
+			it->pc += 1;
+			return TRUE;
+		case SKDPROG_OP_REPEAT:
+			it->repLeft = p[it->pc + 1];
+			break;
+		case SKDPROG_OP_LOOP:
+			it->loop[it->depth].body = it->pc + 2;
+			it->loop[it->depth].left = p[it->pc + 1];
+			it->depth++;
+			it->pc += 2;
+			break;
+		case SKDPROG_OP_END:
+			if (--it->loop[it->depth - 1].left) it->pc = it->loop[it->depth - 1].body;
+			else {
+				it->depth--;
+				it->pc += 1;
+			}
+			break;
+		case SKDPROG_OP_SPEED:
+			it->pendSpd = arg;
+			it->pc += 1;
+			break;
+		case SKDPROG_OP_INTV:
+			it->pendIntv = ((uint16_t)arg << 8) | p[it->pc + 1];
+			it->pc += 2;
+			break;
+		case SKDPROG_OP_SNACK:
+			pEntry->kind = SKDPROG_ENTRY_SNACK;
+			pEntry->code = 0;
+			pEntry->spd = SKDPROG_NO_SPD;
+			pEntry->intv = SKDPROG_NO_INTV;
+			it->pc += 1;
+			return TRUE;
+		default: // not reached for checked programs
+			it->pc = len;
+			return FALSE;
+		}
+	}
+}
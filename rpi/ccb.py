@@ -9,6 +9,14 @@ import threading
 import socket
 import time
 import numpy
+import struct
+import binascii
+import json
+import queue
+import calendar
+import skdprog
+import motprog
+import pattime
 
 
 # BEGIN INIT
@@ -22,8 +30,108 @@ PIN_OUT_FOUND_CAT = 23
 tcpDta = 0
 serialDtaFoundCat = bytes('I1......', encoding = "ascii")
 
+# link to MCU
+# 'binary': SYNC TYPE LEN SEQ PAYLOAD CRC16(LE), CRC-16/CCITT-FALSE over TYPE ~ PAYLOAD(see rpicomm.h)
+#           schedule packets from the app(< T P.. N V D >) are sent as one TYPE_SCHEDULE frame,
+#           or TYPE_CAL_SET if a W packet chose a calendar slot
+# 'ascii' : forward 8-character packets from the app as they are(old firmware)
+LINK_MODE = 'binary'
+FRAME_SYNC = 0xA5
+TYPE_SCHEDULE = ord('S')
+TYPE_FOUNDCAT = ord('I')
+TYPE_LINK_RESET = ord('R')
+TYPE_ACK = ord('a')
+TYPE_NAK = ord('n')
+TYPE_LINK_STAT_REQ = ord('L')
+TYPE_LINK_STAT = ord('l')
+TYPE_TELEMETRY = ord('t')
+TYPE_TELEMETRY_CFG = ord('Y')
+TYPE_BAUD = ord('B')
+TYPE_BAUD_INFO = ord('b')
+TYPE_BAUD_TEST = ord('X')
+TYPE_BAUD_ECHO = ord('x')
+TYPE_STATUS_REQ = ord('Q')
+TYPE_CMD_STAT_REQ = ord('H')
+TYPE_CMD_STAT = ord('h')
+TYPE_SNACK_EVT = ord('k')
+TYPE_MANUAL_STREAM = ord('J')
+TYPE_MANUAL_CFG = ord('K')
+TYPE_CAL_SET = ord('C')
+TYPE_CAL_LIST_REQ = ord('G')
+TYPE_CAL_LIST = ord('g')
+TYPE_CLOCK_SYNC = ord('Z')
+TYPE_CLOCK_STAT = ord('z')
+TYPE_MOTION_SET = ord('O')
+TYPE_MOTION_STAT = ord('o')
+TYPE_PLAY_REPORT = ord('p')
+BAUD_RES_CAPS, BAUD_RES_SWITCH, BAUD_RES_UNSUPPORTED, BAUD_RES_VERIFIED, BAUD_RES_FALLBACK = range(5)
+RES_OK, RES_DUP, RES_BUSY, RES_ORDER, RES_CRC = range(5)
+MAX_PAYLOAD = 128
+LINK_WINDOW = 4 # same as RPI_WINDOW of rpicomm.h
+LINK_TIMEOUT = 0.5 # seconds without ACK before go-back-N retransmit
+LINK_BUSY_RETRY = 0.1 # seconds to wait after NAK busy
+LINK_MAX_RETRIES = 8 # then drop outstanding frames and reset sequence
+SKD_MAX_PATTERNS = 4096 # sanity cap of app input, program size is what limits
+SKD_MAX_PROG = MAX_PAYLOAD - 9 # RPI_SKD_MAX_PROG of rpicomm.h
+CAL_SIZE = 6 # RPI_CAL_SIZE: calendar slots of MCU
+CAL_HDR = 9 # RPI_CAL_SKD: slot, period and local time of first play before the schedule in TYPE_CAL_SET
+CAL_QUERY = ord('G') # 8-character packet from TCP client: calendar of MCU answered as one JSON line
+CAL_LIST_TIMEOUT = 1.0
+calRx = queue.Queue() # TYPE_CAL_LIST frames from reader thread
+CLOCK_EPOCH = 946684800 # 2000-01-01 00:00:00: MCU keeps local time in seconds since then(rtclock.h)
+CLOCK_SYNC_INTV = 600 # seconds between TYPE_CLOCK_SYNC, also sent at startup
+CLOCK_FLAGS = ('set', 'calibrated', 'alarm') # RTCLOCK_FLAG_xxx
+mcuClock = None # last TYPE_CLOCK_STAT, see decodeClockStat()
+MOTION_DIR = os.path.expanduser('~/patterns') # <code>.txt, motion program text(rpi/motprog.py) of patterns 10 ~ 13
+MOTION_RELOAD = ord('O') # 8-character packet from TCP client: upload MOTION_DIR again, answered as one JSON line
+MOTION_TIMEOUT = 1.0
+motionRx = queue.Queue() # TYPE_MOTION_STAT frames from reader thread
+mcuMotion = None # last TYPE_MOTION_STAT, see decodeMotionStat()
+motionProgs = {} # code: motion program bytes last uploaded, sized by rpi/pattime.py
+PLAY_RESULTS = ('done', 'aborted') # RPI_PLR_RES_xxx
+mcuPlay = None # last TYPE_PLAY_REPORT, see decodePlayReport()
+PLAY_TIME_QUERY = ord('L') # 8-character packet from TCP client: pattern time table and fit of the last schedule as one JSON line
+playFit = None # ScheduleBuilder.fit() of the last schedule
+LINK_STAT_INTV = 10 # seconds between MCU line health requests
+LINK_STAT_FIELDS = ('ore', 'fe', 'ne', 'pe', 'restarts', 'crc', 'lenErr', 'discarded', 'frames',
+                    'oreAge', 'feAge', 'neAge', 'peAge') # RPI_LST_xxx of rpicomm.h
+mcuLinkStat = None # last TYPE_LINK_STAT from MCU
+TELEMETRY_INTV = 500 # ms, sent to MCU at startup. 0: off
+TLM_PHASES = ('idle', 'search', 'vibWait', 'play', 'snack', 'park', 'cancelled', 'manual', 'calibrate') # APP_PHASE_xxx of app.h
+TLM_QUERY = ord('?') # 8-character packet from TCP client: answered with latest telemetry as one JSON line
+mcuState = None # latest telemetry, see decodeTelemetry()
+mcuStateLock = threading.Lock()
+CMD_STAT_TYPES = b'!MJSV' # commands whose dispatch latency is polled, one per second
+CMD_STAT_BINS = 12 # RPI_CST_BINS: bin 0 under 1ms, bin n 2^(n-1) ~ 2^n - 1 ms
+mcuCmdStat = {} # command character -> decodeCmdStat()
+SNACK_STATES = ('idle', 'lure', 'settle', 'approach', 'stop', 'door') # SNACK_ST_xxx of app.h
+SNACK_RESULTS = ('running', 'done', 'cancelled') # RPI_SNK_RES_xxx
+mcuSnack = None # last TYPE_SNACK_EVT, see decodeSnackEvt()
+MAN_STREAM = ord('J') # 8-character packet from TCP client: J ttt rrr . , throttle and turn + 100(000 ~ 200)
+MAN_STREAM_OFS = 100
+MAN_EXPO = 30 # TYPE_MANUAL_CFG sent at startup: response curve 0 linear ~ 100 cubic
+MAN_DEADMAN_MS = 300 # wheels stop if no manual update for this long. 0: off
+MAN_MAX_SPD = 0 # wheel speed at full stick. 0: MCU default
+MAN_FLAGS = 0 # RPI_MCF_FLAG_xxx. 0x01: dead-man also stops M01 ~ M04
+
+# link speed negotiation(rpicomm.h RPI_BAUD_xxx): start at BAUD_DEFAULT, step up to the fastest rate
+# that passes the test pattern, fall back to BAUD_DEFAULT on error bursts and try a lower rate later
+BAUD_NEGOTIATE = True
+BAUD_DEFAULT = 9600
+PI_BAUDS = (9600, 115200, 230400, 460800, 921600) # PL011 on 48MHz UART clock
+BAUD_GUARD = 0.05 # seconds around switching: MCU switches after its ACK is on the wire
+BAUD_TEST_LEN = 64
+BAUD_TEST_CNT = 3 # RPI_BAUD_TEST_CNT
+BAUD_VERIFY_TIME = 1.0 # RPI_BAUD_VERIFY_TIME: MCU reverts if test patterns do not arrive
+BAUD_ERR_BURST = 8 # CRC errors in one second, then fall back
+BAUD_RENEGOTIATE = 60 # seconds after a fallback before trying again(without the failed rate)
+baudRx = queue.Queue() # TYPE_BAUD_INFO and TYPE_BAUD_ECHO frames from reader thread
+failedBauds = set()
+renegotiateAt = None
+serLock = threading.Lock()
+
 # serial
-ser = serial.Serial('/dev/ttyAMA0', 9600, timeout=1)
+ser = serial.Serial('/dev/ttyAMA0', BAUD_DEFAULT, timeout=1)
 ser.close()
 time.sleep(0.2)
 ser.open()
@@ -61,9 +169,505 @@ def chkCat(): # capture cam, check if cat exists
     
 def serialSend(dta):
     global ser
-    ser.write(dta)
+    with serLock:
+        ser.write(dta)
+        ser.flush()
     time.sleep(0.05)
 
+def serialWrite(dta): # no pacing: binary link is flow controlled by ACK
+    with serLock:
+        ser.write(dta)
+
+def encodeFrame(ftype, payload, seq):
+    body = bytes([ftype, len(payload), seq]) + bytes(payload)
+    return bytes([FRAME_SYNC]) + body + struct.pack('<H', binascii.crc_hqx(body, 0xFFFF))
+
+def decodeLinkStat(payload): # TYPE_LINK_STAT payload -> dict. ages: ms, None if never
+    st = dict(zip(LINK_STAT_FIELDS, struct.unpack('<13I', payload[1:53])))
+    st['quality'] = payload[0]
+    for k in ('oreAge', 'feAge', 'neAge', 'peAge'):
+        if st[k] == 0xFFFFFFFF:
+            st[k] = None
+    return st
+
+def decodeTelemetry(payload): # TYPE_TELEMETRY payload(RPI_TLM_xxx of rpicomm.h) -> dict
+    (phase, pattern, flags, skdWait, rotA, spdA, rotB, spdB, tgtA, tgtB, servo, irDist, vibCnt,
+     patternQ, rxQ, motionQ, tick) = struct.unpack('<BBBI6BBHHBBBI', payload[:25])
+    return {
+        'phase': TLM_PHASES[phase] if phase < len(TLM_PHASES) else phase,
+        'pattern': None if pattern == 0xFF else pattern,
+        'skdSet': bool(flags & 0x01), 'skdRecv': bool(flags & 0x02), 'cancelled': bool(flags & 0x04),
+        'motorEna': bool(flags & 0x08), 'vibration': bool(flags & 0x10),
+        'aborted': bool(flags & 0x20), 'deadman': bool(flags & 0x40), 'skdPending': bool(flags & 0x80),
+        'skdWaitTime': skdWait,
+        'motor': {'rotA': rotA, 'spdA': spdA, 'rotB': rotB, 'spdB': spdB, 'tgtA': tgtA, 'tgtB': tgtB},
+        'servo': servo, 'irDistMM': irDist, 'vibCnt': vibCnt,
+        'patternQ': patternQ, 'rxQ': rxQ, 'motionQ': motionQ, 'mcuTick': tick,
+        'time': time.time(),
+    }
+
+def decodeCmdStat(payload): # TYPE_CMD_STAT payload(RPI_CST_xxx of rpicomm.h) -> (command character, dict)
+    cnt, dropped, latMax = struct.unpack('<3I', payload[1:13])
+    hist = struct.unpack('<%dH' % CMD_STAT_BINS, payload[13:13 + CMD_STAT_BINS * 2])
+    return chr(payload[0]), {'cnt': cnt, 'dropped': dropped, 'maxMs': latMax, 'hist': hist}
+
+def decodeCalList(payload): # TYPE_CAL_LIST payload(RPI_CLS_xxx of rpicomm.h) -> list of dicts in slot order
+    out = []
+    for i in range(payload[0]):
+        slot, flags, fireIn, period, duration, spd, snackIntv, progLen, plays = struct.unpack_from('<BBIIHBBBI', payload, 1 + i * 19)
+        out.append({'slot': slot, 'armed': bool(flags & 0x01), 'active': bool(flags & 0x02), 'wallClock': bool(flags & 0x04),
+                    'fireIn': fireIn, 'period': period,
+                    'duration': duration, 'speed': spd, 'snackIntv': snackIntv, 'progLen': progLen, 'plays': plays})
+    return out
+
+def decodeClockStat(payload): # TYPE_CLOCK_STAT payload(RPI_CKS_xxx of rpicomm.h) -> dict. ppm: drift of the crystal and calibration
+    now, flags, syncs, steps, lastOfs, maxSlew, drift, calib = struct.unpack('<IBIIiIii', payload[:29])
+    st = {k: bool(flags & (1 << i)) for i, k in enumerate(CLOCK_FLAGS)}
+    st.update({'mcuTime': now, 'syncs': syncs, 'steps': steps, 'lastOfsMs': lastOfs, 'maxSlewMs': maxSlew,
+               'driftPpm': drift / 100, 'calibPpm': calib / 100, 'time': time.time()})
+    return st
+
+def decodeMotionStat(payload): # TYPE_MOTION_STAT payload(RPI_MTS_xxx of rpicomm.h) -> dict
+    lens = list(payload[:motprog.USER_SLOTS])
+    runs, steps, cycAvg, cycMax = struct.unpack_from('<IIHH', payload, 4)
+    return {'slots': {motprog.USER_FIRST + i: n for i, n in enumerate(lens)}, 'runs': runs, 'steps': steps,
+            'cyclesPerStep': cycAvg, 'cyclesMax': cycMax, 'time': time.time()}
+
+def decodePlayReport(payload): # TYPE_PLAY_REPORT payload(RPI_PLR_xxx of rpicomm.h) -> dict. ms
+    res, slot, budget, elapsed, planned, actual, worst, items, overruns = struct.unpack('<BBIIIIiHH', payload[:26])
+    return {'result': PLAY_RESULTS[res] if res < len(PLAY_RESULTS) else res, 'slot': slot, 'budgetMs': budget,
+            'elapsedMs': elapsed, 'plannedMs': planned, 'actualMs': actual, 'worstMs': worst, 'items': items,
+            'overruns': overruns, 'time': time.time()}
+
+def clockNow(): # local time as the MCU keeps it: (seconds since 2000-01-01 local, ms)
+    now = time.time()
+    return calendar.timegm(time.localtime(now)) - CLOCK_EPOCH, int(now * 1000) % 1000
+
+def clockSyncPayload(): # taken when the frame goes out: Link encodes it again on retransmit
+    return struct.pack('<IH', *clockNow())
+
+def nextLocalTime(hh, mm): # next hh:mm local, seconds since 2000-01-01 local
+    sec = clockNow()[0]
+    at = sec - sec % 86400 + hh * 3600 + mm * 60
+    return at if at > sec else at + 86400
+
+def decodeSnackEvt(payload): # TYPE_SNACK_EVT payload(RPI_SNK_xxx of rpicomm.h) -> dict
+    st, progress, res, elapsed = struct.unpack('<BBBH', payload[:5])
+    return {
+        'state': SNACK_STATES[st] if st < len(SNACK_STATES) else st,
+        'progress': progress,
+        'result': SNACK_RESULTS[res] if res < len(SNACK_RESULTS) else res,
+        'elapsedMs': elapsed,
+        'time': time.time(),
+    }
+
+class FrameReader: # byte stream -> (type, seq, payload), same state machine as rpicomm.c
+    def __init__(self):
+        self.state = 0
+        self.crcErrs = 0
+
+    def reset(self): # drop partial frame, e.g. after changing baud rate
+        self.state = 0
+
+    def feed(self, dta):
+        frames = []
+        for c in dta:
+            if self.state == 0:
+                if c == FRAME_SYNC:
+                    self.hdr = bytearray()
+                    self.state = 1
+            elif self.state == 1: # type, len, seq
+                self.hdr.append(c)
+                if len(self.hdr) == 2 and c > MAX_PAYLOAD:
+                    self.state = 0
+                elif len(self.hdr) == 3:
+                    self.body = bytearray()
+                    self.state = 2
+            elif self.state == 2: # payload + crc
+                self.body.append(c)
+                if len(self.body) == self.hdr[1] + 2:
+                    self.state = 0
+                    dta = bytes(self.hdr) + bytes(self.body[:-2])
+                    if binascii.crc_hqx(dta, 0xFFFF) == struct.unpack('<H', bytes(self.body[-2:]))[0]:
+                        frames.append((self.hdr[0], self.hdr[2], bytes(self.body[:-2])))
+                    else:
+                        self.crcErrs += 1
+        return frames
+
+class Link: # sliding window sender: MCU delivers in order and ACKs each frame(rpicomm.c)
+    def __init__(self):
+        self.gate = threading.Event() # cleared while baud rate is negotiated: only bypass frames go out
+        self.gate.set()
+        self.cv = threading.Condition()
+        self.pending = [] # [seq, frame, tFirst, tSent, retries, (type, payload function) or None], oldest first
+        self.nextSeq = 0
+        self.stat = { 'sent': 0, 'acked': 0, 'retransmits': 0, 'timeouts': 0, 'naks': 0,
+                      'failed': 0, 'rttMin': None, 'rttMax': 0.0, 'rttSum': 0.0, 'rttCnt': 0 }
+
+    def _transmit(self, ent, now):
+        ent[3] = now
+        if ent[5] is not None: # time stamped payload: fresh on every transmission
+            ent[1] = encodeFrame(ent[5][0], ent[5][1](), ent[0])
+        serialWrite(ent[1])
+
+    def _push(self, ftype, payload): # payload: bytes, or function returning them when sent
+        with self.cv:
+            while len(self.pending) >= LINK_WINDOW:
+                self.cv.wait()
+            seq = self.nextSeq
+            self.nextSeq = (seq + 1) & 0xFF
+            now = time.monotonic()
+            if callable(payload):
+                ent = [seq, None, now, now, 0, (ftype, payload)]
+            else:
+                ent = [seq, encodeFrame(ftype, payload, seq), now, now, 0, None]
+            self.pending.append(ent)
+            self.stat['sent'] += 1
+            self._transmit(ent, now)
+            return seq
+
+    def send(self, ftype, payload, bypass = False): # blocks while the window is full or negotiation runs
+        if not bypass:
+            self.gate.wait()
+        return self._push(ftype, payload)
+
+    def trySend(self, ftype, payload): # returns None instead of waiting for the window
+        with self.cv: # RLock: _push takes it again
+            if len(self.pending) >= LINK_WINDOW or not self.gate.is_set():
+                return None
+            return self._push(ftype, payload)
+
+    def waitIdle(self, timeout): # wait until every frame is ACKed. returns False on timeout
+        with self.cv:
+            return self.cv.wait_for(lambda: not self.pending, timeout)
+
+    def drop(self): # forget outstanding frames(sent at a rate the MCU no longer uses)
+        with self.cv:
+            self.pending = []
+            self.cv.notify_all()
+
+    def reset(self): # restart sequence on MCU side from our nextSeq
+        with self.cv:
+            self.pending = []
+        self._push(TYPE_LINK_RESET, b'')
+
+    def _ackUpTo(self, seq, now): # in-order delivery: ACK of seq confirms every older frame
+        idx = next((i for i, e in enumerate(self.pending) if e[0] == seq), None)
+        if idx is None:
+            return
+        for ent in self.pending[:idx + 1]:
+            self.stat['acked'] += 1
+            if ent[4] == 0: # RTT only from frames sent once
+                rtt = now - ent[3]
+                st = self.stat
+                st['rttMin'] = rtt if st['rttMin'] is None else min(st['rttMin'], rtt)
+                st['rttMax'] = max(st['rttMax'], rtt)
+                st['rttSum'] += rtt
+                st['rttCnt'] += 1
+        del self.pending[:idx + 1]
+        self.cv.notify_all()
+
+    def _goBack(self, fromIdx, now):
+        for ent in self.pending[fromIdx:]:
+            ent[4] += 1
+            self.stat['retransmits'] += 1
+            self._transmit(ent, now)
+
+    def onFrame(self, ftype, payload): # ACK/NAK from reader thread
+        if len(payload) < 2:
+            return
+        seq, res = payload[0], payload[1]
+        now = time.monotonic()
+        with self.cv:
+            if ftype == TYPE_ACK:
+                self._ackUpTo(seq, now)
+                return
+            self.stat['naks'] += 1
+            if res == RES_ORDER: # seq is the one MCU expects: older ones arrived
+                idx = next((i for i, e in enumerate(self.pending) if e[0] == seq), None)
+                if idx is None: # everything outstanding arrived
+                    if self.pending:
+                        self._ackUpTo(self.pending[-1][0], now)
+                    return
+                if idx > 0:
+                    self._ackUpTo(self.pending[idx - 1][0], now)
+                self._goBack(0, now)
+            elif res == RES_BUSY: # retry after a while, let timer do it
+                for ent in self.pending:
+                    if ent[0] == seq:
+                        ent[3] = now - LINK_TIMEOUT + LINK_BUSY_RETRY
+            else: # CRC: seq unreliable
+                self._goBack(0, now)
+
+    def tick(self): # call periodically
+        now = time.monotonic()
+        with self.cv:
+            if not self.pending or now - self.pending[0][3] < LINK_TIMEOUT:
+                return
+            self.stat['timeouts'] += 1
+            if self.pending[0][4] >= LINK_MAX_RETRIES:
+                self.stat['failed'] += len(self.pending)
+                print('link: no ACK after %d retries, reset' % LINK_MAX_RETRIES)
+                self.pending = []
+                self.cv.notify_all()
+                resetNeeded = True
+            else:
+                self._goBack(0, now)
+                resetNeeded = False
+        if resetNeeded:
+            linkFailed('no ACK')
+            self.reset()
+
+    def statStr(self):
+        st = self.stat
+        avg = st['rttSum'] / st['rttCnt'] * 1000 if st['rttCnt'] else 0
+        return ('sent %d acked %d retransmits %d timeouts %d naks %d failed %d rtt %.0f/%.0f/%.0f ms'
+                % (st['sent'], st['acked'], st['retransmits'], st['timeouts'], st['naks'], st['failed'],
+                   (st['rttMin'] or 0) * 1000, avg, st['rttMax'] * 1000))
+
+link = Link()
+frameReader = FrameReader()
+
+class ManualStream: # newest stick value wins: sent when the link window has room, older values are dropped
+    def __init__(self):
+        self.cv = threading.Condition()
+        self.latest = None
+        self.stat = { 'recv': 0, 'sent': 0, 'dropped': 0 }
+
+    def put(self, thr, turn):
+        with self.cv:
+            if self.latest is not None:
+                self.stat['dropped'] += 1
+            self.latest = (thr, turn)
+            self.stat['recv'] += 1
+            self.cv.notify()
+
+    def run(self):
+        while 1:
+            with self.cv:
+                while self.latest is None:
+                    self.cv.wait()
+                thr, turn = self.latest
+                self.latest = None
+            link.send(TYPE_MANUAL_STREAM, struct.pack('<bb', thr, turn)) # waits for the window, values queue up in latest meanwhile
+            self.stat['sent'] += 1
+
+manStream = ManualStream()
+
+class ScheduleBuilder: # collects 8-character schedule packets of the app into one frame
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.waitTime = 0
+        self.duration = 1 # if no input, play only once
+        self.speed = 2
+        self.snackIntv = 0
+        self.slot = None # calendar slot from W packet. None: TYPE_SCHEDULE, slot 0 once
+        self.period = 0 # seconds
+        self.at = 0 # local time of first play from A packet, see clockNow(). 0: wait time of T packet
+        self.patterns = []
+        self.tStart = time.monotonic()
+
+    def feed(self, pkt): # pkt: 8 bytes. returns True if pkt was a schedule packet
+        t = chr(pkt[0])
+        body = pkt[1:8].decode('ascii', 'replace')
+        digits = body.split('.')[0]
+        if t == '<':
+            self.reset()
+        elif t == 'T':
+            self.waitTime = int(digits or 0)
+        elif t == 'D':
+            self.duration = int(digits or 0) or 1
+        elif t == 'V':
+            self.speed = min(int(digits[:1] or 0), 2)
+        elif t == 'N':
+            self.snackIntv = ord(body[0]) - 0x30
+        elif t == 'W': # slot digit, then period in minutes
+            self.slot = ord(body[0]) - 0x30
+            self.period = int(digits[1:] or 0) * 60
+        elif t == 'A': # hhmm local time of first play: next one from now
+            hhmm = int(digits[:4] or 0)
+            self.at = nextLocalTime(min(hhmm // 100, 23), min(hhmm % 100, 59))
+        elif t == 'P':
+            for c in body:
+                if c == '.':
+                    break
+                if len(self.patterns) < SKD_MAX_PATTERNS:
+                    self.patterns.append(ord(c) - 0x30)
+        else:
+            return False
+        return True
+
+    def fit(self): # does one play of every pattern fit the duration. seconds, see rpi/pattime.py
+        try:
+            ms, unknown = pattime.sessionMs(skdprog.compress(self.patterns), self.snackIntv, motionProgs)
+        except ValueError: # bad pattern code: rejected by MCU anyway
+            return None
+        return {'duration': self.duration, 'minimum': round(ms / 1000, 1), 'fits': ms <= self.duration * 1000, 'unknown': unknown}
+
+    def frame(self): # (type, payload) of the whole schedule
+        if self.slot is None and not self.at:
+            return TYPE_SCHEDULE, self.payload(SKD_MAX_PROG)
+        return TYPE_CAL_SET, struct.pack('<BII', self.slot or 0, self.period, self.at) + self.payload(SKD_MAX_PROG - CAL_HDR)
+
+    def payload(self, maxProg):
+        codes = self.patterns
+        try:
+            prog = skdprog.encode(skdprog.compress(codes))
+            while len(prog) > maxProg: # rare: no repetition to fold. drop the tail
+                codes = codes[:len(codes) * maxProg // len(prog)]
+                prog = skdprog.encode(skdprog.compress(codes))
+            if len(codes) < len(self.patterns):
+                print('schedule: program too long, %d of %d patterns kept' % (len(codes), len(self.patterns)))
+        except ValueError: # bad pattern code: MCU rejects the schedule as before
+            prog = bytes(c & 0xFF for c in codes[:maxProg])
+        return struct.pack('<IHBBB', self.waitTime, self.duration, self.speed, self.snackIntv,
+                           len(prog)) + prog
+
+def setBaud(baud):
+    with serLock:
+        ser.flush()
+        ser.baudrate = baud
+    frameReader.reset()
+
+def baudWait(ftype, results, timeout): # next TYPE_BAUD_INFO with result in results or TYPE_BAUD_ECHO, None on timeout
+    end = time.monotonic() + timeout
+    while True:
+        left = end - time.monotonic()
+        if left <= 0:
+            return None
+        try:
+            t, payload = baudRx.get(timeout = left)
+        except queue.Empty:
+            return None
+        if t == ftype and len(payload) >= 1 and (results is None or payload[0] in results):
+            return payload
+
+def baudTestPattern(n): # RPI_BAUD_TEST_BYTE
+    return bytes((0x55 ^ (i * 29)) & 0xFF for i in range(n))
+
+def trySwitchBaud(baud): # returns True if MCU verified the new rate
+    prev = ser.baudrate
+    link.send(TYPE_BAUD, struct.pack('<I', baud), bypass = True)
+    ans = baudWait(TYPE_BAUD_INFO, (BAUD_RES_SWITCH, BAUD_RES_UNSUPPORTED), 1.0)
+    if ans is None or ans[0] != BAUD_RES_SWITCH:
+        print('baud: switch to %d %s' % (baud, 'not answered' if ans is None else 'refused'))
+        return False
+    link.waitIdle(BAUD_GUARD) # ACK is sent right after the answer
+    link.drop()
+    time.sleep(BAUD_GUARD)
+    setBaud(baud)
+    tStart = time.monotonic()
+    time.sleep(BAUD_GUARD)
+    pat = baudTestPattern(BAUD_TEST_LEN)
+    rtts = []
+    for i in range(BAUD_TEST_CNT): # next pattern only after a good echo: MCU keeps the rate only if every echo came back
+        t0 = time.monotonic()
+        link.send(TYPE_BAUD_TEST, pat, bypass = True)
+        echo = baudWait(TYPE_BAUD_ECHO, None, 0.3)
+        if echo is None or echo[0] != 0 or bytes(echo[1:]) != pat:
+            print('baud: test pattern %d at %d %s' % (i, baud, 'lost' if echo is None else 'corrupted'))
+            break
+        rtts.append(time.monotonic() - t0)
+    else:
+        if baudWait(TYPE_BAUD_INFO, (BAUD_RES_VERIFIED,), 0.3) is not None:
+            link.waitIdle(0.3)
+            print('baud: switched to %d, test echo %.1f ms(%d bytes)' % (baud, min(rtts) * 1000, BAUD_TEST_LEN + 6))
+            return True
+    time.sleep(max(0, BAUD_VERIFY_TIME + 0.2 - (time.monotonic() - tStart))) # MCU reverts after verify time
+    link.drop()
+    setBaud(prev)
+    failedBauds.add(baud)
+    print('baud: %d failed, back to %d' % (baud, prev))
+    link.reset()
+    return False
+
+def negotiateBaud(): # capability query, then try the fastest common rate first
+    link.gate.clear()
+    try:
+        while not baudRx.empty():
+            baudRx.get()
+        link.send(TYPE_BAUD, b'', bypass = True)
+        caps = baudWait(TYPE_BAUD_INFO, (BAUD_RES_CAPS,), 1.0)
+        if caps is None:
+            print('baud: no answer to capability query(old firmware?), staying at %d' % ser.baudrate)
+            return
+        mcuBauds = [struct.unpack('<I', caps[i:i + 4])[0] for i in range(5, len(caps) - 3, 4)]
+        cands = sorted((b for b in mcuBauds if b in PI_BAUDS and b > ser.baudrate and b not in failedBauds), reverse = True)
+        print('baud: MCU supports %s, trying %s' % (mcuBauds, cands))
+        for baud in cands:
+            if trySwitchBaud(baud):
+                return
+        print('baud: staying at %d' % ser.baudrate)
+    finally:
+        link.gate.set()
+
+def linkFailed(why): # error burst or no ACK above BAUD_DEFAULT: fall back, MCU does the same on its errors
+    global renegotiateAt
+    if ser.baudrate == BAUD_DEFAULT:
+        return
+    print('baud: %s at %d, fall back to %d' % (why, ser.baudrate, BAUD_DEFAULT))
+    failedBauds.add(ser.baudrate)
+    setBaud(BAUD_DEFAULT)
+    renegotiateAt = time.monotonic() + BAUD_RENEGOTIATE
+
+def linkSend(pkt): # pkt: 8-character packet from the app
+    if LINK_MODE == 'ascii':
+        serialSend(pkt)
+    else:
+        link.send(pkt[0], pkt[1:8])
+
+def calendarList(): # asks MCU for its calendar. list of decodeCalList() entries, None if no answer
+    while not calRx.empty():
+        calRx.get_nowait()
+    link.send(TYPE_CAL_LIST_REQ, b'')
+    try:
+        return decodeCalList(calRx.get(timeout = CAL_LIST_TIMEOUT))
+    except queue.Empty:
+        return None
+
+def motionUpload(): # patterns of MOTION_DIR to MCU slots, empty slots deleted. decodeMotionStat() of the answer, None if none
+    while not motionRx.empty():
+        motionRx.get_nowait()
+    for code in range(motprog.USER_FIRST, motprog.USER_FIRST + motprog.USER_SLOTS):
+        prog = b''
+        try:
+            with open(os.path.join(MOTION_DIR, '%d.txt' % code)) as f:
+                prog = motprog.assemble(f.read())
+            if len(prog) > motprog.MAX_LEN:
+                raise ValueError('%d bytes' % len(prog))
+        except FileNotFoundError:
+            pass
+        except ValueError as e:
+            print('pattern %d: %s' % (code, e))
+            prog = b''
+        motionProgs[code] = prog
+        link.send(TYPE_MOTION_SET, bytes([code]) + prog)
+    st = None
+    try: # one answer per accepted upload: the last one has every slot
+        for _ in range(motprog.USER_SLOTS):
+            st = decodeMotionStat(motionRx.get(timeout = MOTION_TIMEOUT))
+    except queue.Empty:
+        pass
+    return st
+
+def parseManStream(pkt): # J ttt rrr . -> (throttle, turn), None if malformed
+    try:
+        thr = int(pkt[1:4].decode('ascii')) - MAN_STREAM_OFS
+        turn = int(pkt[4:7].decode('ascii')) - MAN_STREAM_OFS
+    except ValueError:
+        return None
+    if abs(thr) > 100 or abs(turn) > 100:
+        return None
+    return thr, turn
+
+def linkSendFoundCat():
+    if LINK_MODE == 'ascii':
+        serialSend(serialDtaFoundCat)
+    else:
+        link.send(TYPE_FOUNDCAT, b'1')
+
 # END FUNDAMENTAL FUNC
 
 # BEGIN THREADED FUNC
@@ -75,17 +679,128 @@ def thr_conn():
     #s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDP, 1)
     s.bind((HOST, PORT))
     s.listen()
+    skd = ScheduleBuilder()
     while 1:
         clientSock, addr = s.accept()
         while 1:
-            global tcpDta
+            global tcpDta, playFit
             tcpDta = clientSock.recv(8)
             if not tcpDta:
+                if LINK_MODE == 'binary':
+                    manStream.put(0, 0) # client gone: do not wait for the dead-man
                 break
+            elif tcpDta[0] == MAN_STREAM and LINK_MODE == 'binary':
+                val = parseManStream(tcpDta)
+                if val is not None:
+                    manStream.put(*val)
+            elif tcpDta[0] == TLM_QUERY:
+                with mcuStateLock:
+                    st = None if mcuState is None else dict(mcuState, cmdLat = dict(mcuCmdStat), snack = mcuSnack, clock = mcuClock, motion = mcuMotion, play = mcuPlay)
+                clientSock.sendall((json.dumps(st) + '\n').encode('ascii'))
+            elif tcpDta[0] == CAL_QUERY and LINK_MODE == 'binary':
+                clientSock.sendall((json.dumps(calendarList()) + '\n').encode('ascii'))
+            elif tcpDta[0] == MOTION_RELOAD and LINK_MODE == 'binary':
+                clientSock.sendall((json.dumps(motionUpload()) + '\n').encode('ascii'))
+            elif tcpDta[0] == PLAY_TIME_QUERY:
+                clientSock.sendall((json.dumps({'table': pattime.table(), 'last': playFit}) + '\n').encode('ascii'))
+            elif LINK_MODE == 'binary' and skd.feed(tcpDta):
+                if tcpDta[0] == ord('>'): # schedule complete: one frame
+                    ftype, payload = skd.frame()
+                    link.send(ftype, payload)
+                    print('schedule upload%s: %d patterns, %d bytes, %.0f ms from first packet'
+                          % (('' if skd.slot is None else ' to slot %d every %d s' % (skd.slot, skd.period))
+                             + ('' if not skd.at else ' at %s' % time.strftime('%m-%d %H:%M', time.gmtime(skd.at + CLOCK_EPOCH))),
+                             len(skd.patterns), len(payload) + 6, (time.monotonic() - skd.tStart) * 1000))
+                    print('link: ' + link.statStr())
+                    playFit = skd.fit()
+                    if playFit is not None and not playFit['fits']:
+                        print('schedule: every pattern once takes %.1f s, over the duration of %d s: patterns are played once'
+                              % (playFit['minimum'], playFit['duration']))
             else:
-                serialSend(tcpDta)
+                linkSend(tcpDta)
                 #print(tcpDta)
 
+def thr_serialRead():
+    global mcuLinkStat, mcuState, mcuSnack, mcuClock, mcuMotion, mcuPlay
+    while 1:
+        dta = ser.read(max(1, ser.in_waiting))
+        for ftype, seq, payload in frameReader.feed(dta):
+            if ftype == TYPE_ACK or ftype == TYPE_NAK:
+                link.onFrame(ftype, payload)
+            elif ftype == TYPE_BAUD_INFO or ftype == TYPE_BAUD_ECHO:
+                if ftype == TYPE_BAUD_INFO and len(payload) >= 5 and payload[0] == BAUD_RES_FALLBACK:
+                    print('baud: MCU fell back to %d' % struct.unpack('<I', payload[1:5])[0])
+                baudRx.put((ftype, payload))
+            elif ftype == TYPE_TELEMETRY and len(payload) >= 25:
+                st = decodeTelemetry(payload)
+                with mcuStateLock:
+                    mcuState = st
+            elif ftype == TYPE_CAL_LIST and len(payload) >= 1 and len(payload) >= 1 + payload[0] * 19:
+                calRx.put(payload)
+            elif ftype == TYPE_CMD_STAT and len(payload) >= 13 + CMD_STAT_BINS * 2:
+                cmd, st = decodeCmdStat(payload)
+                with mcuStateLock:
+                    mcuCmdStat[cmd] = st
+            elif ftype == TYPE_CLOCK_STAT and len(payload) >= 29:
+                st = decodeClockStat(payload)
+                if mcuClock is None or st['steps'] != mcuClock['steps'] or st['calibPpm'] != mcuClock['calibPpm']:
+                    print('MCU clock: offset %d ms, %d syncs %d steps, max slew %d ms, drift %+.2f ppm, calibration %+.2f ppm'
+                          % (st['lastOfsMs'], st['syncs'], st['steps'], st['maxSlewMs'], st['driftPpm'], st['calibPpm']))
+                with mcuStateLock:
+                    mcuClock = st
+            elif ftype == TYPE_MOTION_STAT and len(payload) >= 16:
+                st = decodeMotionStat(payload)
+                with mcuStateLock:
+                    mcuMotion = st
+                motionRx.put(payload)
+            elif ftype == TYPE_PLAY_REPORT and len(payload) >= 26:
+                st = decodePlayReport(payload)
+                print('play of slot %d %s: %.1f s of %.1f s(%+.1f s), %d items planned %.1f s took %.1f s, worst item %+.1f s, %d overruns'
+                      % (st['slot'], st['result'], st['elapsedMs'] / 1000, st['budgetMs'] / 1000, (st['elapsedMs'] - st['budgetMs']) / 1000,
+                         st['items'], st['plannedMs'] / 1000, st['actualMs'] / 1000, st['worstMs'] / 1000, st['overruns']))
+                with mcuStateLock:
+                    mcuPlay = st
+            elif ftype == TYPE_SNACK_EVT and len(payload) >= 5:
+                st = decodeSnackEvt(payload)
+                if st['result'] != 'running':
+                    print('snack %s in %s after %d ms' % (st['result'], st['state'], st['elapsedMs']))
+                with mcuStateLock:
+                    mcuSnack = st
+            elif ftype == TYPE_LINK_STAT and len(payload) >= 53:
+                st = decodeLinkStat(payload)
+                errs = st['ore'] + st['fe'] + st['ne'] + st['pe']
+                if mcuLinkStat is None or errs != mcuLinkStat['ore'] + mcuLinkStat['fe'] + mcuLinkStat['ne'] + mcuLinkStat['pe']:
+                    print('MCU link: quality %d%% ORE %d FE %d NE %d PE %d restarts %d crc %d'
+                          % (st['quality'], st['ore'], st['fe'], st['ne'], st['pe'], st['restarts'], st['crc']))
+                mcuLinkStat = st
+
+def thr_linkTimer():
+    global renegotiateAt
+    tStat = time.monotonic()
+    tErr = time.monotonic()
+    crcErrs = 0
+    cmdStatIdx = 0
+    tClock = time.monotonic()
+    while 1:
+        time.sleep(0.05)
+        link.tick()
+        now = time.monotonic()
+        if now - tStat >= LINK_STAT_INTV:
+            tStat = now
+            link.trySend(TYPE_LINK_STAT_REQ, b'') # must not block: this thread retransmits
+        if now - tClock >= CLOCK_SYNC_INTV and link.trySend(TYPE_CLOCK_SYNC, clockSyncPayload) is not None:
+            tClock = now
+        if now - tErr >= 1.0:
+            tErr = now
+            link.trySend(TYPE_CMD_STAT_REQ, CMD_STAT_TYPES[cmdStatIdx:cmdStatIdx + 1]) # one command per second
+            cmdStatIdx = (cmdStatIdx + 1) % len(CMD_STAT_TYPES)
+            if frameReader.crcErrs - crcErrs >= BAUD_ERR_BURST:
+                linkFailed('%d CRC errors in 1s' % (frameReader.crcErrs - crcErrs))
+            crcErrs = frameReader.crcErrs
+        if renegotiateAt is not None and now >= renegotiateAt and BAUD_NEGOTIATE:
+            renegotiateAt = None
+            threading.Thread(target = negotiateBaud, daemon = True).start()
+
 # END THREADED FUNC
 
 def main(): 
@@ -94,9 +809,20 @@ def main():
         time.sleep(0.005)
         found = chkCat()
         if found >= 1:
-            serialSend(serialDtaFoundCat)
+            linkSendFoundCat()
             time.sleep(3)
 
+if LINK_MODE == 'binary':
+    threading.Thread(target = thr_serialRead, daemon = True).start()
+    threading.Thread(target = thr_linkTimer, daemon = True).start()
+    link.reset()
+    if BAUD_NEGOTIATE:
+        negotiateBaud()
+    link.send(TYPE_TELEMETRY_CFG, struct.pack('<H', TELEMETRY_INTV))
+    link.send(TYPE_MANUAL_CFG, struct.pack('<BHBB', MAN_EXPO, MAN_DEADMAN_MS, MAN_MAX_SPD, MAN_FLAGS))
+    link.send(TYPE_CLOCK_SYNC, clockSyncPayload) # RTC of MCU runs over its resets, steps only after a power loss
+    threading.Thread(target = motionUpload, daemon = True).start() # slots of MCU are RAM
+    threading.Thread(target = manStream.run, daemon = True).start()
 thr_1 = threading.Thread(target = thr_conn)
 thr_1.start()
 while 1:
@@ -0,0 +1,206 @@
+# motprog.py
+# Motion program of a play pattern(Inc/motprog.h): assembler, disassembler and checker.
+# Used by ccb.py to upload patterns 10 ~ 13 with TYPE_MOTION_SET and by rpi/pattime.py to size them.
+#
+# text form, one op per line, '#' starts a comment, 'name:' labels the next op:
+#   drive ccw:drv+os cw:drv+os 400   wheel A, wheel B(direction:speed), ms
+#                                    direction: stop cw ccw, speed: 0 ~ 100 or drv rot minrot defrot
+#                                    with +os(overshoot) +hos(half overshoot) +cir(circle addend)
+#   wait 100                         wait until wheels stop, then ms
+#   loop 5 ... next                  repeat body, nested up to MAX_DEPTH
+#   loopv intv 3 2 1 ... next        repeat intv / 3 times, 1 if under 2(param: intv or wait)
+#   br irnear flee                   jump to label if condition(always irnear irfar vib novib)
+#   sound 0                          melody id of the MCU(0 pattern 1 found cat 2 snack 3 alarm 4 ack)
+#   laser on                         on / off, off again at the end
+#   servo 0 120 500                  servo motor, angle, ms. door closes again at the end
+#   end
+
+OPS = ('end', 'drive', 'wait', 'loop', 'loopv', 'next', 'br', 'sound', 'laser', 'servo') # opcode = index
+OP_LEN = (0, 5, 2, 1, 4, 0, 2, 1, 1, 4) # operand bytes
+DIRS = ('stop', 'cw', 'ccw')
+CONDS = ('always', 'irnear', 'irfar', 'vib', 'novib')
+SPD_BASES = ('drv', 'rot', 'minrot', 'defrot')
+SPD_ADDS = ('', 'os', 'hos', 'cir')
+PARAMS = ('intv', 'wait')
+SPD_SYM = 0x80
+MAX_DEPTH = 4
+MAX_LEN = 127 # MOTPROG_MAX_LEN
+MAX_SPD = 100
+USER_FIRST = 10
+USER_SLOTS = 4
+
+
+def _spd(s):
+    if s.isdigit():
+        v = int(s)
+        if v > MAX_SPD:
+            raise ValueError('speed %d' % v)
+        return v
+    base, _, add = s.partition('+')
+    return SPD_SYM | SPD_BASES.index(base) << 2 | SPD_ADDS.index(add)
+
+
+def _spdStr(v):
+    if not v & SPD_SYM:
+        return str(v)
+    add = SPD_ADDS[v & 3]
+    return SPD_BASES[(v >> 2) & 3] + ('+' + add if add else '')
+
+
+def _wheel(s): # 'ccw:drv+os' -> (dir, spd)
+    d, _, spd = s.partition(':')
+    return DIRS.index(d), _spd(spd or '0')
+
+
+def assemble(text):
+    # text -> bytes. raises ValueError on syntax errors and where check() fails
+    lines = []
+    labels = {}
+    pc = 0
+    for raw in text.splitlines():
+        toks = raw.split('#', 1)[0].split()
+        while toks and toks[0].endswith(':'):
+            labels[toks.pop(0)[:-1]] = pc
+        if not toks:
+            continue
+        op = OPS.index(toks[0].lower())
+        lines.append((pc, op, toks[1:]))
+        pc += 1 + OP_LEN[op]
+    out = bytearray()
+    for pc, op, args in lines:
+        try:
+            if op == 1:
+                (da, sa), (db, sb) = _wheel(args[0].lower()), _wheel(args[1].lower())
+                ms = int(args[2])
+                a = [da | db << 4, sa, sb, ms & 0xFF, ms >> 8]
+            elif op == 2:
+                a = [int(args[0]) & 0xFF, int(args[0]) >> 8]
+            elif op == 3:
+                a = [int(args[0])]
+            elif op == 4:
+                a = [PARAMS.index(args[0].lower())] + [int(x) for x in args[1:4]]
+            elif op == 6:
+                rel = labels[args[1]] - (pc + 3)
+                if not -128 <= rel <= 127:
+                    raise ValueError('branch to %s too far' % args[1])
+                a = [CONDS.index(args[0].lower()), rel & 0xFF]
+            elif op == 7:
+                a = [int(args[0])]
+            elif op == 8:
+                a = [('off', 'on').index(args[0].lower())]
+            elif op == 9:
+                ms = int(args[2])
+                a = [int(args[0]), int(args[1]), ms & 0xFF, ms >> 8]
+            else:
+                a = []
+        except (IndexError, KeyError) as e:
+            raise ValueError('%s at %d: %r' % (OPS[op], pc, e))
+        if len(a) != OP_LEN[op] or any(not 0 <= x <= 255 for x in a):
+            raise ValueError('%s at %d: operand out of range' % (OPS[op], pc))
+        out += bytes([op] + a)
+    check(bytes(out))
+    return bytes(out)
+
+
+def disassemble(p):
+    # bytes -> text that assembles to the same bytes. labels: L<pc>
+    targets = set()
+    pc = 0
+    while pc < len(p):
+        if p[pc] == 6:
+            targets.add(pc + 3 + (p[pc + 2] - 256 if p[pc + 2] > 127 else p[pc + 2]))
+        pc += 1 + OP_LEN[p[pc]]
+    out = []
+    pc = 0
+    depth = 0
+    while pc <= len(p):
+        if pc in targets:
+            out.append('L%d:' % pc)
+        if pc == len(p):
+            break
+        op = p[pc]
+        a = p[pc + 1:pc + 1 + OP_LEN[op]]
+        if op == 5:
+            depth -= 1
+        if op == 1:
+            s = 'drive %s:%s %s:%s %d' % (DIRS[a[0] & 15], _spdStr(a[1]), DIRS[a[0] >> 4], _spdStr(a[2]), a[3] | a[4] << 8)
+        elif op in (2,):
+            s = 'wait %d' % (a[0] | a[1] << 8)
+        elif op == 4:
+            s = 'loopv %s %d %d %d' % (PARAMS[a[0]], a[1], a[2], a[3])
+        elif op == 6:
+            s = 'br %s L%d' % (CONDS[a[0]], pc + 3 + (a[1] - 256 if a[1] > 127 else a[1]))
+        elif op == 8:
+            s = 'laser ' + ('off', 'on')[a[0]]
+        elif op == 9:
+            s = 'servo %d %d %d' % (a[0], a[1], a[2] | a[3] << 8)
+        else:
+            s = ' '.join([OPS[op]] + [str(x) for x in a])
+        out.append('    ' * max(depth, 0) + s)
+        if op in (3, 4):
+            depth += 1
+        pc += 1 + OP_LEN[op]
+    return '\n'.join(out)
+
+
+def check(p):
+    # raises ValueError where motprog_check() of the MCU returns FALSE
+    starts = set()
+    depth = 0
+    pc = 0
+    while pc < len(p):
+        op = p[pc]
+        if op >= len(OPS) or pc + 1 + OP_LEN[op] > len(p):
+            raise ValueError('bad op or missing operand at %d' % pc)
+        a = p[pc + 1:pc + 1 + OP_LEN[op]]
+        starts.add(pc)
+        if op == 1 and ((a[0] & 15) > 2 or (a[0] >> 4) > 2 or not all(s <= MAX_SPD or s & 0xF0 == SPD_SYM for s in a[1:3])):
+            raise ValueError('drive at %d' % pc)
+        if op in (3, 4):
+            if depth >= MAX_DEPTH or (op == 3 and a[0] == 0) or (op == 4 and (a[0] >= len(PARAMS) or 0 in a[1:4])):
+                raise ValueError('loop at %d' % pc)
+            depth += 1
+        if op == 5:
+            if depth == 0:
+                raise ValueError('next without loop at %d' % pc)
+            depth -= 1
+        if (op == 6 and a[0] >= len(CONDS)) or (op == 8 and a[0] > 1):
+            raise ValueError('operand at %d' % pc)
+        pc += 1 + OP_LEN[op]
+    if depth:
+        raise ValueError('loop without next')
+    pc = 0
+    while pc < len(p):
+        if p[pc] == 6:
+            t = pc + 3 + (p[pc + 2] - 256 if p[pc + 2] > 127 else p[pc + 2])
+            if t < 0 or t > len(p) or (t < len(p) and t not in starts):
+                raise ValueError('branch at %d lands on %d' % (pc, t))
+        pc += 1 + OP_LEN[p[pc]]
+
+
+def duration(p, intv=1, wait=20, reps=0):
+    # ms of drive and wait ops up to the first end, no branch taken: motprog_time() of the MCU.
+    # intv, wait: loopv params in seconds. reps: runs of every 'loopv intv', 0: intv / div as programmed
+    def runs(op, a):
+        if op == 3:
+            return a[0]
+        if a[0] == 0 and reps:
+            return reps
+        cnt = max(intv if a[0] == 0 else wait, 0) // a[1]
+        return min(a[3] if cnt < a[2] else cnt, 0xFFFF)
+    mult = [1]
+    ms = 0
+    pc = 0
+    while pc < len(p) and p[pc] != 0:
+        op = p[pc]
+        a = p[pc + 1:pc + 1 + OP_LEN[op]]
+        if op == 1:
+            ms += mult[-1] * (a[3] | a[4] << 8)
+        elif op == 2:
+            ms += mult[-1] * (a[0] | a[1] << 8)
+        elif op in (3, 4):
+            mult.append(mult[-1] * runs(op, a))
+        elif op == 5:
+            mult.pop()
+        pc += 1 + OP_LEN[op]
+    return min(ms, 0xFFFFFFFF)
@@ -0,0 +1,82 @@
+# pattime.py
+# Play time of patterns and schedules from rpi/pattime.json, the table tools/gen_pattime.py
+# generates with Inc/pattime.h and Src/pattime.c. Used by ccb.py to tell before upload whether
+# a schedule fits its duration; uploaded patterns 10 ~ 13 are sized with motprog.duration().
+#
+# a pattern takes gapMs + baseMs + repMs x runs:
+#   runs: interval // div(dflt if under min) when the schedule sets an interval,
+#         else repeats of the play plan, 1 ~ maxRuns(at least 1 in the minimum of a session)
+
+import json
+import os
+
+import motprog
+import skdprog
+
+SNACK_OFF = 0xFF # RPI_SKD_SNACK_OFF
+AUTO_NEXT = (5, 4, 7, 2, 9, 6, 1, 5, 3, 8) # autoNext[] of Src/app.c: auto-decided pattern after the previous one
+
+_table = None
+
+
+def load(path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'pattime.json')):
+    global _table
+    with open(path) as f:
+        _table = json.load(f)
+    return _table
+
+
+def table():
+    return _table if _table is not None else load()
+
+
+def patternMs(code, intv = None, runs = 1, userProgs = None):
+    # ms of one play of a pattern, gap included. intv: seconds set by the schedule, None: runs of the plan.
+    # userProgs: {code: motion program bytes} of uploaded patterns. None if the pattern is unknown
+    t = table()
+    row = t['patterns'].get(str(code))
+    if row is not None:
+        if intv is not None:
+            runs = 0
+            if row['div']:
+                runs = intv // row['div']
+                runs = row['dflt'] if runs < row['min'] else runs
+        runs = min(runs, row['maxRuns']) if row['repMs'] else 0
+        return t['gapMs'] + row['baseMs'] + row['repMs'] * runs
+    prog = (userProgs or {}).get(code)
+    if not prog:
+        return None
+    if intv is not None:
+        return t['gapMs'] + motprog.duration(prog, intv, t['waitS'])
+    return t['gapMs'] + motprog.duration(prog, 1, t['waitS'], runs)
+
+
+def sessionMs(items, snackIntv = SNACK_OFF, userProgs = None):
+    # minimum ms of a session: every pattern and snack once, in the order of autoDrive(). (ms, unknown codes)
+    t = table()
+    ms = 0
+    unknown = set()
+    cnt = -1 # snack interval count
+    prev = 0
+    for e in skdprog.expand(items) + [None]: # None: end of program, read after the last entry
+        if snackIntv != SNACK_OFF:
+            cnt += 1
+            if cnt >= snackIntv:
+                cnt = 0
+                ms += t['snackMs']
+        if e is None:
+            break
+        if e == 'k': # snack op: interval count unchanged
+            ms += t['snackMs']
+            cnt -= 1
+            continue
+        code, _, intv = e
+        if not code:
+            code = AUTO_NEXT[prev if prev < motprog.USER_FIRST else 0]
+        prev = code
+        one = patternMs(code, intv, 1, userProgs)
+        if one is None:
+            unknown.add(code)
+        else:
+            ms += one
+    return ms, sorted(unknown)
@@ -0,0 +1,217 @@
+# skdprog.py
+# Pattern program of a schedule(Inc/skdprog.h): text form, encoder, decoder and compressor.
+# Used by ccb.py to pack the pattern list of the app into one TYPE_SCHEDULE frame.
+#
+# text form, items separated by spaces:
+#   3         play pattern 3(0: auto-decide)
+#   3*5       play pattern 3 five times
+#   (1 2)*4   loop, nested up to MAX_DEPTH
+#   s2:3      speed 2 for this item(also s2:3*5)
+#   t90:3     interval 90 seconds for this item(also t90:3*5, s0:t90:3)
+#   k         snack
+# A flat list of codes 0 ~ 9 encodes to the same bytes as before(one byte per pattern).
+
+OP_PLAY = 0x00
+OP_REPEAT = 0x10
+OP_LOOP = 0x20
+OP_END = 0x30
+OP_SPEED = 0x40
+OP_INTV = 0x50
+OP_SNACK = 0x60
+MAX_DEPTH = 4
+MAX_CODE = 13 # 10 ~ 13: uploaded motion programs(rpi/motprog.py)
+MAX_INTV = 4095
+MAX_CNT = 255
+
+# items: ('play', code, cnt, spd, intv) / ('loop', cnt, [items]) / ('snack',). spd, intv: None if not overridden
+
+
+def parse(text):
+    items, rest = _parseSeq(text.replace('(', ' ( ').replace(')', ' ) ').split(), 0)
+    if rest:
+        raise ValueError('unbalanced ")"')
+    return items
+
+
+def _parseSeq(toks, depth):
+    items = []
+    while toks:
+        tok = toks.pop(0)
+        if tok == '(':
+            if depth >= MAX_DEPTH:
+                raise ValueError('loops nested deeper than %d' % MAX_DEPTH)
+            body, closed = _parseSeq(toks, depth + 1)
+            if not closed:
+                raise ValueError('missing ")"')
+            cnt = 1
+            if toks and toks[0].startswith('*'):
+                cnt = int(toks.pop(0)[1:])
+            items.append(('loop', cnt, body))
+        elif tok.startswith(')'):
+            if tok != ')': # ")*n" was split to ")" "*n"
+                raise ValueError('bad token %r' % tok)
+            return items, True
+        elif tok == 'k':
+            items.append(('snack',))
+        else:
+            spd = intv = None
+            while ':' in tok:
+                mod, tok = tok.split(':', 1)
+                if mod[0] == 's':
+                    spd = int(mod[1:])
+                elif mod[0] == 't':
+                    intv = int(mod[1:])
+                else:
+                    raise ValueError('bad modifier %r' % mod)
+            code, _, cnt = tok.partition('*')
+            items.append(('play', int(code), int(cnt or 1), spd, intv))
+    return items, False
+
+
+def format(items):
+    out = []
+    for it in items:
+        if it[0] == 'snack':
+            out.append('k')
+        elif it[0] == 'loop':
+            out.append('(%s)*%d' % (format(it[2]), it[1]))
+        else:
+            _, code, cnt, spd, intv = it
+            s = ('s%d:' % spd if spd is not None else '') + ('t%d:' % intv if intv is not None else '') + str(code)
+            out.append(s + ('*%d' % cnt if cnt > 1 else ''))
+    return ' '.join(out)
+
+
+def encode(items):
+    out = bytearray()
+    for it in items:
+        if it[0] == 'snack':
+            out.append(OP_SNACK)
+        elif it[0] == 'loop':
+            cnt = it[1]
+            if not 1 <= cnt <= MAX_CNT or not it[2]:
+                raise ValueError('loop count %d or empty body' % cnt)
+            out += bytes([OP_LOOP, cnt]) + encode(it[2]) + bytes([OP_END])
+        else:
+            _, code, cnt, spd, intv = it
+            if not 0 <= code <= MAX_CODE or not 1 <= cnt:
+                raise ValueError('pattern %d count %d' % (code, cnt))
+            pre = bytearray()
+            if spd is not None:
+                if not 0 <= spd <= 2:
+                    raise ValueError('speed %d' % spd)
+                pre.append(OP_SPEED | spd)
+            if intv is not None:
+                if not 0 <= intv <= MAX_INTV:
+                    raise ValueError('interval %d' % intv)
+                pre += bytes([OP_INTV | (intv >> 8), intv & 0xFF])
+            while cnt > 0: # over 255: split, overrides go with every part
+                n = min(cnt, MAX_CNT)
+                out += pre + (bytes([OP_PLAY | code]) if n == 1 else bytes([OP_REPEAT | code, n]))
+                cnt -= n
+    return bytes(out)
+
+
+def decode(prog):
+    # bytes -> items. raises ValueError where skdprog_check() of the MCU returns FALSE
+    items, pc = _decodeSeq(prog, 0, 0)
+    if pc != len(prog):
+        raise ValueError('END without LOOP at %d' % pc)
+    return items
+
+
+def _decodeSeq(p, pc, depth):
+    items = []
+    spd = intv = None
+    while pc < len(p):
+        op, arg = p[pc] & 0xF0, p[pc] & 0x0F
+        if op in (OP_PLAY, OP_REPEAT):
+            if arg > MAX_CODE:
+                raise ValueError('pattern code %d at %d' % (arg, pc))
+            cnt = 1
+            if op == OP_REPEAT:
+                if pc + 1 >= len(p) or p[pc + 1] < 2:
+                    raise ValueError('repeat count at %d' % pc)
+                cnt = p[pc + 1]
+            items.append(('play', arg, cnt, spd, intv))
+            spd = intv = None
+            pc += 2 if op == OP_REPEAT else 1
+        elif op == OP_LOOP:
+            if arg or pc + 1 >= len(p) or p[pc + 1] == 0 or depth >= MAX_DEPTH or spd is not None or intv is not None:
+                raise ValueError('loop at %d' % pc)
+            body, end = _decodeSeq(p, pc + 2, depth + 1)
+            if end >= len(p) or not body:
+                raise ValueError('loop at %d: missing END or empty body' % pc)
+            items.append(('loop', p[pc + 1], body))
+            pc = end + 1
+        elif op == OP_END and arg == 0 and depth > 0 and spd is None and intv is None:
+            return items, pc
+        elif op == OP_SPEED and arg <= 2:
+            spd = arg
+            pc += 1
+        elif op == OP_INTV and pc + 1 < len(p):
+            intv = (arg << 8) | p[pc + 1]
+            pc += 2
+        elif op == OP_SNACK and arg == 0 and spd is None and intv is None:
+            items.append(('snack',))
+            pc += 1
+        else:
+            raise ValueError('bad op 0x%02X at %d' % (p[pc], pc))
+    if spd is not None or intv is not None:
+        raise ValueError('override at end')
+    return items, pc
+
+
+def expand(items):
+    # items -> flat list of entries as the MCU iterator returns them: (code, spd, intv) or 'k'
+    out = []
+    for it in items:
+        if it[0] == 'snack':
+            out.append('k')
+        elif it[0] == 'loop':
+            body = expand(it[2])
+            out += body * it[1]
+        else:
+            out += [(it[1], it[3], it[4])] * it[2]
+    return out
+
+
+def plays(items): # patterns played, without expanding
+    n = 0
+    for it in items:
+        if it[0] == 'loop':
+            n += it[1] * plays(it[2])
+        elif it[0] == 'play':
+            n += it[2]
+    return n
+
+
+def compress(codes, maxBlock = 16):
+    # flat list of pattern codes -> items with repeats and loops. greedy: at each position take the
+    # block(1 ~ maxBlock codes) and repeat count that save the most bytes, body compressed again
+    items = []
+    i = 0
+    while i < len(codes):
+        best = (0, 1, 1) # saved bytes, block length, count
+        for blk in range(1, maxBlock + 1):
+            if i + blk * 2 > len(codes):
+                break
+            cnt = 1
+            while cnt < MAX_CNT and codes[i + cnt * blk:i + (cnt + 1) * blk] == codes[i:i + blk]:
+                cnt += 1
+            if cnt < 2:
+                continue
+            body = compress(codes[i:i + blk], maxBlock) if blk > 1 else None
+            size = 2 if blk == 1 else 3 + len(encode(body))
+            saved = blk * cnt - size
+            if saved > best[0]:
+                best = (saved, blk, cnt)
+        _, blk, cnt = best
+        if cnt == 1:
+            items.append(('play', codes[i], 1, None, None))
+        elif blk == 1:
+            items.append(('play', codes[i], cnt, None, None))
+        else:
+            items.append(('loop', cnt, compress(codes[i:i + blk], maxBlock)))
+        i += blk * cnt
+    return items
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+# abort_check.py
+# Host check of the safe stop and resume of autoplay in Src/app.c(abortRoutine, motionSet, resumeState).
+# app.c runs on tools/appsim.py from app_start() with a schedule of patterns and snacks. The run is forked
+# every --step ms of the autoplay and '!0'(abort) or '!1'(manual takeover) is sent in the fork:
+#   the wheels stop within CMD_DISPATCH_TICK and never turn again, laser is off
+#   the routine ends(idle for '!0', manual drive loop for '!1') within CMD_DISPATCH_TICK
+#   a snack door open at the abort is shut within SNACK_DOOR_CLOSE_TIME(+ one dispatch)
+# Then '!0' is sent in the middle of every pattern and snack and '!R' after it: the interrupted pattern
+# plays again from its start, an interrupted snack is given again, and the rest of the program follows.
+#
+# usage: python3 tools/abort_check.py [--step 37]
+
+import argparse
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import appsim
+
+DISPATCH_TICK = 10 # CMD_DISPATCH_TICK
+DOOR_CLOSE = 400 # SNACK_DOOR_CLOSE_TIME
+PROGRAM = (1, 2, 3, 4, 5) # patterns of the schedule
+SNACK_INTV = 2 # snack every 2 patterns
+RUN_MS = 400000
+
+# drv s code step
+#   -> ph tick phase                                     phase changes of the run
+#      pat tick code                                     pattern starts
+#      a tick phase moving doorOpen stop exit door restarts laser   one fork, ms from the frame
+# drv r abortAt
+#   -> pat tick code, ph tick phase
+#      r tick phase pattern searched snackCnt            resume state after '!0'
+#      end valid phase                                   after the resumed autoplay
+DRIVER_C = r"""
+#include <sys/wait.h>
+#include <unistd.h>
+static char mode, code;
+static uint32_t step, at = SIM_NEVER, exitAt = SIM_NEVER, stopAt = SIM_NEVER, doorAt = SIM_NEVER, restarts = 0;
+static uint8_t atPhase, lastPhase = 0xFF, lastPattern = RPI_TLM_NO_PATTERN;
+static _Bool atMoving, atDoor, resumed = FALSE;
+static _Bool doorShut(void) { return simServoAng == SNACK_ANG_RDY && !simServoEnd; }
+static void send(const char* s) {
+	simAtStr(simTick, s);
+	at = simTick;
+	atPhase = appPhase;
+	atMoving = (simMode != 0);
+	atDoor = !doorShut();
+}
+static void hook(void) {
+	if (appPhase != lastPhase) {
+		lastPhase = appPhase;
+		if (at == SIM_NEVER || mode == 'r') printf("ph %u %u\n", simTick, appPhase);
+	}
+	if (curPattern != lastPattern) {
+		lastPattern = curPattern;
+		if (curPattern != RPI_TLM_NO_PATTERN && (at == SIM_NEVER || mode == 'r')) printf("pat %u %u\n", simTick, curPattern);
+	}
+	if (mode == 's' && at == SIM_NEVER && (PH(appPhase) & CMD_PH_AUTOPLAY) && simTick % step == 0) {
+		pid_t pid;
+		fflush(stdout);
+		pid = fork();
+		if (pid) {
+			waitpid(pid, NULL, 0);
+			return;
+		}
+		send(code == '0' ? "!0" : "!1");
+	}
+	if (mode == 'r' && simTick == step) send("!0");
+	if (at == SIM_NEVER || simTick <= at) return;
+	if (simMode != 0) {
+		if (exitAt == SIM_NEVER) stopAt = SIM_NEVER;
+		else if (!resumed) restarts++;
+	}
+	else if (stopAt == SIM_NEVER) stopAt = simTick;
+	if (doorAt == SIM_NEVER && doorShut()) doorAt = simTick;
+	if (exitAt == SIM_NEVER && ((code == '0') ? (appPhase == APP_PHASE_IDLE || appPhase == APP_PHASE_CANCELLED) : (isManual && appPhase == APP_PHASE_MANUAL))) {
+		exitAt = simTick;
+		if (mode == 'r') printf("r %u %u %u %u %d\n", at, atPhase, resumeState.pattern, resumeState.searched, resumeState.snackIntvCnt);
+	}
+	if (mode == 'r' && exitAt != SIM_NEVER && simTick == exitAt + 500) {
+		simAtStr(simTick, "!R");
+		resumed = TRUE;
+	}
+	if (mode == 's' && simTick == at + 3000) {
+		printf("a %u %u %u %u %d %d %d %u %u\n", at, atPhase, atMoving, atDoor, (stopAt == SIM_NEVER) ? -1 : (int)(stopAt - at),
+				(exitAt == SIM_NEVER) ? -1 : (int)(exitAt - at), (doorAt == SIM_NEVER) ? -1 : (int)(doorAt - at), restarts, simLaser);
+		fflush(stdout);
+		_exit(0);
+	}
+}
+int main(int argc, char** argv) {
+	static const uint8_t prog[] = { @PROGRAM@ };
+	uint8_t p[RPI_MAX_PAYLOAD] = { 0 };
+	if (argc < 4) return 2;
+	mode = argv[1][0];
+	code = argv[2][0];
+	step = (uint32_t)atoi(argv[3]);
+	simCatOn = TRUE;
+	simCatX = 150.0f; // 60 deg left of the robot
+	simCatY = 236.6f;
+	simVib = TRUE;
+	simTickHook = hook;
+	p[RPI_SKD_WAIT_TIME] = 1;
+	p[RPI_SKD_DURATION] = 60;
+	p[RPI_SKD_SPEED] = 2;
+	p[RPI_SKD_SNACK_INTV] = @SNACK@;
+	p[RPI_SKD_PATTERN_CNT] = sizeof(prog);
+	memcpy(p + RPI_SKD_PATTERNS, prog, sizeof(prog));
+	simAt(100, TYPE_SCHEDULE, p, RPI_SKD_PATTERNS + sizeof(prog));
+	simRun(app_start, @RUN@);
+	if (mode == 'r') printf("end %u %u\n", resumeState.valid, appPhase);
+	return 0;
+}
+"""
+
+PHASES = ('idle', 'search', 'vib wait', 'play', 'snack', 'park', 'cancelled', 'manual', 'calibrate')
+
+
+def run(exe, *a):
+    out = subprocess.run([exe] + [str(x) for x in a], stdout = subprocess.PIPE, text = True, check = True).stdout
+    return [l.split() for l in out.split('\n') if l]
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--step', type=int, default=37, help='ms between aborts of the sweep')
+    args = ap.parse_args()
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print('no host C compiler: check skipped')
+        sys.exit(1)
+
+    drv = DRIVER_C.replace('@PROGRAM@', ', '.join(str(c) for c in PROGRAM)).replace('@SNACK@', str(SNACK_INTV)).replace('@RUN@', str(RUN_MS))
+    ok = True
+
+    def fail(msg):
+        nonlocal ok
+        print('  FAIL: ' + msg)
+        ok = False
+
+    with tempfile.TemporaryDirectory() as d:
+        exe = appsim.build(d, cc, drv)
+        for code in ('0', '1'):
+            rows = run(exe, 's', code, args.step)
+            if code == '0':
+                phases = [(int(r[1]), int(r[2])) for r in rows if r[0] == 'ph']
+                pats = [(int(r[1]), int(r[2])) for r in rows if r[0] == 'pat']
+                play = [t for t, p in phases if p in (1, 2, 3, 4, 5)]
+                print('autoplay %d ~ %d ms: %s' % (play[0], [t for t, p in phases if t > play[0] and p == 0][0],
+                      ', '.join('%s at %d' % (PHASES[p], t) for t, p in phases if t >= play[0])))
+            res = [[int(x) for x in r[1:]] for r in rows if r[0] == 'a']
+            print("'!%s' sent %d times, every %d ms of the autoplay" % (code, len(res), args.step))
+            print('  %-9s %5s %22s %22s %18s' % ('phase', 'sends', 'motor stop avg/max', 'routine end avg/max', 'door shut n/max'))
+            for ph in sorted(set(r[1] for r in res)):
+                v = [r for r in res if r[1] == ph]
+                mv = [r[4] for r in v if r[2]]
+                ex = [r[5] for r in v]
+                dr = [r[6] for r in v if r[3]]
+                print('  %-9s %5d %13s %8s %13s %8s %9s %8s' % (PHASES[ph], len(v), '%.1f' % (sum(mv) / len(mv)) if mv else '-', '%d ms' % max(mv) if mv else '-',
+                      '%.1f' % (sum(ex) / len(ex)), '%d ms' % max(ex), len(dr), '%d ms' % max(dr) if dr else '-'))
+            for r in res:
+                t, ph, moving, door, stop, ext, doorMs, restarts, laser = r
+                if (moving and not 0 <= stop <= DISPATCH_TICK) or not 0 <= ext <= DISPATCH_TICK or restarts or laser \
+                        or (door and not 0 <= doorMs <= DOOR_CLOSE + DISPATCH_TICK):
+                    fail("'!%s' at %d in %s: stop %d, end %d, door %d ms, %d restarts, laser %d" % (code, t, PHASES[ph], stop, ext, doorMs, restarts, laser))
+                    break
+            if not res:
+                fail('no sends')
+
+        # resume in the middle of every pattern and snack
+        ends = phases[1:] + [(RUN_MS, 0)]
+        points = []
+        for i, (t, c) in enumerate(pats):
+            e = min([x for x, _ in pats[i + 1:]] + [x for x, p in phases if x > t and p in (4, 5)])
+            points.append(('pattern %d' % c, (t + e) // 2, c))
+        for (t, p), (e, _) in zip(phases, ends):
+            if p == 4:
+                points.append(('snack', (t + e) // 2, 'k'))
+        seq = [c for _, c in pats]
+        print('resume(!0 in the middle, !R 500 ms after):')
+        for name, t, c in sorted(points, key = lambda x: x[1]):
+            rows = run(exe, 'r', '0', t)
+            r = [x for x in rows if x[0] == 'r'][0]
+            after = [int(x[2]) for x in rows if x[0] == 'pat' and int(x[1]) > t]
+            snackAfter = [int(x[1]) for x in rows if x[0] == 'ph' and int(x[2]) == 4 and int(x[1]) > t]
+            end = [x for x in rows if x[0] == 'end'][0]
+            before = [int(x[2]) for x in rows if x[0] == 'pat' and int(x[1]) <= t]
+            if c == 'k':
+                good = snackAfter and (not after or [int(x[1]) for x in rows if x[0] == 'pat' and int(x[1]) > t][0] > snackAfter[0])
+                good = good and before + after == seq
+            else:
+                good = after[:1] == [c] and before + after[1:] == seq
+            good = good and end[1] == '0' and end[2] == '0'
+            print('  %-10s at %6d: played %s, saved pattern %3s, after resume %s%s%s' % (name, t, before, '-' if r[3] == '255' else r[3], after,
+                  ' (snack first)' if c == 'k' and good else '', '' if good else '  <- wrong'))
+            if not good:
+                fail('resume after abort in %s' % name)
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,451 @@
+# appsim.py
+# Host build of Src/app.c for the tools/*_check.py simulations. app.c is compiled as it is, with the
+# drivers it calls replaced by the mocks below on a virtual 1 ms clock(simTick):
+#   l298n   queue and direct drive, ramp of MOTOR_RAMP_PROFILE/MOTOR_SLEW_RATE, stop is immediate.
+#           the robot turns at the rate of simRotRate[] and drives at simCmPerSpd in a simRoomW x simRoomH room
+#   sg90    door angle jumps to the target when the move time is over
+#   periph  IR distance is cast from the robot to the walls and round obstacles(simObs, seen but not bumped into)
+#           in GP2Y0A02 range(15 ~ 150 cm), vibration from simVib
+#   rpi     frames are scripted with simAt(); the cat pin latches when the cat is in the camera view simCatLag ms ago.
+#           a loop polling for frames without a wait(appMain, manualDrive) moves the clock 1 ms every SIM_SPIN polls
+#   rtclock seconds of simTick plus an offset, alarm is checked every tick
+# The second timer(app_secTimCallbackHandler) runs every 1000 ticks. simRun() calls a routine of app.c and
+# returns when it ends or when the time given runs out, so endless loops like appMain() can be run too.
+# A driver includes app.c, then MOCK_C, then its own main().
+
+import os
+import subprocess
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+MAIN_H = r"""
+#ifndef MAIN_H
+#define MAIN_H
+#include <stdint.h>
+#include <stddef.h>
+typedef struct { int dummy; } TIM_HandleTypeDef;
+typedef struct { int dummy; } UART_HandleTypeDef;
+typedef struct { int dummy; } ADC_HandleTypeDef;
+typedef struct { int dummy; } RTC_HandleTypeDef;
+typedef struct { volatile uint32_t CTRL, CYCCNT; } DWT_Type;
+typedef struct { volatile uint32_t DEMCR; } CoreDebug_Type;
+extern DWT_Type* DWT;
+extern CoreDebug_Type* CoreDebug;
+#define CoreDebug_DEMCR_TRCENA_Msk 1u
+#define DWT_CTRL_CYCCNTENA_Msk 1u
+uint32_t HAL_GetTick(void);
+void __disable_irq(void);
+void __enable_irq(void);
+#endif
+"""
+
+MOCK_C = r"""
+#include <math.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_NEVER 0xFFFFFFFF
+#define SIM_SPIN 8 // empty polls of rx queue in one tick before the clock is moved
+static DWT_Type simDwt;
+static CoreDebug_Type simDbg;
+DWT_Type* DWT = &simDwt;
+CoreDebug_Type* CoreDebug = &simDbg;
+
+uint32_t simTick = 0;
+static uint32_t simEnd = SIM_NEVER; // simRun() returns at this tick
+static jmp_buf simJmp;
+static _Bool simSecTim = TRUE; // run app_secTimCallbackHandler every second
+static void (*simTickHook)(void) = NULL; // called every tick, after the world moved
+
+uint32_t HAL_GetTick(void) { return simTick; }
+void __disable_irq(void) {}
+void __enable_irq(void) {}
+
+/* world */
+static float simRoomW = 300.0f, simRoomH = 400.0f; // cm
+static float simX = 100.0f, simY = 150.0f, simHeading = 0.0f; // cm, deg. CW,CW(rotate left) turns +
+static uint8_t simRotSpd[4] = { 38, 50, 76, 100 };
+static uint16_t simRotRate[4] = { 125, 313, 720, 1096 }; // deg/s * 10, true rate of the robot
+static float simCmPerSpd = 0.3f; // forward speed in cm/s per speed unit
+static float simIrNoise = 0.0f; // cm, uniform +-
+static _Bool simCatOn = FALSE;
+static float simCatX, simCatY;
+static float simCatFov = 15.0f; // deg, half angle of the camera view
+static uint32_t simCatLag = 300; // ms, camera and detection latency
+static float simObs[4][3]; // x, y, radius in cm. radius 0: none
+static _Bool simVib = FALSE;
+static uint32_t simRnd = 1;
+
+static float simRand(void) { // 0 ~ 1
+	simRnd = simRnd * 1103515245 + 12345;
+	return (float)((simRnd >> 8) & 0xFFFF) / 65535.0f;
+}
+
+static float simTrueRate(float spd) { // deg/s
+	if (spd <= 0) return 0;
+	if (spd < simRotSpd[0]) return simRotRate[0] / 10.0f * spd / simRotSpd[0];
+	for (int i = 1; i < 4; i++) {
+		if (spd <= simRotSpd[i]) return (simRotRate[i - 1] + (simRotRate[i] - simRotRate[i - 1]) * (spd - simRotSpd[i - 1]) / (simRotSpd[i] - simRotSpd[i - 1])) / 10.0f;
+	}
+	return simRotRate[3] / 10.0f;
+}
+
+static float simRayDist(float x, float y, float deg) { // ray from x, y to the walls or an obstacle
+	float r = deg * (float)M_PI / 180.0f, dx = cosf(r), dy = sinf(r), t = 1e9f;
+	if (dx > 1e-6f) t = fminf(t, (simRoomW - x) / dx);
+	if (dx < -1e-6f) t = fminf(t, -x / dx);
+	if (dy > 1e-6f) t = fminf(t, (simRoomH - y) / dy);
+	if (dy < -1e-6f) t = fminf(t, -y / dy);
+	for (int i = 0; i < 4; i++) {
+		float ox = simObs[i][0] - x, oy = simObs[i][1] - y, along = ox * dx + oy * dy;
+		float off2 = ox * ox + oy * oy - along * along, r2 = simObs[i][2] * simObs[i][2];
+		if (simObs[i][2] > 0 && along > 0 && off2 < r2) t = fminf(t, along - sqrtf(r2 - off2));
+	}
+	return t;
+}
+
+static float simAngleTo(float x, float y) { // -180 ~ 180 from heading
+	float a = atan2f(y - simY, x - simX) * 180.0f / (float)M_PI - simHeading;
+	a = fmodf(a, 360.0f);
+	if (a > 180.0f) a -= 360.0f;
+	if (a < -180.0f) a += 360.0f;
+	return a;
+}
+
+/* l298n */
+static uint8_t simEna = FALSE;
+static uint8_t simDir[2] = { L298N_STOP, L298N_STOP }, simSpd[2] = { 0, 0 }; // direct drive
+static struct L298nSegment simQ[L298N_QUEUE_SIZE];
+static unsigned simQn = 0;
+static uint32_t simQLeft = 0;
+static uint8_t simRampProfile = L298N_RAMP_NONE;
+static uint16_t simSlew = L298N_DEF_SLEW_RATE;
+static float simSpdNow = 0; // ramped speed of the current motion
+static int simMode = 0; // 0 stop, 1 forward, 2 backward, 3 left, 4 right, 5 arc
+static uint32_t simDrives = 0; // l298n_drive calls that set the wheels moving
+static uint32_t simMovingSince = SIM_NEVER; // wheels turning since, SIM_NEVER when stopped
+
+struct L298nStats l298n_getStat() {
+	struct L298nStats s = { 0 };
+	s.ena = simEna;
+	s.rotA = simDir[0];
+	s.rotB = simDir[1];
+	s.spdA = s.tgtA = simSpd[0];
+	s.spdB = s.tgtB = simSpd[1];
+	return s;
+}
+void l298n_enable() { simEna = TRUE; }
+void l298n_disable() {
+	simEna = FALSE;
+	simQn = 0;
+	simDir[0] = simDir[1] = L298N_STOP;
+	simSpd[0] = simSpd[1] = 0;
+}
+void l298n_drive(uint8_t dirA, uint8_t spdA, uint8_t dirB, uint8_t spdB) {
+	if (!simEna) return;
+	simQn = 0;
+	simDir[0] = dirA;
+	simSpd[0] = spdA;
+	simDir[1] = dirB;
+	simSpd[1] = spdB;
+	if ((dirA != L298N_STOP && spdA) || (dirB != L298N_STOP && spdB)) simDrives++;
+}
+void l298n_setRamp(uint8_t profile, uint16_t slewRate) {
+	simRampProfile = profile;
+	simSlew = slewRate;
+}
+void l298n_waitSettled() {}
+_Bool l298n_queuePush(const struct L298nSegment* pSeg) {
+	if (!simEna || simQn >= L298N_QUEUE_SIZE) return FALSE;
+	simQ[simQn++] = *pSeg;
+	if (simQn == 1) simQLeft = pSeg->ms;
+	return TRUE;
+}
+unsigned l298n_queueDepth() { return simQn; }
+void l298n_queueAbort() {
+	simQn = 0;
+	simDir[0] = simDir[1] = L298N_STOP;
+	simSpd[0] = simSpd[1] = 0;
+}
+
+static void simMotorStep(void) {
+	uint8_t dA = simDir[0], sA = simSpd[0], dB = simDir[1], sB = simSpd[1];
+	int mode = 0;
+	float tgt, step;
+	if (simQn) {
+		dA = simQ[0].dirA;
+		sA = simQ[0].spdA;
+		dB = simQ[0].dirB;
+		sB = simQ[0].spdB;
+		if (simQLeft) simQLeft--;
+		if (!simQLeft) {
+			memmove(simQ, simQ + 1, (simQn - 1) * sizeof(simQ[0]));
+			if (--simQn) simQLeft = simQ[0].ms;
+		}
+	}
+	if (!simEna) sA = sB = 0;
+	if (dA == L298N_STOP) sA = 0;
+	if (dB == L298N_STOP) sB = 0;
+	if (sA || sB) {
+		if (dA == L298N_CW && dB == L298N_CW) mode = 3;
+		else if (dA == L298N_CCW && dB == L298N_CCW) mode = 4;
+		else if (dA == L298N_FWD_A && dB == L298N_FWD_B) mode = (sA == sB) ? 1 : 5;
+		else mode = 2;
+	}
+	tgt = (sA + sB) / 2.0f;
+	if (mode != simMode) simSpdNow = 0; // wheels stop at once and ramp up in the new direction
+	simMode = mode;
+	if (!mode) {
+		simSpdNow = 0;
+		simMovingSince = SIM_NEVER;
+		return;
+	}
+	if (simMovingSince == SIM_NEVER) simMovingSince = simTick;
+	step = simSlew / 1000.0f; // speed units per ms
+	if (simRampProfile == L298N_RAMP_SCURVE) step = step * 2 / 3;
+	else if (simRampProfile == L298N_RAMP_TRAPEZOID) step = step * 3 / 4;
+	if (simRampProfile == L298N_RAMP_NONE || fabsf(tgt - simSpdNow) <= step) simSpdNow = tgt;
+	else simSpdNow += (tgt > simSpdNow) ? step : -step;
+	if (mode == 3 || mode == 4) {
+		simHeading += ((mode == 3) ? 1 : -1) * simTrueRate(simSpdNow) / 1000.0f;
+		simHeading = fmodf(simHeading + 360.0f, 360.0f);
+	}
+	else {
+		float v = simSpdNow * simCmPerSpd / 1000.0f * ((mode == 2) ? -1 : 1);
+		float r = simHeading * (float)M_PI / 180.0f;
+		simX = fminf(fmaxf(simX + v * cosf(r), 10.0f), simRoomW - 10.0f); // bumper: stays off the wall
+		simY = fminf(fmaxf(simY + v * sinf(r), 10.0f), simRoomH - 10.0f);
+	}
+}
+
+/* sg90 */
+static uint8_t simServoEna = FALSE, simServoAng, simServoTgt;
+static uint32_t simServoEnd = 0;
+void sg90_enable(uint8_t m, uint8_t a) {
+	simServoEna = TRUE;
+	simServoAng = simServoTgt = a;
+	simServoEnd = 0;
+}
+void sg90_disable(uint8_t m) {
+	simServoEna = FALSE;
+	simServoEnd = 0;
+}
+void sg90_setAngle(uint8_t m, uint8_t a) {
+	simServoAng = simServoTgt = a;
+	simServoEnd = 0;
+}
+void sg90_setAutoDetach(uint8_t m, uint16_t ms) {}
+_Bool sg90_trajectory(uint8_t m, const struct SG90Waypoint* pPts, uint8_t cnt) {
+	uint32_t ms = 0;
+	if (!simServoEna || !cnt) return FALSE;
+	for (int i = 0; i < cnt; i++) ms += pPts[i].ms;
+	simServoTgt = pPts[cnt - 1].angle;
+	simServoEnd = simTick + ms;
+	return TRUE;
+}
+_Bool sg90_moveTo(uint8_t m, uint8_t a, uint16_t ms, uint8_t easing) {
+	if (!simServoEna) return FALSE;
+	simServoTgt = a;
+	simServoEnd = simTick + ms;
+	return TRUE;
+}
+_Bool sg90_isMoving(uint8_t m) { return simServoEnd != 0; }
+struct SG90Stats sg90_getStat(uint8_t m) {
+	struct SG90Stats s = { { 0 } };
+	s.ena[0] = simServoEna;
+	s.angle[0] = simServoAng;
+	s.moving[0] = (simServoEnd != 0);
+	s.attached[0] = simServoEna;
+	return s;
+}
+
+/* buzzer, laser */
+static const struct BuzzerMelody* simMelody = NULL;
+static uint32_t simMelodies = 0;
+_Bool buzzer_play(const struct BuzzerMelody* pMel, uint8_t priority) {
+	simMelody = pMel;
+	simMelodies++;
+	return TRUE;
+}
+void buzzer_stop() { simMelody = NULL; }
+static _Bool simLaser = FALSE;
+void periph_laser_on() { simLaser = TRUE; }
+void periph_laser_off() { simLaser = FALSE; }
+
+/* periph */
+static float simIrLast = 0;
+float periph_irSnsrRaw() {
+	float d = simRayDist(simX, simY, simHeading) + (simRand() * 2 - 1) * simIrNoise;
+	simIrLast = (d > 150.0f) ? 150.0f : (d < 15.0f) ? 15.0f : d; // GP2Y0A02 range
+	return simIrLast;
+}
+float periph_irSnsrLast() { return simIrLast; }
+int periph_irSnsrChk(int mode) {
+	static const float trig[] = { 0, IR_SNSR_TRIG_DIST_OP, IR_SNSR_TRIG_DIST_FIND, IR_SNSR_TRIG_DIST_LONG, IR_SNSR_TRIG_DIST_SNACK };
+	float d = periph_irSnsrRaw();
+	if (mode < IR_SNSR_MODE_OP || mode > IR_SNSR_MODE_SNACK) return IR_SNSR_ERR;
+	return (d <= trig[mode]) ? IR_SNSR_NEAR : IR_SNSR_FAR;
+}
+static uint16_t simVibCnt = 0;
+_Bool periph_isVibration() { return simVib; }
+uint16_t periph_vibEventCnt() { return simVibCnt; }
+
+/* rpi */
+struct SimFrame {
+	uint32_t t;
+	uint8_t type;
+	uint8_t len;
+	uint8_t p[RPI_MAX_PAYLOAD];
+};
+static struct SimFrame simFrames[1024];
+static unsigned simFrameCnt = 0, simFrameNext = 0;
+static void (*simSentHook)(uint8_t type, const uint8_t* p, uint8_t len) = NULL;
+static uint8_t (*simTlmFunc)(uint8_t* pPayload) = NULL;
+static float simHeadingLog[1024]; // heading by tick, for the camera lag
+static _Bool simCatPin = FALSE;
+
+static void simAt(uint32_t t, uint8_t type, const void* p, uint8_t len) { // frame arrives at t. keep t ascending
+	struct SimFrame* f = &simFrames[simFrameCnt++];
+	if (simFrameCnt > sizeof(simFrames) / sizeof(simFrames[0])) {
+		fprintf(stderr, "simAt: too many frames\n");
+		exit(3);
+	}
+	f->t = t;
+	f->type = type;
+	f->len = len;
+	memcpy(f->p, p, len);
+}
+static void simAtStr(uint32_t t, const char* s) { simAt(t, (uint8_t)s[0], s + 1, (uint8_t)strlen(s + 1)); } // type and payload in one string
+
+int rpi_getSerialDta(struct SerialDta* pDest) {
+	static uint32_t spinTick = SIM_NEVER;
+	static unsigned spins = 0;
+	struct SimFrame* f;
+	if (simFrameNext >= simFrameCnt || simFrames[simFrameNext].t > simTick) {
+		if (simTick != spinTick) {
+			spinTick = simTick;
+			spins = 0;
+		}
+		if (++spins >= SIM_SPIN) core_call_delayms(1); // main loop polls without waiting
+		return 0;
+	}
+	f = &simFrames[simFrameNext++];
+	memset(pDest, 0, sizeof(*pDest));
+	pDest->available = TRUE;
+	pDest->type = f->type;
+	pDest->len = f->len;
+	pDest->tick = f->t;
+	memcpy(pDest->container, f->p, f->len);
+	return 1;
+}
+uint8_t rpi_rxQueueDepth() {
+	uint8_t n = 0;
+	for (unsigned i = simFrameNext; i < simFrameCnt && simFrames[i].t <= simTick; i++) n++;
+	return n;
+}
+_Bool rpi_foundCat() {
+	_Bool r = simCatPin;
+	simCatPin = FALSE;
+	return r;
+}
+void rpi_sendPin(int code) {}
+_Bool rpi_sendFrame(uint8_t type, const uint8_t* pPayload, uint8_t len) {
+	if (simSentHook != NULL) simSentHook(type, pPayload, len);
+	return TRUE;
+}
+void rpi_setTelemetryFunc(uint8_t (*pFunc)(uint8_t* pPayload)) { simTlmFunc = pFunc; }
+
+/* rtclock */
+static int64_t simRtcOfs = 0;
+static _Bool simRtcSet = FALSE;
+static uint32_t simAlarmAt = RTCLOCK_NO_ALARM;
+static void (*simAlarmFunc)() = NULL;
+uint32_t rtclock_now() { return (uint32_t)(simTick / 1000 + simRtcOfs); }
+_Bool rtclock_isSet() { return simRtcSet; }
+int32_t rtclock_sync(uint32_t sec, uint16_t ms) {
+	int64_t ofs = (int64_t)sec - rtclock_now();
+	simRtcOfs += ofs;
+	simRtcSet = TRUE;
+	return (int32_t)ofs;
+}
+void rtclock_setAlarm(uint32_t t, void (*pFunc)()) {
+	simAlarmAt = RTCLOCK_NO_ALARM;
+	simAlarmFunc = NULL;
+	if (t == RTCLOCK_NO_ALARM || pFunc == NULL) return;
+	if (t <= rtclock_now()) {
+		pFunc();
+		return;
+	}
+	simAlarmAt = t;
+	simAlarmFunc = pFunc;
+}
+struct RtclockStats rtclock_getStat() {
+	struct RtclockStats s = { 0 };
+	s.flags = simRtcSet ? RTCLOCK_FLAG_SET : 0;
+	return s;
+}
+
+/* core */
+core_statRetTypeDef core_call_pendingOpRegister(uint8_t* opcodeDest, core_statRetTypeDef(*pHandlerFunc)()) { return OK; }
+core_statRetTypeDef core_call_secTimIntrRegister(core_statRetTypeDef(*pHandlerFunc)()) { return OK; }
+#ifdef _TEST_MODE_ENABLED
+core_statRetTypeDef core_dbgTx(char* str) { return OK; }
+#endif
+
+static void simStep(void) { // one tick of the world
+	simTick++;
+	simMotorStep();
+	if (simServoEnd && simTick >= simServoEnd) {
+		simServoAng = simServoTgt;
+		simServoEnd = 0;
+	}
+	simHeadingLog[simTick % 1024] = simHeading;
+	if (simCatOn) {
+		float h = simHeading, a;
+		if (simTick > simCatLag) simHeading = simHeadingLog[(simTick - simCatLag) % 1024]; // what the camera saw
+		a = simAngleTo(simCatX, simCatY);
+		simHeading = h;
+		if (fabsf(a) <= simCatFov) simCatPin = TRUE;
+	}
+	if (simAlarmFunc != NULL && rtclock_now() >= simAlarmAt) {
+		void (*f)() = simAlarmFunc;
+		simAlarmFunc = NULL;
+		simAlarmAt = RTCLOCK_NO_ALARM;
+		f();
+	}
+	if (simSecTim && simTick % 1000 == 0) app_secTimCallbackHandler();
+	if (simTickHook != NULL) simTickHook();
+	if (simTick >= simEnd) longjmp(simJmp, 1);
+}
+
+void core_call_delayms(uint32_t ms) {
+	if (!ms) ms = 1;
+	while (ms--) simStep();
+}
+
+static _Bool simRun(void (*pFunc)(void), uint32_t ms) { // returns FALSE if time ran out before pFunc returned
+	simEnd = simTick + ms;
+	if (setjmp(simJmp)) {
+		simEnd = SIM_NEVER;
+		return FALSE;
+	}
+	pFunc();
+	simEnd = SIM_NEVER;
+	return TRUE;
+}
+"""
+
+
+def build(d, cc, driver, defines = ()):
+    # compile app.c with the mocks and driver in d. returns the executable
+    exe = os.path.join(d, "drv")
+    with open(os.path.join(d, "main.h"), "w") as f:
+        f.write(MAIN_H)
+    with open(os.path.join(d, "drv.c"), "w") as f:
+        f.write('#include "app.c"\n' + MOCK_C + driver)
+    src = [os.path.join(ROOT, "Src", n) for n in ("motprog.c", "skdprog.c", "playplan.c", "pattime.c")]
+    subprocess.check_call([cc, "-std=gnu11", "-O2", "-Wall", "-Wno-unused-function", "-I", d, "-I", os.path.join(ROOT, "Inc"),
+                           "-I", os.path.join(ROOT, "Src")] + ["-D" + x for x in defines] + ["-o", exe, os.path.join(d, "drv.c")] + src + ["-lm"])
+    return exe
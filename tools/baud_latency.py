@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# baud_latency.py
+# Command latency of the Pi <-> MCU link at each rate of the baud negotiation(RPI_BAUD_LIST).
+# One command frame(TYPE 'M', 2-byte payload, 8 bytes on the wire) is sent and the time until
+# its ACK(7 bytes) is read back is measured.
+#
+# usage: python3 tools/baud_latency.py [--count 50] [--bauds 9600,115200,...]
+#        python3 tools/baud_latency.py --loopback /dev/ttyAMA0 [--count 50]
+#
+# default  runs on a pty pair with a stand-in MCU thread. A pty does not pace bytes at the baud
+#          rate, so the stand-in holds each frame and its ACK for their wire time(10 bits per byte
+#          + one idle character) before passing it on. Result: modeled wire time + host overhead.
+# --loopback  TX jumpered to RX on a real UART. The frame itself comes back instead of an ACK,
+#          so the measured time is one frame on the wire at the real rate + driver latency.
+
+import argparse
+import binascii
+import os
+import pty
+import struct
+import sys
+import threading
+import time
+import tty
+
+import serial
+
+FRAME_SYNC = 0xA5
+FRAME_OVERHEAD = 6
+TYPE_ACK = ord('a')
+TYPE_MOTOR = ord('M')
+BAUDS = (9600, 115200, 230400, 460800, 921600) # RPI_BAUD_LIST of rpicomm.h
+
+
+def encodeFrame(ftype, payload, seq): # same as ccb.py
+    body = bytes([ftype, len(payload), seq]) + bytes(payload)
+    return bytes([FRAME_SYNC]) + body + struct.pack('<H', binascii.crc_hqx(body, 0xFFFF))
+
+
+def wireTime(n, baud): # n bytes 8N1 + one idle character before the receiver sees the frame end
+    return (n + 1) * 10.0 / baud
+
+
+def readExact(ser, n, until):
+    buf = bytearray()
+    while len(buf) < n and time.monotonic() < until:
+        buf += ser.read(n - len(buf))
+    return bytes(buf)
+
+
+class StandIn(threading.Thread): # answers each command frame with an ACK after both wire times
+    def __init__(self, fd):
+        super().__init__(daemon = True)
+        self.fd = fd
+        self.baud = BAUDS[0]
+
+    def run(self):
+        acc = bytearray()
+        while True:
+            try:
+                acc += os.read(self.fd, 256)
+            except OSError:
+                return
+            while len(acc) >= 3 and len(acc) >= acc[2] + FRAME_OVERHEAD:
+                n = acc[2] + FRAME_OVERHEAD
+                seq = acc[3]
+                del acc[:n]
+                ack = encodeFrame(TYPE_ACK, bytes([seq, 0]), seq)
+                time.sleep(wireTime(n, self.baud) + wireTime(len(ack), self.baud))
+                os.write(self.fd, ack)
+
+
+def measure(ser, count, expect, setBaud):
+    res = {}
+    for baud in setBaud:
+        setBaud[baud]()
+        lat = []
+        for i in range(count):
+            seq = i & 0xFF
+            fr = encodeFrame(TYPE_MOTOR, b'01', seq)
+            ser.reset_input_buffer()
+            t0 = time.monotonic()
+            ser.write(fr)
+            ans = readExact(ser, expect(fr), t0 + 1.0)
+            if len(ans) == expect(fr):
+                lat.append(time.monotonic() - t0)
+        res[baud] = lat
+    return res
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--count', type=int, default=50)
+    ap.add_argument('--bauds', default=','.join(map(str, BAUDS)))
+    ap.add_argument('--loopback', default=None, metavar='PORT')
+    args = ap.parse_args()
+    bauds = [int(b) for b in args.bauds.split(',')]
+
+    if args.loopback is None:
+        master, slave = pty.openpty()
+        tty.setraw(master)
+        ser = serial.Serial(os.ttyname(slave), bauds[0], timeout=0.01)
+        standIn = StandIn(master)
+        standIn.start()
+        setBaud = {b: (lambda b=b: setattr(standIn, 'baud', b)) for b in bauds}
+        expect = lambda fr: 7 # ACK frame
+        model = lambda b: wireTime(8, b) + wireTime(7, b)
+        print('pty stand-in, wire time modeled(frame 8 + ACK 7 bytes)')
+    else:
+        ser = serial.Serial(args.loopback, bauds[0], timeout=0.01)
+        setBaud = {b: (lambda b=b: setattr(ser, 'baudrate', b)) for b in bauds}
+        expect = lambda fr: len(fr) # own frame back
+        model = lambda b: wireTime(8, b)
+        print('loopback on %s(frame 8 bytes)' % args.loopback)
+
+    res = measure(ser, args.count, expect, setBaud)
+    print('%8s %8s %8s %8s %8s %6s' % ('baud', 'wire', 'min', 'avg', 'max', 'lost'))
+    ok = True
+    for baud in bauds:
+        lat = res[baud]
+        lost = args.count - len(lat)
+        ok = ok and lost == 0
+        if not lat:
+            print('%8d %7.2fms %8s %8s %8s %6d' % (baud, model(baud) * 1000, '-', '-', '-', lost))
+            continue
+        print('%8d %7.2fms %7.2fms %7.2fms %7.2fms %6d'
+              % (baud, model(baud) * 1000, min(lat) * 1000, sum(lat) / len(lat) * 1000, max(lat) * 1000, lost))
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+# calendar_check.py
+# Host check of the schedule calendar of Src/app.c(skdHeap, skdQueue/skdUnqueue/skdHeapFix, skdFire,
+# skdValidate/skdCommit). app.c is built on tools/appsim.py and its calendar functions are called directly.
+#   heap     random uploads, deletes, rollbacks, clock steps, fires and autoplays(--ops): after every op the heap is
+#            ordered, skdHeapPos points back to it and holds exactly the armed slots, skdFire() plays the
+#            one with the earliest fireAt(brute force over the calendar) and nothing that is not due.
+#            slots of the calendar, staging, rollback and held upload never share a struct Schedule
+#   order    periodic, one-shot and wall clock slots fire by the RTC alarm and second timer in the order
+#            and at the second python works out, also after a long autoplay(plays missed are skipped)
+#   held     uploads during the play of a slot: one for the played slot is held until autoplay ends, the
+#            next one for it replaces the held one, a rejected one or one for another slot leaves it alone
+#
+# usage: python3 tools/calendar_check.py [--ops 20000] [--seed n]
+
+import argparse
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import appsim
+
+CLOCK = 800000000 # rtclock time the Pi syncs before the order test
+ORDER_MS = 900000
+BLOCK = (300, 560) # s from start: autoplay, no fires
+# slot, period s, wait s(None: wall clock at CLOCK + at), at
+ORDER_SKD = [
+    (1, 100, 20, 0),
+    (2, 100, 71, 0),
+    (0, 0, 43, 0),
+    (3, 41, 6, 0),
+    (4, 0, None, 155),
+    (5, 250, None, 9),
+]
+
+# drv h ops seed   -> heap ops bad fires skipped
+#                     bad op k: what
+# drv o            -> fire sec slot
+# drv s            -> held step pendingProg cal0Prog cal1Prog ok
+DRIVER_C = r"""
+static void reset(void) { // calendar of app_start()
+	for (int i = 0; i < RPI_CAL_SIZE; i++) {
+		skdCal[i] = NULL;
+		skdHeapPos[i] = SKD_NOT_QUEUED;
+	}
+	skdHeapCnt = 0;
+	pSkdActive = &skdNone;
+	pSkdStaging = &skdSlot[0];
+	pSkdPrev = &skdSlot[1];
+	pSkdPending = NULL;
+	skdPrevValid = FALSE;
+	appPhase = APP_PHASE_IDLE;
+	skdClock = rtclock_now();
+}
+static _Bool upload(uint8_t slot, uint32_t period, uint32_t at, uint32_t wait, const uint8_t* prog, uint8_t n) {
+	uint8_t p[RPI_MAX_PAYLOAD] = { 0 };
+	p[RPI_SKD_WAIT_TIME] = (uint8_t)wait;
+	p[RPI_SKD_WAIT_TIME + 1] = (uint8_t)(wait >> 8);
+	p[RPI_SKD_WAIT_TIME + 2] = (uint8_t)(wait >> 16);
+	p[RPI_SKD_DURATION] = 10;
+	p[RPI_SKD_SPEED] = 2;
+	p[RPI_SKD_SNACK_INTV] = RPI_SKD_SNACK_OFF;
+	p[RPI_SKD_PATTERN_CNT] = n;
+	memcpy(p + RPI_SKD_PATTERNS, prog, n);
+	return loadSchedule(p, RPI_SKD_PATTERNS + n, slot, period, at);
+}
+static const char* poolBad(void) { // struct Schedule shared by two roles
+	for (int i = 0; i < RPI_CAL_SIZE; i++) {
+		if (skdCal[i] == NULL) continue;
+		if (skdCal[i] == pSkdStaging) return "staging is in calendar";
+		if (skdCal[i] == pSkdPending) return "held upload is in calendar";
+		for (int j = i + 1; j < RPI_CAL_SIZE; j++) {
+			if (skdCal[i] == skdCal[j]) return "two slots share a schedule";
+		}
+	}
+	if (pSkdPending == pSkdStaging) return "held upload is staging";
+	if (skdPrevValid && (pSkdPrev == pSkdStaging || pSkdPrev == pSkdPending)) return "rollback is staging or held";
+	return NULL;
+}
+static const char* heapBad(void) {
+	int armed = 0;
+	for (int i = 1; i < skdHeapCnt; i++) {
+		if (skdCal[skdHeap[i]]->fireAt < skdCal[skdHeap[(i - 1) / 2]]->fireAt) return "heap order";
+	}
+	for (int i = 0; i < skdHeapCnt; i++) {
+		if (skdHeapPos[skdHeap[i]] != i) return "heap position";
+	}
+	for (int i = 0; i < RPI_CAL_SIZE; i++) {
+		_Bool a = skdCal[i] != NULL && skdCal[i]->armed;
+		armed += a;
+		if (a != (skdHeapPos[i] != SKD_NOT_QUEUED)) return "armed slot not in heap, or disarmed one in it";
+	}
+	if (armed != skdHeapCnt) return "heap count";
+	return poolBad();
+}
+static void heap(unsigned ops, unsigned seed) {
+	unsigned bad = 0, fires = 0, idle = 0;
+	srand(seed);
+	simRtcSet = TRUE;
+	reset();
+	for (unsigned k = 0; k < ops; k++) {
+		int r = rand() % 8;
+		uint8_t s = (uint8_t)(rand() % RPI_CAL_SIZE);
+		const char* what = NULL;
+		if (r < 3) {
+			uint8_t prog[1] = { (uint8_t)(1 + rand() % 9) };
+			uint32_t at = (rand() % 4) ? 0 : rtclock_now() + rand() % 2000 - 200;
+			upload(s, (rand() % 2) * (1 + rand() % 500), at, rand() % 1000, prog, 1);
+		}
+		else if (r == 3) skdDelete(s);
+		else if (r == 4) skdRollback();
+		else if (r == 5) {
+			int32_t step = rand() % 400 - 200;
+			simRtcOfs += step;
+			skdClock = rtclock_now();
+			skdShift(step);
+		}
+		else if (r == 7) { // autoplay of the last fired slot starts or ends
+			if (appPhase == APP_PHASE_IDLE) appPhase = APP_PHASE_PLAY;
+			else {
+				appPhase = APP_PHASE_IDLE;
+				if (pSkdPending != NULL) skdCommit(pSkdPending); // as appMain
+			}
+		}
+		else if (appPhase == APP_PHASE_IDLE) { // appMain does not fire during autoplay
+			uint32_t mn = SIM_NEVER, top;
+			struct Schedule* pTop;
+			struct Schedule* f;
+			simRtcOfs += rand() % 60;
+			for (int i = 0; i < RPI_CAL_SIZE; i++) {
+				if (skdCal[i] != NULL && skdCal[i]->armed && skdCal[i]->fireAt < mn) mn = skdCal[i]->fireAt;
+			}
+			pTop = skdHeapCnt ? skdCal[skdHeap[0]] : NULL;
+			top = pTop ? pTop->fireAt : SIM_NEVER;
+			f = skdFire();
+			if (top != mn) what = "heap top is not the earliest";
+			else if (mn <= rtclock_now() && f != pTop) what = "due schedule not fired";
+			else if (mn > rtclock_now() && f != NULL) what = "fired before its time";
+			if (f != NULL) fires++;
+			else idle++;
+		}
+		if (what == NULL) what = heapBad();
+		if (what != NULL) {
+			if (bad < 5) printf("bad op %u: %s\n", k, what);
+			bad++;
+		}
+	}
+	printf("heap %u %u %u %u\n", ops, bad, fires, idle);
+}
+static void order(void) {
+	static const int skd[][4] = { @ORDER@ };
+	uint8_t prog[1] = { 1 };
+	simRtcSet = TRUE;
+	simRtcOfs = @CLOCK@;
+	reset();
+	for (int i = 0; i < (int)(sizeof(skd) / sizeof(skd[0])); i++) {
+		if (!upload(skd[i][0], skd[i][1], skd[i][2] < 0 ? @CLOCK@ + skd[i][3] : 0, skd[i][2] < 0 ? 0 : skd[i][2], prog, 1)) printf("rejected %d\n", i);
+	}
+	while (simTick < @ORDER_MS@) {
+		simStep();
+		if (simTick >= @BLOCK0@ * 1000 && simTick < @BLOCK1@ * 1000) continue; // autoplay: appMain does not look
+		if (flagSkdTimeElapsed) { // as appMain
+			struct Schedule* f;
+			flagSkdTimeElapsed = FALSE;
+			if ((f = skdFire()) != NULL) printf("fire %u %u\n", rtclock_now() - @CLOCK@, f->slot);
+		}
+	}
+}
+static void heldRow(const char* step, _Bool ok) {
+	uint8_t tlm[RPI_TLM_SIZE];
+	fillTelemetry(tlm);
+	ok = ok && poolBad() == NULL && (appPhase == APP_PHASE_IDLE || pSkdActive == skdCal[0]);
+	printf("held %s %d %d %d %d %d\n", step, (pSkdPending != NULL) ? pSkdPending->prog[0] : -1, skdCal[0] ? skdCal[0]->prog[0] : -1,
+			skdCal[1] ? skdCal[1]->prog[0] : -1, ok, (tlm[RPI_TLM_FLAGS] & RPI_TLM_FLAG_SKD_PENDING) != 0);
+}
+static void held(void) {
+	static const uint8_t p1[] = { 1, 2 }, p4[] = { 4 }, p5[] = { 5 }, p6[] = { 6 }, bad[] = { 99 };
+	reset();
+	upload(0, 0, 0, 0, p1, sizeof(p1));
+	simRtcOfs += 1;
+	if (skdFire() != skdCal[0]) printf("not fired\n");
+	appPhase = APP_PHASE_PLAY; // autoplay of slot 0
+	heldRow("slot0", upload(0, 0, 0, 3600, p4, sizeof(p4)));
+	heldRow("slot1", upload(1, 0, 0, 3600, p5, sizeof(p5)));
+	heldRow("rejected", !upload(0, 0, 0, 3600, bad, sizeof(bad)));
+	skdStage(); // ASCII upload cut off before '>'
+	recvScheduleMode = FALSE;
+	heldRow("partial", TRUE);
+	heldRow("slot0again", upload(0, 0, 0, 3600, p6, sizeof(p6)));
+	appPhase = APP_PHASE_IDLE; // autoplay ended
+	if (pSkdPending != NULL) skdCommit(pSkdPending); // as appMain
+	heldRow("ended", TRUE);
+	heldRow("idle", upload(1, 0, 0, 3600, p4, sizeof(p4)));
+}
+int main(int argc, char** argv) {
+	if (argc < 2) return 2;
+	if (argv[1][0] == 'h') heap((unsigned)atoi(argv[2]), (unsigned)atoi(argv[3]));
+	if (argv[1][0] == 'o') order();
+	if (argv[1][0] == 's') held();
+	return 0;
+}
+"""
+
+# held step: (held program, slot 0, slot 1, pending flag) expected after it
+HELD = [
+    ('slot0', 'upload for the played slot 0', (4, 1, -1, 1)),
+    ('slot1', 'upload for slot 1', (4, 1, 5, 1)),
+    ('rejected', 'rejected upload for slot 0', (4, 1, 5, 1)),
+    ('partial', 'ASCII upload cut off', (4, 1, 5, 1)),
+    ('slot0again', 'second upload for slot 0', (6, 1, 5, 1)),
+    ('ended', 'autoplay ended', (-1, 6, 5, 0)),
+    ('idle', 'upload for slot 1 while idle', (-1, 6, 4, 0)),
+]
+
+
+def expectedFires(skds):
+    # (sec, slot) of every fire: each second the due slots fire earliest first, none during BLOCK
+    armed = {}
+    for slot, period, wait, at in skds:
+        armed[slot] = [at if wait is None else wait, period]
+    fires = []
+    for t in range(ORDER_MS // 1000 + 1):
+        if BLOCK[0] <= t < BLOCK[1]:
+            continue
+        while True:
+            due = [(f, s) for s, (f, p) in armed.items() if f <= t]
+            if not due:
+                break
+            f, s = min(due)
+            if [x for x, _ in due].count(f) > 1:
+                raise ValueError('slots due at the same second fire in heap order: change ORDER_SKD')
+            fires.append((t, s))
+            p = armed[s][1]
+            if p:
+                armed[s][0] = f + ((t - f) // p + 1) * p
+            else:
+                del armed[s]
+    return fires
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--ops', type=int, default=20000)
+    ap.add_argument('--seed', type=int, default=1)
+    args = ap.parse_args()
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print('no host C compiler: check skipped')
+        sys.exit(1)
+
+    order = ', '.join('{ %d, %d, %d, %d }' % (s, p, -1 if w is None else w, a) for s, p, w, a in ORDER_SKD)
+    drv = DRIVER_C.replace('@ORDER@', order).replace('@CLOCK@', '%du' % CLOCK).replace('@ORDER_MS@', str(ORDER_MS))
+    drv = drv.replace('@BLOCK0@', str(BLOCK[0])).replace('@BLOCK1@', str(BLOCK[1]))
+    ok = True
+    with tempfile.TemporaryDirectory() as d:
+        exe = appsim.build(d, cc, drv)
+
+        def run(*a):
+            out = subprocess.run([exe] + [str(x) for x in a], stdout = subprocess.PIPE, text = True, check = True).stdout
+            return [l.split() for l in out.split('\n') if l]
+
+        rows = run('h', args.ops, args.seed)
+        for r in rows:
+            if r[0] == 'bad':
+                print('  ' + ' '.join(r))
+        h = [int(x) for x in [r for r in rows if r[0] == 'heap'][0][1:]]
+        print('heap: %d random ops, %d fires, %d with nothing due, %d mismatches against brute force' % (h[0], h[2], h[3], h[1]))
+        ok = ok and h[1] == 0
+
+        rows = run('o')
+        got = [(int(r[1]), int(r[2])) for r in rows if r[0] == 'fire']
+        want = expectedFires(ORDER_SKD)
+        bad = [r for r in rows if r[0] == 'rejected']
+        print('order: %d fires in %d s, autoplay %d ~ %d s, %s' % (len(got), ORDER_MS // 1000, BLOCK[0], BLOCK[1],
+              'same as python' if got == want and not bad else 'differs'))
+        if got != want or bad:
+            ok = False
+            for i in range(max(len(got), len(want))):
+                g = got[i] if i < len(got) else None
+                w = want[i] if i < len(want) else None
+                if g != w:
+                    print('  fire %d: app %s, python %s' % (i, g, w))
+                    break
+        else:
+            print('  after autoplay: %s' % ', '.join('slot %d at %d' % (s, t) for t, s in got if t == BLOCK[1]))
+
+        rows = run('s')
+        print('held upload(slot 0 playing, program 1 2):')
+        res = {r[1]: [int(x) for x in r[2:]] for r in rows if r[0] == 'held'}
+        for key, name, want in HELD:
+            r = res.get(key)
+            good = r is not None and tuple(r[:3]) + (r[4],) == want and r[3] == 1
+            print('  %-30s held %2s, slot 0 %2s, slot 1 %2s, flag %s%s' % (name, *(('-' if x < 0 else x) for x in r[:3]), r[4], '' if good else '  <- wrong'))
+            ok = ok and good
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+# dispatch_check.py
+# Host check of the command dispatch of Src/app.c(cmdTable, cmdDispatch, appWait, abortRoutine).
+# app.c runs on tools/appsim.py from app_start(): a binary 'S' schedule is uploaded at 100 ms and played
+# with the cat in view, while 'Q' is sent every 500 ms from the end of the start-up delays on.
+#   every 'Q' is answered within CMD_DISPATCH_TICK, also during search, patterns and parking
+#   the 'h' answer of 'H' counts every 'Q' and its latency histogram matches the answer times seen on the link,
+#   a manual code sent while idle is counted as dropped
+#   a schedule uploaded during the play is held(RPI_TLM_FLAG_SKD_PENDING), the schedule being played goes on
+#   unchanged, and the upload takes the calendar slot when autoplay ends
+# Then '!0' is sent at points in the search and in every pattern of the same run: the motors stop in the
+# dispatch of the frame and never restart, and the app is back to idle soon after.
+#
+# usage: python3 tools/dispatch_check.py [--points 6] [-v]
+
+import argparse
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import appsim
+
+CST_BINS = 12 # RPI_CST_BINS
+DISPATCH_TICK = 10 # CMD_DISPATCH_TICK
+SKD_PENDING = 0x80 # RPI_TLM_FLAG_SKD_PENDING
+RUN_MS = 150000
+PLAYED = (1, 2, 3) # program of the schedule played
+UPLOAD = (4,) # program uploaded during the play
+
+# drv abortAt(0: none)
+#   -> ph tick phase                          phase changes
+#      q tick latency phase flags             answers of 'Q'
+#      play tick n code prog...               pattern n of the played schedule starts, program it is read from
+#      up tick                                upload sent
+#      hq tick                                'H' sent
+#      h type cnt dropped max bins...
+#      cal0 armed prog...                     calendar slot 0 at the end
+#      abort tick phase moving stopLat exitLat restarts
+DRIVER_C = r"""
+static uint32_t abortAt, upAt = SIM_NEVER, idleAt = SIM_NEVER;
+static uint32_t qAt[64];
+static unsigned qHead = 0, qTail = 0;
+static uint8_t lastPhase = 0xFF;
+static uint32_t lastPlayed = 0;
+static _Bool playSeen = FALSE;
+static uint32_t lastMoving = SIM_NEVER, exitAt = SIM_NEVER, restarts = 0;
+static uint8_t abortPhase;
+static _Bool abortMoving;
+static void schedule(uint32_t t, uint32_t wait, const uint8_t* prog, uint8_t n) {
+	uint8_t p[RPI_MAX_PAYLOAD] = { 0 };
+	p[RPI_SKD_WAIT_TIME] = (uint8_t)wait;
+	p[RPI_SKD_WAIT_TIME + 1] = (uint8_t)(wait >> 8);
+	p[RPI_SKD_DURATION] = 30;
+	p[RPI_SKD_SPEED] = 2;
+	p[RPI_SKD_SNACK_INTV] = RPI_SKD_SNACK_OFF;
+	p[RPI_SKD_PATTERN_CNT] = n;
+	memcpy(p + RPI_SKD_PATTERNS, prog, n);
+	simAt(t, TYPE_SCHEDULE, p, RPI_SKD_PATTERNS + n);
+}
+static void sent(uint8_t type, const uint8_t* p, uint8_t len) {
+	if (type == TYPE_TELEMETRY && qHead != qTail) {
+		uint32_t t = qAt[qTail++ % 64];
+		printf("q %u %u %u %u\n", t, simTick - t, p[RPI_TLM_PHASE], p[RPI_TLM_FLAGS]);
+	}
+	if (type == TYPE_CMD_STAT) {
+		printf("h %c %u %u %u", p[RPI_CST_TYPE], p[RPI_CST_CNT] | (p[RPI_CST_CNT + 1] << 8),
+				p[RPI_CST_DROPPED] | (p[RPI_CST_DROPPED + 1] << 8), p[RPI_CST_MAX] | (p[RPI_CST_MAX + 1] << 8));
+		for (int i = 0; i < RPI_CST_BINS; i++) printf(" %u", p[RPI_CST_HIST + i * 2] | (p[RPI_CST_HIST + i * 2 + 1] << 8));
+		printf("\n");
+	}
+}
+static void hook(void) {
+	static const uint8_t up[] = { @UPLOAD@ };
+	if (appPhase != lastPhase) {
+		lastPhase = appPhase;
+		printf("ph %u %u\n", simTick, appPhase);
+		if (appPhase == APP_PHASE_PLAY) playSeen = TRUE;
+		if (playSeen && appPhase == APP_PHASE_IDLE && idleAt == SIM_NEVER) idleAt = simTick;
+	}
+	if (pSkdActive->played != lastPlayed) {
+		lastPlayed = pSkdActive->played;
+		if (lastPlayed) printf("play %u %u %u", simTick, lastPlayed, skdEntry.code);
+		for (int i = 0; lastPlayed && i < pSkdActive->progLen; i++) printf(" %u", pSkdActive->prog[i]);
+		if (lastPlayed) printf("\n");
+	}
+	if (abortAt) {
+		if (simTick == abortAt) {
+			simAtStr(simTick, "!0");
+			abortPhase = appPhase;
+			abortMoving = (simMode != 0);
+			if (abortMoving) lastMoving = simTick;
+		}
+		if (simTick > abortAt) {
+			if (simMode != 0 && exitAt == SIM_NEVER) lastMoving = simTick;
+			if (simMode != 0 && exitAt != SIM_NEVER) restarts++;
+			if (exitAt == SIM_NEVER && (appPhase == APP_PHASE_IDLE || appPhase == APP_PHASE_CANCELLED)) exitAt = simTick;
+		}
+		return;
+	}
+	if (simTick >= 1000 && simTick % 500 == 37) { // after start-up delays of app_start()
+		qAt[qHead++ % 64] = simTick;
+		simAtStr(simTick, "Q");
+	}
+	if (simTick == 300) simAtStr(simTick, "M01"); // manual code while idle: dropped
+	if (lastPlayed == 2 && upAt == SIM_NEVER) {
+		upAt = simTick;
+		printf("up %u\n", simTick);
+		schedule(simTick, 3600, up, sizeof(up));
+	}
+	if (idleAt != SIM_NEVER && simTick == idleAt + 1000) {
+		printf("hq %u\n", simTick);
+		simAtStr(simTick, "HQ");
+		simAtStr(simTick, "HM");
+		simAtStr(simTick, "HS");
+	}
+}
+int main(int argc, char** argv) {
+	static const uint8_t prog[] = { @PLAYED@ };
+	if (argc < 2) return 2;
+	abortAt = (uint32_t)atoi(argv[1]);
+	simCatOn = TRUE;
+	simCatX = 150.0f; // 60 deg left of the robot
+	simCatY = 236.6f;
+	simVib = TRUE;
+	simSentHook = sent;
+	simTickHook = hook;
+	schedule(100, 1, prog, sizeof(prog));
+	simRun(app_start, abortAt ? abortAt + 20000 : @RUN@);
+	if (abortAt) printf("abort %u %u %u %d %d %u\n", abortAt, abortPhase, abortMoving, (int)(lastMoving + 1 - abortAt),
+			(exitAt == SIM_NEVER) ? -1 : (int)(exitAt - abortAt), restarts);
+	else {
+		printf("cal0 %d", skdCal[0] != NULL && skdCal[0]->armed);
+		for (int i = 0; skdCal[0] != NULL && i < skdCal[0]->progLen; i++) printf(" %u", skdCal[0]->prog[i]);
+		printf("\n");
+	}
+	return 0;
+}
+"""
+
+PHASES = ('idle', 'search', 'vib wait', 'play', 'snack', 'park', 'cancelled', 'manual', 'calibrate')
+
+
+def latBin(ms):
+    b = 0
+    while ms and b < CST_BINS - 1:
+        ms >>= 1
+        b += 1
+    return b
+
+
+def run(exe, abortAt):
+    out = subprocess.run([exe, str(abortAt)], stdout = subprocess.PIPE, text = True, check = True).stdout
+    return [l.split() for l in out.split('\n') if l]
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--points', type=int, default=6, help='aborts per phase')
+    ap.add_argument('-v', action='store_true', help='print every abort')
+    args = ap.parse_args()
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print('no host C compiler: check skipped')
+        sys.exit(1)
+
+    drv = DRIVER_C.replace('@PLAYED@', ', '.join(str(c) for c in PLAYED)).replace('@UPLOAD@', ', '.join(str(c) for c in UPLOAD))
+    drv = drv.replace('@RUN@', str(RUN_MS))
+    ok = True
+
+    def fail(msg):
+        nonlocal ok
+        print('  FAIL: ' + msg)
+        ok = False
+
+    with tempfile.TemporaryDirectory() as d:
+        exe = appsim.build(d, cc, drv)
+        rows = run(exe, 0)
+        phases = [(int(r[1]), int(r[2])) for r in rows if r[0] == 'ph']
+        print('phases: ' + ', '.join('%s at %d' % (PHASES[p], t) for t, p in phases))
+
+        # 'Q' answers and the 'h' histogram
+        qs = [(int(r[1]), int(r[2]), int(r[3]), int(r[4])) for r in rows if r[0] == 'q']
+        hs = {r[1]: [int(x) for x in r[2:]] for r in rows if r[0] == 'h'}
+        byPhase = {}
+        for _, lat, ph, _ in qs:
+            byPhase.setdefault(ph, []).append(lat)
+        print("'Q' answered %d times: %s" % (len(qs), ', '.join('%s max %d ms' % (PHASES[p], max(v)) for p, v in sorted(byPhase.items()))))
+        late = [q for q in qs if q[1] > DISPATCH_TICK]
+        if late:
+            fail("'Q' answered later than %d ms: %s" % (DISPATCH_TICK, late[:5]))
+        if 'Q' not in hs or 'M' not in hs:
+            fail("no 'h' answer")
+        else:
+            hist = [0] * CST_BINS
+            hq = [int(r[1]) for r in rows if r[0] == 'hq'][0]
+            cnt, dropped, mx = hs['Q'][:3]
+            n = len([q for q in qs if q[0] <= hq]) # sent before 'H'
+            for t, lat, _, _ in qs[:n]:
+                hist[latBin(lat)] += 1
+            print("'h' of 'Q': handled %d, dropped %d, max %d ms, bins %s" % (cnt, dropped, mx, ' '.join(str(x) for x in hs['Q'][3:])))
+            print("    seen on link: handled %d, max %d ms, bins %s" % (n, max(q[1] for q in qs[:n]), ' '.join(str(x) for x in hist)))
+            if cnt != n or hs['Q'][3:] != hist or mx != max(q[1] for q in qs[:n]):
+                fail("'h' does not match the answers")
+            cnt, dropped = hs['M'][:2]
+            print("'h' of 'M': handled %d, dropped %d" % (cnt, dropped))
+            if (cnt, dropped) != (0, 1):
+                fail("manual code while idle is not counted as dropped")
+
+        # upload during the play
+        plays = [(int(r[1]), int(r[3]), tuple(int(x) for x in r[4:])) for r in rows if r[0] == 'play']
+        up = [int(r[1]) for r in rows if r[0] == 'up']
+        cal0 = [r for r in rows if r[0] == 'cal0'][0]
+        print('played: %s' % ', '.join('%d from program %s' % (c, list(p)) for _, c, p in plays))
+        if [c for _, c, _ in plays] != list(PLAYED) or any(p != PLAYED for _, _, p in plays):
+            fail('schedule being played was changed by the upload')
+        if not up:
+            fail('no upload during the play')
+        else:
+            during = [q for q in qs if q[0] > up[0] and q[2] in (3, 4, 5)]
+            after = [q for q in qs if q[0] > up[0] and q[2] == 0]
+            print('upload at %d: held in %d answers during autoplay(flag %s), flag cleared in %d answers after'
+                  % (up[0], len([q for q in during if q[3] & SKD_PENDING]), 'set' if during and all(q[3] & SKD_PENDING for q in during) else 'missing',
+                     len([q for q in after if not q[3] & SKD_PENDING])))
+            if not during or not all(q[3] & SKD_PENDING for q in during) or not after or any(q[3] & SKD_PENDING for q in after):
+                fail('pending flag does not follow the held upload')
+        print('calendar slot 0 after autoplay: %s program %s' % ('armed' if cal0[1] == '1' else 'not armed', [int(x) for x in cal0[2:]]))
+        if cal0[1] != '1' or tuple(int(x) for x in cal0[2:]) != UPLOAD:
+            fail('held upload did not take the slot after autoplay')
+
+        # aborts
+        spans = {}
+        for i, (t, p) in enumerate(phases):
+            end = phases[i + 1][0] if i + 1 < len(phases) else RUN_MS
+            spans.setdefault(p, []).append((t, end))
+        pats = [t for t, _, _ in plays] + ([spans[5][0][0]] if 5 in spans else []) # pattern starts, park
+        points = []
+        for s, e in spans.get(1, []):
+            points += [('search', s + (e - s) * (k + 1) // (args.points + 1)) for k in range(args.points)]
+        for i in range(len(pats) - 1):
+            s, e = pats[i], pats[i + 1]
+            points += [('pattern %d' % plays[i][1], s + (e - s) * (k + 1) // (args.points + 1)) for k in range(args.points)]
+        res = {}
+        for name, t in points:
+            r = [x for x in run(exe, t) if x[0] == 'abort'][0]
+            moving, stop, ext, restarts = int(r[3]), int(r[4]), int(r[5]), int(r[6])
+            if args.v:
+                print('  !0 at %6d in %-10s %s: stopped in %d ms, idle in %d ms, %d restarts' % (t, name, 'moving' if moving else 'standing', stop if moving else 0, ext, restarts))
+            res.setdefault(name, []).append((moving, stop, ext, restarts))
+            if ext < 0 or restarts or (moving and stop > DISPATCH_TICK):
+                fail('!0 at %d in %s: stop %d ms, idle %d ms, %d restarts' % (t, name, stop, ext, restarts))
+        for name, v in res.items():
+            mv = [x[1] for x in v if x[0]]
+            print('!0 in %-10s %d aborts, %d while moving: motors stopped in %s ms, idle in %d ~ %d ms'
+                  % (name, len(v), len(mv), '%d ~ %d' % (min(mv), max(mv)) if mv else '-', min(x[2] for x in v), max(x[2] for x in v)))
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+# gen_fxtables.py
+# Generates Inc/fxtables.h and Src/fxtables.c: CCR lookup tables for sg90, l298n and buzzer.
+# Input constants are read from the driver headers, so run this again after changing
+#   SG90_TIM_ARR, SG90_MIN_DUTY, SG90_MAX_DUTY (sg90.h)
+#   L298N_TIM_ARR (l298n.h)
+#   tone enum, BUZZER_STD_DUTY_0..n (buzzer.h)
+# The drivers refuse to compile(#error / _Static_assert) when the tables are out of date.
+#
+# usage: python3 tools/gen_fxtables.py          regenerate
+#        python3 tools/gen_fxtables.py --check  verify tables against the float formulas
+#                                               and the committed files without writing
+#
+# Table entries are computed by reproducing the float code the drivers used before(single
+# precision multiply, truncating cast), so every entry is bit-exact to the old results.
+# --check also reports how far the runtime Q16 fallback(fixedpt.h) is from the float path.
+
+import os
+import re
+import struct
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+INC = os.path.join(ROOT, "Inc")
+SRC = os.path.join(ROOT, "Src")
+
+FX_FRAC_BITS = 16
+
+
+def read(path):
+    with open(path, encoding="utf-8") as f:
+        return f.read()
+
+
+def define(text, name):
+    m = re.search(r"#define\s+" + name + r"\s+(\d+)", text)
+    if m is None:
+        sys.exit("gen_fxtables: %s not found" % name)
+    return int(m.group(1))
+
+
+def f32(x):  # round a double to single precision, same as storing to float
+    return struct.unpack("<f", struct.pack("<f", x))[0]
+
+
+# float reference paths(the driver code before fixed-point conversion)
+def sg90_ref(arr, dmin, dmax, angle):
+    ccrmin = arr * dmin // 100
+    ccrmax = arr * dmax // 100
+    multr = f32((ccrmax - ccrmin) / 180.0)
+    return ccrmin + (int(f32(f32(float(angle)) * multr)) & 0xFFFF)
+
+
+def l298n_ref(arr, speed):
+    return speed * (arr // 100)
+
+
+def buzzer_ref(arr, duty):
+    return int(f32(float(arr)) * (f32(float(duty)) / 100.0)) & 0xFFFF
+
+
+# Q16 runtime fallback paths(fixedpt.h)
+def fx_fromRatio(num, den):
+    n = num << FX_FRAC_BITS
+    return (n + den // 2) // den
+
+
+def fx_scaleU(u, q):
+    return (u * q) >> FX_FRAC_BITS
+
+
+def sg90_fx(arr, dmin, dmax, angle):
+    ccrmin = arr * dmin // 100
+    ccrmax = arr * dmax // 100
+    return ccrmin + fx_scaleU(angle, fx_fromRatio(ccrmax - ccrmin, 180))
+
+
+def buzzer_fx(arr, duty):
+    return fx_scaleU(arr, fx_fromRatio(duty, 100))
+
+
+def parse_inputs():
+    sg = read(os.path.join(INC, "sg90.h"))
+    lm = read(os.path.join(INC, "l298n.h"))
+    bz = read(os.path.join(INC, "buzzer.h"))
+    tones = [(n, int(v)) for n, v in re.findall(r"\b(tone\w+)\s*=\s*(\d+)", bz)]
+    duties = []
+    while True:
+        m = re.search(r"#define\s+BUZZER_STD_DUTY_%d\s+(\d+)" % len(duties), bz)
+        if m is None:
+            break
+        duties.append(int(m.group(1)))
+    if not tones or not duties:
+        sys.exit("gen_fxtables: buzzer tone enum or BUZZER_STD_DUTY_n not found")
+    return {
+        "sg_arr": define(sg, "SG90_TIM_ARR"),
+        "sg_min": define(sg, "SG90_MIN_DUTY"),
+        "sg_max": define(sg, "SG90_MAX_DUTY"),
+        "lm_arr": define(lm, "L298N_TIM_ARR"),
+        "lm_max": define(lm, "L298N_MAX_SPD"),
+        "tones": tones,
+        "duties": duties,
+    }
+
+
+def rows(values, per_line=12):
+    out = []
+    for i in range(0, len(values), per_line):
+        out.append("\t" + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+    return "\n".join(out)
+
+
+HEADER_TOP = """/**
+  *********************************************************************************************
+  * NAME OF THE FILE : fxtables.%s
+  * BRIEF INFORMATION: GENERATED BY tools/gen_fxtables.py. DO NOT EDIT.
+  * 				   CCR lookup tables for sg90, l298n and buzzer.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+"""
+
+
+def generate(p):
+    tones = sorted(p["tones"], key=lambda t: t[1])
+    arrs = [v for _, v in tones]
+    sg = [sg90_ref(p["sg_arr"], p["sg_min"], p["sg_max"], a) for a in range(181)]
+    lm = [l298n_ref(p["lm_arr"], s) for s in range(p["lm_max"] + 1)]
+    bz = [[buzzer_ref(a, d) for a in arrs] for d in p["duties"]]
+
+    h = HEADER_TOP % "h"
+    h += """
+#ifndef FXTABLES_H
+#define FXTABLES_H
+
+#include <stdint.h>
+
+/* generator inputs: compared against the driver headers at compile time */
+#define FXT_SG90_TIM_ARR %d
+#define FXT_SG90_MIN_DUTY %d
+#define FXT_SG90_MAX_DUTY %d
+#define FXT_L298N_TIM_ARR %d
+#define FXT_L298N_MAX_SPD %d
+#define FXT_BUZZER_STD_DUTY_CNT %d
+""" % (p["sg_arr"], p["sg_min"], p["sg_max"], p["lm_arr"], p["lm_max"], len(p["duties"]))
+    for i, d in enumerate(p["duties"]):
+        h += "#define FXT_BUZZER_STD_DUTY_%d %d\n" % (i, d)
+    h += """#define FXT_TONE_CNT %d
+
+/* exported vars */
+extern const uint16_t fxtSg90AngleCCR[181]; // index: angle 0 to 180
+extern const uint16_t fxtL298nSpdCCR[FXT_L298N_MAX_SPD + 1]; // index: speed 0 to L298N_MAX_SPD
+extern const uint16_t fxtToneARR[FXT_TONE_CNT]; // tone enum values in ascending order
+extern const uint16_t fxtToneCCR[FXT_BUZZER_STD_DUTY_CNT][FXT_TONE_CNT]; // [std duty index][tone index]
+
+#endif
+""" % len(arrs)
+
+    c = HEADER_TOP % "c"
+    c += """
+#include "fxtables.h"
+#include "buzzer.h"
+
+// tone enum must match the values the tables were generated from
+#define FXT_TONE(name, val) _Static_assert(name == val, "fxtables out of date: run tools/gen_fxtables.py");
+"""
+    c += "\n".join("FXT_TONE(%s, %d)" % t for t in tones) + "\n#undef FXT_TONE\n"
+    c += "\nconst uint16_t fxtSg90AngleCCR[181] = {\n%s\n};\n" % rows(sg)
+    c += "\nconst uint16_t fxtL298nSpdCCR[FXT_L298N_MAX_SPD + 1] = {\n%s\n};\n" % rows(lm)
+    c += "\nconst uint16_t fxtToneARR[FXT_TONE_CNT] = {\n%s\n};\n" % rows(arrs)
+    c += "\nconst uint16_t fxtToneCCR[FXT_BUZZER_STD_DUTY_CNT][FXT_TONE_CNT] = {\n"
+    for d, r in zip(p["duties"], bz):
+        c += "\t{ // %d%%\n%s\n\t},\n" % (d, "\n".join("\t" + l for l in rows(r).split("\n")))
+    c += "};\n"
+    return h, c, (arrs, sg, lm, bz)
+
+
+# the old float expressions compiled with the host C compiler, single precision like the FPU
+FLOAT_REF_C = r"""
+#include <stdio.h>
+#include <stdint.h>
+int main(void) {
+	volatile uint32_t arr = %d;
+	uint16_t CCRmin = (uint16_t)(arr * %d / 100);
+	uint16_t CCRmax = (uint16_t)(arr * %d / 100);
+	float angleMultr = (CCRmax - CCRmin) / 180.0;
+	static const uint16_t tones[] = { %s };
+	static const uint8_t duties[] = { %s };
+	for (int a = 0; a <= 180; a++) printf("%%u\n", (unsigned)(CCRmin + (uint16_t)((float)a * angleMultr)));
+	for (unsigned d = 0; d < sizeof(duties); d++)
+		for (unsigned t = 0; t < sizeof(tones) / 2; t++) {
+			volatile uint32_t tarr = tones[t];
+			printf("%%u\n", (unsigned)(uint16_t)((float)tarr * ((float)duties[d] / 100.0)));
+		}
+	return 0;
+}
+"""
+
+
+def host_float_results(p, arrs):
+    import shutil
+    import subprocess
+    import tempfile
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        return None
+    src = FLOAT_REF_C % (p["sg_arr"], p["sg_min"], p["sg_max"],
+                         ", ".join(map(str, arrs)), ", ".join(map(str, p["duties"])))
+    with tempfile.TemporaryDirectory() as d:
+        cpath = os.path.join(d, "ref.c")
+        exe = os.path.join(d, "ref")
+        with open(cpath, "w") as f:
+            f.write(src)
+        # -ffp-contract=off: the M4 build does not fuse the multiply, keep the host equal
+        subprocess.check_call([cc, "-O0", "-ffp-contract=off", "-o", exe, cpath])
+        return [int(v) for v in subprocess.check_output([exe]).split()]
+
+
+def check(p, tables):
+    arrs, sg, lm, bz = tables
+    ok = True
+    ref = host_float_results(p, arrs)
+    if ref is None:
+        print("no host C compiler: float reference check skipped")
+    else:
+        expect = sg + [v for r in bz for v in r]
+        bad = [i for i, (a, b) in enumerate(zip(ref, expect)) if a != b]
+        if bad or len(ref) != len(expect):
+            print("tables differ from host float results at %d entries" % len(bad))
+            ok = False
+        else:
+            print("tables match host float results(%d entries)" % len(ref))
+    # Q16 fallback distance from float path(informational; used only when ARR differs at runtime)
+    worst = max(abs(sg90_fx(p["sg_arr"], p["sg_min"], p["sg_max"], a) - sg[a]) for a in range(181))
+    print("sg90 : %d entries exact, Q16 fallback max error %d counts" % (len(sg), worst))
+    print("l298n: %d entries exact" % len(lm))
+    worst = 0
+    for d in range(5, 51):
+        for arr in arrs:
+            worst = max(worst, abs(buzzer_fx(arr, d) - buzzer_ref(arr, d)))
+    print("buzzer: %d x %d entries exact, Q16 fallback max error %d counts(duty 5..50)"
+          % (len(p["duties"]), len(arrs), worst))
+    return ok
+
+
+def main():
+    p = parse_inputs()
+    h, c, tables = generate(p)
+    hpath = os.path.join(INC, "fxtables.h")
+    cpath = os.path.join(SRC, "fxtables.c")
+    if "--check" in sys.argv[1:]:
+        ok = check(p, tables)
+        for path, text in ((hpath, h), (cpath, c)):
+            if not os.path.exists(path) or read(path) != text:
+                print("%s is out of date" % os.path.relpath(path, ROOT))
+                ok = False
+        sys.exit(0 if ok else 1)
+    for path, text in ((hpath, h), (cpath, c)):
+        with open(path, "w", encoding="utf-8", newline="\n") as f:
+            f.write(text)
+    print("wrote %s, %s" % (os.path.relpath(hpath, ROOT), os.path.relpath(cpath, ROOT)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,315 @@
+#!/usr/bin/env python3
+# gen_pattime.py
+# Generates Inc/pattime.h, Src/pattime.c and rpi/pattime.json: play time of the built-in patterns.
+# Each pattern takes baseMs + repMs x runs of its interval loop('loopv intv'), runs = interval / div,
+# dflt if under min. Over maxRuns the interpreter hits MOTPROG_STEP_LIMIT and cuts the pattern short.
+# The numbers come from the byte-code tables of Src/motprog.c(built with the host compiler and
+# dumped) walked like motprog_time(). Wheel segments are timed, so the play speed setting changes
+# how fast the robot goes but not how long: one row per pattern covers speeds 0 ~ 2.
+# Inputs are also read from Src/app.c, so run this again after changing
+#   a built-in pattern(Src/motprog.c)
+#   PATTERN_GAP_TIME, PATTERN_WAIT_AND_FLEE_WAIT_TIME, snack state times(Src/app.c)
+#   MOTPROG_STEP_LIMIT, MOTPROG_BUILTIN_CNT(Inc/motprog.h)
+# pattime.c refuses to compile(_Static_assert) when the motprog.h inputs changed, and the firmware
+# with _TEST_MODE_ENABLED prints PATTIME OUT OF DATE at start when a pattern or app.c input did.
+#
+# usage: python3 tools/gen_pattime.py          regenerate
+#        python3 tools/gen_pattime.py --check  check the table against the patterns run on the host
+#                                              interpreter with a clock and against the committed
+#                                              files without writing
+#
+# The host run times every step as motionRun() does: wheel segments go to a queue that runs
+# behind the interpreter, a step that is not a wait takes one tick, a wait drains the queue first.
+
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+INC = os.path.join(ROOT, "Inc")
+SRC = os.path.join(ROOT, "Src")
+sys.path.insert(0, os.path.join(ROOT, "rpi"))
+import motprog  # noqa: E402
+
+INTVS = (0, 1, 2, 3, 5, 6, 9, 10, 19, 20, 21, 40, 61, 300, 4095) # interval overrides tried by --check
+REPS = (1, 2, 7, 60) # runs given by the play plan tried by --check
+SPEEDS = ((38, 38), (48, 44), (96, 88)) # drive, rotation of setPlaySpeed(0 ~ 2)
+
+
+def read(path):
+    with open(path, encoding="utf-8") as f:
+        return f.read()
+
+
+def const(text, name):
+    m = re.search(r"\b" + name + r"\s*=\s*(\d+)", text)
+    if m is None:
+        sys.exit("gen_pattime: %s not found in Src/app.c" % name)
+    return int(m.group(1))
+
+
+def define(text, name):
+    m = re.search(r"#define\s+" + name + r"\s+(\d+)", text)
+    if m is None:
+        sys.exit("gen_pattime: %s not found in Inc/motprog.h" % name)
+    return int(m.group(1))
+
+
+def parse_inputs():
+    app = read(os.path.join(SRC, "app.c"))
+    mp = read(os.path.join(INC, "motprog.h"))
+    states = re.findall(r"\[SNACK_ST_(\w+)\]\s*=\s*\{[^}]*,\s*(\d+)\s*\}", app)
+    if not states:
+        sys.exit("gen_pattime: snackStates not found in Src/app.c")
+    names = dict(re.findall(r"static const uint8_t pat(\d+)\[\] = \{ // ([^\n]*)", read(os.path.join(SRC, "motprog.c"))))
+    return {
+        "gap": const(app, "PATTERN_GAP_TIME"),
+        "wait": const(app, "PATTERN_WAIT_AND_FLEE_WAIT_TIME"),
+        # snackTotal(): states up to the door, then open, hold and close
+        "snack": sum(int(ms) for st, ms in states if st != "DOOR") + const(app, "SNACK_DOOR_OPEN_TIME")
+                 + const(app, "OP_SNACK_RET_MOTOR_WAITING_TIME") + const(app, "SNACK_DOOR_CLOSE_TIME"),
+        "names": {int(k): v for k, v in names.items()},
+        "limit": define(mp, "MOTPROG_STEP_LIMIT"),
+        "cnt": define(mp, "MOTPROG_BUILTIN_CNT"),
+    }
+
+
+# host driver, one command per line:
+#   b                      -> built-in tables in hex, codes 1 ~ 9
+#   r code intv reps drv rot -> ms of a run on the clock of motionRun(), steps, motprog_time()
+DRIVER_C = r"""
+#include <stdio.h>
+#include "motprog.h"
+static _Bool never(uint8_t c) {
+	return c == MOTPROG_COND_IR_FAR; // the cat never comes: full wait
+}
+int main(void) {
+	char line[256];
+	unsigned code, intv, reps, drv, rot;
+	while (fgets(line, sizeof(line), stdin)) {
+		if (line[0] == 'b') {
+			for (uint8_t c = 1; c <= MOTPROG_BUILTIN_CNT; c++) {
+				uint8_t l;
+				const uint8_t* q = motprog_builtin(c, &l);
+				for (uint8_t i = 0; i < l; i++) printf("%02x", q[i]);
+				printf("\n");
+			}
+		}
+		else if (sscanf(line, "r %u %u %u %u %u", &code, &intv, &reps, &drv, &rot) == 5) {
+			struct MotProgEnv env = { { drv, rot, 38, 44 }, { 0, 12, 6, 3 }, { intv, @WAIT@ }, reps, never };
+			struct MotProgVm vm;
+			struct MotProgAct a;
+			uint8_t len = 0;
+			const uint8_t* p = motprog_builtin(code, &len);
+			uint64_t t = 0, qEnd = 0;
+			motprog_begin(&vm, &env);
+			while (motprog_step(&vm, p, len, &a)) {
+				if (a.kind == MOTPROG_ACT_WAIT) { // motionWait(), appWait(ms)
+					t = ((t > qEnd) ? t : qEnd) + a.ms;
+					continue;
+				}
+				if (a.kind == MOTPROG_ACT_DRIVE) qEnd = ((t > qEnd) ? t : qEnd) + a.ms; // motionPush()
+				t++; // appWait(1)
+			}
+			if (qEnd > t) t = qEnd; // motionWait() at the end of exePattern()
+			printf("%llu %u %u\n", (unsigned long long)t, vm.steps, motprog_time(p, len, &env));
+		}
+		fflush(stdout);
+	}
+	return 0;
+}
+"""
+
+
+class Host: # driver built from Src/motprog.c
+    def __init__(self, d, p):
+        cc = shutil.which("cc") or shutil.which("gcc")
+        if cc is None:
+            sys.exit("gen_pattime: no host C compiler to read the tables of Src/motprog.c")
+        exe = os.path.join(d, "drv")
+        with open(os.path.join(d, "drv.c"), "w") as f:
+            f.write(DRIVER_C.replace("@WAIT@", str(p["wait"])))
+        subprocess.check_call([cc, "-std=gnu11", "-O2", "-Wall", "-I", INC, "-o", exe, os.path.join(d, "drv.c"), os.path.join(SRC, "motprog.c")])
+        self.proc = subprocess.Popen([exe], stdin = subprocess.PIPE, stdout = subprocess.PIPE, text = True)
+
+    def ask(self, cmd, lines = 1):
+        self.proc.stdin.write(cmd + "\n")
+        self.proc.stdin.flush()
+        return [self.proc.stdout.readline().strip() for _ in range(lines)]
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
+
+
+def model(host, code, prog, p):
+    # (baseMs, repMs, div, min, dflt, maxRuns) of a pattern. exits if the time is not base + rep x runs
+    loops = set()
+    pc = 0
+    while pc < len(prog):
+        if prog[pc] == 4 and prog[pc + 1] == 0:
+            loops.add(tuple(prog[pc + 2:pc + 5]))
+        pc += 1 + motprog.OP_LEN[prog[pc]]
+    if len(loops) > 1:
+        sys.exit("gen_pattime: pattern %d has interval loops of different div/min/dflt" % code)
+    t = [motprog.duration(prog, wait = p["wait"], reps = r) for r in (1, 2, 3, 5)]
+    n = [int(host.ask("r %d 1 %d 96 88" % (code, r))[0].split()[1]) for r in (1, 2, 3)] # interpreter steps
+    rep = t[1] - t[0]
+    if t[2] - t[1] != rep or t[3] - t[2] != 2 * rep or n[2] - n[1] != n[1] - n[0]:
+        sys.exit("gen_pattime: pattern %d does not grow linearly with its interval loop(nested loops?)" % code)
+    div, mn, dflt = loops.pop() if loops else (0, 0, 0)
+    maxRuns = min((p["limit"] - (n[0] - (n[1] - n[0]))) // (n[1] - n[0]), 0xFFFF) if rep else 0
+    return (t[0] - rep, rep, div, mn, dflt, maxRuns)
+
+
+def runs(row, intv): # runs of the interval loop for an interval override, as the interpreter counts them
+    base, rep, div, mn, dflt, maxRuns = row
+    if not div:
+        return 0
+    cnt = intv // div
+    return min(dflt if cnt < mn else cnt, 0xFFFF)
+
+
+HEADER_TOP = """/**
+  *********************************************************************************************
+  * NAME OF THE FILE : pattime.%s
+  * BRIEF INFORMATION: GENERATED BY tools/gen_pattime.py. DO NOT EDIT.
+  * 				   Play time of built-in patterns 1 ~ 9, also in rpi/pattime.json.
+  *
+  * Copyright (c) 2023 Lee Geon-goo.
+  * All rights reserved.
+  *
+  * This file is part of catCareBot.
+  *
+  *********************************************************************************************
+  */
+"""
+
+
+def generate(host, p, tables):
+    rows = [model(host, code, prog, p) for code, prog in enumerate(tables, 1)]
+    h = HEADER_TOP % "h"
+    h += """
+#ifndef PATTIME_H
+#define PATTIME_H
+
+#include <stdint.h>
+
+/* generator inputs(Src/app.c) */
+#define PATTIME_GAP_MS %d // PATTERN_GAP_TIME, before every pattern. not in the table
+#define PATTIME_WAIT_S %d // PATTERN_WAIT_AND_FLEE_WAIT_TIME. pattern 7 waits all of it
+#define PATTIME_SNACK_MS %d // whole snack
+/* generator inputs(motprog.h): compared at compile time */
+#define PATTIME_STEP_LIMIT %d
+#define PATTIME_CNT %d
+
+/* exported typedef */
+struct PatTime { // ms = baseMs + repMs x runs. runs = interval / div, dflt if under min, or repeats of the play plan
+	uint32_t baseMs;
+	uint32_t repMs; // 0: no interval loop
+	uint8_t div; // 0: no interval loop
+	uint8_t min;
+	uint8_t dflt;
+	uint16_t maxRuns; // runs that end within MOTPROG_STEP_LIMIT. over it the pattern is cut short
+};
+
+/* exported vars */
+extern const struct PatTime pattime[PATTIME_CNT + 1]; // by pattern code. 0(auto-decide) is empty
+
+#endif
+""" % (p["gap"], p["wait"], p["snack"], p["limit"], len(rows))
+
+    c = HEADER_TOP % "c"
+    c += """
+#include "pattime.h"
+#include "motprog.h"
+
+_Static_assert(PATTIME_STEP_LIMIT == MOTPROG_STEP_LIMIT, "pattime out of date: run tools/gen_pattime.py");
+_Static_assert(PATTIME_CNT == MOTPROG_BUILTIN_CNT, "pattime out of date: run tools/gen_pattime.py");
+
+const struct PatTime pattime[PATTIME_CNT + 1] = {
+	{ 0, 0, 0, 0, 0, 0 },
+"""
+    for code, r in enumerate(rows, 1):
+        c += "\t{ %d, %d, %d, %d, %d, %d }, // %d: %s\n" % (r + (code, p["names"].get(code, "")))
+    c += "};\n"
+
+    j = {
+        "generator": "tools/gen_pattime.py",
+        "formula": "ms = baseMs + repMs * runs, runs = interval // div (dflt if under min) or repeats of the play plan, up to maxRuns",
+        "gapMs": p["gap"], "waitS": p["wait"], "snackMs": p["snack"],
+        "patterns": {str(code): dict(zip(("baseMs", "repMs", "div", "min", "dflt", "maxRuns"), r)) for code, r in enumerate(rows, 1)},
+    }
+    return h, c, json.dumps(j, indent = 1) + "\n", rows
+
+
+def check(host, rows):
+    ok = True
+    runCnt = worst = cut = 0
+    for code, row in enumerate(rows, 1):
+        base, rep = row[0], row[1]
+        cases = [(intv, 0, runs(row, intv)) for intv in INTVS] + [(1, r, r if rep else 0) for r in REPS]
+        if rep: # around the step limit
+            cases += [(1, row[5], row[5]), (1, row[5] + 1, row[5] + 1)]
+        for intv, reps, n in cases:
+            got = set()
+            for drv, rot in SPEEDS:
+                ms, steps, cms = (int(x) for x in host.ask("r %d %d %d %d %d" % (code, intv, reps, drv, rot))[0].split())
+                runCnt += 1
+                want = base + rep * n
+                if rep and n > row[5]: # cut short by the step limit: ends within the last run it fits
+                    runCnt += 1
+                    cut += 1
+                    if not base + rep * row[5] <= ms <= base + rep * (row[5] + 1):
+                        print("pattern %d interval %d reps %d: cut at %d ms, table allows %d runs" % (code, intv, reps, ms, row[5]))
+                        ok = False
+                    continue
+                if cms != want: # motprog_time() of the MCU
+                    print("pattern %d interval %d reps %d: motprog_time %d ms, table %d ms" % (code, intv, reps, cms, want))
+                    ok = False
+                # host run: table plus ticks of steps the wheel queue did not cover
+                err = ms - want
+                worst = max(worst, err)
+                if err < 0 or err > max(20, want // 200):
+                    print("pattern %d interval %d reps %d: ran %d ms in %d steps, table %d ms" % (code, intv, reps, ms, steps, want))
+                    ok = False
+                got.add(ms)
+            if len(got) > 1:
+                print("pattern %d interval %d: time depends on play speed %s" % (code, intv, sorted(got)))
+                ok = False
+    print("table against host runs: %d runs(%d intervals, %d plan repeats, 3 speeds), run is at most %d ms over, %d cut by the step limit"
+          % (runCnt, len(INTVS), len(REPS), worst, cut))
+    return ok
+
+
+def main():
+    p = parse_inputs()
+    with tempfile.TemporaryDirectory() as d:
+        host = Host(d, p)
+        tables = [bytes.fromhex(x) for x in host.ask("b", 9)]
+        h, c, j, rows = generate(host, p, tables)
+        paths = ((os.path.join(INC, "pattime.h"), h), (os.path.join(SRC, "pattime.c"), c), (os.path.join(ROOT, "rpi", "pattime.json"), j))
+        print("%-8s %9s %9s %8s  %s" % ("pattern", "base ms", "rep ms", "max runs", "runs"))
+        for code, r in enumerate(rows, 1):
+            print("%-8d %9d %9d %8s  %s" % (code, r[0], r[1], r[5] or "-", "interval / %d, %d if under %d" % (r[2], r[4], r[3]) if r[2] else "-"))
+        if "--check" in sys.argv[1:]:
+            ok = check(host, rows)
+            host.close()
+            for path, text in paths:
+                if not os.path.exists(path) or read(path) != text:
+                    print("%s is out of date" % os.path.relpath(path, ROOT))
+                    ok = False
+            sys.exit(0 if ok else 1)
+        host.close()
+    for path, text in paths:
+        with open(path, "w", encoding="utf-8", newline="\n") as f:
+            f.write(text)
+    print("wrote %s" % ", ".join(os.path.relpath(path, ROOT) for path, _ in paths))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+# link_fault.py
+# Fault injection for the Pi <-> MCU link(rpicomm.c). Run on the Pi with ccb.py stopped.
+# Each round corrupts the byte stream in one way, then sends TYPE_LINK_RESET probes every
+# PROBE_GAP seconds until the MCU acknowledges one. Recovery time is measured from the end of
+# the fault to the first probe that got through; a round passes if that is within one frame time
+# of the longest frame(RPI_MAX_PAYLOAD). Line health of the MCU(TYPE_LINK_STAT) is printed at the end.
+#
+# usage: python3 tools/link_fault.py [--port /dev/ttyAMA0] [--baud 9600] [--rounds 10]
+#                                    [--faults flip,drop,junk,break,baud,ascii] [--seed n]
+#
+# faults: flip   one bit flipped in a frame                    -> CRC NAK, resync
+#         drop   bytes cut out of the middle of a frame        -> CRC NAK or LEN wait, resync
+#         junk   random bytes, may contain false SYNC          -> resync
+#         break  line held low for a few characters            -> FE, reception restarted
+#         baud   bytes sent at twice the baud rate             -> FE/NE, reception restarted
+#         ascii  bad CRC, SEQ + payload read as 'I1......'     -> CRC NAK, resync, no ASCII frame accepted
+# An overrun cannot be caused from this side. It shows in the ORE counter if the MCU stalls.
+# For ascii the frame counter of the MCU must grow by the valid frames sent only: an ASCII frame
+# taken from inside the bad frame would count too.
+
+import argparse
+import binascii
+import random
+import struct
+import sys
+import time
+
+import serial
+
+FRAME_SYNC = 0xA5
+FRAME_OVERHEAD = 6
+MAX_PAYLOAD = 128
+TYPE_LINK_RESET = ord('R')
+TYPE_LINK_STAT_REQ = ord('L')
+TYPE_LINK_STAT = ord('l')
+TYPE_ACK = ord('a')
+PROBE_GAP = 0.01 # seconds between probes
+RECOVERY_LIMIT = 2.0 # seconds, then the round fails as not recovered
+STAT_FIELDS = ('ore', 'fe', 'ne', 'pe', 'restarts', 'crc', 'lenErr', 'discarded', 'frames',
+               'oreAge', 'feAge', 'neAge', 'peAge') # RPI_LST_xxx of rpicomm.h
+
+
+def encodeFrame(ftype, payload, seq): # same as ccb.py
+    body = bytes([ftype, len(payload), seq]) + bytes(payload)
+    return bytes([FRAME_SYNC]) + body + struct.pack('<H', binascii.crc_hqx(body, 0xFFFF))
+
+
+class FrameReader: # same resync rule as rpicomm.c: drop one byte and rescan on a bad frame
+    def __init__(self):
+        self.acc = bytearray()
+
+    def feed(self, dta):
+        frames = []
+        self.acc += dta
+        while self.acc:
+            if self.acc[0] != FRAME_SYNC or (len(self.acc) >= 3 and self.acc[2] > MAX_PAYLOAD):
+                del self.acc[0]
+                continue
+            if len(self.acc) < 3 or len(self.acc) < self.acc[2] + FRAME_OVERHEAD:
+                break
+            total = self.acc[2] + FRAME_OVERHEAD
+            body = bytes(self.acc[1:total - 2])
+            if binascii.crc_hqx(body, 0xFFFF) != struct.unpack('<H', self.acc[total - 2:total])[0]:
+                del self.acc[0]
+                continue
+            frames.append((body[0], body[2], body[3:]))
+            del self.acc[:total]
+        return frames
+
+
+class Tester:
+    def __init__(self, ser, rnd):
+        self.ser = ser
+        self.rnd = rnd
+        self.reader = FrameReader()
+        self.seq = 0
+        self.sent = 0 # valid frames sent
+
+    def nextSeq(self):
+        self.seq = (self.seq + 1) & 0xFF
+        return self.seq
+
+    def poll(self, until):
+        frames = []
+        while True:
+            frames += self.reader.feed(self.ser.read(max(1, self.ser.in_waiting)))
+            if time.monotonic() >= until:
+                return frames
+
+    def probe(self, tStart):
+        # returns(recovery, ack delay) in seconds from tStart, None if no probe got through
+        sent = {}
+        while time.monotonic() - tStart < RECOVERY_LIMIT:
+            seq = self.nextSeq()
+            sent[seq] = time.monotonic()
+            self.ser.write(encodeFrame(TYPE_LINK_RESET, b'', seq))
+            self.sent += 1
+            for ftype, fseq, payload in self.poll(time.monotonic() + PROBE_GAP):
+                if ftype == TYPE_ACK and len(payload) >= 1 and payload[0] in sent:
+                    tAck = time.monotonic()
+                    self.poll(tAck + 0.05) # drain ACKs of later probes
+                    return sent[payload[0]] - tStart, tAck - tStart
+        return None
+
+    def randBytes(self, n):
+        return bytes(self.rnd.randrange(256) for _ in range(n))
+
+    def inject(self, kind):
+        rnd = self.rnd
+        if kind == 'flip':
+            fr = bytearray(encodeFrame(TYPE_LINK_RESET, self.randBytes(16), self.nextSeq()))
+            fr[rnd.randrange(1, len(fr))] ^= 1 << rnd.randrange(8)
+            self.ser.write(fr)
+        elif kind == 'drop':
+            fr = encodeFrame(TYPE_LINK_RESET, self.randBytes(16), self.nextSeq())
+            pos = rnd.randrange(4, len(fr) - 3)
+            self.ser.write(fr[:pos] + fr[pos + rnd.randint(1, 3):])
+        elif kind == 'junk':
+            self.ser.write(self.randBytes(32))
+        elif kind == 'break':
+            self.ser.break_condition = True
+            time.sleep(20.0 / self.ser.baudrate) # 2 characters
+            self.ser.break_condition = False
+        elif kind == 'baud':
+            baud = self.ser.baudrate
+            self.ser.baudrate = baud * 2
+            self.ser.write(self.randBytes(16))
+            self.ser.flush()
+            self.ser.baudrate = baud
+        elif kind == 'ascii':
+            fr = bytearray(encodeFrame(TYPE_LINK_RESET, b'1......', ord('I'))) # SEQ 'I': TYPE_FOUNDCAT
+            fr[-1] ^= 1 << rnd.randrange(8)
+            self.ser.write(fr)
+        self.ser.flush() # wait until the last byte is on the line
+
+    def linkStat(self):
+        self.ser.write(encodeFrame(TYPE_LINK_RESET, b'', self.nextSeq()))
+        self.ser.write(encodeFrame(TYPE_LINK_STAT_REQ, b'', self.nextSeq()))
+        self.sent += 2
+        for ftype, fseq, payload in self.poll(time.monotonic() + 0.5):
+            if ftype == TYPE_LINK_STAT and len(payload) >= 53:
+                st = dict(zip(STAT_FIELDS, struct.unpack('<13I', payload[1:53])))
+                st['quality'] = payload[0]
+                return st
+        return None
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--port', default='/dev/ttyAMA0')
+    ap.add_argument('--baud', type=int, default=9600)
+    ap.add_argument('--rounds', type=int, default=10)
+    ap.add_argument('--faults', default='flip,drop,junk,break,baud,ascii')
+    ap.add_argument('--seed', type=int, default=None)
+    args = ap.parse_args()
+
+    ser = serial.Serial(args.port, args.baud, timeout=0.002)
+    t = Tester(ser, random.Random(args.seed))
+    frameTime = (MAX_PAYLOAD + FRAME_OVERHEAD) * 10.0 / args.baud
+    base = t.probe(time.monotonic())
+    if base is None:
+        sys.exit('no ACK from MCU: check wiring and that ccb.py is stopped')
+    print('baseline probe ACK %.1f ms, limit %.1f ms(one %d-byte frame)'
+          % (base[1] * 1000, frameTime * 1000, MAX_PAYLOAD + FRAME_OVERHEAD))
+    before = t.linkStat()
+
+    ok = True
+    for kind in args.faults.split(','):
+        res = []
+        st0, sent0 = (t.linkStat(), t.sent) if kind == 'ascii' else (None, 0)
+        for _ in range(args.rounds):
+            t.inject(kind)
+            r = t.probe(time.monotonic())
+            res.append(r)
+            time.sleep(0.05)
+        lost = sum(1 for r in res if r is None)
+        rec = [r[0] for r in res if r is not None]
+        worst = max(rec) if rec else 0
+        passed = lost == 0 and worst <= frameTime
+        note = ''
+        if kind == 'ascii':
+            st1 = t.linkStat()
+            if st0 is not None and st1 is not None:
+                accepted = st1['frames'] - st0['frames'] - (t.sent - sent0)
+                passed = passed and accepted == 0
+                note = '  accepted as ASCII %d' % accepted
+        ok = ok and passed
+        print('%-5s %s  recovered %d/%d  recovery avg %.1f max %.1f ms%s'
+              % (kind, 'PASS' if passed else 'FAIL', len(rec), len(res),
+                 sum(rec) / len(rec) * 1000 if rec else 0, worst * 1000, note))
+
+    after = t.linkStat()
+    if after is None:
+        print('no TYPE_LINK_STAT from MCU(old firmware?)')
+    else:
+        print('MCU quality %d%%' % after['quality'])
+        for k in ('ore', 'fe', 'ne', 'pe', 'restarts', 'crc', 'lenErr', 'discarded'):
+            print('  %-9s %6d(+%d)' % (k, after[k], after[k] - (before[k] if before else 0)))
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
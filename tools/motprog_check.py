@@ -0,0 +1,429 @@
+#!/usr/bin/env python3
+# motprog_check.py
+# Check of the pattern motion programs(Inc/motprog.h, Src/motprog.c, rpi/motprog.py).
+#   built-in tables -> disassemble -> assemble      (python assembler writes the same bytes as the C tables)
+#   built-in tables on the C interpreter            (same wheel segments and waits as the hand-written
+#                                                    exePattern switch it replaced, REF_C below, for
+#                                                    every pattern, speed, interval and IR timing tried)
+#   malformed programs                              (C and python reject the same ones)
+# Then prints table size against the replaced switch and interpreter time per step, both built
+# with the host compiler at -Os: a proxy, the MCU reports its own cycles in TYPE_MOTION_STAT.
+#
+# usage: python3 tools/motprog_check.py [--random 300] [--seed n]
+
+import argparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+sys.path.insert(0, os.path.join(ROOT, "rpi"))
+import motprog  # noqa: E402
+
+# constants of Src/app.c
+AUTO_DEF_ROT_SPD = 44
+AUTO_DEF_DRV_SPD = 48
+AUTO_MIN_ROT_SPD = 38
+AUTO_MIN_DRV_SPD = 38
+SPD_ADDEND = 3
+SPD_OVERSHOOT_ADDEND = 100 - AUTO_DEF_ROT_SPD * 2
+WAIT_TIME = 20 # PATTERN_WAIT_AND_FLEE_WAIT_TIME
+
+# exePattern switch before motion programs, segments and waits recorded
+REF_C = r"""
+#include <stdint.h>
+#include <stdio.h>
+#define L298N_STOP 0
+#define L298N_CW 1
+#define L298N_CCW 2
+#define IR_SNSR_MODE_OP 1
+#define IR_SNSR_NEAR 1
+#define IR_SNSR_FAR 0
+extern const uint8_t AUTO_DEF_ROT_SPD, AUTO_MIN_ROT_SPD, SPD_OVERSHOOT_ADDEND, SPD_ADDEND;
+extern const int32_t PATTERN_WAIT_AND_FLEE_WAIT_TIME;
+void motionPush(uint8_t dirA, uint8_t spdA, uint8_t dirB, uint8_t spdB, uint32_t ms);
+void appWait(uint32_t ms);
+int periph_irSnsrChk(int mode);
+void refPattern(int code, int32_t interval, uint8_t drvSpd, uint8_t rotSpd) {
+	int32_t rptNum = 1;
+	int32_t rptTime = 1;
+	int32_t cnt = 0;
+@SWITCH@}
+"""
+
+# host driver, one command per line:
+#   c hex                      -> "ok" or "bad"
+#   b                          -> built-in tables in hex, codes 1 ~ 9
+#   r hex intv drv rot near    -> trace of the interpreter. near: IR check that sees the cat, -1 never
+#   f code intv drv rot near   -> trace of REF_C
+#   t hex intv reps            -> ns per step
+DRIVER_C = r"""
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "motprog.h"
+const uint8_t AUTO_DEF_ROT_SPD = @DEF_ROT@, AUTO_MIN_ROT_SPD = @MIN_ROT@, SPD_OVERSHOOT_ADDEND = @OS@, SPD_ADDEND = @ADD@;
+const int32_t PATTERN_WAIT_AND_FLEE_WAIT_TIME = @WAIT@;
+void refPattern(int code, int32_t interval, uint8_t drvSpd, uint8_t rotSpd);
+static int near, checks;
+static _Bool quiet;
+void motionPush(uint8_t dirA, uint8_t spdA, uint8_t dirB, uint8_t spdB, uint32_t ms) {
+	printf(" D%u.%u.%u.%u.%u", dirA, spdA > 100 ? 100 : spdA, dirB, spdB > 100 ? 100 : spdB, ms); // l298n clamps to 100
+}
+void appWait(uint32_t ms) {
+	printf(" W%u", ms);
+}
+int periph_irSnsrChk(int mode) {
+	return checks++ == near;
+}
+static _Bool cond(uint8_t c) {
+	if (quiet) return FALSE;
+	if (c == MOTPROG_COND_IR_NEAR) return periph_irSnsrChk(0);
+	if (c == MOTPROG_COND_IR_FAR) return !periph_irSnsrChk(0);
+	return FALSE;
+}
+static unsigned hex(const char* s, uint8_t* p) {
+	unsigned len = 0, v;
+	int n;
+	while (sscanf(s, "%2x%n", &v, &n) == 1 && len < 255) { p[len++] = (uint8_t)v; s += n; }
+	return len;
+}
+int main(void) {
+	char line[1024], h[600];
+	while (fgets(line, sizeof(line), stdin)) {
+		uint8_t p[255];
+		unsigned len;
+		int intv, drv, rot, reps;
+		struct MotProgEnv env = { { 0, 0, AUTO_MIN_ROT_SPD, AUTO_DEF_ROT_SPD }, { 0, SPD_OVERSHOOT_ADDEND, SPD_OVERSHOOT_ADDEND / 2, SPD_ADDEND },
+				{ 0, PATTERN_WAIT_AND_FLEE_WAIT_TIME }, 0, cond };
+		struct MotProgVm vm;
+		struct MotProgAct a;
+		if (line[0] == 'c') {
+			len = hex(line + 2, p);
+			printf(motprog_check(p, (uint8_t)len) ? "ok\n" : "bad\n");
+		}
+		else if (line[0] == 'b') {
+			for (uint8_t c = 1; c <= MOTPROG_BUILTIN_CNT; c++) {
+				uint8_t l;
+				const uint8_t* q = motprog_builtin(c, &l);
+				for (uint8_t i = 0; i < l; i++) printf("%02x", q[i]);
+				printf("\n");
+			}
+		}
+		else if (line[0] == 'r' && sscanf(line + 2, "%599s %d %d %d %d", h, &intv, &drv, &rot, &near) == 5) {
+			len = hex(h, p);
+			env.base[MOTPROG_SPD_DRV] = drv;
+			env.base[MOTPROG_SPD_ROT] = rot;
+			env.param[MOTPROG_PARAM_INTV] = intv;
+			checks = 0;
+			quiet = 0;
+			motprog_begin(&vm, &env);
+			while (motprog_step(&vm, p, (uint8_t)len, &a)) {
+				if (a.kind == MOTPROG_ACT_DRIVE) motionPush(a.dirA, a.spdA, a.dirB, a.spdB, a.ms);
+				else if (a.kind == MOTPROG_ACT_WAIT) appWait(a.ms);
+				else if (a.kind != MOTPROG_ACT_NONE) printf(" A%u.%u", a.kind, a.id);
+			}
+			printf(" S%u\n", vm.steps);
+		}
+		else if (line[0] == 'f' && sscanf(line + 2, "%d %d %d %d %d", &reps, &intv, &drv, &rot, &near) == 5) {
+			checks = 0;
+			refPattern(reps, intv, drv, rot);
+			printf("\n");
+		}
+		else if (line[0] == 't' && sscanf(line + 2, "%599s %d %d", h, &intv, &reps) == 3) {
+			uint64_t steps = 0;
+			struct timespec t0, t1;
+			len = hex(h, p);
+			env.base[MOTPROG_SPD_DRV] = 96;
+			env.base[MOTPROG_SPD_ROT] = 88;
+			env.param[MOTPROG_PARAM_INTV] = intv;
+			quiet = 1;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			for (int i = 0; i < reps; i++) {
+				motprog_begin(&vm, &env);
+				while (motprog_step(&vm, p, (uint8_t)len, &a)) steps++;
+				steps++; // END
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			printf("%.1f %llu\n", ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / steps, (unsigned long long)steps);
+		}
+		fflush(stdout);
+	}
+	return 0;
+}
+"""
+
+MALFORMED = [ # hex, rejected by both
+    "0A", "01", "0103000000", "0133000000e803", "0111650000e803", "01119000e803", "0300", "0305", "0302",
+    "05", "040001000101", "0402010101", "0400010101", "0600", "060505", "0600fe", "060003", "06000102e803",
+    "0802", "0303030303030303030305050505", "02e8", "09000000",
+]
+
+SPEEDS = (0, 1, 2)
+INTVS = (0, 1, 2, 3, 5, 6, 9, 10, 19, 20, 21, 40, 61, 300)
+NEARS = (-1, 0, 7, 199, 200)
+
+
+def merge(trace): # consecutive segments of equal wheels are one: pattern 4 is queued in 1 s pieces now
+    out = []
+    for t in trace:
+        if t[0] == 'D' and out and out[-1][0] == 'D' and out[-1].rsplit('.', 1)[0] == t.rsplit('.', 1)[0]:
+            head, ms = out[-1].rsplit('.', 1)
+            out[-1] = '%s.%d' % (head, int(ms) + int(t.rsplit('.', 1)[1]))
+        else:
+            out.append(t)
+    return out
+
+
+def speeds(spd): # setPlaySpeed()
+    return (AUTO_MIN_DRV_SPD, AUTO_MIN_ROT_SPD) if spd == 0 else (AUTO_DEF_DRV_SPD * spd, AUTO_DEF_ROT_SPD * spd)
+
+
+def build(d, cc):
+    exe = os.path.join(d, "drv")
+    with open(os.path.join(d, "ref.c"), "w") as f:
+        f.write(REF_C.replace('@SWITCH@', SWITCH))
+    drv = DRIVER_C
+    for k, v in (('@DEF_ROT@', AUTO_DEF_ROT_SPD), ('@MIN_ROT@', AUTO_MIN_ROT_SPD), ('@OS@', SPD_OVERSHOOT_ADDEND),
+                 ('@ADD@', SPD_ADDEND), ('@WAIT@', WAIT_TIME)):
+        drv = drv.replace(k, str(v))
+    with open(os.path.join(d, "drv.c"), "w") as f:
+        f.write(drv)
+    inc = ["-I", os.path.join(ROOT, "Inc")]
+    subprocess.check_call([cc, "-std=gnu11", "-O2", "-Wall", "-Wno-unused-variable"] + inc + ["-o", exe, os.path.join(d, "drv.c"),
+                           os.path.join(d, "ref.c"), os.path.join(ROOT, "Src", "motprog.c")])
+    sizes = {}
+    for name, src in (('ref', os.path.join(d, "ref.c")), ('motprog', os.path.join(ROOT, "Src", "motprog.c"))):
+        obj = os.path.join(d, name + ".o")
+        subprocess.check_call([cc, "-std=gnu11", "-Os", "-c", "-w", "-fno-asynchronous-unwind-tables"] + inc + ["-o", obj, src])
+        sizes[name] = objSize(obj)
+    return exe, sizes
+
+
+def objSize(obj): # text + rodata bytes, None if no size tool
+    tool = shutil.which("size") or shutil.which("llvm-size")
+    if tool is None:
+        return None
+    f = subprocess.run([tool, obj], capture_output = True, text = True, check = True).stdout.splitlines()[1].split()
+    return int(f[0])
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--random', type=int, default=300)
+    ap.add_argument('--seed', type=int, default=1)
+    args = ap.parse_args()
+    rnd = random.Random(args.seed)
+    ok = True
+
+    bad = []
+    for h in MALFORMED:
+        try:
+            motprog.check(bytes.fromhex(h))
+            print('python accepted malformed %s' % h)
+            ok = False
+        except ValueError:
+            pass
+        bad.append(h)
+
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print('no host C compiler: check skipped')
+        sys.exit(1)
+    with tempfile.TemporaryDirectory() as d:
+        exe, sizes = build(d, cc)
+        proc = subprocess.Popen([exe], stdin = subprocess.PIPE, stdout = subprocess.PIPE, text = True)
+
+        def ask(cmd, lines = 1):
+            proc.stdin.write(cmd + '\n')
+            proc.stdin.flush()
+            return [proc.stdout.readline().strip() for _ in range(lines)]
+
+        tables = [bytes.fromhex(h) for h in ask('b', 9)]
+        for code, p in enumerate(tables, 1):
+            text = motprog.disassemble(p)
+            if motprog.assemble(text) != p:
+                print('pattern %d: assembler differs from the C table' % code)
+                ok = False
+
+        runs = diff = 0
+        for code, p in enumerate(tables, 1):
+            for spd in SPEEDS:
+                drv, rot = speeds(spd)
+                for intv in INTVS:
+                    for near in (NEARS if code == 7 else (-1,)):
+                        got = ask('r %s %d %d %d %d' % (p.hex(), intv, drv, rot, near))[0].split()
+                        ref = ask('f %d %d %d %d %d' % (code, intv, drv, rot, near))[0].split()
+                        runs += 1
+                        if merge(got[:-1]) != merge(ref):
+                            diff += 1
+                            if diff <= 5:
+                                print('pattern %d speed %d interval %d near %d differs:\n  ref %s\n  got %s'
+                                      % (code, spd, intv, near, ' '.join(ref[:12]), ' '.join(got[:12])))
+        ok = ok and diff == 0
+        print('built-in patterns: %d runs against the replaced switch, %d differ' % (runs, diff))
+
+        for h in bad:
+            if ask('c ' + h)[0] != 'bad':
+                print('C accepted malformed %s' % h)
+                ok = False
+        mism = 0
+        for _ in range(args.random): # random bytes: C and python agree on validity
+            p = bytes(rnd.choice((0, 1, 2, 3, 4, 5, 6, 5, 1, rnd.randrange(256))) for _ in range(rnd.randint(1, 24)))
+            try:
+                motprog.check(p)
+                py = 'ok'
+            except ValueError:
+                py = 'bad'
+            if ask('c ' + p.hex())[0] != py:
+                mism += 1
+                if mism <= 5:
+                    print('C and python disagree on %s' % p.hex())
+        ok = ok and mism == 0
+        print('check: %d malformed, %d random programs, %d disagree' % (len(bad), args.random, mism))
+
+        print()
+        print('%-8s %6s %8s %10s' % ('pattern', 'bytes', 'steps', 'ns/step'))
+        total = 0
+        for code, p in enumerate(tables, 1):
+            ns, steps = ask('t %s 60 2000' % p.hex())[0].split()
+            total += len(p)
+            print('%-8d %6d %8d %10s' % (code, len(p), int(steps) // 2000, ns))
+        print('tables %d bytes; host -Os text+rodata: switch %s, interpreter with tables %s'
+              % (total, sizes['ref'], sizes['motprog']))
+        proc.stdin.close()
+        proc.wait()
+    sys.exit(0 if ok else 1)
+
+
+SWITCH = r"""	switch (code) {
+	case 1: // Waltz(S-shaped route zig-zaging)
+		rptNum = interval / 3;
+		if (rptNum < 2) rptNum = 1; // execute at least one time
+		motionPush(L298N_CCW, AUTO_DEF_ROT_SPD, L298N_CW, AUTO_MIN_ROT_SPD, 500); // initial rotation
+		for (int32_t i32 = 0; i32 < rptNum; i32++) {
+			// forward
+			motionPush(L298N_CCW, drvSpd, L298N_CW, drvSpd, 500);
+			motionPush(L298N_CCW, AUTO_MIN_ROT_SPD, L298N_CW, AUTO_DEF_ROT_SPD, 1500); // rotation speed will not be affected by speed multiplier
+			motionPush(L298N_CCW, drvSpd, L298N_CW, drvSpd, 500);
+			motionPush(L298N_CCW, AUTO_DEF_ROT_SPD, L298N_CW, AUTO_MIN_ROT_SPD, 1500); // rotation speed will not be affected by speed multiplier
+		}
+		break;
+	case 2: // loop of Sudden accel., decel.
+		rptNum = interval / 20;
+		if (rptNum < 2) rptNum = 1; // execute at least one time
+		for (int32_t i32 = 0; i32 < rptNum; i32++) {
+			// forward
+			for (int i = 0; i < 4; i++) {
+				motionPush(L298N_CCW, drvSpd + SPD_OVERSHOOT_ADDEND, L298N_CW, drvSpd + SPD_OVERSHOOT_ADDEND, 800);
+				motionPush(L298N_CCW, drvSpd, L298N_CW, drvSpd, 700);
+				motionPush(L298N_CCW, 0, L298N_CW, 0, 1000);
+			}
+			// backward
+			for (int i = 0; i < 4; i++) {
+				motionPush(L298N_CW, drvSpd + SPD_OVERSHOOT_ADDEND, L298N_CCW, drvSpd + SPD_OVERSHOOT_ADDEND, 800);
+				motionPush(L298N_CW, drvSpd, L298N_CCW, drvSpd, 700);
+				motionPush(L298N_CW, 0, L298N_CCW, 0, 1000);
+			}
+
+		}
+		break;
+	case 3: // crawling, left wheel forwards a little bit, right goes next, then left goes again...
+		rptNum = interval / 10;
+		if (rptNum < 2) rptNum = 1; /// execute at least one time
+		for (int32_t i32 = 0; i32 < rptNum; i32++) {
+			for (int i = 0; i < 5; i++) {
+				motionPush(L298N_CCW, drvSpd, L298N_CW, AUTO_MIN_ROT_SPD, 1000);
+				motionPush(L298N_CCW, AUTO_MIN_ROT_SPD, L298N_CW, drvSpd, 1000);
+			}
+			for (int i = 0; i < 5; i++) {
+				motionPush(L298N_CW, rotSpd, L298N_STOP, 0, 1000);
+				motionPush(L298N_STOP, 0, L298N_CCW, rotSpd, 1000);
+			}
+		}
+		break;
+	case 4: // draw circle fast
+		rptTime = interval;
+		if (rptTime < 2) rptTime = 10; // ensure execution
+		motionPush(L298N_CCW, drvSpd + SPD_ADDEND, L298N_CCW, rotSpd, rptTime * 1000); // right
+		break;
+	case 5: // shake the toy left and right but doesn't go anywhere
+		// this pattern will rotate the robot faster than pattern 8
+		rptNum = interval;
+		if (rptNum < 2) rptNum = 10; // execute at least one time
+		for (int32_t i32 = 0; i32 < rptNum; i32++) {
+			motionPush(L298N_CCW, rotSpd + SPD_OVERSHOOT_ADDEND, L298N_CCW, rotSpd + SPD_OVERSHOOT_ADDEND, 400); // right
+			motionPush(L298N_CCW, rotSpd, L298N_CCW, rotSpd, 600);
+			motionPush(L298N_CCW, 0, L298N_CCW, 0, 250);
+			motionPush(L298N_CW, rotSpd + SPD_OVERSHOOT_ADDEND, L298N_CW, rotSpd + SPD_OVERSHOOT_ADDEND, 400); // left
+			motionPush(L298N_CW, rotSpd, L298N_CW, rotSpd, 600);
+			motionPush(L298N_CW, 0, L298N_CW, 0, 250);
+		}
+		break;
+	case 6: // rotate, go to somewhere else, then rotate again
+		rptNum = interval / 6;
+		if (rptNum < 2) rptNum = 1; // execute at least one time
+		for (int32_t i32 = 0; i32 < rptNum; i32++) {
+			motionPush(L298N_CCW, rotSpd, L298N_CCW, rotSpd, 7000); // right
+			motionPush(L298N_CCW, drvSpd, L298N_CW, drvSpd, 5000); // forward
+			motionPush(L298N_CW, rotSpd, L298N_CW, rotSpd, 7000); // left
+			motionPush(L298N_CW, drvSpd, L298N_CCW, drvSpd, 5000); // backward
+		}
+		break;
+	case 7: // wait until something reaches in front of IR sensor, then flee backwards
+		// this pattern is not affected by interval time and it'll be executed only one time
+		// if pre defined time has been elapsed, the robot will do nothing
+		for (cnt = 0; cnt < PATTERN_WAIT_AND_FLEE_WAIT_TIME * 10; cnt++) { // old loop never advanced its counter: intended bound
+			if (periph_irSnsrChk(IR_SNSR_MODE_OP) == IR_SNSR_NEAR) {
+				motionPush(L298N_CW, drvSpd + SPD_OVERSHOOT_ADDEND, L298N_CCW, drvSpd + SPD_OVERSHOOT_ADDEND, 500); // backward
+				motionPush(L298N_CW, drvSpd, L298N_CCW, drvSpd, 1000);
+				break;
+			}
+			appWait(100);
+		}
+		break;
+	case 8: // shake the toy left and right, flee to somewhere else, then shake the toy again
+		rptNum = interval / 2;
+		if (rptNum < 2) rptNum = 2; // execute at least one time
+		for (int32_t i32 = 0; i32 < rptNum; i32++) {
+			for (int i = 0; i < 5; i++) { // shake
+				motionPush(L298N_CW, rotSpd + SPD_OVERSHOOT_ADDEND / 2, L298N_CW, rotSpd + SPD_OVERSHOOT_ADDEND / 2, 400); // left
+				motionPush(L298N_CW, rotSpd, L298N_CW, rotSpd, 600);
+				motionPush(L298N_CW, 0, L298N_CW, 0, 100);
+				motionPush(L298N_CCW, rotSpd + SPD_OVERSHOOT_ADDEND / 2, L298N_CCW, rotSpd + SPD_OVERSHOOT_ADDEND / 2, 400); // right
+				motionPush(L298N_CCW, rotSpd, L298N_CCW, rotSpd, 600);
+				motionPush(L298N_CCW, 0, L298N_CCW, 0, 100);
+			}
+			motionPush(L298N_CCW, drvSpd + SPD_OVERSHOOT_ADDEND / 2, L298N_CW, drvSpd + SPD_OVERSHOOT_ADDEND / 2, 200); // forward
+			motionPush(L298N_CCW, drvSpd, L298N_CW, drvSpd, 300);
+			motionPush(L298N_CCW, 0, L298N_CW, 0, 200);
+			for (int i = 0; i < 5; i++) { // shake again
+				motionPush(L298N_CW, rotSpd + SPD_OVERSHOOT_ADDEND / 2, L298N_CW, rotSpd + SPD_OVERSHOOT_ADDEND / 2, 400); // left
+				motionPush(L298N_CW, rotSpd, L298N_CW, rotSpd, 600);
+				motionPush(L298N_CW, 0, L298N_CW, 0, 100);
+				motionPush(L298N_CCW, rotSpd + SPD_OVERSHOOT_ADDEND / 2, L298N_CCW, rotSpd + SPD_OVERSHOOT_ADDEND / 2, 400); // right
+				motionPush(L298N_CCW, rotSpd, L298N_CCW, rotSpd, 600);
+				motionPush(L298N_CCW, 0, L298N_CCW, 0, 100);
+			}
+		}
+		break;
+	case 9: // stand still, move toy left and right like the robot is fishing horizontally
+		rptNum = interval / 2;
+		if (rptNum < 4) rptNum = 3; // execute at least 3 times
+		appWait(400);
+		for (int32_t i32 = 0; i32 < rptNum; i32++) {
+			// implementation here
+			motionPush(L298N_CW, rotSpd, L298N_CW, rotSpd, 1000); // left slow
+			motionPush(L298N_STOP, 0, L298N_STOP, 0, 500);
+			motionPush(L298N_CW, rotSpd, L298N_CW, rotSpd, 500); // right fast
+			motionPush(L298N_STOP, 0, L298N_STOP, 0, 500);
+		}
+		break;
+	}
+"""
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,313 @@
+#!/usr/bin/env python3
+# playplan_check.py
+# Session check of the play time budget(Inc/playplan.h, Src/playplan.c).
+# Autoplay sessions are run on the host against a virtual clock: the planner, the motion
+# interpreter and the schedule program are the MCU sources, the session loop below mirrors
+# autoDrive()/planSession()/patternCost() of Src/app.c with costs from the generated Src/pattime.c.
+# A pattern takes the time of its wheel queue(DRIVE segments scaled by a random motor jitter), its waits and one tick per step;
+# pattern 7 ends early when the IR check sees the cat; snacks run slow at random.
+#   planned sessions end within tolerance of the duration when the duration can be met
+#   sessions too short for one run of everything play every pattern once
+# Then prints the end error of planned sessions against the interval of the old firmware
+# (duration / patterns, given to the first pattern only).
+#
+# usage: python3 tools/playplan_check.py [--random 200] [--seed n] [-v]
+
+import argparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+sys.path.insert(0, os.path.join(ROOT, "rpi"))
+import skdprog  # noqa: E402
+
+# constants of Src/app.c
+PATTERN_GAP_TIME = 300
+WAIT_TIME = 20 # PATTERN_WAIT_AND_FLEE_WAIT_TIME
+SNACK_MS = 4500 + 500 + 1000 + 1000 + 250 + 650 + 400 # snackTotal()
+SCAN_MAX = 1000 # PLAY_PLAN_SCAN_MAX
+
+# host driver, one session per line:
+#   s hex duration snackIntv near jitter slow seed old
+#     near: permille of IR checks that see the cat, jitter: permille of DRIVE time off, slow: ms a snack may overrun
+#     old: 1 plays with the interval of the old firmware instead of the plan
+#   -> budget elapsed planned actual worst items overruns min
+DRIVER_C = r"""
+#include <stdio.h>
+#include <stdlib.h>
+#include "motprog.h"
+#include "skdprog.h"
+#include "playplan.h"
+#include "pattime.h"
+#define GAP @GAP@
+#define WAIT_S @WAIT@
+#define SNACK_MS @SNACK@
+#define SCAN_MAX @SCAN@
+#define NO_PATTERN 0xFF
+static const uint8_t autoNext[MOTPROG_BUILTIN_CNT + 1] = { 5, 4, 7, 2, 9, 6, 1, 5, 3, 8 };
+static struct PlayPlan plan;
+static uint32_t now, rnd;
+static int nearPm, jitPm, slowMs;
+static uint8_t prog[255], progLen, snackIntv;
+static uint32_t plays, played;
+static struct SkdProgIter it;
+static unsigned rand15(void) {
+	rnd = rnd * 1103515245 + 12345;
+	return (rnd >> 16) & 0x7FFF;
+}
+static _Bool cond(uint8_t c) {
+	_Bool near = (int)(rand15() % 1000) < nearPm;
+	return (c == MOTPROG_COND_IR_NEAR) ? near : (c == MOTPROG_COND_IR_FAR) ? !near : 0;
+}
+static void patternCost(uint8_t code, uint16_t intv, struct PlayPlanCost* pc) {
+	pc->baseMs = 0;
+	pc->repMs = 0;
+	pc->maxReps = 0;
+	if (code >= 1 && code <= PATTIME_CNT) {
+		const struct PatTime* pt = &pattime[code];
+		pc->baseMs = pt->baseMs;
+		if (intv == SKDPROG_NO_INTV) {
+			pc->repMs = pt->repMs;
+			pc->maxReps = pt->maxRuns;
+		}
+		else if (pt->div) {
+			uint32_t runs = intv / pt->div;
+			if (runs < pt->min) runs = pt->dflt;
+			pc->baseMs += pt->repMs * ((runs > pt->maxRuns) ? pt->maxRuns : runs);
+		}
+	}
+	pc->baseMs += GAP;
+}
+static void planSession(uint32_t budgetMs, int snackCnt) {
+	struct SkdProgIter i2 = it;
+	struct SkdProgEntry e;
+	struct PlayPlanCost pc, snack = { SNACK_MS, 0, 0 };
+	uint64_t sumBase = 0, sumRep = 0;
+	uint32_t scanned = 0;
+	uint16_t n = 0;
+	uint8_t codePrev = 0;
+	_Bool more = 1;
+	playplan_begin(&plan, now, budgetMs);
+	while (n < SCAN_MAX) {
+		uint8_t code;
+		if (snackIntv && ++snackCnt >= snackIntv) {
+			snackCnt = 0;
+			playplan_add(&plan, &snack, 1);
+		}
+		if (!(more = skdprog_next(&i2, prog, progLen, &e))) break;
+		if (e.kind == SKDPROG_ENTRY_SNACK) {
+			snackCnt--;
+			playplan_add(&plan, &snack, 1);
+			continue;
+		}
+		scanned++;
+		code = e.code ? e.code : autoNext[codePrev < MOTPROG_USER_FIRST ? codePrev : 0];
+		patternCost(code, e.intv, &pc);
+		codePrev = code;
+		playplan_add(&plan, &pc, 1);
+		sumBase += pc.baseMs;
+		sumRep += pc.repMs;
+		n++;
+	}
+	if (more && n) {
+		uint32_t rest = plays - played;
+		rest = (rest > scanned) ? rest - scanned : 0;
+		pc.baseMs = (uint32_t)(sumBase / n);
+		pc.repMs = (uint32_t)(sumRep / n);
+		playplan_add(&plan, &pc, rest);
+		if (snackIntv) playplan_add(&plan, &snack, rest / snackIntv);
+	}
+}
+static uint32_t run(uint8_t code, int32_t interval, uint16_t reps) { // ms of exePattern(): queue model of motionRun()
+	struct MotProgEnv env = { { 96, 88, 38, 44 }, { 0, 12, 6, 3 }, { interval, WAIT_S }, reps, cond };
+	struct MotProgVm vm;
+	struct MotProgAct a;
+	uint8_t len = 0;
+	const uint8_t* p = motprog_builtin(code, &len);
+	uint32_t t = GAP, qEnd = GAP;
+	if (p == NULL) return t;
+	motprog_begin(&vm, &env);
+	while (motprog_step(&vm, p, len, &a)) {
+		if (a.kind == MOTPROG_ACT_WAIT) {
+			t = ((t > qEnd) ? t : qEnd) + a.ms;
+			continue;
+		}
+		if (a.kind == MOTPROG_ACT_DRIVE) {
+			int32_t ms = a.ms + (int32_t)a.ms * ((int)(rand15() % (2 * jitPm + 1)) - jitPm) / 1000;
+			qEnd = ((t > qEnd) ? t : qEnd) + ms;
+		}
+		t++;
+	}
+	return (t > qEnd) ? t : qEnd;
+}
+static void snack(void) {
+	struct PlayPlanCost pc = { SNACK_MS, 0, 0 };
+	playplan_start(&plan, now, &pc);
+	now += SNACK_MS + (slowMs ? rand15() % (slowMs + 1) : 0);
+	playplan_end(&plan, now);
+}
+int main(void) {
+	char line[1024], h[600];
+	while (fgets(line, sizeof(line), stdin)) {
+		unsigned dur, si, seed, old, len = 0, v;
+		int n;
+		char* s = h;
+		if (sscanf(line, "s %599s %u %u %d %d %d %u %u", h, &dur, &si, &nearPm, &jitPm, &slowMs, &seed, &old) != 8) continue;
+		while (sscanf(s, "%2x%n", &v, &n) == 1 && len < 255) { prog[len++] = (uint8_t)v; s += n; }
+		progLen = (uint8_t)len;
+		snackIntv = (uint8_t)si;
+		rnd = seed;
+		now = 1000;
+		played = 0;
+		if (!skdprog_check(prog, progLen, &plays)) {
+			printf("bad\n");
+			fflush(stdout);
+			continue;
+		}
+		skdprog_begin(&it);
+		int snackCnt = -1;
+		uint8_t code = 0, codePrev;
+		_Bool first = 1;
+		struct SkdProgEntry e;
+		planSession(dur * 1000, snackCnt);
+		uint32_t minMs = plan.aheadMs;
+		while (1) {
+			codePrev = code;
+			if (snackIntv && ++snackCnt >= snackIntv) {
+				snackCnt = 0;
+				snack();
+			}
+			if (!skdprog_next(&it, prog, progLen, &e)) break;
+			if (e.kind == SKDPROG_ENTRY_SNACK) {
+				snackCnt--;
+				snack();
+				continue;
+			}
+			played++;
+			code = e.code ? e.code : autoNext[codePrev < MOTPROG_USER_FIRST ? codePrev : 0];
+			struct PlayPlanCost pc;
+			int32_t interval = 1;
+			uint16_t reps = 0;
+			patternCost(code, e.intv, &pc);
+			if (old) { // exePattern() before the plan: interval only for the first pattern of a session
+				uint32_t left = plays - played;
+				interval = first ? (int32_t)dur / (int32_t)(left < 1 ? 1 : left) : 0;
+				first = 0;
+			}
+			uint16_t r = playplan_start(&plan, now, &pc);
+			if (!old) reps = r;
+			if (e.intv != SKDPROG_NO_INTV) {
+				interval = e.intv;
+				reps = 0;
+			}
+			now += run(code, interval, reps);
+			playplan_end(&plan, now);
+		}
+		printf("%u %u %u %u %d %u %u %u\n", plan.budget, now - plan.start, plan.plannedMs, plan.actualMs, plan.worstMs,
+				plan.items, plan.overruns, minMs);
+		fflush(stdout);
+	}
+	return 0;
+}
+"""
+
+SESSIONS = [ # text form of rpi/skdprog.py, duration in seconds, patterns per snack(0: off)
+    ("1 2 3 4 5 6 7 8 9", 600, 0),
+    ("1 2 3 4 5 6 7 8 9", 1800, 3),
+    ("0*10", 900, 0),
+    ("0*30", 3600, 5),
+    ("(4 5 6)*5", 1200, 0),
+    ("7*6 1", 900, 0),
+    ("(1 k 2)*4", 600, 0),
+    ("s2:4 5*3 t60:1 9", 600, 2),
+    ("t30:1 t30:2 t30:3 4", 300, 0),
+    ("8*3", 60, 0), # too short: minimum
+    ("(0*50)*30", 7200, 0), # longer than the scan
+]
+
+
+def build(d, cc):
+    exe = os.path.join(d, "drv")
+    drv = DRIVER_C
+    for k, v in (('@GAP@', PATTERN_GAP_TIME), ('@WAIT@', WAIT_TIME), ('@SNACK@', SNACK_MS), ('@SCAN@', SCAN_MAX)):
+        drv = drv.replace(k, str(v))
+    with open(os.path.join(d, "drv.c"), "w") as f:
+        f.write(drv)
+    src = [os.path.join(ROOT, "Src", n) for n in ("playplan.c", "motprog.c", "skdprog.c", "pattime.c")]
+    subprocess.check_call([cc, "-std=gnu11", "-O2", "-Wall", "-I", os.path.join(ROOT, "Inc"), "-o", exe, os.path.join(d, "drv.c")] + src)
+    return exe
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--random', type=int, default=200)
+    ap.add_argument('--seed', type=int, default=1)
+    ap.add_argument('-v', action='store_true', help='print every session')
+    args = ap.parse_args()
+    rnd = random.Random(args.seed)
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print('no host C compiler: check skipped')
+        sys.exit(1)
+
+    cases = [(skdprog.encode(skdprog.parse(t)), dur, si, t) for t, dur, si in SESSIONS]
+    for _ in range(args.random):
+        codes = [rnd.choice((0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9)) for _ in range(rnd.randint(1, 40))]
+        cases.append((skdprog.encode(skdprog.compress(codes)), rnd.choice((60, 300, 600, 1200, 3600)), rnd.choice((0, 0, 2, 5)),
+                      'random %d patterns' % len(codes)))
+
+    ok = True
+    worst = 0.0
+    fails = short = 0
+    errNew = []
+    errOld = []
+    with tempfile.TemporaryDirectory() as d:
+        exe = build(d, cc)
+        proc = subprocess.Popen([exe], stdin = subprocess.PIPE, stdout = subprocess.PIPE, text = True)
+
+        def ask(cmd):
+            proc.stdin.write(cmd + '\n')
+            proc.stdin.flush()
+            return proc.stdout.readline().split()
+
+        for n, (p, dur, si, name) in enumerate(cases):
+            near, jit, slow, seed = rnd.choice((0, 2, 10)), rnd.choice((0, 30, 80)), rnd.choice((0, 0, 3000)), rnd.randrange(1 << 30)
+            new = [int(x) for x in ask('s %s %d %d %d %d %d %d 0' % (p.hex(), dur, si, near, jit, slow, seed))]
+            old = [int(x) for x in ask('s %s %d %d %d %d %d %d 1' % (p.hex(), dur, si, near, jit, slow, seed))]
+            budget, elapsed, minMs = new[0], new[1], new[7]
+            err = elapsed - budget
+            if minMs + 30000 >= budget: # no room to plan in: every pattern once, late items may overrun
+                short += 1
+                good = elapsed <= max(budget, minMs) + 30000
+            else: # tolerance: half a repeat of the last flexible pattern, jitter and overruns not yet absorbed
+                tol = max(15000, budget // 50)
+                good = abs(err) <= tol
+                errNew.append(abs(err) / budget)
+                errOld.append(abs(old[1] - budget) / budget)
+                worst = max(worst, abs(err) / budget)
+            if not good:
+                fails += 1
+                ok = False
+            if args.v or not good:
+                print('%-24s %5d s snack %d near %2d jit %2d: min %7.1f s, ended %+7.1f s (old firmware %+8.1f s), items %d, overruns %d, worst item %+.1f s%s'
+                      % (name[:24], dur, si, near, jit, minMs / 1000, err / 1000, (old[1] - budget) / 1000, new[5], new[6],
+                         new[4] / 1000, '' if good else '  <- out of tolerance'))
+        proc.stdin.close()
+        proc.wait()
+
+    errNew.sort()
+    errOld.sort()
+    print('sessions: %d, %d too short to plan, %d out of tolerance' % (len(cases), short, fails))
+    if errNew:
+        print('end error against duration  median    p90    max')
+        print('  planned                  %6.1f%% %5.1f%% %5.1f%%' % (100 * errNew[len(errNew) // 2], 100 * errNew[len(errNew) * 9 // 10], 100 * worst))
+        print('  old firmware             %6.1f%% %5.1f%% %5.1f%%' % (100 * errOld[len(errOld) // 2], 100 * errOld[len(errOld) * 9 // 10], 100 * errOld[-1]))
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,380 @@
+#!/usr/bin/env python3
+# port_check.py
+# Host check of the drivers on the port layer(Inc/port.h). l298n.c, sg90.c and buzzer.c are compiled as they are
+# with -DPORT_BACKEND=2(PORT_BACKEND_HOST): every pin write, PWM start/stop and timer start goes to portHostLog
+# of Src/port.c, which is read back after each call. Register writes land in plain structs(MAIN_H below, which
+# is what a host main.h has to provide) and the update event copies TIM1 CCR1/CCR2 like the CCR preload does.
+#   l298n   init resets the four IN pins, l298n_drive and l298n_setRotation write no pin themselves and leave
+#           UDIS clear; the next update event writes the direction pins with exactly one BSRR write, together
+#           with the duty latched on it(setRotation: zero duty and the new direction on the same edge).
+#           Queued segments: at most one BSRR write per update. Disable stops both PWM channels, which stops
+#           the counter too, then writes the stop pins with one BSRR write
+#   sg90    enable starts the channel at the angle, a move ends on its frame, auto-detach stops the PWM once
+#           after the settle time and the next setAngle starts it again
+#   buzzer  mute/unmute start and stop the PWM only on a change, a melody starts it once and stops it once at the end
+#
+# usage: python3 tools/port_check.py [-v]
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+MAIN_H = r"""
+#ifndef MAIN_H
+#define MAIN_H
+#include <stdint.h>
+#include <stddef.h>
+typedef struct { volatile uint32_t IDR, ODR, BSRR; } GPIO_TypeDef;
+typedef struct { volatile uint32_t CR1, DIER, CCMR1, CCMR2, CCER, CNT, ARR, CCR1, CCR2, CCR3, CCR4, BDTR; } TIM_TypeDef;
+typedef struct { volatile uint32_t CR, ISR, DR; } ADC_TypeDef;
+typedef struct { TIM_TypeDef* Instance; } TIM_HandleTypeDef;
+typedef struct { ADC_TypeDef* Instance; } ADC_HandleTypeDef;
+extern GPIO_TypeDef hostGpioA, hostGpioB;
+#define GPIOA (&hostGpioA)
+#define GPIOB (&hostGpioB)
+#define GPIO_PIN_0 0x0001u
+#define GPIO_PIN_1 0x0002u
+#define GPIO_PIN_2 0x0004u
+#define GPIO_PIN_3 0x0008u
+#define GPIO_PIN_4 0x0010u
+#define GPIO_PIN_5 0x0020u
+#define GPIO_PIN_6 0x0040u
+#define GPIO_PIN_7 0x0080u
+#define GPIO_PIN_8 0x0100u
+#define GPIO_PIN_9 0x0200u
+#define GPIO_PIN_10 0x0400u
+#define GPIO_PIN_11 0x0800u
+#define GPIO_PIN_12 0x1000u
+#define GPIO_PIN_13 0x2000u
+#define GPIO_PIN_14 0x4000u
+#define GPIO_PIN_15 0x8000u
+#define TIM_CHANNEL_1 0x00u
+#define TIM_CHANNEL_2 0x04u
+#define TIM_CHANNEL_3 0x08u
+#define TIM_CHANNEL_4 0x0Cu
+#define TIM_CR1_UDIS (1u << 1)
+#define TIM_CCMR1_OC1PE (1u << 3)
+#define TIM_CCMR1_OC2PE (1u << 11)
+#define TIM_CCMR2_OC3PE (1u << 3)
+#define TIM_CCMR2_OC4PE (1u << 11)
+void HAL_Delay(uint32_t ms);
+#define __disable_irq() do {} while (0)
+#define __enable_irq() do {} while (0)
+#endif
+"""
+
+# drv l|s|b       runs the l298n, sg90 or buzzer steps below
+#   -> cfg in1 in2 in3 in4                    (l only) pin masks of L298N_IN_x
+#   -> tag bsrr gpio start on off late pins udis a b
+#      calls since the last line: BSRR writes, GPIO set/reset, timer starts, channel index masks of PWM enable
+#      and disable, late: 1 if a BSRR write came after a PWM disable. pins: L298N IN pins of GPIOB, udis: TIM1 UDIS. a b: l TIM1 CCR1 CCR2 latched on the last update
+#      event, s TIM2 CCR1 and moves done, b melodies done and buzzer_isPlaying()
+DRIVER_C = r"""
+#include <stdio.h>
+#include <string.h>
+#include "port.h"
+#include "l298n.h"
+#include "sg90.h"
+#include "buzzer.h"
+
+#define IN_PINS (L298N_IN_1 | L298N_IN_2 | L298N_IN_3 | L298N_IN_4)
+
+GPIO_TypeDef hostGpioA, hostGpioB;
+static TIM_TypeDef tim1, tim2, tim15;
+static TIM_HandleTypeDef htim1 = { &tim1 }, htim2 = { &tim2 }, htim15 = { &tim15 };
+static uint32_t pinsB; // GPIOB levels written so far
+static uint32_t dutyA, dutyB; // TIM1 CCR1/CCR2 latched on the last update event
+static unsigned seen = 0; // portHostLog entries read
+static int moveDone = 0, melDone = 0;
+
+void HAL_Delay(uint32_t ms) {
+}
+
+static void step(const char* tag, uint32_t a, uint32_t b) {
+	unsigned n[PORT_OP_ADC_READ + 1] = { 0 };
+	unsigned on = 0, off = 0, late = 0;
+	if (portHostLogCnt - seen > PORT_HOST_LOG_LEN) printf("overflow\n");
+	for (; seen < portHostLogCnt; seen++) {
+		const struct PortHostCall* pc = &portHostLog[seen % PORT_HOST_LOG_LEN];
+		n[pc->op]++;
+		if (pc->op == PORT_OP_GPIO_BSRR && off != 0) late = 1;
+		if (pc->target == GPIOB) {
+			if (pc->op == PORT_OP_GPIO_SET) pinsB |= pc->arg;
+			else if (pc->op == PORT_OP_GPIO_RESET) pinsB &= ~pc->arg;
+			else if (pc->op == PORT_OP_GPIO_BSRR) pinsB = (pinsB & ~(pc->arg >> 16)) | (pc->arg & 0xFFFF); // set wins
+		}
+		if (pc->op == PORT_OP_PWM_ENABLE) on |= 1u << (pc->arg / 4);
+		if (pc->op == PORT_OP_PWM_DISABLE) off |= 1u << (pc->arg / 4);
+	}
+	printf("%s %u %u %u %x %x %u %x %u %u %u\n", tag, n[PORT_OP_GPIO_BSRR], n[PORT_OP_GPIO_SET] + n[PORT_OP_GPIO_RESET],
+	       n[PORT_OP_TIM_START_IT], on, off, late, (unsigned)(pinsB & IN_PINS), (tim1.CR1 & TIM_CR1_UDIS) ? 1 : 0, (unsigned)a, (unsigned)b);
+}
+
+static void lUpdate(void) { // update event of TIM1: preload transfer, then the interrupt
+	dutyA = tim1.CCR1;
+	dutyB = tim1.CCR2;
+	l298n_periodElapsedHandler(&htim1);
+}
+
+static void lStep(const char* tag, uint8_t dirA, uint8_t dirB) {
+	char s[32];
+	snprintf(s, sizeof(s), "%s:%u:%u", tag, dirA, dirB);
+	step(s, dutyA, dutyB);
+}
+
+static void runL298n(void) {
+	static const uint8_t dirs[][2] = { { L298N_CW, L298N_CCW }, { L298N_CW, L298N_CCW }, { L298N_CCW, L298N_CW },
+		{ L298N_STOP, L298N_CW }, { L298N_CCW, L298N_CCW }, { L298N_CW, L298N_STOP }, { L298N_STOP, L298N_STOP } };
+	printf("cfg %u %u %u %u\n", L298N_IN_1, L298N_IN_2, L298N_IN_3, L298N_IN_4);
+	tim1.ARR = L298N_TIM_ARR;
+	l298n_setHandle(&htim1);
+	l298n_init();
+	step("init", 0, 0);
+	l298n_enable();
+	step("enable", 0, 0);
+	for (unsigned i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+		l298n_drive(dirs[i][0], 30 + i * 10, dirs[i][1], 90 - i * 10);
+		lStep("drive", dirs[i][0], dirs[i][1]);
+		lUpdate();
+		lStep("upd", dirs[i][0], dirs[i][1]);
+		lUpdate();
+		lStep("idle", dirs[i][0], dirs[i][1]);
+	}
+
+	// direction of one running wheel
+	l298n_drive(L298N_CW, 60, L298N_CW, 60);
+	lUpdate();
+	lStep("run", L298N_CW, L298N_CW);
+	l298n_setRotation(L298N_MOTOR_A, L298N_CCW);
+	lStep("rotA", L298N_CW, L298N_CW);
+	lUpdate();
+	lStep("rotupdA", L298N_CCW, L298N_CW);
+	l298n_setSpeed(L298N_MOTOR_A, 40);
+	l298n_drive(L298N_CCW, 40, L298N_CW, 60); // staged, then replaced for wheel B by setRotation
+	l298n_setRotation(L298N_MOTOR_B, L298N_CCW);
+	lStep("rotB", L298N_CCW, L298N_CW);
+	lUpdate();
+	lStep("rotupdB", L298N_CCW, L298N_CCW);
+
+	// queued segments: 20 ms, 10 ms, 10 ms at 2 ms per update
+	l298n_queueDrive(L298N_FORWARD, 50, 20);
+	l298n_queueRotate(L298N_LEFT, 40, 10);
+	l298n_queuePause(10);
+	for (int i = 0; i < 30; i++) {
+		lUpdate();
+		step("q", dutyA, dutyB);
+	}
+
+	l298n_disable();
+	lStep("disable", L298N_STOP, L298N_STOP);
+	lUpdate();
+	lStep("stopped", L298N_STOP, L298N_STOP);
+}
+
+static void onMoveDone(uint8_t motorNum) {
+	moveDone++;
+}
+
+static void runSg90(void) {
+	char s[16];
+	tim2.ARR = SG90_TIM_ARR;
+	sg90_setHandle(&htim2);
+	sg90_init();
+	step("init", tim2.CCR1, moveDone);
+	sg90_enable(SG90_MOTOR_A, 90);
+	step("enable", tim2.CCR1, moveDone);
+	sg90_setMoveDoneCallback(onMoveDone);
+	sg90_setAutoDetach(SG90_MOTOR_A, 200);
+	sg90_moveTo(SG90_MOTOR_A, 0, 500, SG90_EASE_LINEAR);
+	step("move", tim2.CCR1, moveDone);
+	for (int f = 1; f <= 30; f++) {
+		sg90_periodElapsedHandler(&htim2);
+		snprintf(s, sizeof(s), "f:%d", f);
+		step(s, tim2.CCR1, moveDone);
+	}
+	sg90_setAngle(SG90_MOTOR_A, 45);
+	step("attach", tim2.CCR1, moveDone);
+	sg90_disable(SG90_MOTOR_A);
+	step("disable", tim2.CCR1, moveDone);
+}
+
+static void onMelDone(const struct BuzzerMelody* pMel) {
+	melDone++;
+}
+
+static void runBuzzer(void) {
+	static const struct BuzzerNote notes[] = { BUZZER_NOTE(toneA4, 25, 30), BUZZER_NOTE(BUZZER_REST, 25, 20), BUZZER_NOTE(toneC5, 50, 30) };
+	static const struct BuzzerMelody mel = { notes, 3, 1 };
+	buzzer_setHandle(&htim15);
+	buzzer_init();
+	step("init", melDone, buzzer_isPlaying());
+	buzzer_unmute();
+	step("unmute", melDone, buzzer_isPlaying());
+	buzzer_unmute();
+	step("again", melDone, buzzer_isPlaying());
+	buzzer_mute();
+	step("mute", melDone, buzzer_isPlaying());
+	buzzer_mute();
+	step("again", melDone, buzzer_isPlaying());
+	buzzer_setMelodyDoneCallback(onMelDone);
+	buzzer_play(&mel, 0);
+	step("play", melDone, buzzer_isPlaying());
+	for (int i = 0; i < 1000; i++) {
+		buzzer_periodElapsedHandler(&htim15);
+		step("t", melDone, buzzer_isPlaying());
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) return 1;
+	if (argv[1][0] == 'l') runL298n();
+	else if (argv[1][0] == 's') runSg90();
+	else if (argv[1][0] == 'b') runBuzzer();
+	return 0;
+}
+"""
+
+L298N_STOP, L298N_CW, L298N_CCW = 0, 1, 2
+SG90_TIM_ARR, SG90_MIN_DUTY, SG90_MAX_DUTY = 50000, 5, 10 # Inc/sg90.h
+
+
+def sgCCR(angle):
+    lo = SG90_TIM_ARR * SG90_MIN_DUTY // 100
+    return lo + (SG90_TIM_ARR * SG90_MAX_DUTY // 100 - lo) * angle / 180.0
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('-v', action='store_true', help='print every line of the driver')
+    args = ap.parse_args()
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print('no host C compiler: check skipped')
+        sys.exit(1)
+
+    ok = True
+
+    def fail(msg):
+        nonlocal ok
+        print('  FAIL: ' + msg)
+        ok = False
+
+    with tempfile.TemporaryDirectory() as d:
+        with open(os.path.join(d, "main.h"), "w") as f:
+            f.write(MAIN_H)
+        with open(os.path.join(d, "drv.c"), "w") as f:
+            f.write(DRIVER_C)
+        exe = os.path.join(d, "drv")
+        subprocess.check_call([cc, "-std=gnu11", "-O2", "-Wall", "-Wno-unused-function", "-DPORT_BACKEND=2", "-I", d,
+                               "-I", os.path.join(ROOT, "Inc"), "-o", exe, os.path.join(d, "drv.c")]
+                              + [os.path.join(ROOT, "Src", n) for n in ("l298n.c", "sg90.c", "buzzer.c", "port.c", "fxtables.c")])
+
+        def run(which):
+            out = subprocess.run([exe, which], stdout = subprocess.PIPE, text = True, check = True).stdout
+            rows = []
+            for l in out.split('\n'):
+                if not l:
+                    continue
+                if args.v:
+                    print('    ' + l)
+                if l == 'overflow':
+                    fail('portHostLog wrapped between two reads')
+                    continue
+                w = l.split()
+                if w[0] == 'cfg':
+                    rows.append(w)
+                    continue
+                rows.append({'tag': w[0], 'bsrr': int(w[1]), 'gpio': int(w[2]), 'start': int(w[3]), 'on': int(w[4], 16),
+                             'off': int(w[5], 16), 'late': int(w[6]), 'pins': int(w[7], 16), 'udis': int(w[8]), 'a': int(w[9]),
+                             'b': int(w[10])})
+            return rows
+
+        # l298n
+        rows = run('l')
+        in1, in2, in3, in4 = [int(x) for x in rows.pop(0)[1:]]
+
+        def pinsOf(dirA, dirB):
+            return {L298N_CW: in1, L298N_CCW: in2}.get(dirA, 0) | {L298N_CW: in3, L298N_CCW: in4}.get(dirB, 0)
+
+        r = rows.pop(0)
+        if (r['gpio'], r['bsrr'], r['start'], r['pins']) != (2, 0, 1, 0):
+            fail('l298n_init: %d GPIO resets, %d BSRR writes, %d timer starts, pins %x' % (r['gpio'], r['bsrr'], r['start'], r['pins']))
+        r = rows.pop(0)
+        if r['on'] != 0x3:
+            fail('l298n_enable: PWM channels %x started' % r['on'])
+        upd = qWrites = 0
+        qMax = 0
+        for r in rows:
+            tag = r['tag'].split(':')
+            if r['udis']:
+                fail('%s: UDIS left set' % r['tag'])
+            if tag[0] in ('drive', 'rotA', 'rotB') and r['bsrr'] + r['gpio'] > 0:
+                fail('%s: %d pin writes before the update event' % (r['tag'], r['bsrr'] + r['gpio']))
+            if tag[0] in ('upd', 'rotupdA', 'rotupdB'):
+                upd += 1
+                want = pinsOf(int(tag[1]), int(tag[2]))
+                if r['bsrr'] != 1 or r['gpio'] != 0:
+                    fail('%s: %d BSRR writes and %d GPIO writes on the update event, 1 and 0 expected' % (r['tag'], r['bsrr'], r['gpio']))
+                if r['pins'] != want:
+                    fail('%s: pins %x, %x expected' % (r['tag'], r['pins'], want))
+            if tag[0] in ('idle', 'stopped') and r['bsrr'] + r['gpio'] > 0:
+                fail('%s: pins written again on the next update event' % r['tag'])
+            if tag[0] in ('rotupdA', 'rotupdB') and r[tag[0][-1].lower()] != 0:
+                fail('%s: duty %d latched with the new direction, 0 expected' % (r['tag'], r[tag[0][-1].lower()]))
+            if tag[0] == 'q':
+                qWrites += r['bsrr']
+                qMax = max(qMax, r['bsrr'])
+            if tag[0] == 'disable' and (r['off'], r['bsrr'], r['gpio'], r['late'], r['pins']) != (0x3, 1, 0, 1, 0):
+                fail('l298n_disable: PWM channels %x stopped, %d BSRR writes(after the stop: %d), pins %x'
+                     % (r['off'], r['bsrr'], r['late'], r['pins']))
+        print('l298n: %d update events with staged pins, one BSRR write each; queue of 3 segments: %d BSRR writes, at most %d per update'
+              % (upd, qWrites, qMax))
+        if qMax > 1 or qWrites != 4:
+            fail('queue: 4 BSRR writes(3 segments and the stop) expected, at most one per update')
+
+        # sg90
+        rows = {r['tag']: r for r in run('s')}
+        r = rows['init']
+        if (r['start'], r['on']) != (1, 0):
+            fail('sg90_init: %d timer starts, PWM channels %x started' % (r['start'], r['on']))
+        if rows['enable']['on'] != 0x1 or abs(rows['enable']['a'] - sgCCR(90)) > 1:
+            fail('sg90_enable: PWM channels %x, CCR1 %d' % (rows['enable']['on'], rows['enable']['a']))
+        done = [f for f in range(1, 31) if rows['f:%d' % f]['b'] > rows['f:%d' % (f - 1) if f > 1 else 'move']['b']]
+        detach = [f for f in range(1, 31) if rows['f:%d' % f]['off']]
+        print('sg90: 500 ms move done on frame %s, PWM stopped on frame %s, CCR1 %d' % (done, detach, rows['f:30']['a']))
+        if done != [10] or detach != [14] or abs(rows['f:30']['a'] - sgCCR(0)) > 1:
+            fail('move done on frame 10 and one detach 200 ms(4 frames) later expected, at CCR1 %d' % sgCCR(0))
+        if any(rows[t]['on'] for t in ['move'] + ['f:%d' % f for f in range(1, 31)]):
+            fail('PWM started again while attached')
+        if rows['attach']['on'] != 0x1 or abs(rows['attach']['a'] - sgCCR(45)) > 1:
+            fail('sg90_setAngle after detach: PWM channels %x started, CCR1 %d' % (rows['attach']['on'], rows['attach']['a']))
+        if rows['disable']['off'] != 0x1:
+            fail('sg90_disable: PWM channels %x stopped' % rows['disable']['off'])
+
+        # buzzer
+        rows = run('b')
+        seq = [(r['tag'], r['on'], r['off']) for r in rows[:5]]
+        want = [('init', 0, 0), ('unmute', 1, 0), ('again', 0, 0), ('mute', 0, 1), ('again', 0, 0)]
+        if seq != want or rows[0]['start'] != 1:
+            fail('buzzer init/mute/unmute: %s' % seq)
+        play = rows[5:]
+        starts = sum(bin(r['on']).count('1') for r in play)
+        stops = [i for i, r in enumerate(play) if r['off']]
+        ends = [i for i, r in enumerate(play) if i > 0 and r['a'] > play[i - 1]['a']]
+        print('buzzer: melody of 3 notes twice, PWM started %d times, stopped on update %s, done callback on %s'
+              % (starts, stops, ends))
+        if starts != 1 or len(stops) != 1 or stops != ends or play[-1]['b'] != 0:
+            fail('melody: one PWM start, one stop on the update that ends it expected')
+        if any(r['gpio'] or r['bsrr'] for r in rows):
+            fail('buzzer wrote GPIO pins')
+
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
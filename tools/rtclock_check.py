@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+# rtclock_check.py
+# Host check of the wall clock of Src/rtclock.c. rtclock.c is compiled as it is on a model of the RTC:
+# calendar registers set by HAL_RTC_SetTime/SetDate, sub-seconds counting down from the synchronous
+# prescaler, shift register(ADD1S, SUBFS), smooth calibration(CALP, CALM per 2^20 pulses), backup registers
+# and alarm A. The crystal runs --ppm fast(+) or slow(-) and the calibration is applied on top.
+#   conversion   the time is stepped to dates over 2000 ~ 2099(leap days, month and year ends): the calendar
+#                written to the RTC and rtclock_now() agree with python datetime, weekdays included
+#   alarm        date/hour/minute/second of alarm A match the alarm time, a time already due calls the function
+#                at once, RTCLOCK_NO_ALARM disarms and the alarm interrupt calls the function
+#   drift        the Pi syncs every --intv s for --hours: the calibration settles within one CALM step of the
+#                crystal drift, no sync after the first is stepped and the slews stay small.
+#                A reset(rtclock_init with the backup registers kept) keeps the time and the calibration
+#
+# usage: python3 tools/rtclock_check.py [--ppm 23.7] [--hours 48] [--intv 600] [-v]
+
+import argparse
+import datetime
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+CAL_STEP = 1e6 / (1 << 20) # ppm of one CALM pulse
+STEP_MS = 1000 # RTCLOCK_STEP_MS
+CAL_MIN_SEC = 3600 # RTCLOCK_CAL_MIN_SEC
+EPOCH = datetime.datetime(2000, 1, 1)
+
+MAIN_H = r"""
+#ifndef MAIN_H
+#define MAIN_H
+#include <stdint.h>
+#include <stddef.h>
+typedef enum { HAL_OK, HAL_ERROR } HAL_StatusTypeDef;
+typedef struct { uint8_t Hours, Minutes, Seconds, TimeFormat; uint32_t SubSeconds, SecondFraction, DayLightSaving, StoreOperation; } RTC_TimeTypeDef;
+typedef struct { uint8_t WeekDay, Month, Date, Year; } RTC_DateTypeDef;
+typedef struct { RTC_TimeTypeDef AlarmTime; uint32_t AlarmMask, AlarmSubSecondMask, AlarmDateWeekDaySel; uint8_t AlarmDateWeekDay; uint32_t Alarm; } RTC_AlarmTypeDef;
+typedef struct { struct { uint32_t AsynchPrediv, SynchPrediv; } Init; } RTC_HandleTypeDef;
+#define RTC_FORMAT_BIN 0
+#define RTC_HOURFORMAT12_AM 0
+#define RTC_DAYLIGHTSAVING_NONE 0
+#define RTC_STOREOPERATION_RESET 0
+#define RTC_SHIFTADD1S_RESET 0
+#define RTC_SHIFTADD1S_SET 1
+#define RTC_SMOOTHCALIB_PERIOD_32SEC 0
+#define RTC_SMOOTHCALIB_PLUSPULSES_RESET 0
+#define RTC_SMOOTHCALIB_PLUSPULSES_SET 1
+#define RTC_ALARM_A 0x100
+#define RTC_ALARMMASK_NONE 0
+#define RTC_ALARMSUBSECONDMASK_ALL 0
+#define RTC_ALARMDATEWEEKDAYSEL_DATE 0
+#define RTC_BKP_DR0 0
+#define RTC_BKP_DR1 1
+#define RTC_BKP_DR2 2
+#define RTC_BKP_DR3 3
+HAL_StatusTypeDef HAL_RTC_GetTime(RTC_HandleTypeDef* h, RTC_TimeTypeDef* t, uint32_t f);
+HAL_StatusTypeDef HAL_RTC_GetDate(RTC_HandleTypeDef* h, RTC_DateTypeDef* d, uint32_t f);
+HAL_StatusTypeDef HAL_RTC_SetTime(RTC_HandleTypeDef* h, RTC_TimeTypeDef* t, uint32_t f);
+HAL_StatusTypeDef HAL_RTC_SetDate(RTC_HandleTypeDef* h, RTC_DateTypeDef* d, uint32_t f);
+HAL_StatusTypeDef HAL_RTC_SetAlarm_IT(RTC_HandleTypeDef* h, RTC_AlarmTypeDef* a, uint32_t f);
+HAL_StatusTypeDef HAL_RTC_DeactivateAlarm(RTC_HandleTypeDef* h, uint32_t a);
+HAL_StatusTypeDef HAL_RTCEx_SetSynchroShift(RTC_HandleTypeDef* h, uint32_t add1s, uint32_t subfs);
+HAL_StatusTypeDef HAL_RTCEx_SetSmoothCalib(RTC_HandleTypeDef* h, uint32_t period, uint32_t plus, uint32_t calm);
+void HAL_RTCEx_BKUPWrite(RTC_HandleTypeDef* h, uint32_t r, uint32_t v);
+uint32_t HAL_RTCEx_BKUPRead(RTC_HandleTypeDef* h, uint32_t r);
+void __disable_irq(void);
+void __enable_irq(void);
+#endif
+"""
+
+# drv c           reads times from stdin, one per line
+#   -> c t now Y M D h m s wd           calendar written by the step, rtclock_now() after it
+# drv a t ahead   time stepped to t, alarm set ahead s later
+#   -> a D h m s armed fired            alarm A registers, fired: calls of the function so far
+#      p fired armed                    alarm at t - 5: called at once, not armed
+#      x armed                          RTCLOCK_NO_ALARM
+#      i fired armed                    alarm armed, then the interrupt
+# drv d ppm hours intv
+#   -> s k pi ofs step drift calib eff  every sync: Pi time(s), offset(ms) and return of rtclock_sync,
+#                                       drift and calib(ppm x 100), effective rate(ppm) after it
+#      r set calib eff diff             after rtclock_init with the backup registers kept, one interval after the
+#                                       last sync: diff = RTC - Pi(ms)
+DRIVER_C = r"""
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rtclock.h"
+
+#define EPOCH 946684800 // 2000-01-01 in unix time
+static RTC_HandleTypeDef rtc;
+static double simRtc; // RTC time in s since 2000, fraction is the sub-second counter
+static double simCrystal, simCal; // rate errors, + = fast
+static RTC_TimeTypeDef simSetT;
+static RTC_DateTypeDef simSetD;
+static RTC_AlarmTypeDef simAlarm;
+static int simArmed = 0, simFired = 0;
+static uint32_t simBkp[4];
+static uint32_t prediv(void) { return rtc.Init.SynchPrediv + 1; }
+void __disable_irq(void) {}
+void __enable_irq(void) {}
+HAL_StatusTypeDef HAL_RTC_GetTime(RTC_HandleTypeDef* h, RTC_TimeTypeDef* t, uint32_t f) {
+	double s = floor(simRtc);
+	uint32_t n = (uint32_t)((simRtc - s) * prediv()); // sub-second steps elapsed
+	long sec = (long)s;
+	t->Hours = sec % 86400 / 3600;
+	t->Minutes = sec / 60 % 60;
+	t->Seconds = sec % 60;
+	t->SecondFraction = rtc.Init.SynchPrediv;
+	t->SubSeconds = rtc.Init.SynchPrediv - n; // counts down
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_RTC_GetDate(RTC_HandleTypeDef* h, RTC_DateTypeDef* d, uint32_t f) {
+	time_t u = (time_t)floor(simRtc) + EPOCH;
+	struct tm tm;
+	gmtime_r(&u, &tm);
+	d->Year = tm.tm_year - 100;
+	d->Month = tm.tm_mon + 1;
+	d->Date = tm.tm_mday;
+	d->WeekDay = tm.tm_wday ? tm.tm_wday : 7;
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_RTC_SetTime(RTC_HandleTypeDef* h, RTC_TimeTypeDef* t, uint32_t f) {
+	simSetT = *t;
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_RTC_SetDate(RTC_HandleTypeDef* h, RTC_DateTypeDef* d, uint32_t f) {
+	struct tm tm = { 0 };
+	simSetD = *d;
+	tm.tm_year = d->Year + 100;
+	tm.tm_mon = d->Month - 1;
+	tm.tm_mday = d->Date;
+	tm.tm_hour = simSetT.Hours;
+	tm.tm_min = simSetT.Minutes;
+	tm.tm_sec = simSetT.Seconds;
+	simRtc = (double)(timegm(&tm) - EPOCH); // sub-seconds restart
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_RTCEx_SetSynchroShift(RTC_HandleTypeDef* h, uint32_t add1s, uint32_t subfs) {
+	simRtc += (add1s == RTC_SHIFTADD1S_SET) - (double)subfs / prediv();
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_RTCEx_SetSmoothCalib(RTC_HandleTypeDef* h, uint32_t period, uint32_t plus, uint32_t calm) {
+	simCal = ((plus == RTC_SMOOTHCALIB_PLUSPULSES_SET) * 512.0 - calm) / 1048576.0;
+	return HAL_OK;
+}
+void HAL_RTCEx_BKUPWrite(RTC_HandleTypeDef* h, uint32_t r, uint32_t v) { simBkp[r] = v; }
+uint32_t HAL_RTCEx_BKUPRead(RTC_HandleTypeDef* h, uint32_t r) { return simBkp[r]; }
+HAL_StatusTypeDef HAL_RTC_SetAlarm_IT(RTC_HandleTypeDef* h, RTC_AlarmTypeDef* a, uint32_t f) {
+	simAlarm = *a;
+	simArmed = 1;
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_RTC_DeactivateAlarm(RTC_HandleTypeDef* h, uint32_t a) {
+	simArmed = 0;
+	return HAL_OK;
+}
+static void alarmFunc() { simFired++; }
+
+int main(int argc, char** argv) {
+	rtc.Init.AsynchPrediv = 127;
+	rtc.Init.SynchPrediv = 255;
+	rtclock_setHandle(&rtc);
+	rtclock_init();
+	if (argc < 2) return 2;
+	if (argv[1][0] == 'c') {
+		unsigned long t;
+		while (scanf("%lu", &t) == 1) {
+			simRtc = t + 3600.5; // an hour off: stepped
+			rtclock_sync((uint32_t)t, 0);
+			printf("c %lu %u %u %u %u %u %u %u %u\n", t, rtclock_now(), simSetD.Year, simSetD.Month, simSetD.Date,
+					simSetT.Hours, simSetT.Minutes, simSetT.Seconds, simSetD.WeekDay);
+		}
+	}
+	else if (argv[1][0] == 'a' && argc >= 4) {
+		uint32_t t = (uint32_t)strtoul(argv[2], NULL, 10), ahead = (uint32_t)strtoul(argv[3], NULL, 10);
+		rtclock_sync(t, 0);
+		rtclock_setAlarm(t + ahead, alarmFunc);
+		printf("a %u %u %u %u %d %d\n", simAlarm.AlarmDateWeekDay, simAlarm.AlarmTime.Hours, simAlarm.AlarmTime.Minutes,
+				simAlarm.AlarmTime.Seconds, simArmed, simFired);
+		rtclock_setAlarm(t - 5, alarmFunc);
+		printf("p %d %d\n", simFired, simArmed);
+		rtclock_setAlarm(RTCLOCK_NO_ALARM, alarmFunc);
+		printf("x %d\n", simArmed);
+		rtclock_setAlarm(t + ahead, alarmFunc);
+		rtclock_alarmHandler(&rtc);
+		printf("i %d %d\n", simFired, (rtclock_getStat().flags & RTCLOCK_FLAG_ALARM) != 0);
+	}
+	else if (argv[1][0] == 'd' && argc >= 5) {
+		double pi = 750000000.25; // Pi time, s since 2000
+		double hours = atof(argv[3]), intv = atof(argv[4]);
+		simCrystal = atof(argv[2]) * 1e-6;
+		for (int k = 0; k * intv <= hours * 3600; k++) {
+			uint32_t s = (uint32_t)floor(pi);
+			uint16_t ms = (uint16_t)((pi - s) * 1000);
+			int32_t step = rtclock_sync(s, ms);
+			struct RtclockStats st = rtclock_getStat();
+			printf("s %d %.3f %d %d %d %d %.3f\n", k, pi, st.lastOfs, step, st.drift, st.calib, (simCrystal + simCal) * 1e6);
+			pi += intv;
+			simRtc += intv * (1 + simCrystal + simCal);
+		}
+		uint16_t ms;
+		rtclock_init(); // reset: RTC and backup registers keep running
+		uint32_t now = rtclock_nowMs(&ms);
+		printf("r %d %d %.3f %.0f\n", rtclock_isSet(), rtclock_getStat().calib, (simCrystal + simCal) * 1e6,
+				(now - pi) * 1000 + ms);
+	}
+	return 0;
+}
+"""
+
+
+def dateOf(t):
+    return EPOCH + datetime.timedelta(seconds = t)
+
+
+def toT(*a):
+    return int((datetime.datetime(*a) - EPOCH).total_seconds())
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--ppm', type=float, default=23.7, help='crystal drift, + = fast')
+    ap.add_argument('--hours', type=float, default=48)
+    ap.add_argument('--intv', type=int, default=600, help='s between syncs')
+    ap.add_argument('-v', action='store_true', help='print every sync')
+    args = ap.parse_args()
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print('no host C compiler: check skipped')
+        sys.exit(1)
+
+    ok = True
+
+    def fail(msg):
+        nonlocal ok
+        print('  FAIL: ' + msg)
+        ok = False
+
+    with tempfile.TemporaryDirectory() as d:
+        with open(os.path.join(d, "main.h"), "w") as f:
+            f.write(MAIN_H)
+        with open(os.path.join(d, "drv.c"), "w") as f:
+            f.write(DRIVER_C)
+        exe = os.path.join(d, "drv")
+        subprocess.check_call([cc, "-std=gnu11", "-O2", "-Wall", "-I", d, "-I", os.path.join(ROOT, "Inc"), "-o", exe,
+                               os.path.join(d, "drv.c"), os.path.join(ROOT, "Src", "rtclock.c"), "-lm"])
+
+        def run(*a, stdin = None):
+            out = subprocess.run([exe] + [str(x) for x in a], input = stdin, stdout = subprocess.PIPE, text = True, check = True).stdout
+            return [l.split() for l in out.split('\n') if l]
+
+        # conversion
+        times = list(range(0, toT(2099, 12, 31, 23, 59, 59), 86400 * 17 + 3671))
+        for y in range(2000, 2100):
+            times += [toT(y, 1, 1), toT(y, 1, 1) - 1, toT(y, 3, 1), toT(y, 3, 1) - 1, toT(y, 12, 31, 23, 59, 59)]
+            if y % 4 == 0:
+                times += [toT(y, 2, 29, 12, 0, 0)]
+        times = sorted(t for t in set(times) if t >= 0)
+        rows = run('c', stdin = '\n'.join(str(t) for t in times) + '\n')
+        bad = 0
+        for r in rows:
+            t, now, yy, mo, dd, hh, mi, ss, wd = [int(x) for x in r[1:]]
+            e = dateOf(t)
+            if now != t or (yy + 2000, mo, dd, hh, mi, ss, wd) != (e.year, e.month, e.day, e.hour, e.minute, e.second, e.isoweekday()):
+                if bad < 5:
+                    fail('%s: calendar %04d-%02d-%02d %02d:%02d:%02d weekday %d, now %d' % (e, yy + 2000, mo, dd, hh, mi, ss, wd, now - t))
+                bad += 1
+        print('conversion: %d times over %s ~ %s, %d wrong' % (len(rows), dateOf(times[0]).date(), dateOf(times[-1]).date(), bad))
+        if len(rows) != len(times):
+            fail('driver stopped after %d times' % len(rows))
+
+        # alarm
+        for t, ahead in ((750000000, 86400 * 3 + 3723), (toT(2024, 2, 28, 23, 59, 50), 15), (toT(2023, 12, 31, 23, 0, 0), 3600)):
+            r = {x[0]: [int(v) for v in x[1:]] for x in run('a', t, ahead)}
+            e = dateOf(t + ahead)
+            print('alarm at %s: registers day %d %02d:%02d:%02d, due one called %d, cancel armed %d, interrupt called %d'
+                  % (e, r['a'][0], r['a'][1], r['a'][2], r['a'][3], r['p'][0], r['x'][0], r['i'][0] - r['p'][0]))
+            if r['a'][:4] != [e.day, e.hour, e.minute, e.second] or r['a'][4:] != [1, 0]:
+                fail('alarm registers')
+            if r['p'] != [1, 0] or r['x'] != [0] or r['i'] != [2, 0]:
+                fail('due alarm, cancel or interrupt')
+
+        # drift
+        rows = run('d', args.ppm, args.hours, args.intv)
+        syncs = [(int(r[1]), float(r[2]), int(r[3]), int(r[4]), int(r[5]), int(r[6]), float(r[7])) for r in rows if r[0] == 's']
+        reset = [x for x in rows if x[0] == 'r'][0]
+    per = max(1, 3600 // args.intv)
+    print('drift: crystal %+.2f ppm, sync every %d s for %g h' % (args.ppm, args.intv, args.hours))
+    for k, pi, ofs, step, drift, calib, eff in syncs:
+        if args.v or (k % (per * 6) == 0 and k) or k == len(syncs) - 1:
+            print('  %5.1f h: offset %4d ms, drift %+7.2f ppm, calibration %+7.2f ppm, effective %+6.2f ppm'
+                  % (k * args.intv / 3600, ofs, drift / 100, calib / 100, eff))
+    first = [k for k, pi, ofs, step, drift, calib, eff in syncs if abs(eff) <= CAL_STEP]
+    eff = syncs[-1][6]
+    late = [s for s in syncs if s[0] * args.intv >= 3 * CAL_MIN_SEC]
+    maxSlew = max(abs(s[2]) for s in syncs[1:])
+    lateSlew = max(abs(s[2]) for s in late) if late else 0
+    print('  within one calibration step(%.2f ppm) after %s h, effective %+.2f ppm at the end' % (CAL_STEP, '%.1f' % (first[0] * args.intv / 3600) if first else '-', eff))
+    print('  %d steps after the first sync, largest slew %d ms, %d ms after %d h' % (sum(1 for s in syncs[1:] if s[3]), maxSlew, lateSlew, 3 * CAL_MIN_SEC // 3600))
+    print('  reset: set %s, calibration %+.2f ppm, effective %+.2f ppm, clock off by %s ms' % (reset[1], int(reset[2]) / 100, float(reset[3]), reset[4]))
+    if abs(args.ppm) * 100 <= 48800:
+        if abs(eff) > CAL_STEP:
+            fail('effective rate %+.2f ppm: not within one calibration step' % eff)
+        if late and lateSlew > max(2, abs(args.ppm) * args.intv / 1000 / 2 + 4):
+            fail('slews of %d ms after the calibration settled' % lateSlew)
+    if any(s[3] for s in syncs[1:]) or maxSlew >= STEP_MS:
+        fail('syncs after the first were stepped')
+    if reset[1] != '1' or int(reset[2]) != syncs[-1][5] or float(reset[3]) != syncs[-1][6] or abs(int(reset[4])) > lateSlew + 4:
+        fail('reset lost the time or the calibration')
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
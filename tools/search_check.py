@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+# search_check.py
+# Host check of the rotation rate table of Src/app.c(rotRate/rotTimeMs, calibrateRotation, searchCat).
+# app.c runs on tools/appsim.py against a robot whose true rotation rate differs from the default table,
+# like one on a worn battery or carpet. The robot stands near a pillar, whose edge is the IR signature.
+#   calibration measures every table point within 3% of the true rate
+#   after calibration, turns converted with rotTimeMs land within 10%(2 deg for short ones) of the asked angle
+# Then searchCat() runs for cats at random places in the room, once with the default table and once
+# after calibration, and the search time(schedule start to the found melody) and the heading error
+# to the cat after the correction turn are printed for both.
+#
+# usage: python3 tools/search_check.py [--cats 40] [--seed n] [-v]
+
+import argparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import appsim
+
+# true rates at rotCalSpd[] = { 38, 50, 76, 100 }, deg/s * 10. default table: 125 313 720 1096
+ROBOTS = [
+    ("slow(battery low)", (105, 240, 590, 930)),
+    ("fast(hard floor)", (150, 350, 790, 1180)),
+]
+START = (70.0, 120.0, 0.0) # x, y, heading. pillar edge in the first IR window of calibration
+PILLAR = (112.3, 135.4, 10.0)
+CAT_LAG = 1000 # ms, frame grab and cascade detection of ccb.py before the pin is raised
+
+# drv r38 r50 r76 r100 cal catX catY seed
+#   -> cal updated rate0 rate1 rate2 rate3
+#      turn spd deg actual(deg x 10)   ...
+#      search result foundMs errDeg x 10
+DRIVER_C = r"""
+static uint32_t foundAt = SIM_NEVER;
+static float foundErr = 0;
+static void searchHook(void) {
+	if (foundAt == SIM_NEVER && simMelody == &melFoundCat) {
+		foundAt = simTick;
+		foundErr = simAngleTo(simCatX, simCatY);
+	}
+	if (appPhase == APP_PHASE_VIB_WAIT) appReq |= APP_REQ_ABORT; // not found: end instead of waiting for vibration
+}
+static int searchRes;
+static void runSearch(void) { searchRes = searchCat(); }
+static int calUpdated;
+static void runCal(void) { calUpdated = calibrateRotation(); }
+static void place(void) {
+	simX = @X@;
+	simY = @Y@;
+	simHeading = @H@;
+}
+static void turn(uint8_t spd, uint16_t deg) { // one turn as searchCat does it
+	float h = simHeading, d;
+	motionSet(L298N_CW, spd, L298N_CW, spd);
+	appWait(rotTimeMs(spd, deg));
+	motionSet(L298N_STOP, 0, L298N_STOP, 0);
+	appWait(50);
+	d = fmodf(simHeading - h + 360.0f, 360.0f);
+	printf("turn %u %u %d\n", spd, deg, (int)(d * 10 + 0.5f));
+}
+int main(int argc, char** argv) {
+	static const uint8_t spds[] = { AUTO_MIN_ROT_SPD, AUTO_MIN_ROT_SPD, ROOM_SEARCH_ROT_SPD, 50, 100 };
+	static const uint16_t degs[] = { CAT_FOUND_CORRECTION_ANGLE, 90, ROOM_SEARCH_STEP_ANGLE, 90, 180 };
+	if (argc < 9) return 2;
+	for (int i = 0; i < 4; i++) simRotRate[i] = (uint16_t)atoi(argv[1 + i]);
+	simCatX = (float)atof(argv[6]);
+	simCatY = (float)atof(argv[7]);
+	simRnd = (uint32_t)atoi(argv[8]);
+	simObs[0][0] = @PX@;
+	simObs[0][1] = @PY@;
+	simObs[0][2] = @PR@;
+	simIrNoise = 1.0f;
+	simCatLag = @LAG@;
+	l298n_setRamp(MOTOR_RAMP_PROFILE, MOTOR_SLEW_RATE);
+	place();
+	if (atoi(argv[5])) {
+		simRun(runCal, 600000);
+		printf("cal %d %u %u %u %u\n", calUpdated, rotCalRate[0], rotCalRate[1], rotCalRate[2], rotCalRate[3]);
+	}
+	l298n_enable();
+	for (int i = 0; i < (int)sizeof(spds); i++) turn(spds[i], degs[i]);
+	l298n_disable();
+	place();
+	simCatOn = TRUE;
+	simTickHook = searchHook;
+	l298n_enable();
+	uint32_t t0 = simTick;
+	simRun(runSearch, 400000);
+	printf("search %d %d %d\n", searchRes, (foundAt == SIM_NEVER) ? -1 : (int)(foundAt - t0), (int)(foundErr * 10));
+	return 0;
+}
+"""
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--cats', type=int, default=40)
+    ap.add_argument('--seed', type=int, default=1)
+    ap.add_argument('-v', action='store_true', help='print every search')
+    args = ap.parse_args()
+    rnd = random.Random(args.seed)
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print('no host C compiler: check skipped')
+        sys.exit(1)
+
+    drv = DRIVER_C
+    for k, v in (('@X@', START[0]), ('@Y@', START[1]), ('@H@', START[2]), ('@PX@', PILLAR[0]), ('@PY@', PILLAR[1]), ('@PR@', PILLAR[2])):
+        drv = drv.replace(k, '%.1ff' % v)
+    drv = drv.replace('@LAG@', str(CAT_LAG))
+    cats = [(rnd.uniform(20, 280), rnd.uniform(20, 380)) for _ in range(args.cats)]
+    ok = True
+    with tempfile.TemporaryDirectory() as d:
+        exe = appsim.build(d, cc, drv)
+        for name, rates in ROBOTS:
+            print('%s: true rate %s, default table 125 313 720 1096' % (name, ' '.join(str(r) for r in rates)))
+            res = {}
+            for cal in (0, 1):
+                found = {} # cat: search time
+                errs = []
+                turns = None
+                for n, (cx, cy) in enumerate(cats):
+                    out = subprocess.run([exe] + [str(r) for r in rates] + [str(cal), '%.1f' % cx, '%.1f' % cy, str(n + 1)],
+                                         stdout = subprocess.PIPE, text = True, check = True).stdout.split('\n')
+                    rows = [l.split() for l in out if l]
+                    turns = [(int(r[1]), int(r[2]), int(r[3]) / 10) for r in rows if r[0] == 'turn']
+                    for r in rows:
+                        if r[0] == 'cal' and n == 0:
+                            table = [int(x) for x in r[2:]]
+                            bad = [i for i in range(4) if abs(table[i] - rates[i]) > rates[i] * 0.03]
+                            print('  calibrated table %s%s' % (' '.join(str(x) for x in table), '  <- off by more than 3%' if bad else ''))
+                            ok = ok and not bad
+                        if r[0] == 'search':
+                            if int(r[2]) >= 0:
+                                found[n] = int(r[2]) / 1000
+                                errs.append(abs(int(r[3])) / 10)
+                            if args.v:
+                                print('    cat at %5.1f, %5.1f: %s' % (cx, cy, 'not found' if int(r[2]) < 0 else '%6.1f s, heading off %5.1f deg' % (int(r[2]) / 1000, abs(int(r[3])) / 10)))
+                label = 'calibrated' if cal else 'default table'
+                print('  %-13s turns(speed: asked -> turned) %s' % (label, ', '.join('%d: %d -> %.1f' % t for t in turns)))
+                if cal:
+                    far = [t for t in turns if abs(t[2] - t[1]) > max(t[1] * 0.1, 2)]
+                    if far:
+                        print('  calibrated turns out of tolerance: %s' % far)
+                        ok = False
+                times = sorted(found.values())
+                res[cal] = found
+                print('  %-13s search: found %d of %d, median %.1f s, p90 %.1f s, mean %.1f s, heading off %.1f deg mean'
+                      % (label, len(times), len(cats), times[len(times) // 2] if times else 0, times[len(times) * 9 // 10] if times else 0,
+                         sum(times) / len(times) if times else 0, sum(errs) / len(errs) if errs else 0))
+            both = [n for n in res[0] if n in res[1]]
+            if both:
+                t0 = sum(res[0][n] for n in both)
+                t1 = sum(res[1][n] for n in both)
+                print('  mean search time of the %d cats found both times: %.1f s -> %.1f s(%+.1f%%) with calibration'
+                      % (len(both), t0 / len(both), t1 / len(both), 100 * (t1 / t0 - 1)))
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+# skdprog_check.py
+# Round-trip check of the schedule pattern program(Inc/skdprog.h, Src/skdprog.c, rpi/skdprog.py).
+#   text -> items -> bytes -> items -> text        (python encoder/decoder agree)
+#   flat code list -> compress -> expand            (compressor loses nothing)
+#   bytes -> skdprog_check/skdprog_next of the MCU  (C decoder built with the host compiler
+#                                                    returns the same entries as python)
+#   malformed programs                              (C and python reject the same ones)
+# Then prints program size against the flat list(1 byte per pattern, 70 at most, ASCII P
+# packets of 7 codes) for a few sessions.
+#
+# usage: python3 tools/skdprog_check.py [--random 500] [--seed n]
+
+import argparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+sys.path.insert(0, os.path.join(ROOT, "rpi"))
+import skdprog  # noqa: E402
+
+MAX_PROG = 128 - 9 # RPI_SKD_MAX_PROG: one TYPE_SCHEDULE frame
+OLD_MAX_PATTERNS = 70
+
+# host driver: one program per line in hex. prints "ok plays" and the entries, or "bad"
+DRIVER_C = r"""
+#include <stdio.h>
+#include <string.h>
+#include "skdprog.h"
+int main(void) {
+	char line[1024];
+	while (fgets(line, sizeof(line), stdin)) {
+		uint8_t p[255];
+		unsigned len = 0, v;
+		char* s = line;
+		int n;
+		while (sscanf(s, "%2x%n", &v, &n) == 1) { p[len++] = (uint8_t)v; s += n; }
+		uint32_t plays;
+		if (!skdprog_check(p, (uint8_t)len, &plays)) { printf("bad\n"); continue; }
+		printf("ok %u", plays);
+		struct SkdProgIter it;
+		struct SkdProgEntry e;
+		unsigned cnt = 0;
+		skdprog_begin(&it);
+		while (skdprog_next(&it, p, (uint8_t)len, &e) && cnt++ < 20000) {
+			if (e.kind == SKDPROG_ENTRY_SNACK) printf(" k");
+			else printf(" %u/%d/%d", e.code, e.spd == SKDPROG_NO_SPD ? -1 : e.spd, e.intv == SKDPROG_NO_INTV ? -1 : e.intv);
+		}
+		printf("\n");
+	}
+	return 0;
+}
+"""
+
+CASES = [ # text form, all must encode in one frame
+    "1 2 3 4 5 6 7 8 9 0",
+    "3*5",
+    "(1 2)*4",
+    "k (1 2*3 s2:5)*10 t120:7",
+    "s0:t90:3*4 k (5 (6 k)*3)*2",
+    "((((1)*2)*3)*4)*5",
+    "t4095:9 s1:0*255 2*255",
+    "(1 2 3 4 5 6 7 8 9 k)*255",
+]
+
+MALFORMED = [ # hex, rejected by both
+    "0E", "1501", "1401", "2000", "2002", "30", "200201", "2002303030", "4303", "41", "5001",
+    "2002412030", "200260304F", "2005201020012001200101303030", "200130", "4160", "1E05", "70", "2101 01 30",
+]
+
+
+def entryStr(e):
+    return 'k' if e == 'k' else '%d/%d/%d' % (e[0], -1 if e[1] is None else e[1], -1 if e[2] is None else e[2])
+
+
+def buildDriver(d):
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        return None
+    src = os.path.join(d, "drv.c")
+    exe = os.path.join(d, "drv")
+    with open(src, "w") as f:
+        f.write(DRIVER_C)
+    subprocess.check_call([cc, "-std=gnu11", "-O1", "-Wall", "-I", os.path.join(ROOT, "Inc"), "-o", exe, src,
+                           os.path.join(ROOT, "Src", "skdprog.c")])
+    return exe
+
+
+def randItems(rnd, depth = 0):
+    items = []
+    for _ in range(rnd.randint(1, 4)):
+        r = rnd.random()
+        if r < 0.1:
+            items.append(('snack',))
+        elif r < 0.3 and depth < skdprog.MAX_DEPTH:
+            items.append(('loop', rnd.randint(1, 6), randItems(rnd, depth + 1)))
+        else:
+            items.append(('play', rnd.randint(0, 9), rnd.choice((1, 1, 2, 7, 300)),
+                          rnd.choice((None, None, 0, 2)), rnd.choice((None, None, 0, 600, 4095))))
+    return items
+
+
+def normalize(items): # encode() splits counts over 255 into several items
+    return skdprog.decode(skdprog.encode(items))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('--random', type=int, default=500)
+    ap.add_argument('--seed', type=int, default=1)
+    args = ap.parse_args()
+    rnd = random.Random(args.seed)
+    ok = True
+
+    progs = [] # (bytes, expected entries or None if malformed)
+    for text in CASES:
+        items = skdprog.parse(text)
+        prog = skdprog.encode(items)
+        back = skdprog.decode(prog)
+        if back != items or skdprog.format(back) != text or skdprog.parse(skdprog.format(items)) != items:
+            print('text round trip failed: %s' % text)
+            ok = False
+        if len(prog) > MAX_PROG:
+            print('%s: %d bytes, over one frame' % (text, len(prog)))
+            ok = False
+        progs.append((prog, skdprog.expand(items)))
+    for _ in range(args.random):
+        items = normalize(randItems(rnd))
+        prog = skdprog.encode(items)
+        if len(prog) > 255:
+            continue
+        if skdprog.decode(prog) != items:
+            print('random round trip failed: %s' % skdprog.format(items))
+            ok = False
+        if len(skdprog.expand(items)) <= 20000:
+            progs.append((prog, skdprog.expand(items)))
+        codes = [rnd.choice((1, 2, 3, 5)) for _ in range(rnd.randint(1, 120))]
+        if rnd.random() < 0.5:
+            codes = (codes[:rnd.randint(1, 6)] * rnd.randint(2, 40))[:300]
+        comp = skdprog.compress(codes)
+        if [e[0] for e in skdprog.expand(comp)] != codes or skdprog.decode(skdprog.encode(comp)) != normalize(comp):
+            print('compress lost data: %s' % codes)
+            ok = False
+        progs.append((skdprog.encode(comp), skdprog.expand(comp)))
+    for h in MALFORMED:
+        prog = bytes.fromhex(h.replace(' ', ''))
+        try:
+            skdprog.decode(prog)
+            print('python accepted malformed %s' % h)
+            ok = False
+        except ValueError:
+            pass
+        progs.append((prog, None))
+    print('python: %d text cases, %d random programs and flat lists, %d malformed' % (len(CASES), args.random, len(MALFORMED)))
+
+    with tempfile.TemporaryDirectory() as d:
+        exe = buildDriver(d)
+        if exe is None:
+            print('no host C compiler: MCU decoder check skipped')
+        else:
+            out = subprocess.run([exe], input = ''.join(p.hex() + '\n' for p, _ in progs), capture_output = True,
+                                 text = True, check = True).stdout.splitlines()
+            bad = 0
+            for (prog, expect), line in zip(progs, out):
+                if expect is None:
+                    good = line == 'bad'
+                else:
+                    f = line.split()
+                    good = f[:2] == ['ok', str(sum(1 for e in expect if e != 'k'))] and f[2:] == [entryStr(e) for e in expect]
+                if not good:
+                    bad += 1
+                    if bad <= 5:
+                        print('C decoder differs on %s: %s' % (prog.hex(), line[:120]))
+            ok = ok and bad == 0 and len(out) == len(progs)
+            print('C decoder: %d programs, %d differ' % (len(progs), bad))
+
+    print()
+    print('%-44s %6s %6s %7s %7s' % ('session', 'plays', 'flat', 'P pkts', 'program'))
+    sessions = [
+        ('app schedule, 16 patterns', [0, 2, 4, 5, 7, 8, 1, 3, 8, 2, 9, 7, 0, 9, 3, 5]),
+        ('70 patterns(old cap), cycle of 5', [5, 6, 1, 4, 9] * 14),
+        ('auto-decide all evening(300 plays)', [0] * 300),
+        ('warm-up 3*2, then (1 2 3 4)*60', [3, 3] + [1, 2, 3, 4] * 60),
+        ('3 h: ((5 6)*3 1 4 9 8)*100', ([5, 6] * 3 + [1, 4, 9, 8]) * 100),
+    ]
+    for name, codes in sessions:
+        prog = skdprog.encode(skdprog.compress(codes))
+        flat = '%d' % len(codes) if len(codes) <= OLD_MAX_PATTERNS else 'over'
+        print('%-44s %6d %6s %7d %6dB' % (name, len(codes), flat, (len(codes) + 6) // 7, len(prog)))
+    text = 'k (s2:t60:4 5*3 k)*8 s0:t300:7'
+    items = skdprog.parse(text)
+    print('%-44s %6d %6s %7s %6dB' % (text, skdprog.plays(items), '-', '-', len(skdprog.encode(items))))
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+# snack_check.py
+# Host check of the snack state machine of Src/app.c(snackStart, snackStep, snackCancel) in manual drive.
+# app.c runs on tools/appsim.py from app_start(), '!1' starts manual drive and the app sends:
+#   M10 snack, 'Q' during it        telemetry is answered at once, in the snack phase
+#   M01 during the snack            steering cancels the snack and drives in the same dispatch
+#   M10, left to the end            every state is reported in order by 'k', done at the nominal snack time
+#                                   (snackMs of rpi/pattime.json) with the door shut
+#   M10, then MP1 during it         the pattern waits until the snack is done
+#   M10, M11 in the door state      snack is cancelled and the door is shut within SNACK_DOOR_CLOSE_TIME
+#   !2                              manual drive ends
+#
+# usage: python3 tools/snack_check.py [-v]
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import appsim
+
+DOOR_CLOSE = 400 # SNACK_DOOR_CLOSE_TIME
+STATES = ('idle', 'lure', 'settle', 'approach', 'stop', 'door')
+RESULTS = ('running', 'done', 'cancelled')
+RUN_MS = 120000
+
+# drv
+#   -> send tick frame                     frame sent to the app
+#      k tick state progress result elapsed
+#      q tick phase
+#      mode tick mode                      wheels: 0 stop, 1 forward, 2 backward, 3 left, 4 right, 5 arc
+#      pat tick code                       pattern start, 255: end
+#      door tick shut
+#      ph tick phase
+DRIVER_C = r"""
+static uint32_t snacks = 0, doneAt = SIM_NEVER, patEndAt = SIM_NEVER, cancelAt = SIM_NEVER;
+static uint8_t lastPhase = 0xFF, lastPattern = RPI_TLM_NO_PATTERN;
+static int lastMode = -1, lastDoor = -1;
+static void send(const char* s) {
+	printf("send %u %s\n", simTick, s);
+	simAtStr(simTick, s);
+}
+static void sent(uint8_t type, const uint8_t* p, uint8_t len) {
+	if (type == TYPE_SNACK_EVT) {
+		printf("k %u %u %u %u %u\n", simTick, p[RPI_SNK_STATE], p[RPI_SNK_PROGRESS], p[RPI_SNK_RESULT], p[RPI_SNK_ELAPSED] | (p[RPI_SNK_ELAPSED + 1] << 8));
+		if (p[RPI_SNK_RESULT] == RPI_SNK_RES_DONE) doneAt = simTick;
+		if (p[RPI_SNK_RESULT] == RPI_SNK_RES_CANCELLED) cancelAt = simTick;
+		if (p[RPI_SNK_STATE] == SNACK_ST_DOOR && p[RPI_SNK_RESULT] == RPI_SNK_RES_RUNNING && snacks == 5) send("M11");
+	}
+	if (type == TYPE_TELEMETRY) printf("q %u %u\n", simTick, p[RPI_TLM_PHASE]);
+}
+static void hook(void) {
+	int door = simServoAng == SNACK_ANG_RDY && !simServoEnd;
+	if (appPhase != lastPhase) {
+		lastPhase = appPhase;
+		printf("ph %u %u\n", simTick, appPhase);
+	}
+	if (simMode != lastMode) {
+		lastMode = simMode;
+		printf("mode %u %d\n", simTick, simMode);
+	}
+	if (door != lastDoor) {
+		lastDoor = door;
+		printf("door %u %d\n", simTick, door);
+	}
+	if (curPattern != lastPattern) {
+		lastPattern = curPattern;
+		printf("pat %u %u\n", simTick, curPattern);
+		if (curPattern == RPI_TLM_NO_PATTERN) patEndAt = simTick;
+	}
+	switch (snacks) {
+	case 0:
+		if (simTick == 1000) send("!1");
+		if (simTick == 2000) {
+			send("M10");
+			snacks++;
+		}
+		break;
+	case 1:
+		if (simTick == 4000) send("Q");
+		if (simTick == 6000) send("M01"); // steering cancels it
+		if (simTick == 6500) send("M00");
+		if (simTick == 7000) {
+			send("M10");
+			snacks++;
+		}
+		break;
+	case 2:
+		if (doneAt != SIM_NEVER && simTick == doneAt + 500) {
+			send("M10");
+			snacks++;
+		}
+		break;
+	case 3:
+		if (simTick == doneAt + 700) { // done of the snack before
+			send("MP1");
+			snacks++;
+		}
+		break;
+	case 4:
+		if (patEndAt != SIM_NEVER && simTick == patEndAt + 500) {
+			send("M10");
+			snacks++; // M11 is sent in the door state
+		}
+		break;
+	case 5:
+		if (cancelAt != SIM_NEVER && simTick == cancelAt + 1000) {
+			send("!2");
+			snacks++;
+		}
+		break;
+	}
+}
+int main(void) {
+	simSentHook = sent;
+	simTickHook = hook;
+	simRun(app_start, @RUN@);
+	return 0;
+}
+"""
+
+PHASES = ('idle', 'search', 'vib wait', 'play', 'snack', 'park', 'cancelled', 'manual', 'calibrate')
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument('-v', action='store_true', help='print the whole run')
+    args = ap.parse_args()
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print('no host C compiler: check skipped')
+        sys.exit(1)
+    with open(os.path.join(appsim.ROOT, 'rpi', 'pattime.json')) as f:
+        snackMs = json.load(f)['snackMs']
+
+    ok = True
+
+    def fail(msg):
+        nonlocal ok
+        print('  FAIL: ' + msg)
+        ok = False
+
+    with tempfile.TemporaryDirectory() as d:
+        exe = appsim.build(d, cc, DRIVER_C.replace('@RUN@', str(RUN_MS)))
+        out = subprocess.run([exe], stdout = subprocess.PIPE, text = True, check = True).stdout
+    rows = [l.split() for l in out.split('\n') if l]
+    for r in rows:
+        r[1] = int(r[1])
+    sends = [(r[1], r[2]) for r in rows if r[0] == 'send']
+    ks = [(r[1], int(r[2]), int(r[3]), int(r[4]), int(r[5])) for r in rows if r[0] == 'k']
+    if args.v:
+        for r in rows:
+            if r[0] == 'k':
+                print('  %6d k %-8s %3d%% %-9s %5d ms' % (r[1], STATES[int(r[2])], int(r[3]), RESULTS[int(r[4])], int(r[5])))
+            elif r[0] == 'ph':
+                print('  %6d phase %s' % (r[1], PHASES[int(r[2])]))
+            else:
+                print('  %6d %s %s' % (r[1], r[0], ' '.join(str(x) for x in r[2:])))
+
+    def after(kind, t):
+        return [r for r in rows if r[0] == kind and r[1] >= t]
+
+    # snacks, by the frame that started them
+    starts = [t for t, s in sends if s == 'M10']
+    if len(starts) != 4:
+        fail('scenario did not run: %s' % sends)
+        sys.exit(1)
+
+    def events(i):
+        e = starts[i + 1] if i + 1 < len(starts) else 1 << 31
+        return [k for k in ks if starts[i] <= k[0] < e]
+
+    # 1: 'Q' and steering during the snack
+    q = [r for r in rows if r[0] == 'q'][0]
+    qAt = [t for t, s in sends if s == 'Q'][0]
+    print("'Q' at %d answered in %d ms, phase %s" % (qAt, q[1] - qAt, PHASES[int(q[2])]))
+    if q[1] - qAt > 1 or int(q[2]) != 4:
+        fail("'Q' not answered at once in the snack phase")
+    m01 = [t for t, s in sends if s == 'M01'][0]
+    cancel = [k for k in events(0) if k[3] == 2]
+    drove = [r for r in after('mode', m01) if r[2] == '1']
+    if not cancel or not drove:
+        fail('M01 did not cancel the snack and drive')
+    else:
+        print('M01 at %d: snack cancelled at %d%%(%s) in %d ms, driving forward in %d ms'
+              % (m01, cancel[0][2], STATES[cancel[0][1]], cancel[0][0] - m01, drove[0][1] - m01))
+        if cancel[0][0] - m01 > 1 or drove[0][1] - cancel[0][0] > 1:
+            fail('M01 did not drive in the dispatch that cancelled the snack')
+
+    # 2: full snack
+    ev = events(1)
+    run = [k[1] for k in ev if k[3] == 0]
+    done = [k for k in ev if k[3] == 1]
+    shut = [r for r in after('door', starts[1]) if r[2] == '1']
+    print('full snack from %d: states %s, %s' % (starts[1], ' '.join(STATES[s] for s in run),
+          'done %d%% at %d ms(nominal %d)' % (done[0][2], done[0][4], snackMs) if done else 'not done'))
+    if run != [1, 2, 3, 4, 5] or not done or not snackMs <= done[0][4] <= snackMs + 10 or done[0][2] != 100:
+        fail('full snack did not report every state or did not end at the nominal time')
+    elif not shut or shut[0][1] > done[0][0]:
+        fail('door not shut when the snack was done')
+
+    # 3: pattern request during a snack
+    mp = [t for t, s in sends if s == 'MP1'][0]
+    done = [k for k in events(2) if k[3] == 1]
+    pat = [r for r in after('pat', mp) if r[2] == '1']
+    if not done or not pat:
+        fail('snack or pattern did not run')
+    else:
+        print('MP1 at %d during a snack: snack done at %d, pattern 1 started at %d' % (mp, done[0][0], pat[0][1]))
+        if pat[0][1] < done[0][0]:
+            fail('pattern started during the snack')
+
+    # 4: M11 in the door state
+    m11 = [t for t, s in sends if s == 'M11']
+    cancel = [k for k in events(3) if k[3] == 2]
+    if not m11 or not cancel:
+        fail('M11 did not cancel the snack')
+    else:
+        shut = [r for r in after('door', m11[0]) if r[2] == '1']
+        print('M11 at %d in the door state: cancelled in %d ms(%s), door shut in %s ms'
+              % (m11[0], cancel[0][0] - m11[0], STATES[cancel[0][1]], shut[0][1] - m11[0] if shut else '-'))
+        if cancel[0][1] != 5 or not shut or shut[0][1] - m11[0] > DOOR_CLOSE + 1:
+            fail('door not shut after M11')
+
+    # 5: end of manual drive
+    end = [t for t, s in sends if s == '!2']
+    idle = [r for r in after('ph', end[0]) if r[2] == '0'] if end else []
+    print('!2 at %s: %s' % (end[0] if end else '-', 'idle in %d ms' % (idle[0][1] - end[0]) if idle else 'manual drive did not end'))
+    if not idle:
+        fail('manual drive did not end')
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == '__main__':
+    main()